@@ -5,7 +5,17 @@
 #include "ProceduralMeshComponent.h"
 #include "NavigationSystem.h"
 #include "NavMesh/RecastNavMesh.h"
+#include "NavAreas/NavArea.h"
 #include "Engine/Texture2D.h"
+#include "GAGridSystem.h"
+#include "GAGridSnapshot.h"
+#include "Async/Async.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
 
 
 UE_DISABLE_OPTIMIZATION
@@ -14,6 +24,9 @@ UE_DISABLE_OPTIMIZATION
 
 FCellRef FCellRef::Invalid(INDEX_NONE, INDEX_NONE);
 
+// Source of AGAGridActor::GridId. 0 is never used, so a default FGACellHandle belongs to no grid.
+static uint32 GNextGridId = 1;
+
 
 AGAGridActor::AGAGridActor(const FObjectInitializer& ObjectInitializer)
 : Super(ObjectInitializer)
@@ -21,6 +34,20 @@ AGAGridActor::AGAGridActor(const FObjectInitializer& ObjectInitializer)
 	XCount = 100;
 	YCount = 100;
 	CellScale = 100.0f;
+	MemoryLayout = EGAGridMemoryLayout::RowMajor;
+	MinCostMultiplier = 1.0f;
+	MaxClearance = 1000.0f;
+	NextObstacleId = 0;
+	GridVersion = 0;
+	Residency = EGAGridResidency::Resident;
+	LoadRequestId = 0;
+	bStreamingCacheValid = false;
+	StreamingCacheFileSize = 0;
+	MinLayerSeparation = 200.0f;
+	LayerStepHeight = 100.0f;
+	ObstacleProbeHeight = 1000.0f;
+	ExtraLayerCellCount = 0;
+	GridId = GNextGridId++;
 	RefreshDerivedValues();
 
 	SceneComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
@@ -51,11 +78,95 @@ void AGAGridActor::PostLoad()
 #endif //WITH_EDITORONLY_DATA
 
 	RefreshDerivedValues();
+	RefreshExtraLayerCells();
+
+	// Grids baked before clearance existed, or before it was capped at MaxClearance
+	if ((ClearanceData.Num() != Data.Num()) || ((MaxClearance > 0.0f) && (ClearanceData.Num() > 0) && (FMath::Max(ClearanceData) > MaxClearance)))
+	{
+		RefreshClearance();
+	}
+
+	// Obstacles are runtime-only, so if any were around when we were saved, they're not anymore
+	BlockedData.SetNumZeroed(GetTotalStorageCount());
+	for (ECellData& CellData : Data)
+	{
+		if (EnumHasAnyFlags(CellData, ECellData::CellDataBlocked))
+		{
+			EnumRemoveFlags(CellData, ECellData::CellDataBlocked);
+			EnumAddFlags(CellData, ECellData::CellDataTraversable);
+		}
+	}
+
+	// Likewise for costs. Runtime stamps aren't saved, so start from the baked costs.
+	if (BaseCostData.Num() != Data.Num())
+	{
+		BaseCostData.Init(CostUnit, Data.Num());
+	}
+	CostData = BaseCostData;
+	RefreshCostBounds();
+
 	Super::PostLoad();
 }
 
+void AGAGridActor::PostRegisterAllComponents()
+{
+	Super::PostRegisterAllComponents();
+
+	// Keep the cached transform and cell centers in sync with the actor, wherever it gets moved from
+	if (SceneComponent && !SceneComponent->TransformUpdated.IsBoundToObject(this))
+	{
+		SceneComponent->TransformUpdated.AddUObject(this, &AGAGridActor::OnRootTransformUpdated);
+	}
+
+	RefreshCellCenters();
+}
+
+void AGAGridActor::BeginPlay()
+{
+	Super::BeginPlay();
+
+	UGAGridSystem* GridSystem = UGAGridSystem::GetGridSystem(this);
+	if (GridSystem)
+	{
+		GridSystem->RegisterGrid(this);
+	}
+}
+
+void AGAGridActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	UGAGridSystem* GridSystem = UGAGridSystem::GetGridSystem(this);
+	if (GridSystem)
+	{
+		GridSystem->UnregisterGrid(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AGAGridActor::OnRootTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	RefreshCellCenters();
+}
+
 
 #if WITH_EDITORONLY_DATA
+
+// Relayout the per-column part of a per-cell array. The extra layers after it don't depend on the layout, so they
+// just stay at the end.
+template<typename T>
+static void RelayoutCells(TArray<T>& Values, const FGAGridIndexer& From, const FGAGridIndexer& To, int32 ExtraCount)
+{
+	if (Values.Num() != From.GetStorageCount() + ExtraCount)
+	{
+		return;
+	}
+
+	TArray<T> Extra(Values.GetData() + From.GetStorageCount(), ExtraCount);
+	Values.SetNum(From.GetStorageCount());
+	FGAGridIndexer::Relayout(Values, From, To);
+	Values.Append(Extra);
+}
+
 void AGAGridActor::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
 {
 	FName ChangedPropertyName = PropertyChangedEvent.GetMemberPropertyName();
@@ -66,11 +177,55 @@ void AGAGridActor::PostEditChangeProperty(FPropertyChangedEvent& PropertyChanged
 		RefreshBoxComponent();
 	}
 
+	// Move any existing data over to the new layout
+	FGAGridIndexer OldIndexer = Indexer;
+
 	RefreshDerivedValues();
 
+	if ((ChangedPropertyName == FName("MemoryLayout")) && (OldIndexer.Layout != Indexer.Layout))
+	{
+		RelayoutData(OldIndexer);
+	}
+
+	RefreshCellCenters();
+
+	if (ChangedPropertyName == FName("MaxClearance"))
+	{
+		RefreshClearance();
+	}
+
 	Super::PostEditChangeProperty(PropertyChangedEvent);
 }
 
+void AGAGridActor::RelayoutData(const FGAGridIndexer& OldIndexer)
+{
+	RelayoutCells(Data, OldIndexer, Indexer, ExtraLayerCellCount);
+	RelayoutCells(HeightData, OldIndexer, Indexer, ExtraLayerCellCount);
+	RelayoutCells(ObstacleHeightData, OldIndexer, Indexer, 0);
+	RelayoutCells(ClearanceData, OldIndexer, Indexer, ExtraLayerCellCount);
+	RelayoutCells(BaseCostData, OldIndexer, Indexer, ExtraLayerCellCount);
+	RelayoutCells(CostData, OldIndexer, Indexer, ExtraLayerCellCount);
+	RelayoutCells(BlockedData, OldIndexer, Indexer, ExtraLayerCellCount);
+
+	for (TPair<int32, FObstacle>& Pair : Obstacles)
+	{
+		for (int32& CellIndex : Pair.Value.CellIndices)
+		{
+			if (CellIndex >= OldIndexer.GetStorageCount())
+			{
+				// Extra layer -- only moves by however much the per-column part grew or shrank
+				CellIndex += Indexer.GetStorageCount() - OldIndexer.GetStorageCount();
+			}
+			else
+			{
+				int32 X, Y;
+				OldIndexer.IndexToCell(CellIndex, X, Y);
+				CellIndex = Indexer.CellToIndex(X, Y);
+			}
+		}
+	}
+}
+
 void AGAGridActor::RefreshBoxComponent()
 {
 	FVector DesiredExtents;
@@ -90,15 +245,43 @@ void AGAGridActor::RefreshDerivedValues()
 	// Refresh HalfExtents
 	HalfExtents.X = 0.5f * CellScale * float(XCount);
 	HalfExtents.Y = 0.5f * CellScale * float(YCount);
+
+	Indexer = FGAGridIndexer(MemoryLayout, XCount, YCount);
+
+	RegionsX = (XCount + RegionSize - 1) >> RegionShift;
+	RegionsY = (YCount + RegionSize - 1) >> RegionShift;
+	if (RegionVersions.Num() != RegionsX * RegionsY)
+	{
+		// Region indices have all changed meaning
+		RegionVersions.SetNumZeroed(RegionsX * RegionsY);
+		ChangeDispatcher.Reset(RegionsX * RegionsY);
+	}
 }
 
 
 bool AGAGridActor::ResetData()
 {
 	bool Result = false;
-	int32 CellCount = GetCellCount();
-	Data.SetNumZeroed(GetCellCount());
-	HeightData.SetNumZeroed(CellCount);
+	int32 StorageCount = GetStorageCount();
+	Obstacles.Empty();
+	ColumnLayers.Empty();
+	ExtraLayerCellCount = 0;
+	ExtraLayerCells.Empty();
+	BlockedData.SetNumZeroed(StorageCount);
+
+	// Whatever was (or was being) streamed out is gone now
+	Residency = EGAGridResidency::Resident;
+	LoadRequestId++;
+	bStreamingCacheValid = false;
+
+	Data.SetNumZeroed(StorageCount);
+	HeightData.SetNumZeroed(StorageCount);
+	ObstacleHeightData.SetNumZeroed(StorageCount);
+	ClearanceData.SetNumZeroed(StorageCount);
+	BaseCostData.Init(CostUnit, StorageCount);
+	CostData = BaseCostData;
+	MinCostMultiplier = 1.0f;
+	RefreshCellCenters();
 
 	return Result;
 }
@@ -110,10 +293,17 @@ bool AGAGridActor::ResetData()
 FCellRef AGAGridActor::GetCellRef(const FVector& Point, bool bClamp) const
 {
 	// First, transform the point into grid-local space
-	// note, we drop the Z dimension at this point, by casting to a FVector2D
-	FTransform GridTransform = GetActorTransform();
-	FVector2D LocalPoint = FVector2D(GridTransform.InverseTransformPosition(Point));
+	// note, we drop the Z dimension at this point (other than to pick a layer)
+	FCellRef Result = LocalPointToCellRef(WorldToLocal2D(Point), bClamp);
+	if (HasLayers() && Result.IsValid())
+	{
+		Result.Layer = GetLayerAtHeight(Result.X, Result.Y, WorldToLocalHeight(Point));
+	}
+	return Result;
+}
 
+FCellRef AGAGridActor::LocalPointToCellRef(FVector2D LocalPoint, bool bClamp) const
+{
 	if (bClamp)
 	{
 		LocalPoint.X = FMath::Clamp(LocalPoint.X, -HalfExtents.X, HalfExtents.X);
@@ -136,10 +326,42 @@ FCellRef AGAGridActor::GetCellRef(const FVector& Point, bool bClamp) const
 	return Result;
 }
 
-FVector AGAGridActor::GetCellPosition(const FCellRef& CellRef) const
+void AGAGridActor::GetCellRefs(const TArray<FVector>& Points, TArray<FCellRef>& CellRefsOut, bool bClamp) const
+{
+	int32 Count = Points.Num();
+	CellRefsOut.SetNumUninitialized(Count);
+
+	// Transform everything into local space first, as one tight loop over plain multiply-adds
+	// (which the compiler vectorizes), then discretize
+	TArray<FVector2D> LocalPoints;
+	LocalPoints.SetNumUninitialized(Count);
+	for (int32 Index = 0; Index < Count; Index++)
+	{
+		LocalPoints[Index] = WorldToLocal2D(Points[Index]);
+	}
+
+	for (int32 Index = 0; Index < Count; Index++)
+	{
+		CellRefsOut[Index] = LocalPointToCellRef(LocalPoints[Index], bClamp);
+	}
+
+	if (HasLayers())
+	{
+		for (int32 Index = 0; Index < Count; Index++)
+		{
+			FCellRef& CellRef = CellRefsOut[Index];
+			if (CellRef.IsValid())
+			{
+				CellRef.Layer = GetLayerAtHeight(CellRef.X, CellRef.Y, WorldToLocalHeight(Points[Index]));
+			}
+		}
+	}
+}
+
+FVector AGAGridActor::GetCellLocalPosition(const FCellRef& CellRef) const
 {
 	float HalfScale = 0.5f * CellScale;
-	int32 Index = CellRefToIndex(CellRef);
+	int32 Index = IsValidCell(CellRef) ? CellRefToIndex(CellRef) : INDEX_NONE;
 
 	// Grab the center of the cell, then offset by -HalfExtents, so that it is relative to the center of the grid
 	FVector LocalResult;
@@ -147,9 +369,74 @@ FVector AGAGridActor::GetCellPosition(const FCellRef& CellRef) const
 	LocalResult.Y = CellRef.Y * CellScale + HalfScale - HalfExtents.Y;
 	LocalResult.Z = HeightData.IsValidIndex(Index) ? HeightData[Index] :  0.0f;
 
-	FTransform ActorTransform = GetActorTransform();
-	FVector Result = ActorTransform.TransformPosition(LocalResult);
-	return Result;
+	return LocalResult;
+}
+
+FVector AGAGridActor::GetCellPosition(const FCellRef& CellRef) const
+{
+	if (IsValidCell(CellRef))
+	{
+		int32 Index = CellRefToIndex(CellRef);
+		if (CellCenterX.IsValidIndex(Index))
+		{
+			return FVector(CellCenterX[Index], CellCenterY[Index], CellCenterZ[Index]);
+		}
+	}
+
+	// Off the grid (or the table hasn't been built yet) -- do it the long way
+	return CachedGridTransform.TransformPosition(GetCellLocalPosition(CellRef));
+}
+
+void AGAGridActor::GetCellPositions(const TArray<FCellRef>& CellRefs, TArray<FVector>& PositionsOut) const
+{
+	int32 Count = CellRefs.Num();
+	PositionsOut.SetNumUninitialized(Count);
+
+	for (int32 Index = 0; Index < Count; Index++)
+	{
+		PositionsOut[Index] = GetCellPosition(CellRefs[Index]);
+	}
+}
+
+void AGAGridActor::RefreshCachedTransform()
+{
+	CachedGridTransform = GetActorTransform();
+
+	// Note, FMatrix uses row vectors, so the columns of the inverse give us the local X and Y as dot products
+	FMatrix WorldToLocal = CachedGridTransform.ToInverseMatrixWithScale();
+	WorldToLocalX = FVector4(WorldToLocal.M[0][0], WorldToLocal.M[1][0], WorldToLocal.M[2][0], WorldToLocal.M[3][0]);
+	WorldToLocalY = FVector4(WorldToLocal.M[0][1], WorldToLocal.M[1][1], WorldToLocal.M[2][1], WorldToLocal.M[3][1]);
+	WorldToLocalZ = FVector4(WorldToLocal.M[0][2], WorldToLocal.M[1][2], WorldToLocal.M[2][2], WorldToLocal.M[3][2]);
+}
+
+void AGAGridActor::RefreshCellCenters()
+{
+	RefreshCachedTransform();
+
+	int32 StorageCount = GetTotalStorageCount();
+	CellCenterX.SetNumZeroed(StorageCount);
+	CellCenterY.SetNumZeroed(StorageCount);
+	CellCenterZ.SetNumZeroed(StorageCount);
+
+	FMatrix LocalToWorld = CachedGridTransform.ToMatrixWithScale();
+
+	for (int32 Y = 0; Y < YCount; Y++)
+	{
+		for (int32 X = 0; X < XCount; X++)
+		{
+			int32 LayerCount = GetLayerCount(X, Y);
+			for (int32 Layer = 0; Layer < LayerCount; Layer++)
+			{
+				FCellRef CellRef(X, Y, Layer);
+				int32 Index = CellRefToIndex(CellRef);
+				FVector World = LocalToWorld.TransformPosition(GetCellLocalPosition(CellRef));
+
+				CellCenterX[Index] = World.X;
+				CellCenterY[Index] = World.Y;
+				CellCenterZ[Index] = World.Z;
+			}
+		}
+	}
 }
 
 bool AGAGridActor::IsCellRefInBounds(const FCellRef& CellRef) const
@@ -157,6 +444,18 @@ bool AGAGridActor::IsCellRefInBounds(const FCellRef& CellRef) const
 	return (CellRef.X >= 0) && (CellRef.X < XCount) && (CellRef.Y >= 0) && (CellRef.Y < YCount);
 }
 
+FBox2D AGAGridActor::GetWorldBounds() const
+{
+	FBox2D Result(EForceInit::ForceInit);
+	for (const FVector2D& Corner : { FVector2D(0.0f, 0.0f), FVector2D(XCount, 0.0f), FVector2D(0.0f, YCount), FVector2D(XCount, YCount) })
+	{
+		FVector WorldCorner;
+		TransformNormalizedGridSpaceToWorld(Corner, WorldCorner);
+		Result += FVector2D(WorldCorner);
+	}
+	return Result;
+}
+
 FVector2D AGAGridActor::GetCellGridSpacePosition(const FCellRef& CellRef) const
 {
 	float HalfScale = 0.5f * CellScale;
@@ -185,6 +484,207 @@ float AGAGridActor::GetCellHeightData(const FCellRef& CellRef) const
 }
 
 
+float AGAGridActor::GetCellClearance(const FCellRef& CellRef) const
+{
+	int32 CellIndex = CellRefToIndex(CellRef);
+	return ClearanceData.IsValidIndex(CellIndex) ? ClearanceData[CellIndex] : 0.0f;
+}
+
+
+// Cell handles --------------------------------
+
+FCellRef AGAGridActor::HandleToCellRef(const FGACellHandle& Handle) const
+{
+	if ((Handle.GridId != GridId) || (Handle.Index >= uint32(GetTotalStorageCount())))
+	{
+		return FCellRef::Invalid;
+	}
+
+	int32 Index = int32(Handle.Index);
+	if (Index < GetStorageCount())
+	{
+		int32 X, Y;
+		Indexer.IndexToCell(Index, X, Y);
+		return ((X < XCount) && (Y < YCount)) ? FCellRef(X, Y) : FCellRef::Invalid;		// could be tile padding
+	}
+
+	const FIntPoint& ColumnAndLayer = ExtraLayerCells[Index - GetStorageCount()];
+	return FCellRef(ColumnAndLayer.X % XCount, ColumnAndLayer.X / XCount, ColumnAndLayer.Y);
+}
+
+void AGAGridActor::GetPassableNeighbors(const FGACellHandle& Cell, float MinClearance, TArray<FGACellStep, TInlineAllocator<8>>& StepsOut) const
+{
+	// Same as GetNeighbors, but with handles, and only the one conversion
+	FCellRef CellRef = HandleToCellRef(Cell);
+	if (!CellRef.IsValid())
+	{
+		return;
+	}
+
+	bool bCellLayered = HasLayers() && ((CellRef.Layer > 0) || IsColumnLayered(CellRef.X, CellRef.Y));
+	float CellHeight = HasLayers() ? HeightData[Cell.Index] : 0.0f;
+
+	for (int32 Y = CellRef.Y - 1; Y <= CellRef.Y + 1; Y++)
+	{
+		for (int32 X = CellRef.X - 1; X <= CellRef.X + 1; X++)
+		{
+			FCellRef NCell(X, Y);
+			if (((X == CellRef.X) && (Y == CellRef.Y)) || !IsValidCell(NCell))
+			{
+				continue;
+			}
+
+			if (bCellLayered || IsColumnLayered(X, Y))
+			{
+				NCell.Layer = GetConnectedLayer(X, Y, CellHeight);
+				if (NCell.Layer == INDEX_NONE)
+				{
+					continue;
+				}
+			}
+
+			FGACellHandle NHandle(uint32(CellRefToIndex(NCell)), GridId);
+			if (IsHandlePassable(NHandle, MinClearance))
+			{
+				FGACellStep& Step = StepsOut.AddDefaulted_GetRef();
+				Step.Cell = NHandle;
+				Step.CellRef = NCell;
+				Step.Length = ((X != CellRef.X) && (Y != CellRef.Y)) ? UE_SQRT_2 : 1.0f;
+			}
+		}
+	}
+}
+
+
+bool AGAGridActor::ClipGridBox(const FGridBox& Box, FGridBox& ClippedOut) const
+{
+	if (!Box.IsValid())
+	{
+		return false;
+	}
+
+	ClippedOut.MinX = FMath::Max(Box.MinX, 0);
+	ClippedOut.MaxX = FMath::Min(Box.MaxX, XCount - 1);
+	ClippedOut.MinY = FMath::Max(Box.MinY, 0);
+	ClippedOut.MaxY = FMath::Min(Box.MaxY, YCount - 1);
+
+	return ClippedOut.IsValid();
+}
+
+
+// Traversal cost --------------------------------
+
+void AGAGridActor::StampCost(const FGridBox& Box, float CostMultiplier)
+{
+	FGridBox Clipped;
+	if ((CostData.Num() != GetTotalStorageCount()) || !ClipGridBox(Box, Clipped))
+	{
+		return;
+	}
+
+	// Note, stamps cover every layer of the column
+	uint8 Cost = CostMultiplierToByte(CostMultiplier);
+	for (int32 Y = Clipped.MinY; Y <= Clipped.MaxY; Y++)
+	{
+		for (int32 X = Clipped.MinX; X <= Clipped.MaxX; X++)
+		{
+			int32 LayerCount = GetLayerCount(X, Y);
+			for (int32 Layer = 0; Layer < LayerCount; Layer++)
+			{
+				CostData[CellRefToIndex(FCellRef(X, Y, Layer))] = Cost;
+			}
+		}
+	}
+
+	// Stamping can only lower the bound, never raise it (it just might not be as tight as it could be)
+	MinCostMultiplier = FMath::Min(MinCostMultiplier, float(Cost) / CostUnit);
+
+	NotifyCellsChanged(Clipped);
+}
+
+void AGAGridActor::StampCostMap(const FGAGridMap& CostMap, float CostPerUnit)
+{
+	FGridBox Clipped;
+	if ((CostData.Num() != GetTotalStorageCount()) || !ClipGridBox(CostMap.GridBounds, Clipped))
+	{
+		return;
+	}
+
+	for (int32 Y = Clipped.MinY; Y <= Clipped.MaxY; Y++)
+	{
+		const float* Row = CostMap.GetRowData(Y);
+		for (int32 X = Clipped.MinX; X <= Clipped.MaxX; X++)
+		{
+			float Added = Row[X - CostMap.GridBounds.MinX] * CostPerUnit * CostUnit;
+			int32 LayerCount = GetLayerCount(X, Y);
+			for (int32 Layer = 0; Layer < LayerCount; Layer++)
+			{
+				uint8& Cost = CostData[CellRefToIndex(FCellRef(X, Y, Layer))];
+				Cost = uint8(FMath::Clamp(FMath::RoundToInt32(float(Cost) + Added), 1, 255));
+			}
+		}
+	}
+
+	// Negative values (or a negative CostPerUnit) can make things cheaper
+	RefreshCostBounds();
+
+	NotifyCellsChanged(Clipped);
+}
+
+void AGAGridActor::ClearCostStamps(const FGridBox& Box)
+{
+	FGridBox Clipped;
+	if ((CostData.Num() != BaseCostData.Num()) || !ClipGridBox(Box, Clipped))
+	{
+		return;
+	}
+
+	for (int32 Y = Clipped.MinY; Y <= Clipped.MaxY; Y++)
+	{
+		for (int32 X = Clipped.MinX; X <= Clipped.MaxX; X++)
+		{
+			int32 LayerCount = GetLayerCount(X, Y);
+			for (int32 Layer = 0; Layer < LayerCount; Layer++)
+			{
+				int32 CellIndex = CellRefToIndex(FCellRef(X, Y, Layer));
+				CostData[CellIndex] = BaseCostData[CellIndex];
+			}
+		}
+	}
+
+	RefreshCostBounds();
+
+	NotifyCellsChanged(Clipped);
+}
+
+void AGAGridActor::RefreshCostBounds()
+{
+	if (CostData.Num() != GetTotalStorageCount())
+	{
+		MinCostMultiplier = 1.0f;
+		return;
+	}
+
+	// Note, we only look at real cells -- tile padding is zeroed
+	uint8 MinCost = 255;
+	for (int32 Y = 0; Y < YCount; Y++)
+	{
+		for (int32 X = 0; X < XCount; X++)
+		{
+			MinCost = FMath::Min(MinCost, CostData[CellRefToIndex(FCellRef(X, Y))]);
+		}
+	}
+
+	// Plus the extra layers, which are all real
+	for (int32 Index = GetStorageCount(); Index < CostData.Num(); Index++)
+	{
+		MinCost = FMath::Min(MinCost, CostData[Index]);
+	}
+
+	MinCostMultiplier = FMath::Min(float(MinCost) / CostUnit, 1.0f);
+}
+
+
 bool AGAGridActor::GridSpaceBoundsToRect2D(const FBox2D& Box, FIntRect &RectOut) const
 {
 	float HalfScale = 0.5f * CellScale;
@@ -198,18 +698,41 @@ bool AGAGridActor::GridSpaceBoundsToRect2D(const FBox2D& Box, FIntRect &RectOut)
 }
 
 
-void AGAGridActor::GetNeighbors(const FCellRef& Cell, bool OnlyTraversable, TArray<FCellRef> &Neighbors) const
+void AGAGridActor::GetNeighbors(const FCellRef& Cell, bool OnlyTraversable, TArray<FCellRef> &Neighbors, float MinClearance) const
 {
+	// Heights only matter if there's a layered column involved. Everywhere else, the neighbors are just the cells around us.
+	bool bCellLayered = false;
+	float CellHeight = 0.0f;
+	if (HasLayers() && IsValidCell(Cell))
+	{
+		bCellLayered = (Cell.Layer > 0) || IsColumnLayered(Cell.X, Cell.Y);
+		CellHeight = GetCellHeightData(Cell);
+	}
+
 	for (int32 Y = Cell.Y -1; Y <= Cell.Y + 1; Y++)
 	{
 		for (int32 X = Cell.X - 1; X <= Cell.X + 1; X++)
 		{
-			if ((X != 0) || (Y != 0))
+			if ((X != Cell.X) || (Y != Cell.Y))
 			{
 				FCellRef NCell(X, Y);
 				if (IsValidCell(NCell))
 				{
-					if (!OnlyTraversable || EnumHasAllFlags(GetCellData(NCell), ECellData::CellDataTraversable))
+					if (bCellLayered || IsColumnLayered(X, Y))
+					{
+						NCell.Layer = GetConnectedLayer(X, Y, CellHeight);
+						if (NCell.Layer == INDEX_NONE)
+						{
+							if (OnlyTraversable)
+							{
+								// Can't get there from here
+								continue;
+							}
+							NCell.Layer = GetLayerAtHeight(X, Y, CellHeight);
+						}
+					}
+
+					if (!OnlyTraversable || IsCellPassable(NCell, MinClearance))
 					{
 						Neighbors.Add(NCell);
 					}
@@ -223,9 +746,8 @@ void AGAGridActor::GetNeighbors(const FCellRef& Cell, bool OnlyTraversable, TArr
 void AGAGridActor::TransformPointToNormalizedGridSpace(const FVector& WorldPosition, FVector2D& UniformGridSpacePosition) const
 {
 	// First, transform the point into grid-local space
-	// note, we drop the Z dimension at this point, by casting to a FVector2D
-	FTransform GridTransform = GetActorTransform();
-	FVector2D LocalPoint = FVector2D(GridTransform.InverseTransformPosition(WorldPosition));
+	// note, we drop the Z dimension at this point
+	FVector2D LocalPoint = WorldToLocal2D(WorldPosition);
 
 	LocalPoint += HalfExtents;		// Now LocalPoint is relative the to the (0, 0) corner of grid
 
@@ -239,20 +761,17 @@ void AGAGridActor::TransformNormalizedGridSpaceToWorld(const FVector2D& UniformG
 
 	GridSpacePoint -= HalfExtents;
 
-	// First, transform the point into grid-local space
-	// note, we drop the Z dimension at this point, by casting to a FVector2D
-	FTransform GridTransform = GetActorTransform();
-
+	// Finally, transform the point from grid-local space into world space
 	FVector LocalPoint3D(GridSpacePoint, 0.0f);
 
-	WorldPosition = GridTransform.TransformPosition(LocalPoint3D);
+	WorldPosition = CachedGridTransform.TransformPosition(LocalPoint3D);
 }
 
 
 // Spatial Queries --------------------------------
 
 
-bool AGAGridActor::TraceLine(const FVector& Start, const FVector& End, FVector& HitLocationOut) const
+bool AGAGridActor::TraceLine(const FVector& Start, const FVector& End, FVector& HitLocationOut, float MinClearance) const
 {
 	FCellRef StartCell = GetCellRef(Start);
 	FCellRef EndCell = GetCellRef(End);
@@ -261,6 +780,15 @@ bool AGAGridActor::TraceLine(const FVector& Start, const FVector& End, FVector&
 	{
 		FCellRef CurrentCell = StartCell;
 		FVector2D P0, P1, V;
+
+		// On layered grids, we follow the surface we start on, stepping between layers the same way GetNeighbors does
+		bool bCurrentLayered = false;
+		float CurrentHeight = 0.0f;
+		if (HasLayers())
+		{
+			bCurrentLayered = (CurrentCell.Layer > 0) || IsColumnLayered(CurrentCell.X, CurrentCell.Y);
+			CurrentHeight = GetCellHeightData(CurrentCell);
+		}
 		TransformPointToNormalizedGridSpace(Start, P0);
 		TransformPointToNormalizedGridSpace(End, P1);
 
@@ -329,9 +857,25 @@ bool AGAGridActor::TraceLine(const FVector& Start, const FVector& End, FVector&
 					CurrentCell.Y = (V.Y > 0) ? CurrentCell.Y + 1 : CurrentCell.Y - 1;
 				}
 
-				if (IsValidCell(CurrentCell) && EnumHasAllFlags(GetCellData(CurrentCell), ECellData::CellDataTraversable))
+				CurrentCell.Layer = 0;
+				if (HasLayers() && IsValidCell(CurrentCell))
+				{
+					bool bNextLayered = IsColumnLayered(CurrentCell.X, CurrentCell.Y);
+					if (bCurrentLayered || bNextLayered)
+					{
+						CurrentCell.Layer = GetConnectedLayer(CurrentCell.X, CurrentCell.Y, CurrentHeight);
+					}
+					bCurrentLayered = bNextLayered;
+				}
+
+				if (IsValidCell(CurrentCell) && IsCellPassable(CurrentCell, MinClearance))
 				{
 					// we're good, iterate
+					if (HasLayers())
+					{
+						bCurrentLayered = bCurrentLayered || (CurrentCell.Layer > 0);
+						CurrentHeight = GetCellHeightData(CurrentCell);
+					}
 				}
 				else
 				{
@@ -348,196 +892,1308 @@ bool AGAGridActor::TraceLine(const FVector& Start, const FVector& End, FVector&
 			return false;
 		}
 	}
-	else
+	else
+	{
+		HitLocationOut = Start;
+		return true;
+	}
+}
+
+bool AGAGridActor::TraceHeightfield(const FVector& Start, const FVector& End, FVector& HitLocationOut) const
+{
+	if (ObstacleHeightData.Num() != GetStorageCount())
+	{
+		// Never baked -- the best we can do is the walkability trace
+		return TraceLine(Start, End, HitLocationOut);
+	}
+
+	FVector2D P0, P1;
+	TransformPointToNormalizedGridSpace(Start, P0);
+	TransformPointToNormalizedGridSpace(End, P1);
+	float Z0 = WorldToLocalHeight(Start);
+	float Z1 = WorldToLocalHeight(End);
+
+	// Same walk as TraceLine, but parameterized over the whole segment (T in [0, 1]), since we need the height of
+	// the line where it enters and leaves each cell
+	FVector2D V = P1 - P0;
+	int32 X = FMath::FloorToInt32(P0.X);
+	int32 Y = FMath::FloorToInt32(P0.Y);
+	int32 EndX = FMath::FloorToInt32(P1.X);
+	int32 EndY = FMath::FloorToInt32(P1.Y);
+	int32 StepX = (V.X >= 0.0f) ? 1 : -1;
+	int32 StepY = (V.Y >= 0.0f) ? 1 : -1;
+
+	float TDeltaX = (FMath::Abs(V.X) > UE_KINDA_SMALL_NUMBER) ? float(1.0f / FMath::Abs(V.X)) : FLT_MAX;
+	float TDeltaY = (FMath::Abs(V.Y) > UE_KINDA_SMALL_NUMBER) ? float(1.0f / FMath::Abs(V.Y)) : FLT_MAX;
+	float TMaxX = (TDeltaX < FLT_MAX) ? float(((StepX > 0) ? (X + 1 - P0.X) : (P0.X - X)) * TDeltaX) : FLT_MAX;
+	float TMaxY = (TDeltaY < FLT_MAX) ? float(((StepY > 0) ? (Y + 1 - P0.Y) : (P0.Y - Y)) * TDeltaY) : FLT_MAX;
+
+	while ((X != EndX) || (Y != EndY))
+	{
+		float TEnter = FMath::Min(TMaxX, TMaxY);
+		if (TEnter >= 1.0f)
+		{
+			break;
+		}
+
+		if (TMaxX < TMaxY)
+		{
+			X += StepX;
+			TMaxX += TDeltaX;
+		}
+		else
+		{
+			Y += StepY;
+			TMaxY += TDeltaY;
+		}
+
+		if (((X == EndX) && (Y == EndY)) || (X < 0) || (X >= XCount) || (Y < 0) || (Y >= YCount))
+		{
+			// Off the grid counts as clear
+			continue;
+		}
+
+		// The line is lowest at one end or the other of its run through the cell
+		float TLeave = FMath::Min3(TMaxX, TMaxY, 1.0f);
+		float LineZ = FMath::Min(FMath::Lerp(Z0, Z1, TEnter), FMath::Lerp(Z0, Z1, TLeave));
+
+		if (ObstacleHeightData[Indexer.CellToIndex(X, Y)] > LineZ)
+		{
+			HitLocationOut = FMath::Lerp(Start, End, double(TEnter));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+// Data from NavSystem --------------------------------
+
+bool AGAGridActor::RefreshDataFromNav()
+{
+	bool Result = false;
+	UNavigationSystemV1 *NavSystem = UNavigationSystemV1::GetNavigationSystem(this);
+	if (NavSystem)
+	{
+		INavigationDataInterface* NavData = NavSystem->GetMainNavData();		// Note: only using the default nav data here
+		const ARecastNavMesh* NavMesh = Cast<ARecastNavMesh>(NavData);
+		FTransform ActorTransform = GetActorTransform();
+
+		// Allocate the array and set to 0
+		ResetData();
+
+		ECellData* CellData = GetData();
+		FVector HalfExtents3D(HalfExtents.X, HalfExtents.Y, 0.0f);
+
+		// Cost of each nav area we've run into, from the area class's DefaultCost
+		TMap<uint32, uint8> AreaCosts;
+
+		// Surfaces (height and cost) found under a cell besides the one in HeightData, far enough from it to be
+		// a separate layer. Keyed by cell index. These become the extra layers once we've seen every poly.
+		TMap<int32, TArray<TPair<float, uint8>>> OtherSurfaces;
+
+		// Code for extracting nav polys taken from here:
+		// https://nerivec.github.io/old-ue4-wiki/pages/ai-navigation-in-c-customize-path-following-every-tick.html
+
+		TArray<FNavTileRef> NavTiles;
+		NavMesh->GetAllNavMeshTiles(NavTiles);
+		for (FNavTileRef &TileRef : NavTiles)
+		{
+			const FBox TileBounds = NavMesh->GetNavMeshTileBounds(TileRef);
+			if (TileBounds.IsValid)			// reportedly will crash if this is not checked
+			{
+				TArray<FNavPoly> Polys;
+
+				if (NavMesh->GetPolysInTile(TileRef, Polys))
+				{
+					for (FNavPoly& NavPoly : Polys)
+					{
+						TArray<FVector> PolyVerts;
+						TArray<FVector> PolyVertsLocal;
+						NavNodeRef Ref = NavPoly.Ref;
+
+						// We're converting polys to triangles
+						PolyVertsLocal.SetNum(3);
+
+						NavMesh->GetPolyVerts(Ref, PolyVerts);
+
+						uint32 AreaID = NavMesh->GetPolyAreaID(Ref);
+						uint8* PolyCostPtr = AreaCosts.Find(AreaID);
+						if (PolyCostPtr == NULL)
+						{
+							float AreaCost = 1.0f;
+							const UClass* AreaClass = NavMesh->GetAreaClass(AreaID);
+							const UNavArea* Area = AreaClass ? Cast<UNavArea>(AreaClass->GetDefaultObject()) : NULL;
+							if (Area)
+							{
+								AreaCost = Area->DefaultCost;
+							}
+							PolyCostPtr = &AreaCosts.Add(AreaID, CostMultiplierToByte(AreaCost));
+						}
+						uint8 PolyCost = *PolyCostPtr;
+
+						// Warning: contrary to what a healthy, well-adjusted individual might expect, nav polys are not planar.
+
+						// We can't do any of the above if we don't have at least 2 verts in the poly
+						// (it wouldn't even be a poly at that point)
+						if (PolyVerts.Num() <= 2)
+						{
+							continue;
+						}
+
+						for (int32 TriangleIndex= 0; TriangleIndex <= PolyVerts.Num() - 3; TriangleIndex++)
+						{
+							PolyVertsLocal[0] = PolyVerts[0];
+							PolyVertsLocal[1] = PolyVerts[1 + TriangleIndex];
+							PolyVertsLocal[2] = PolyVerts[2 + TriangleIndex];
+
+							// transform verts to local space
+							for (int32 VertexIndex = 0; VertexIndex < PolyVertsLocal.Num(); VertexIndex++)
+							{
+								PolyVertsLocal[VertexIndex] = ActorTransform.InverseTransformPosition(PolyVertsLocal[VertexIndex]) + HalfExtents3D;
+							}
+
+							{
+								FBox2D PolyBounds(EForceInit::ForceInit);
+								for (const FVector& Vert : PolyVertsLocal)
+								{
+									PolyBounds += FVector2D(Vert);
+								}
+
+								FIntRect GridBox;
+								if (GridSpaceBoundsToRect2D(PolyBounds, GridBox))
+								{
+									FVector PlaneNormal;
+									FVector2D PlaneNormal2D;
+									float PlaneD;
+
+									TArray<FVector2D> OutsideVectors;
+									OutsideVectors.SetNum(PolyVertsLocal.Num());
+
+									// calculate the plane of the poly (this is all in local grid space)
+									// Remember a plane is defined by the equation N.x - d = 0
+									// where N is the normal and d is a constant (distance from the origin)
+
+									{
+										FVector V0, V1;
+
+										V0 = PolyVertsLocal[1] - PolyVertsLocal[0];
+										V1 = PolyVertsLocal[2] - PolyVertsLocal[0];
+
+										PlaneNormal = V1 ^ V0;				// cross product
+										PlaneNormal.Normalize();
+
+										PlaneD = PlaneNormal | PolyVertsLocal[0];			// dot product. Note, we know the poly verts are on the plane in question
+										PlaneNormal2D = FVector2D(PlaneNormal);
+									}
+
+									// This should never happen -- it would suggest a poly that is vertical wall, instead of 
+									// a mostly-level floor. Still, we're going to divide by this below, so to be safe...
+									if (PlaneNormal.Z == 0.0f)
+									{
+										continue;
+									}
+
+									// Cache off a set of "outside vectors", so that we can test each cell in the box against the
+									// bounds of the polygons
+
+									for (int32 V0Index = 0; V0Index < PolyVertsLocal.Num(); V0Index++)
+									{
+										int32 V1Index = (V0Index + 1) % PolyVertsLocal.Num();
+										FVector2D V0V1 = FVector2D(PolyVertsLocal[V1Index] - PolyVertsLocal[V0Index]);
+
+										// Rotate 90 degrees
+										FVector2D& OutsideVector = OutsideVectors[V0Index];
+										OutsideVector.X = -V0V1.Y;
+										OutsideVector.Y = V0V1.X;
+									}
+
+									// Grid box now represents the intersection between Grid and the poly in question.
+									// Check each cell in the box to see if it's inside the poly
+
+									// Note, this is way inefficient
+									// A smarter way would be to use some kind of rasterization approach
+
+									for (int Y = GridBox.Min.Y; Y <= GridBox.Max.Y; Y++)
+									{
+										for (int X = GridBox.Min.X; X <= GridBox.Max.X; X++)
+										{
+											FCellRef CellRef(X, Y);
+											FVector2D CellCenter = GetCellGridSpacePosition(CellRef);
+											bool IsOutside = false;
+
+											for (int32 VIndex = 0; (VIndex < PolyVertsLocal.Num()) && !IsOutside; VIndex++)
+											{
+												FVector2D V = FVector2D(PolyVertsLocal[VIndex]);
+												const FVector2D& OutsideVector = OutsideVectors[VIndex];
+												FVector2D V2Cell = CellCenter - V;
+
+												if ((V2Cell | OutsideVector) > 0.0f)		// Dot product
+												{
+													// the cell is outside this edge
+													IsOutside = true;
+												}
+											}
+
+											if (!IsOutside)
+											{
+												// turn on the traversable bit
+												int32 CellIndex = CellRefToIndex(CellRef);
+												bool bFirst = false;
+
+												if (!EnumHasAnyFlags(CellData[CellIndex], ECellData::CellDataTraversable))
+												{
+													EnumAddFlags(CellData[CellIndex], ECellData::CellDataTraversable);
+													bFirst = true;
+												}
+
+												// Compute the height based on the local poly verts
+												// Find the vertical projection of the CellCenter to the plane
+												float H = (PlaneD - (CellCenter | PlaneNormal2D)) / PlaneNormal.Z;
+
+												if (!bFirst && (FMath::Abs(H - HeightData[CellIndex]) >= MinLayerSeparation))
+												{
+													// A different surface, above or below. The highest stays in HeightData, as layer 0.
+													TArray<TPair<float, uint8>>& Others = OtherSurfaces.FindOrAdd(CellIndex);
+													if (H > HeightData[CellIndex])
+													{
+														Others.Add(TPair<float, uint8>(HeightData[CellIndex], BaseCostData[CellIndex]));
+														HeightData[CellIndex] = H;
+														BaseCostData[CellIndex] = PolyCost;
+													}
+													else
+													{
+														Others.Add(TPair<float, uint8>(H, PolyCost));
+													}
+												}
+												// See if it's higher than what's already there
+												else if (bFirst || (H > HeightData[CellIndex]))
+												{
+													HeightData[CellIndex] = H;
+													BaseCostData[CellIndex] = PolyCost;
+												}
+
+											}
+										}
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+
+		// Stack up the other surfaces into layers. The same surface can show up several times (from neighboring
+		// polys), so merge anything closer than MinLayerSeparation, keeping the highest as we do for layer 0.
+		for (TPair<int32, TArray<TPair<float, uint8>>>& Pair : OtherSurfaces)
+		{
+			TArray<TPair<float, uint8>>& Surfaces = Pair.Value;
+			Surfaces.Add(TPair<float, uint8>(HeightData[Pair.Key], BaseCostData[Pair.Key]));
+			Surfaces.Sort([](const TPair<float, uint8>& A, const TPair<float, uint8>& B) { return A.Key > B.Key; });
+
+			TArray<TPair<float, uint8>> Layers;
+			for (const TPair<float, uint8>& Surface : Surfaces)
+			{
+				if ((Layers.Num() == 0) || (Layers.Last().Key - Surface.Key >= MinLayerSeparation))
+				{
+					Layers.Add(Surface);
+				}
+			}
+
+			int32 X, Y;
+			Indexer.IndexToCell(Pair.Key, X, Y);
+			AddColumnLayers(X, Y, Layers);
+		}
+
+		// Heights have changed, so the cached cell centers need to be recomputed
+		RefreshCellCenters();
+
+		// ... and so has what blocks sight lines
+		RefreshObstacleHeights();
+
+		// As has traversability
+		RefreshClearance();
+
+		// Baking throws away any runtime cost stamps
+		CostData = BaseCostData;
+		RefreshCostBounds();
+
+		// (and ResetData threw away the obstacles)
+		NotifyCellsChanged(FGridBox(0, XCount - 1, 0, YCount - 1));
+	}
+
+	return Result;
+}
+
+void AGAGridActor::RefreshObstacleHeights()
+{
+	RefreshCachedTransform();
+
+	UWorld* World = GetWorld();
+	FMatrix LocalToWorld = CachedGridTransform.ToMatrixWithScale();
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(GridObstacleHeights), false, this);
+
+	ObstacleHeightData.SetNumUninitialized(GetStorageCount());
+
+	for (int32 Y = 0; Y < YCount; Y++)
+	{
+		for (int32 X = 0; X < XCount; X++)
+		{
+			FCellRef CellRef(X, Y);
+			int32 Index = CellRefToIndex(CellRef);
+
+			if (EnumHasAllFlags(Data[Index], ECellData::CellDataTraversable))
+			{
+				// Note, the highest surface, which is what layer 0 always is
+				ObstacleHeightData[Index] = HeightData[Index];
+				continue;
+			}
+
+			ObstacleHeightData[Index] = -UE_BIG_NUMBER;
+
+			if (World)
+			{
+				FVector Local = GetCellLocalPosition(CellRef);
+				Local.Z = ObstacleProbeHeight;
+				FVector ProbeStart = LocalToWorld.TransformPosition(Local);
+				Local.Z = -ObstacleProbeHeight;
+				FVector ProbeEnd = LocalToWorld.TransformPosition(Local);
+
+				FHitResult HitResult;
+				if (World->LineTraceSingleByChannel(HitResult, ProbeStart, ProbeEnd, ECollisionChannel::ECC_Visibility, Params))
+				{
+					ObstacleHeightData[Index] = WorldToLocalHeight(HitResult.ImpactPoint);
+				}
+			}
+		}
+	}
+}
+
+
+// Clearance --------------------------------
+
+// One-dimensional squared distance transform (Felzenszwalb & Huttenlocher, "Distance Transforms of Sampled Functions")
+// F is the input function (0 at obstacles, "infinity" elsewhere), D receives the squared distance to the nearest obstacle.
+// V and Z are scratch arrays, of size N and N + 1 respectively.
+static void DistanceTransform1D(const float* F, float* D, int32 N, int32* V, float* Z)
+{
+	int32 K = 0;
+	V[0] = 0;
+	Z[0] = -UE_BIG_NUMBER;
+	Z[1] = UE_BIG_NUMBER;
+
+	// Build the lower envelope of the parabolas rooted at each sample
+	for (int32 Q = 1; Q < N; Q++)
+	{
+		float S = ((F[Q] + float(Q * Q)) - (F[V[K]] + float(V[K] * V[K]))) / float(2 * Q - 2 * V[K]);
+		while (S <= Z[K])
+		{
+			K--;
+			S = ((F[Q] + float(Q * Q)) - (F[V[K]] + float(V[K] * V[K]))) / float(2 * Q - 2 * V[K]);
+		}
+		K++;
+		V[K] = Q;
+		Z[K] = S;
+		Z[K + 1] = UE_BIG_NUMBER;
+	}
+
+	// Sample the envelope
+	K = 0;
+	for (int32 Q = 0; Q < N; Q++)
+	{
+		while (Z[K + 1] < float(Q))
+		{
+			K++;
+		}
+		D[Q] = float((Q - V[K]) * (Q - V[K])) + F[V[K]];
+	}
+}
+
+void AGAGridActor::RefreshClearance()
+{
+	UpdateClearance(FGridBox(0, XCount - 1, 0, YCount - 1));
+}
+
+FGridBox AGAGridActor::GetClearanceBox(const FGridBox& Box) const
+{
+	// Cells further than this (center to center) from a change can't see it through the cap. Without a cap, anything can.
+	if ((MaxClearance <= 0.0f) || !Box.IsValid())
+	{
+		return FGridBox(0, XCount - 1, 0, YCount - 1);
+	}
+
+	int32 Reach = FMath::CeilToInt32(MaxClearance / CellScale + 0.5f);
+	return FGridBox(FMath::Max(Box.MinX - Reach, 0), FMath::Min(Box.MaxX + Reach, XCount - 1),
+		FMath::Max(Box.MinY - Reach, 0), FMath::Min(Box.MaxY + Reach, YCount - 1));
+}
+
+FGridBox AGAGridActor::UpdateClearance(const FGridBox& Box)
+{
+	FGridBox Changed;
+	if (!IsDataResident() || (Data.Num() != GetTotalStorageCount()))
+	{
+		return Changed;
+	}
+
+	FGridBox FullBox(0, XCount - 1, 0, YCount - 1);
+	FGridBox UpdateBox = Box;
+	if (ClearanceData.Num() != GetTotalStorageCount())
+	{
+		// Never been done (or the grid's changed shape): everything, and everything changed
+		ClearanceData.SetNumZeroed(GetTotalStorageCount());
+		UpdateBox = FullBox;
+		Changed = FullBox;
+	}
+	else if (MaxClearance <= 0.0f)
+	{
+		UpdateBox = FullBox;
+	}
+
+	UpdateBox = FGridBox(FMath::Max(UpdateBox.MinX, 0), FMath::Min(UpdateBox.MaxX, XCount - 1), FMath::Max(UpdateBox.MinY, 0), FMath::Min(UpdateBox.MaxY, YCount - 1));
+	if (!UpdateBox.IsValid())
+	{
+		return Changed;
+	}
+
+	// Keep the old values in the box, to see what changed
+	TArray<float> OldClearance;
+	OldClearance.Reserve(UpdateBox.GetCellCount());
+	for (int32 Y = UpdateBox.MinY; Y <= UpdateBox.MaxY; Y++)
+	{
+		for (int32 X = UpdateBox.MinX; X <= UpdateBox.MaxX; X++)
+		{
+			int32 LayerCount = GetLayerCount(X, Y);
+			for (int32 Layer = 0; Layer < LayerCount; Layer++)
+			{
+				OldClearance.Add(ClearanceData[CellRefToIndex(FCellRef(X, Y, Layer))]);
+			}
+		}
+	}
+
+	// Work on the box plus everything close enough to matter (with the cap), padded with a ring of obstacles where it
+	// goes off the grid, so the grid's edge counts as a wall. Anything further away than the window can only make
+	// for clearance past the cap.
+	// Note: "infinity" just needs to be bigger than any real squared distance, without overflowing when we add to it
+	const float Infinity = 1.0e20f;
+	FGridBox Window = GetClearanceBox(UpdateBox);
+	Window = FGridBox(Window.MinX - 1, Window.MaxX + 1, Window.MinY - 1, Window.MaxY + 1);
+	int32 PaddedX = Window.GetWidth();
+	int32 PaddedY = Window.GetHeight();
+	int32 MaxN = FMath::Max(PaddedX, PaddedY);
+
+	TArray<float> SquaredDistance;
+	SquaredDistance.Init(0.0f, PaddedX * PaddedY);
+
+	for (int32 Y = FMath::Max(Window.MinY, 0); Y <= FMath::Min(Window.MaxY, YCount - 1); Y++)
+	{
+		for (int32 X = FMath::Max(Window.MinX, 0); X <= FMath::Min(Window.MaxX, XCount - 1); X++)
+		{
+			bool Traversable = EnumHasAllFlags(GetCellData(FCellRef(X, Y)), ECellData::CellDataTraversable);
+			SquaredDistance[(Y - Window.MinY) * PaddedX + (X - Window.MinX)] = Traversable ? Infinity : 0.0f;
+		}
+	}
+
+	TArray<float> F, D, Z;
+	TArray<int32> V;
+	F.SetNumUninitialized(MaxN);
+	D.SetNumUninitialized(MaxN);
+	Z.SetNumUninitialized(MaxN + 1);
+	V.SetNumUninitialized(MaxN);
+
+	// Pass 1: down each column
+	for (int32 X = 0; X < PaddedX; X++)
+	{
+		for (int32 Y = 0; Y < PaddedY; Y++)
+		{
+			F[Y] = SquaredDistance[Y * PaddedX + X];
+		}
+		DistanceTransform1D(F.GetData(), D.GetData(), PaddedY, V.GetData(), Z.GetData());
+		for (int32 Y = 0; Y < PaddedY; Y++)
+		{
+			SquaredDistance[Y * PaddedX + X] = D[Y];
+		}
+	}
+
+	// Pass 2: along each row
+	for (int32 Y = 0; Y < PaddedY; Y++)
+	{
+		float* Row = SquaredDistance.GetData() + Y * PaddedX;
+		FMemory::Memcpy(F.GetData(), Row, PaddedX * sizeof(float));
+		DistanceTransform1D(F.GetData(), Row, PaddedX, V.GetData(), Z.GetData());
+	}
+
+	// Distance is between cell centers. Subtract half a cell to get the distance to the obstacle's edge.
+	float Cap = (MaxClearance > 0.0f) ? MaxClearance : UE_MAX_FLT;
+	for (int32 Y = UpdateBox.MinY; Y <= UpdateBox.MaxY; Y++)
+	{
+		for (int32 X = UpdateBox.MinX; X <= UpdateBox.MaxX; X++)
+		{
+			float CellDistance = FMath::Sqrt(SquaredDistance[(Y - Window.MinY) * PaddedX + (X - Window.MinX)]);
+			ClearanceData[CellRefToIndex(FCellRef(X, Y))] = FMath::Min(FMath::Max(CellDistance - 0.5f, 0.0f) * CellScale, Cap);
+		}
+	}
+
+	RefreshLayeredClearance(UpdateBox);
+
+	int32 OldIndex = 0;
+	for (int32 Y = UpdateBox.MinY; Y <= UpdateBox.MaxY; Y++)
+	{
+		for (int32 X = UpdateBox.MinX; X <= UpdateBox.MaxX; X++)
+		{
+			int32 LayerCount = GetLayerCount(X, Y);
+			for (int32 Layer = 0; Layer < LayerCount; Layer++)
+			{
+				int32 CellIndex = CellRefToIndex(FCellRef(X, Y, Layer));
+				if (OldClearance[OldIndex++] != ClearanceData[CellIndex])
+				{
+					Changed = Changed.IsValid() ? FGridBox(
+						FMath::Min(Changed.MinX, X), FMath::Max(Changed.MaxX, X),
+						FMath::Min(Changed.MinY, Y), FMath::Max(Changed.MaxY, Y)) : FGridBox(X, X, Y, Y);
+				}
+			}
+		}
+	}
+
+	return Changed;
+}
+
+
+// Layers --------------------------------
+
+int32 AGAGridActor::GetLayerCount(int32 X, int32 Y) const
+{
+	if (IsCellRefInBounds(FCellRef(X, Y)) && IsColumnLayered(X, Y))
+	{
+		const FGAColumnLayers* Column = ColumnLayers.Find(Y * XCount + X);
+		return Column ? Column->Count + 1 : 1;
+	}
+	return 1;
+}
+
+int32 AGAGridActor::LayerCellToIndex(const FCellRef& CellRef) const
+{
+	const FGAColumnLayers* Column = ColumnLayers.Find(CellRef.Y * XCount + CellRef.X);
+	if ((Column == NULL) || (CellRef.Layer < 1) || (CellRef.Layer > Column->Count))
+	{
+		return INDEX_NONE;
+	}
+	return GetStorageCount() + Column->FirstIndex + (CellRef.Layer - 1);
+}
+
+int32 AGAGridActor::GetLayerAtHeight(int32 X, int32 Y, float LocalZ) const
+{
+	// Layers go from highest to lowest
+	int32 LayerCount = GetLayerCount(X, Y);
+	for (int32 Layer = 0; Layer < LayerCount - 1; Layer++)
+	{
+		if (HeightData[CellRefToIndex(FCellRef(X, Y, Layer))] <= LocalZ + LayerStepHeight)
+		{
+			return Layer;
+		}
+	}
+	return LayerCount - 1;
+}
+
+int32 AGAGridActor::GetConnectedLayer(int32 X, int32 Y, float FromLocalZ) const
+{
+	int32 Result = INDEX_NONE;
+	float BestDifference = LayerStepHeight;
+
+	int32 LayerCount = GetLayerCount(X, Y);
+	for (int32 Layer = 0; Layer < LayerCount; Layer++)
+	{
+		float Difference = FMath::Abs(HeightData[CellRefToIndex(FCellRef(X, Y, Layer))] - FromLocalZ);
+		if (Difference <= BestDifference)
+		{
+			BestDifference = Difference;
+			Result = Layer;
+		}
+	}
+
+	return Result;
+}
+
+void AGAGridActor::RefreshExtraLayerCells()
+{
+	ExtraLayerCells.SetNum(ExtraLayerCellCount);
+	for (const TPair<int32, FGAColumnLayers>& Pair : ColumnLayers)
+	{
+		for (int32 Layer = 1; Layer <= Pair.Value.Count; Layer++)
+		{
+			int32 ExtraIndex = Pair.Value.FirstIndex + (Layer - 1);
+			if (ExtraLayerCells.IsValidIndex(ExtraIndex))
+			{
+				ExtraLayerCells[ExtraIndex] = FIntPoint(Pair.Key, Layer);
+			}
+		}
+	}
+}
+
+void AGAGridActor::AddColumnLayers(int32 X, int32 Y, const TArray<TPair<float, uint8>>& Surfaces)
+{
+	// Only called while baking, so the end of the arrays is the end of the extra layers
+	int32 ExtraCount = Surfaces.Num() - 1;
+	if (ExtraCount <= 0)
+	{
+		return;
+	}
+
+	FGAColumnLayers& Column = ColumnLayers.Add(Y * XCount + X);
+	Column.FirstIndex = ExtraLayerCellCount;
+	Column.Count = ExtraCount;
+	ExtraLayerCellCount += ExtraCount;
+
+	EnumAddFlags(Data[Indexer.CellToIndex(X, Y)], ECellData::CellDataLayered);
+
+	for (int32 Layer = 1; Layer < Surfaces.Num(); Layer++)
+	{
+		ExtraLayerCells.Add(FIntPoint(Y * XCount + X, Layer));
+		Data.Add(ECellData::CellDataTraversable);
+		HeightData.Add(Surfaces[Layer].Key);
+		ClearanceData.Add(0.0f);
+		BaseCostData.Add(Surfaces[Layer].Value);
+		CostData.Add(Surfaces[Layer].Value);
+		BlockedData.Add(0);
+	}
+}
+
+// How far (in cells) RefreshLayeredClearance looks. Clearance in and around layered columns is capped at this.
+static const int32 LayeredClearanceRadius = 8;
+
+void AGAGridActor::RefreshLayeredClearance(const FGridBox& Box)
+{
+	if (!HasLayers() || !Box.IsValid())
+	{
+		return;
+	}
+
+	// Stacked surfaces are usually small (floors, bridges, walkways), so rather than a distance transform per layer,
+	// brute force a window around each cell that might be affected: every cell of a layered column, and layer 0 of
+	// every column near one. That keeps the cost proportional to the layered area.
+	const int32 Radius = LayeredClearanceRadius;
+	int32 BoxWidth = Box.GetWidth();
+	TBitArray<> Affected(false, Box.GetCellCount());
+	for (const TPair<int32, FGAColumnLayers>& Pair : ColumnLayers)
+	{
+		int32 CX = Pair.Key % XCount;
+		int32 CY = Pair.Key / XCount;
+		for (int32 Y = FMath::Max(CY - Radius, Box.MinY); Y <= FMath::Min(CY + Radius, Box.MaxY); Y++)
+		{
+			for (int32 X = FMath::Max(CX - Radius, Box.MinX); X <= FMath::Min(CX + Radius, Box.MaxX); X++)
+			{
+				Affected[(Y - Box.MinY) * BoxWidth + (X - Box.MinX)] = true;
+			}
+		}
+	}
+
+	// Squared distance (in cells) from Cell to the nearest cell it couldn't walk into. A cell counts as open if its
+	// column has a traversable surface within a step per cell of Cell's height -- the same rule GetNeighbors uses,
+	// without following the actual route.
+	auto NearestBlockedSquared = [this, Radius](const FCellRef& Cell)
+	{
+		float Height = HeightData[CellRefToIndex(Cell)];
+		int32 BestSquared = (Radius + 1) * (Radius + 1);
+
+		for (int32 DY = -Radius; DY <= Radius; DY++)
+		{
+			for (int32 DX = -Radius; DX <= Radius; DX++)
+			{
+				int32 SquaredDistance = DX * DX + DY * DY;
+				if ((SquaredDistance >= BestSquared) || (SquaredDistance == 0))
+				{
+					continue;
+				}
+
+				int32 X = Cell.X + DX;
+				int32 Y = Cell.Y + DY;
+				bool bOpen = false;
+				if (IsCellRefInBounds(FCellRef(X, Y)))
+				{
+					float Reach = LayerStepHeight * FMath::Max(FMath::Abs(DX), FMath::Abs(DY));
+					int32 LayerCount = GetLayerCount(X, Y);
+					for (int32 Layer = 0; (Layer < LayerCount) && !bOpen; Layer++)
+					{
+						int32 Index = CellRefToIndex(FCellRef(X, Y, Layer));
+						bOpen = EnumHasAllFlags(Data[Index], ECellData::CellDataTraversable) && (FMath::Abs(HeightData[Index] - Height) <= Reach);
+					}
+				}
+
+				if (!bOpen)
+				{
+					BestSquared = SquaredDistance;
+				}
+			}
+		}
+
+		return BestSquared;
+	};
+
+	float Cap = (MaxClearance > 0.0f) ? MaxClearance : UE_MAX_FLT;
+	for (int32 Y = Box.MinY; Y <= Box.MaxY; Y++)
+	{
+		for (int32 X = Box.MinX; X <= Box.MaxX; X++)
+		{
+			if (!Affected[(Y - Box.MinY) * BoxWidth + (X - Box.MinX)])
+			{
+				continue;
+			}
+
+			int32 LayerCount = GetLayerCount(X, Y);
+			for (int32 Layer = 0; Layer < LayerCount; Layer++)
+			{
+				FCellRef CellRef(X, Y, Layer);
+				int32 Index = CellRefToIndex(CellRef);
+				if (!EnumHasAllFlags(Data[Index], ECellData::CellDataTraversable))
+				{
+					ClearanceData[Index] = 0.0f;
+					continue;
+				}
+
+				float Clearance = FMath::Min(FMath::Max(FMath::Sqrt(float(NearestBlockedSquared(CellRef))) - 0.5f, 0.0f) * CellScale, Cap);
+
+				// Layer 0 already has the distance transform's answer, which is right as long as nothing nearby is
+				// out of reach
+				ClearanceData[Index] = (Layer == 0) ? FMath::Min(ClearanceData[Index], Clearance) : Clearance;
+			}
+		}
+	}
+}
+
+
+// Dynamic obstacles --------------------------------
+
+// Smallest box containing both (either of which can be invalid)
+static FGridBox UnionBoxes(const FGridBox& A, const FGridBox& B)
+{
+	if (!A.IsValid())
+	{
+		return B;
+	}
+	else if (!B.IsValid())
+	{
+		return A;
+	}
+	return FGridBox(FMath::Min(A.MinX, B.MinX), FMath::Max(A.MaxX, B.MaxX), FMath::Min(A.MinY, B.MinY), FMath::Max(A.MaxY, B.MaxY));
+}
+
+int32 AGAGridActor::AddBoxObstacle(const FVector& Center, const FVector2D& HalfSize, float YawDegrees)
+{
+	// Just a 4-sided polygon
+	FVector AxisX = FRotator(0.0f, YawDegrees, 0.0f).RotateVector(FVector(HalfSize.X, 0.0f, 0.0f));
+	FVector AxisY = FRotator(0.0f, YawDegrees, 0.0f).RotateVector(FVector(0.0f, HalfSize.Y, 0.0f));
+
+	TArray<FVector> Points = {
+		Center - AxisX - AxisY,
+		Center + AxisX - AxisY,
+		Center + AxisX + AxisY,
+		Center - AxisX + AxisY
+	};
+	return AddPolygonObstacle(Points);
+}
+
+int32 AGAGridActor::AddCircleObstacle(const FVector& Center, float Radius)
+{
+	FVector2D GridCenter;
+	TransformPointToNormalizedGridSpace(Center, GridCenter);
+	float LocalZ = WorldToLocalHeight(Center);
+	float GridRadius = Radius / CellScale;
+	float GridRadiusSquared = GridRadius * GridRadius;
+
+	FObstacle Obstacle;
+	FGridBox Box(
+		FMath::FloorToInt32(GridCenter.X - GridRadius), FMath::FloorToInt32(GridCenter.X + GridRadius),
+		FMath::FloorToInt32(GridCenter.Y - GridRadius), FMath::FloorToInt32(GridCenter.Y + GridRadius));
+
+	if (ClipGridBox(Box, Obstacle.Bounds))
+	{
+		for (int32 Y = Obstacle.Bounds.MinY; Y <= Obstacle.Bounds.MaxY; Y++)
+		{
+			for (int32 X = Obstacle.Bounds.MinX; X <= Obstacle.Bounds.MaxX; X++)
+			{
+				// Test the cell center
+				if (FVector2D::DistSquared(FVector2D(X + 0.5f, Y + 0.5f), GridCenter) <= GridRadiusSquared)
+				{
+					Obstacle.CellIndices.Add(CellRefToIndex(FCellRef(X, Y, GetLayerAtHeight(X, Y, LocalZ))));
+				}
+			}
+		}
+	}
+
+	return AddObstacle(MoveTemp(Obstacle));
+}
+
+int32 AGAGridActor::AddPolygonObstacle(const TArray<FVector>& Points)
+{
+	if (Points.Num() < 3)
+	{
+		return INDEX_NONE;
+	}
+
+	TArray<FVector2D> GridPoints;
+	GridPoints.SetNumUninitialized(Points.Num());
+	float LocalZ = 0.0f;
+	for (int32 Index = 0; Index < Points.Num(); Index++)
+	{
+		TransformPointToNormalizedGridSpace(Points[Index], GridPoints[Index]);
+		LocalZ += WorldToLocalHeight(Points[Index]) / Points.Num();
+	}
+
+	FObstacle Obstacle;
+	RasterizePolygon(GridPoints, LocalZ, Obstacle.CellIndices, Obstacle.Bounds);
+	return AddObstacle(MoveTemp(Obstacle));
+}
+
+void AGAGridActor::RasterizePolygon(const TArray<FVector2D>& GridPoints, float LocalZ, TArray<int32>& CellIndicesOut, FGridBox& BoundsOut) const
+{
+	FBox2D PolyBounds(GridPoints);
+	FGridBox Box(
+		FMath::FloorToInt32(PolyBounds.Min.X), FMath::FloorToInt32(PolyBounds.Max.X),
+		FMath::FloorToInt32(PolyBounds.Min.Y), FMath::FloorToInt32(PolyBounds.Max.Y));
+
+	if (!ClipGridBox(Box, BoundsOut))
+	{
+		return;
+	}
+
+	// Scanline: for each row of cell centers, find where the polygon's edges cross it, and fill between pairs of
+	// crossings (even-odd rule)
+	TArray<float, TInlineAllocator<16>> Crossings;
+	int32 PointCount = GridPoints.Num();
+
+	for (int32 Y = BoundsOut.MinY; Y <= BoundsOut.MaxY; Y++)
+	{
+		float CenterY = Y + 0.5f;
+
+		Crossings.Reset();
+		for (int32 Index = 0; Index < PointCount; Index++)
+		{
+			const FVector2D& P0 = GridPoints[Index];
+			const FVector2D& P1 = GridPoints[(Index + 1) % PointCount];
+
+			// Half-open, so a vertex exactly on the scanline is only counted once
+			if ((P0.Y <= CenterY) != (P1.Y <= CenterY))
+			{
+				float T = (CenterY - P0.Y) / (P1.Y - P0.Y);
+				Crossings.Add(P0.X + T * (P1.X - P0.X));
+			}
+		}
+		Crossings.Sort();
+
+		for (int32 Index = 0; Index + 1 < Crossings.Num(); Index += 2)
+		{
+			// Cells whose centers lie in [Crossings[Index], Crossings[Index + 1]]
+			int32 MinX = FMath::Max(FMath::CeilToInt32(Crossings[Index] - 0.5f), BoundsOut.MinX);
+			int32 MaxX = FMath::Min(FMath::FloorToInt32(Crossings[Index + 1] - 0.5f), BoundsOut.MaxX);
+			for (int32 X = MinX; X <= MaxX; X++)
+			{
+				CellIndicesOut.Add(CellRefToIndex(FCellRef(X, Y, GetLayerAtHeight(X, Y, LocalZ))));
+			}
+		}
+	}
+}
+
+int32 AGAGridActor::AddObstacle(FObstacle&& Obstacle)
+{
+	if ((Obstacle.CellIndices.Num() == 0) || (BlockedData.Num() != GetTotalStorageCount()))
+	{
+		return INDEX_NONE;
+	}
+
+	for (int32 CellIndex : Obstacle.CellIndices)
+	{
+		uint16& Count = BlockedData[CellIndex];
+		if (Count == 0)
+		{
+			ECellData& CellData = Data[CellIndex];
+			if (EnumHasAnyFlags(CellData, ECellData::CellDataTraversable))
+			{
+				EnumRemoveFlags(CellData, ECellData::CellDataTraversable);
+				EnumAddFlags(CellData, ECellData::CellDataBlocked);
+			}
+		}
+		Count = (Count < MAX_uint16) ? Count + 1 : Count;
+	}
+
+	int32 ObstacleId = NextObstacleId++;
+	FGridBox Bounds = Obstacle.Bounds;
+	Obstacles.Add(ObstacleId, MoveTemp(Obstacle));
+
+	// Clearance can change outside the obstacle (up to MaxClearance away), so that counts as a change too
+	NotifyCellsChanged(UnionBoxes(Bounds, UpdateClearance(GetClearanceBox(Bounds))));
+
+	return ObstacleId;
+}
+
+bool AGAGridActor::RemoveObstacle(int32 ObstacleId)
+{
+	FObstacle Obstacle;
+	if (!Obstacles.RemoveAndCopyValue(ObstacleId, Obstacle))
+	{
+		return false;
+	}
+
+	if (!IsDataResident())
+	{
+		// Nothing to unstamp. It just won't get re-applied when the data comes back.
+		return true;
+	}
+
+	for (int32 CellIndex : Obstacle.CellIndices)
+	{
+		uint16& Count = BlockedData[CellIndex];
+		if (Count > 0)
+		{
+			Count--;
+			if (Count == 0)
+			{
+				ECellData& CellData = Data[CellIndex];
+				if (EnumHasAnyFlags(CellData, ECellData::CellDataBlocked))
+				{
+					EnumRemoveFlags(CellData, ECellData::CellDataBlocked);
+					EnumAddFlags(CellData, ECellData::CellDataTraversable);
+				}
+			}
+		}
+	}
+
+	NotifyCellsChanged(UnionBoxes(Obstacle.Bounds, UpdateClearance(GetClearanceBox(Obstacle.Bounds))));
+
+	return true;
+}
+
+
+// Streaming --------------------------------
+
+// Bump this if SerializeBakedData changes
+static const int32 GridStreamingCacheVersion = 3;
+
+template<typename T>
+static void SerializeRawArray(FArchive& Ar, TArray<T>& Array)
+{
+	int32 Num = Array.Num();
+	Ar << Num;
+	if (Ar.IsLoading())
 	{
-		HitLocationOut = Start;
-		return true;
+		Array.SetNumUninitialized(Num);
 	}
+	Ar.Serialize(Array.GetData(), Num * sizeof(T));
+}
+
+void AGAGridActor::SerializeBakedData(FArchive& Ar)
+{
+	SerializeRawArray(Ar, Data);
+	SerializeRawArray(Ar, HeightData);
+	SerializeRawArray(Ar, ObstacleHeightData);
+	SerializeRawArray(Ar, ClearanceData);
+	SerializeRawArray(Ar, BaseCostData);
 }
 
+FString AGAGridActor::GetStreamingCachePath() const
+{
+	FString MapName = GetWorld() ? GetWorld()->GetMapName() : FString(TEXT("NoWorld"));
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("GridStreaming"), FString::Printf(TEXT("%s_%s.grid"), *MapName, *GetName()));
+}
 
+bool AGAGridActor::WriteStreamingCache()
+{
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
 
+	int32 Version = GridStreamingCacheVersion;
+	uint8 Layout = uint8(MemoryLayout);
+	uint8 bClearanceHasObstacles = (Obstacles.Num() > 0) ? 1 : 0;
+	Writer << Version << XCount << YCount << Layout << ExtraLayerCellCount << bClearanceHasObstacles;
 
-// Data from NavSystem --------------------------------
+	// Write out the baked traversability, not what the obstacles have done to it (they get re-applied on load)
+	TArray<ECellData> LiveData = Data;
+	for (ECellData& CellData : Data)
+	{
+		if (EnumHasAnyFlags(CellData, ECellData::CellDataBlocked))
+		{
+			EnumRemoveFlags(CellData, ECellData::CellDataBlocked);
+			EnumAddFlags(CellData, ECellData::CellDataTraversable);
+		}
+	}
+	SerializeBakedData(Writer);
+	Data = MoveTemp(LiveData);
 
-bool AGAGridActor::RefreshDataFromNav()
+	// Traversability is mostly long runs of the same thing, so this compresses very well
+	int32 UncompressedSize = Bytes.Num();
+	int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, UncompressedSize);
+	TArray<uint8> CompressedBytes;
+	CompressedBytes.SetNumUninitialized(sizeof(int32) + CompressedSize);
+	FMemory::Memcpy(CompressedBytes.GetData(), &UncompressedSize, sizeof(int32));
+
+	if (!FCompression::CompressMemory(NAME_Zlib, CompressedBytes.GetData() + sizeof(int32), CompressedSize, Bytes.GetData(), UncompressedSize))
+	{
+		return false;
+	}
+	CompressedBytes.SetNum(sizeof(int32) + CompressedSize);
+
+	bStreamingCacheValid = false;
+	FString Path = GetStreamingCachePath();
+	if (!FFileHelper::SaveArrayToFile(CompressedBytes, *Path))
+	{
+		return false;
+	}
+
+	// Don't throw the data away on the strength of a file we can't get it back from
+	TArray<uint8> ReadBack;
+	TArray<uint8> ReadBackBytes;
+	ReadBackBytes.SetNumUninitialized(UncompressedSize);
+	if (!FFileHelper::LoadFileToArray(ReadBack, *Path) || (ReadBack != CompressedBytes) ||
+		!FCompression::UncompressMemory(NAME_Zlib, ReadBackBytes.GetData(), UncompressedSize, ReadBack.GetData() + sizeof(int32), ReadBack.Num() - int32(sizeof(int32))) ||
+		(ReadBackBytes != Bytes))
+	{
+		return false;
+	}
+
+	StreamingCacheFileSize = CompressedBytes.Num();
+	bStreamingCacheValid = true;
+	return true;
+}
+
+bool AGAGridActor::UnloadData()
 {
-	bool Result = false;
-	UNavigationSystemV1 *NavSystem = UNavigationSystemV1::GetNavigationSystem(this);
-	if (NavSystem)
+	if (Residency == EGAGridResidency::Loading)
 	{
-		INavigationDataInterface* NavData = NavSystem->GetMainNavData();		// Note: only using the default nav data here
-		const ARecastNavMesh* NavMesh = Cast<ARecastNavMesh>(NavData);
-		FTransform ActorTransform = GetActorTransform();
+		// Cancel the load
+		Residency = EGAGridResidency::Unloaded;
+		LoadRequestId++;
+		return true;
+	}
+	else if ((Residency == EGAGridResidency::Unloaded) || (Residency == EGAGridResidency::Failed))
+	{
+		return true;
+	}
 
-		// Allocate the array and set to 0
-		ResetData();
+	// Someone may have cleaned out Saved/ since we wrote it
+	if (bStreamingCacheValid && (IFileManager::Get().FileSize(*GetStreamingCachePath()) != StreamingCacheFileSize))
+	{
+		bStreamingCacheValid = false;
+	}
 
-		ECellData* CellData = GetData();
-		FVector HalfExtents3D(HalfExtents.X, HalfExtents.Y, 0.0f);
+	if (!bStreamingCacheValid && !WriteStreamingCache())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s: couldn't write the grid streaming cache, keeping the data resident"), *GetName());
+		return false;
+	}
 
-		// Code for extracting nav polys taken from here:
-		// https://nerivec.github.io/old-ue4-wiki/pages/ai-navigation-in-c-customize-path-following-every-tick.html
+	Data.Empty();
+	HeightData.Empty();
+	ObstacleHeightData.Empty();
+	ClearanceData.Empty();
+	BaseCostData.Empty();
+	CostData.Empty();
+	BlockedData.Empty();
+	CellCenterX.Empty();
+	CellCenterY.Empty();
+	CellCenterZ.Empty();
 
-		TArray<FNavTileRef> NavTiles;
-		NavMesh->GetAllNavMeshTiles(NavTiles);
-		for (FNavTileRef &TileRef : NavTiles)
-		{
-			const FBox TileBounds = NavMesh->GetNavMeshTileBounds(TileRef);
-			if (TileBounds.IsValid)			// reportedly will crash if this is not checked
-			{
-				TArray<FNavPoly> Polys;
+	Residency = EGAGridResidency::Unloaded;
 
-				if (NavMesh->GetPolysInTile(TileRef, Polys))
-				{
-					for (FNavPoly& NavPoly : Polys)
-					{
-						TArray<FVector> PolyVerts;
-						TArray<FVector> PolyVertsLocal;
-						NavNodeRef Ref = NavPoly.Ref;
+	// Anything relying on this grid needs to let go of it
+	NotifyCellsChanged(FGridBox(0, XCount - 1, 0, YCount - 1));
 
-						// We're converting polys to triangles
-						PolyVertsLocal.SetNum(3);
+	UGAGridSystem* GridSystem = UGAGridSystem::GetGridSystem(this);
+	if (GridSystem)
+	{
+		GridSystem->RefreshGrids();
+	}
 
-						NavMesh->GetPolyVerts(Ref, PolyVerts);
+	return true;
+}
 
-						// Warning: contrary to what a healthy, well-adjusted individual might expect, nav polys are not planar.
+bool AGAGridActor::RequestLoadData()
+{
+	if (Residency != EGAGridResidency::Unloaded)
+	{
+		return false;
+	}
 
-						// We can't do any of the above if we don't have at least 2 verts in the poly
-						// (it wouldn't even be a poly at that point)
-						if (PolyVerts.Num() <= 2)
-						{
-							continue;
-						}
+	Residency = EGAGridResidency::Loading;
+	int32 RequestId = ++LoadRequestId;
 
-						for (int32 TriangleIndex= 0; TriangleIndex <= PolyVerts.Num() - 3; TriangleIndex++)
-						{
-							PolyVertsLocal[0] = PolyVerts[0];
-							PolyVertsLocal[1] = PolyVerts[1 + TriangleIndex];
-							PolyVertsLocal[2] = PolyVerts[2 + TriangleIndex];
+	// Read (and decompress) on a worker thread, then hand the result back to the game thread
+	TWeakObjectPtr<AGAGridActor> WeakThis(this);
+	FString Path = GetStreamingCachePath();
 
-							// transform verts to local space
-							for (int32 VertexIndex = 0; VertexIndex < PolyVertsLocal.Num(); VertexIndex++)
-							{
-								PolyVertsLocal[VertexIndex] = ActorTransform.InverseTransformPosition(PolyVertsLocal[VertexIndex]) + HalfExtents3D;
-							}
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Path, RequestId]()
+	{
+		TSharedRef<TArray<uint8>> Bytes = MakeShared<TArray<uint8>>();
+		FFileHelper::LoadFileToArray(*Bytes, *Path);
 
-							{
-								FBox2D PolyBounds(EForceInit::ForceInit);
-								for (const FVector& Vert : PolyVertsLocal)
-								{
-									PolyBounds += FVector2D(Vert);
-								}
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Bytes, RequestId]()
+		{
+			AGAGridActor* Grid = WeakThis.Get();
+			if (Grid)
+			{
+				Grid->FinishLoadData(*Bytes, RequestId);
+			}
+		});
+	});
 
-								FIntRect GridBox;
-								if (GridSpaceBoundsToRect2D(PolyBounds, GridBox))
-								{
-									FVector PlaneNormal;
-									FVector2D PlaneNormal2D;
-									float PlaneD;
+	return true;
+}
 
-									TArray<FVector2D> OutsideVectors;
-									OutsideVectors.SetNum(PolyVertsLocal.Num());
+void AGAGridActor::FinishLoadData(const TArray<uint8>& CompressedBytes, int32 RequestId)
+{
+	if ((RequestId != LoadRequestId) || (Residency != EGAGridResidency::Loading))
+	{
+		// Cancelled, or superseded
+		return;
+	}
 
-									// calculate the plane of the poly (this is all in local grid space)
-									// Remember a plane is defined by the equation N.x - d = 0
-									// where N is the normal and d is a constant (distance from the origin)
+	bool bValid = false;
+	uint8 bClearanceHasObstacles = 0;
+	if (CompressedBytes.Num() > int32(sizeof(int32)))
+	{
+		int32 UncompressedSize;
+		FMemory::Memcpy(&UncompressedSize, CompressedBytes.GetData(), sizeof(int32));
 
-									{
-										FVector V0, V1;
+		TArray<uint8> Bytes;
+		Bytes.SetNumUninitialized(UncompressedSize);
+		if (FCompression::UncompressMemory(NAME_Zlib, Bytes.GetData(), UncompressedSize, CompressedBytes.GetData() + sizeof(int32), CompressedBytes.Num() - int32(sizeof(int32))))
+		{
+			FMemoryReader Reader(Bytes);
 
-										V0 = PolyVertsLocal[1] - PolyVertsLocal[0];
-										V1 = PolyVertsLocal[2] - PolyVertsLocal[0];
+			int32 Version, CachedXCount, CachedYCount, CachedExtraLayerCellCount;
+			uint8 Layout;
+			Reader << Version << CachedXCount << CachedYCount << Layout << CachedExtraLayerCellCount << bClearanceHasObstacles;
 
-										PlaneNormal = V1 ^ V0;				// cross product
-										PlaneNormal.Normalize();
+			// Note, ColumnLayers stays resident, so the extra layers have to line up with it
+			if ((Version == GridStreamingCacheVersion) && (CachedXCount == XCount) && (CachedYCount == YCount) &&
+				(Layout == uint8(MemoryLayout)) && (CachedExtraLayerCellCount == ExtraLayerCellCount))
+			{
+				SerializeBakedData(Reader);
+				bValid = !Reader.IsError() && (Data.Num() == GetTotalStorageCount());
+			}
+		}
+	}
 
-										PlaneD = PlaneNormal | PolyVertsLocal[0];			// dot product. Note, we know the poly verts are on the plane in question
-										PlaneNormal2D = FVector2D(PlaneNormal);
-									}
+	if (!bValid)
+	{
+		// Note, not back to Unloaded, or the streaming would just ask again every frame. The data's gone now; only
+		// rebuilding the grid brings it back.
+		UE_LOG(LogTemp, Error, TEXT("%s: grid streaming cache is missing or out of date, the grid's data is lost until it's rebuilt"), *GetName());
+		Residency = EGAGridResidency::Failed;
+		bStreamingCacheValid = false;
+		return;
+	}
 
-									// This should never happen -- it would suggest a poly that is vertical wall, instead of 
-									// a mostly-level floor. Still, we're going to divide by this below, so to be safe...
-									if (PlaneNormal.Z == 0.0f)
-									{
-										continue;
-									}
+	Residency = EGAGridResidency::Resident;
 
-									// Cache off a set of "outside vectors", so that we can test each cell in the box against the
-									// bounds of the polygons
+	// Rebuild the runtime-only state
+	CostData = BaseCostData;
+	RefreshCostBounds();
+	RefreshCellCenters();
 
-									for (int32 V0Index = 0; V0Index < PolyVertsLocal.Num(); V0Index++)
-									{
-										int32 V1Index = (V0Index + 1) % PolyVertsLocal.Num();
-										FVector2D V0V1 = FVector2D(PolyVertsLocal[V1Index] - PolyVertsLocal[V0Index]);
+	BlockedData.SetNumZeroed(GetTotalStorageCount());
+	for (const TPair<int32, FObstacle>& Pair : Obstacles)
+	{
+		for (int32 CellIndex : Pair.Value.CellIndices)
+		{
+			uint16& Count = BlockedData[CellIndex];
+			if ((Count == 0) && EnumHasAnyFlags(Data[CellIndex], ECellData::CellDataTraversable))
+			{
+				EnumRemoveFlags(Data[CellIndex], ECellData::CellDataTraversable);
+				EnumAddFlags(Data[CellIndex], ECellData::CellDataBlocked);
+			}
+			Count = (Count < MAX_uint16) ? Count + 1 : Count;
+		}
+	}
+	// The cached clearance was baked with whatever obstacles were around at the time
+	if ((Obstacles.Num() > 0) || bClearanceHasObstacles)
+	{
+		RefreshClearance();
+	}
 
-										// Rotate 90 degrees
-										FVector2D& OutsideVector = OutsideVectors[V0Index];
-										OutsideVector.X = -V0V1.Y;
-										OutsideVector.Y = V0V1.X;
-									}
+	NotifyCellsChanged(FGridBox(0, XCount - 1, 0, YCount - 1));
 
-									// Grid box now represents the intersection between Grid and the poly in question.
-									// Check each cell in the box to see if it's inside the poly
+	UGAGridSystem* GridSystem = UGAGridSystem::GetGridSystem(this);
+	if (GridSystem)
+	{
+		GridSystem->RefreshGrids();
+	}
+}
 
-									// Note, this is way inefficient
-									// A smarter way would be to use some kind of rasterization approach
+int64 AGAGridActor::GetResidentDataSize() const
+{
+	return Data.GetAllocatedSize() + HeightData.GetAllocatedSize() + ObstacleHeightData.GetAllocatedSize() + ClearanceData.GetAllocatedSize()
+		+ BaseCostData.GetAllocatedSize() + CostData.GetAllocatedSize() + BlockedData.GetAllocatedSize()
+		+ CellCenterX.GetAllocatedSize() + CellCenterY.GetAllocatedSize() + CellCenterZ.GetAllocatedSize();
+}
 
-									for (int Y = GridBox.Min.Y; Y <= GridBox.Max.Y; Y++)
-									{
-										for (int X = GridBox.Min.X; X <= GridBox.Max.X; X++)
-										{
-											FCellRef CellRef(X, Y);
-											FVector2D CellCenter = GetCellGridSpacePosition(CellRef);
-											bool IsOutside = false;
 
-											for (int32 VIndex = 0; (VIndex < PolyVertsLocal.Num()) && !IsOutside; VIndex++)
-											{
-												FVector2D V = FVector2D(PolyVertsLocal[VIndex]);
-												const FVector2D& OutsideVector = OutsideVectors[VIndex];
-												FVector2D V2Cell = CellCenter - V;
+// Change notifications --------------------------------
 
-												if ((V2Cell | OutsideVector) > 0.0f)		// Dot product
-												{
-													// the cell is outside this edge
-													IsOutside = true;
-												}
-											}
+void AGAGridActor::NotifyCellsChanged(const FGridBox& Box)
+{
+	FGridBox Clipped;
+	if (!ClipGridBox(Box, Clipped))
+	{
+		return;
+	}
 
-											if (!IsOutside)
-											{
-												// turn on the traversable bit
-												int32 CellIndex = CellRefToIndex(CellRef);
-												bool bFirst = false;
+	GridVersion++;
 
-												if (!EnumHasAnyFlags(CellData[CellIndex], ECellData::CellDataTraversable))
-												{
-													EnumAddFlags(CellData[CellIndex], ECellData::CellDataTraversable);
-													bFirst = true;
-												}
+	TArray<int32, TInlineAllocator<16>> DirtyRegions;
+	for (int32 RY = Clipped.MinY >> RegionShift; RY <= (Clipped.MaxY >> RegionShift); RY++)
+	{
+		for (int32 RX = Clipped.MinX >> RegionShift; RX <= (Clipped.MaxX >> RegionShift); RX++)
+		{
+			int32 RegionIndex = RY * RegionsX + RX;
+			RegionVersions[RegionIndex]++;
+			DirtyRegions.Add(RegionIndex);
+		}
+	}
 
-												// Compute the height based on the local poly verts
-												// Find the vertical projection of the CellCenter to the plane
-												float H = (PlaneD - (CellCenter | PlaneNormal2D)) / PlaneNormal.Z;
+	ChangeDispatcher.Dispatch(DirtyRegions, Clipped);
+	OnGridChanged.Broadcast(this, Clipped);
+}
 
-												// See if it's higher than what's already there
-												if (bFirst || (H > HeightData[CellIndex]))
-												{
-													HeightData[CellIndex] = H;
-												}
+FGridBox AGAGridActor::GetRegionBox(int32 RegionIndex) const
+{
+	int32 RX = RegionIndex % RegionsX;
+	int32 RY = RegionIndex / RegionsX;
+	return FGridBox(
+		RX << RegionShift, FMath::Min(((RX + 1) << RegionShift) - 1, XCount - 1),
+		RY << RegionShift, FMath::Min(((RY + 1) << RegionShift) - 1, YCount - 1));
+}
 
-											}
-										}
-									}
-								}
-							}
-						}
-					}
-				}
-			}
+void AGAGridActor::GetRegionsInBox(const FGridBox& Box, TArray<int32>& RegionIndicesOut) const
+{
+	FGridBox Clipped;
+	if (!ClipGridBox(Box, Clipped))
+	{
+		return;
+	}
+
+	for (int32 RY = Clipped.MinY >> RegionShift; RY <= (Clipped.MaxY >> RegionShift); RY++)
+	{
+		for (int32 RX = Clipped.MinX >> RegionShift; RX <= (Clipped.MaxX >> RegionShift); RX++)
+		{
+			RegionIndicesOut.Add(RY * RegionsX + RX);
 		}
 	}
+}
+
+
+// Snapshots --------------------------------
+
+TSharedRef<const FGAGridSnapshot, ESPMode::ThreadSafe> AGAGridActor::GetSnapshot() const
+{
+	// Every change bumps GridVersion, but the transform and residency can change without one
+	if (LatestSnapshot.IsValid() && (LatestSnapshot->GridVersion == GridVersion) &&
+		(LatestSnapshot->HasData() == IsDataResident()) && LatestSnapshot->GridTransform.Equals(CachedGridTransform, 0.0f))
+	{
+		return LatestSnapshot.ToSharedRef();
+	}
 
+	TSharedRef<const FGAGridSnapshot, ESPMode::ThreadSafe> Result = FGAGridSnapshot::Create(*this, LatestSnapshot.Get());
+	LatestSnapshot = Result;
 	return Result;
 }
 
@@ -825,4 +2481,29 @@ bool AGAGridActor::RefreshDebugTexture()
 	return Result;
 }
 
+void AGAGridActor::BenchmarkMemoryLayouts()
+{
+#if WITH_EDITORONLY_DATA
+	auto SwitchLayout = [this](EGAGridMemoryLayout Layout)
+	{
+		FGAGridIndexer OldIndexer = Indexer;
+		MemoryLayout = Layout;
+		RefreshDerivedValues();
+		if (OldIndexer.Layout != Indexer.Layout)
+		{
+			RelayoutData(OldIndexer);
+			RefreshCellCenters();
+		}
+	};
+
+	EGAGridMemoryLayout OriginalLayout = MemoryLayout;
+	for (EGAGridMemoryLayout Layout : { EGAGridMemoryLayout::RowMajor, EGAGridMemoryLayout::Tiled })
+	{
+		SwitchLayout(Layout);
+		GAGridLayoutBenchmark::Run(this);
+	}
+	SwitchLayout(OriginalLayout);
+#endif
+}
+
 UE_ENABLE_OPTIMIZATION
@@ -3,29 +3,55 @@
 #include "CoreMinimal.h"
 #include "Math/MathFwd.h"
 #include "GAGridMap.h"
+#include "GAGridLayout.h"
+#include "GAGridChangeDispatcher.h"
 #include "GAGridActor.generated.h"
 
 class UBoxComponent;
 class USceneComponent;
 class UProceduralMeshComponent;
 class UTexture2D;
+class AGAGridActor;
+class FGAGridSnapshot;
+
+// Broadcast whenever the traversability or costs of a set of cells change at runtime.
+// The box is in cell coordinates, and covers (at least) every cell that changed.
+DECLARE_MULTICAST_DELEGATE_TwoParams(FGAGridChangedEvent, AGAGridActor* /*Grid*/, const FGridBox& /*DirtyBox*/);
 
 UENUM(BlueprintType, meta = (Bitflags, UseEnumValuesAsMaskValuesInEditor = "true"))
 enum class ECellData : uint8
 {
 	CellDataNone = 0,
-	CellDataTraversable = 1 << 0
+	CellDataTraversable = 1 << 0,
+
+	// Traversable according to the nav mesh, but currently covered by a runtime obstacle (see AddBoxObstacle etc.)
+	// While this is set, CellDataTraversable is cleared, so code that only looks at CellDataTraversable does the right thing.
+	CellDataBlocked = 1 << 1,
+
+	// This column has more than one layer (see Layers in AGAGridActor). Only ever set on layer 0.
+	CellDataLayered = 1 << 2
 };
 ENUM_CLASS_FLAGS(ECellData);
 
 
+// Whether a grid's per-cell data is in memory (see AGAGridActor::UnloadData)
+UENUM(BlueprintType)
+enum class EGAGridResidency : uint8
+{
+	Resident,
+	Unloaded,
+	Loading,
+	Failed		// unloaded, and the cache couldn't be read back. Stays that way until the grid is rebuilt (RefreshDataFromNav).
+};
+
+
 USTRUCT(BlueprintType)
 struct FCellRef
 {
 	GENERATED_BODY()
 
-	FCellRef() : X(INDEX_NONE), Y(INDEX_NONE) {}
-	FCellRef(int32 Xin, int32 Yin) : X(Xin), Y(Yin) {}
+	FCellRef() : X(INDEX_NONE), Y(INDEX_NONE), Layer(0) {}
+	FCellRef(int32 Xin, int32 Yin, int32 LayerIn = 0) : X(Xin), Y(Yin), Layer(LayerIn) {}
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	int32 X;
@@ -33,6 +59,10 @@ struct FCellRef
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	int32 Y;
 
+	// Which surface of the column, on multi-layer grids. 0 is the top one (and the only one, almost everywhere).
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 Layer;
+
 	// Note: can't add specifiers, or call from blueprint, because UStructs
 	// don't get UFunctions in Unreal
 	FORCEINLINE bool IsValid() const
@@ -40,7 +70,7 @@ struct FCellRef
 		return (X >= 0) && (Y >= 0);
 	}
 
-	// Returns a "cell space" distance between cells
+	// Returns a "cell space" distance between cells (ignoring layers)
 	float Distance(const FCellRef& OtherCell) const
 	{
 		int32 DX = (X - OtherCell.X);
@@ -51,7 +81,7 @@ struct FCellRef
 	// Tests equality between two cells. Needed to use FCellRef in a TMap
 	bool operator==(const FCellRef& CellRef) const
 	{
-		return (X == CellRef.X) && (Y == CellRef.Y);
+		return (X == CellRef.X) && (Y == CellRef.Y) && (Layer == CellRef.Layer);
 	}
 
 	// Hash value. Needed to use FCellRef in a TMap
@@ -64,6 +94,64 @@ struct FCellRef
 };
 
 
+// The compact form of a cell used inside searches: its index in its grid's per-cell arrays (see
+// AGAGridActor::CellRefToIndex) plus the id of the grid (AGAGridActor::GetGridId). Converting to and from an FCellRef
+// is O(1) (see AGAGridActor::CellRefToHandle and HandleToCellRef), but most of the time there's no need to -- a handle
+// indexes the per-cell arrays directly, and hashes and compares as two integers.
+// Not a USTRUCT: FCellRef is still what blueprints (and anything saved) see.
+struct FGACellHandle
+{
+	FGACellHandle() : Index(MAX_uint32), GridId(0) {}
+	FGACellHandle(uint32 IndexIn, uint32 GridIdIn) : Index(IndexIn), GridId(GridIdIn) {}
+
+	uint32 Index;
+	uint32 GridId;
+
+	FORCEINLINE bool IsValid() const { return Index != MAX_uint32; }
+
+	FORCEINLINE bool operator==(const FGACellHandle& Other) const
+	{
+		return (Index == Other.Index) && (GridId == Other.GridId);
+	}
+
+	FORCEINLINE bool operator!=(const FGACellHandle& Other) const
+	{
+		return !(*this == Other);
+	}
+
+	friend FORCEINLINE uint32 GetTypeHash(const FGACellHandle& Handle)
+	{
+		return HashCombineFast(Handle.Index, Handle.GridId);
+	}
+};
+
+// One step from a cell to one of its neighbors (see AGAGridActor::GetPassableNeighbors)
+struct FGACellStep
+{
+	FGACellHandle Cell;
+	FCellRef CellRef;
+
+	// In cells: 1 for a straight step, sqrt(2) for a diagonal one
+	float Length;
+};
+
+
+// Where the extra layers of one column are stored (see Layers in AGAGridActor)
+USTRUCT()
+struct FGAColumnLayers
+{
+	GENERATED_BODY()
+
+	// Layer 1 of the column is at GetStorageCount() + FirstIndex in the per-cell arrays, layer 2 right after it, etc.
+	UPROPERTY()
+	int32 FirstIndex = 0;
+
+	// Number of layers besides layer 0
+	UPROPERTY()
+	int32 Count = 0;
+};
+
+
 UCLASS(BlueprintType, Blueprintable)
 class AGAGridActor : public AActor 
 {
@@ -96,6 +184,14 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	TObjectPtr<USceneComponent> SceneComponent;
 
+	// How Data, HeightData etc. are laid out in memory. Use CellRefToIndex to index them, never compute indices by hand.
+	// Changing this in the editor re-lays out the existing data.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	EGAGridMemoryLayout MemoryLayout;
+
+	// Calculated from MemoryLayout, XCount and YCount
+	FGAGridIndexer Indexer;
+
 	// Data
 	UPROPERTY(VisibleAnywhere, BlueprintReadWrite)
 	TArray<ECellData> Data;
@@ -104,7 +200,45 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadWrite)
 	TArray<float> HeightData;
 
+	// Clearance: for each traversable cell, the world-space distance from the cell center to the nearest
+	// edge of a non-traversable cell (or of the grid itself), up to MaxClearance. 0 for non-traversable cells.
+	// An agent of radius R can stand in any cell with clearance >= R. Baked along with Data by RefreshClearance.
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	TArray<float> ClearanceData;
+
+	// Clearance is capped at this, which should be at least the biggest agent radius. Keeping it small keeps
+	// obstacles cheap: adding or removing one only recomputes clearance within this distance of it. 0 means no cap,
+	// in which case every obstacle recomputes the whole grid's clearance.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, meta = (ClampMin = "0"))
+	float MaxClearance;
+
+	// Traversal cost, as a fixed-point multiplier on distance: CostUnit means "normal" (1.0x), 2 * CostUnit twice as
+	// expensive, and so on (range 1/16x to ~16x). BaseCostData is baked from the nav areas by RefreshDataFromNav.
+	// CostData is what the searches actually read: BaseCostData plus whatever has been stamped on top at runtime.
+	// Both are indexed with CellRefToIndex.
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	TArray<uint8> BaseCostData;
+
+	// For sight lines (see TraceHeightfield): the height of the top of whatever stands in each column, in the same
+	// space as HeightData. The floor for traversable cells, otherwise the top of whatever the collision is there (or
+	// -BIG_NUMBER if there's nothing). One per column -- extra layers don't get their own. Indexed with
+	// CellRefToIndex (layer 0). Baked by RefreshDataFromNav.
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	TArray<float> ObstacleHeightData;
+
+	UPROPERTY(Transient, BlueprintReadOnly)
+	TArray<uint8> CostData;
+
+	static constexpr uint8 CostUnit = 16;
+
+	// Number of runtime obstacles covering each cell (see Dynamic obstacles below). Indexed with CellRefToIndex.
+	// Note, not a UPROPERTY -- it's runtime only, and blueprint doesn't do uint16 anyway
+	TArray<uint16> BlockedData;
+
 	virtual void PostLoad() override;
+	virtual void PostRegisterAllComponents() override;
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 #if WITH_EDITORONLY_DATA
 	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
@@ -120,8 +254,23 @@ private:
 	float* GetHeightData() { return HeightData.GetData(); }
 	int32 GetCellCount() { return XCount*YCount; }
 
+	// Number of elements in the per-column part of each per-cell array (can be more than GetCellCount(), due to tile
+	// padding). The arrays are GetTotalStorageCount() long, with the extra layers after this.
+	int32 GetStorageCount() const { return Indexer.GetStorageCount(); }
+	int32 GetTotalStorageCount() const { return Indexer.GetStorageCount() + ExtraLayerCellCount; }
+
 	void RefreshDerivedValues();
 
+#if WITH_EDITORONLY_DATA
+	// Move the per-cell arrays (and the obstacles' cell indices) from OldIndexer's layout to Indexer's
+	void RelayoutData(const FGAGridIndexer& OldIndexer);
+#endif
+
+	// Clip Box to the grid. Returns false if they don't overlap.
+	bool ClipGridBox(const FGridBox& Box, FGridBox& ClippedOut) const;
+
+	void OnRootTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
 public:
 	bool ResetData();
 
@@ -137,9 +286,23 @@ public:
 	UFUNCTION(BlueprintCallable)
 	FVector GetCellPosition(const FCellRef& CellRef) const;
 
+	// Batched versions of GetCellRef and GetCellPosition. Much cheaper than calling those in a loop.
+	UFUNCTION(BlueprintCallable)
+	void GetCellRefs(const TArray<FVector>& Points, TArray<FCellRef>& CellRefsOut, bool bClamp = false) const;
+
+	UFUNCTION(BlueprintCallable)
+	void GetCellPositions(const TArray<FCellRef>& CellRefs, TArray<FVector>& PositionsOut) const;
+
 	UFUNCTION(BlueprintCallable)
 	bool IsCellRefInBounds(const FCellRef& CellRef) const;
 
+	// True if Point is over the grid (ignoring Z)
+	UFUNCTION(BlueprintCallable)
+	bool ContainsPoint(const FVector& Point) const { return GetCellRef(Point).IsValid(); }
+
+	// World-space XY bounds of the whole grid
+	FBox2D GetWorldBounds() const;
+
 	// Get the grid-space position of the center of the given cell
 	// Note, grid-space is a bit of a weird idea.
 	// In actor space, (0, 0) is the center of the grid
@@ -150,12 +313,53 @@ public:
 
 
 	// Return the flattened index of the cell
-	// The assumes a X-major ordering of the data array.
+	// With the default RowMajor layout, this assumes a X-major ordering of the data array.
 	// i.e. if we had a three by three grid, the flattened array would have the data in this order
 	//		(0, 0), (1, 0), (2, 0), (0, 1), (1, 1), (2, 1), (0, 2), (1, 2), (2, 2)
 	// Put another way, all the values in a given X-row are stored in consecutive spans of memory
+	// With the Tiled layout, see EGAGridMemoryLayout.
+	// Cells on extra layers are stored after all of those (see Layers).
 	UFUNCTION(BlueprintCallable)
-	FORCEINLINE int32 CellRefToIndex(const FCellRef& CellRef) const { return CellRef.Y * XCount + CellRef.X; }
+	FORCEINLINE int32 CellRefToIndex(const FCellRef& CellRef) const
+	{
+		return (CellRef.Layer == 0) ? Indexer.CellToIndex(CellRef.X, CellRef.Y) : LayerCellToIndex(CellRef);
+	}
+
+	// Cell handles --------------------------------
+	// See FGACellHandle. The handle accessors skip all validity checks, so only pass them valid handles for this grid.
+
+	// Unique (for this run) id of the grid, for FGACellHandle
+	FORCEINLINE uint32 GetGridId() const { return GridId; }
+
+	// An invalid handle if CellRef isn't on the grid
+	FORCEINLINE FGACellHandle CellRefToHandle(const FCellRef& CellRef) const
+	{
+		return IsValidCell(CellRef) ? FGACellHandle(uint32(CellRefToIndex(CellRef)), GridId) : FGACellHandle();
+	}
+
+	// FCellRef::Invalid if the handle isn't a cell of this grid
+	FCellRef HandleToCellRef(const FGACellHandle& Handle) const;
+
+	FORCEINLINE FGACellHandle PointToHandle(const FVector& Point, bool bClamp = false) const { return CellRefToHandle(GetCellRef(Point, bClamp)); }
+
+	FORCEINLINE FVector GetHandlePosition(const FGACellHandle& Handle) const
+	{
+		return FVector(CellCenterX[Handle.Index], CellCenterY[Handle.Index], CellCenterZ[Handle.Index]);
+	}
+
+	FORCEINLINE bool IsHandlePassable(const FGACellHandle& Handle, float MinClearance) const
+	{
+		return EnumHasAllFlags(Data[Handle.Index], ECellData::CellDataTraversable) &&
+			((MinClearance <= 0.0f) || !ClearanceData.IsValidIndex(Handle.Index) || (ClearanceData[Handle.Index] >= MinClearance));
+	}
+
+	FORCEINLINE float GetHandleCostMultiplier(const FGACellHandle& Handle) const
+	{
+		return CostData.IsValidIndex(Handle.Index) ? float(CostData[Handle.Index]) * (1.0f / CostUnit) : 1.0f;
+	}
+
+	// The passable neighbors of a cell, the same ones GetNeighbors(..., true, ...) would return
+	void GetPassableNeighbors(const FGACellHandle& Cell, float MinClearance, TArray<FGACellStep, TInlineAllocator<8>>& StepsOut) const;
 
 	// Get the flags associated with the given cell reference
 	UFUNCTION(BlueprintCallable)
@@ -165,6 +369,51 @@ public:
 	UFUNCTION(BlueprintCallable)
 	float GetCellHeightData(const FCellRef &CellRef) const;
 
+	// Get the clearance (see ClearanceData) of the given cell
+	UFUNCTION(BlueprintCallable)
+	float GetCellClearance(const FCellRef& CellRef) const;
+
+	// True if the cell is traversable AND has at least MinClearance clearance
+	// (MinClearance <= 0 means any traversable cell will do)
+	FORCEINLINE bool IsCellPassable(const FCellRef& CellRef, float MinClearance) const
+	{
+		int32 CellIndex = CellRefToIndex(CellRef);
+		return EnumHasAllFlags(Data[CellIndex], ECellData::CellDataTraversable) &&
+			((MinClearance <= 0.0f) || !ClearanceData.IsValidIndex(CellIndex) || (ClearanceData[CellIndex] >= MinClearance));
+	}
+
+	// Traversal cost --------------------------------
+
+	// Cost multiplier for moving through the given cell (see CostData)
+	FORCEINLINE float GetCellCostMultiplier(const FCellRef& CellRef) const
+	{
+		int32 CellIndex = CellRefToIndex(CellRef);
+		return CostData.IsValidIndex(CellIndex) ? float(CostData[CellIndex]) * (1.0f / CostUnit) : 1.0f;
+	}
+
+	// Lower bound on GetCellCostMultiplier over the whole grid.
+	// Searches scale their (distance-based) heuristics by this, so they stay admissible even when some cells are
+	// cheaper than normal.
+	FORCEINLINE float GetMinCostMultiplier() const { return MinCostMultiplier; }
+
+	// Stamp a cost multiplier onto every cell in Box, replacing whatever was there
+	UFUNCTION(BlueprintCallable)
+	void StampCost(const FGridBox& Box, float CostMultiplier);
+
+	// Add a cost map on top of the current costs: each cell's multiplier goes up by (map value * CostPerUnit)
+	// e.g. stamp a visibility map to make the searches avoid the player's line of sight
+	UFUNCTION(BlueprintCallable)
+	void StampCostMap(const FGAGridMap& CostMap, float CostPerUnit);
+
+	// Put every cell in Box back to its baked cost
+	UFUNCTION(BlueprintCallable)
+	void ClearCostStamps(const FGridBox& Box);
+
+	static FORCEINLINE uint8 CostMultiplierToByte(float CostMultiplier)
+	{
+		return uint8(FMath::Clamp(FMath::RoundToInt32(CostMultiplier * CostUnit), 1, 255));
+	}
+
 	// Returns the bounds of the given box in cell indices
 	// Note, assumes the Box is in grid-space already
 	// Returns an invalid rectangle if the Box and the grid are disjoint
@@ -172,13 +421,16 @@ public:
 
 	FORCEINLINE bool IsValidCell(const FCellRef& Cell) const
 	{
-		return (Cell.X >= 0) && (Cell.X < XCount) && (Cell.Y >= 0) && (Cell.Y < YCount);
+		return (Cell.X >= 0) && (Cell.X < XCount) && (Cell.Y >= 0) && (Cell.Y < YCount) &&
+			((Cell.Layer == 0) || ((Cell.Layer > 0) && (Cell.Layer < GetLayerCount(Cell.X, Cell.Y))));
 	}
 
 	// Return the traversable neighbors of a given cell
 	// There are a max of 8. 
-	// Return value is the number of valid neighbors
-	void GetNeighbors(const FCellRef& Cell, bool OnlyTraversable, TArray<FCellRef>& Neighbors) const;
+	// Where layered columns are involved, a neighbor is the layer of the next column within LayerStepHeight of this
+	// cell's height (if there is one).
+	// If MinClearance > 0, (and OnlyTraversable is true) only neighbors with at least that much clearance are returned
+	void GetNeighbors(const FCellRef& Cell, bool OnlyTraversable, TArray<FCellRef>& Neighbors, float MinClearance = 0.0f) const;
 
 	// Transform a world-space position into normalized grid space
 	// Normalized grid space is the space in which a cell is 1.0 units wide
@@ -190,15 +442,315 @@ public:
 
 	// Return true if there was a hit, false if it was clear
 	// If return value is true, HitLocationOut will be valid
+	// Cells with less than MinClearance clearance count as hits (so MinClearance = agent radius traces a "fat" line)
 	UFUNCTION(BlueprintCallable)
-	bool TraceLine(const FVector &Start, const FVector &End, FVector &HitLocationOut) const;
+	bool TraceLine(const FVector &Start, const FVector &End, FVector &HitLocationOut, float MinClearance = 0.0f) const;
+
+	// A sight line rather than a walk: the 3D segment from Start to End is blocked by any column it crosses below the
+	// top of (see ObstacleHeightData). The start and end cells themselves never block. Much cheaper than a physics
+	// trace, but only as good as a heightfield is -- nothing overhangs, so e.g. the underside of a bridge is solid.
+	// Same return values as TraceLine.
+	UFUNCTION(BlueprintCallable)
+	bool TraceHeightfield(const FVector& Start, const FVector& End, FVector& HitLocationOut) const;
+
+
+	// Cached transform and cell centers --------------------------------
+	// The actor transform is cached, and the world-space center of every cell is precomputed into the
+	// CellCenter arrays (indexed with CellRefToIndex). Both refresh automatically when the actor moves, when the
+	// grid is resized, and when RefreshDataFromNav runs. If you edit HeightData by hand, call RefreshCellCenters.
+
+	UFUNCTION(BlueprintCallable)
+	void RefreshCellCenters();
+
+	FORCEINLINE const FTransform& GetGridTransform() const { return CachedGridTransform; }
+
+private:
+	float MinCostMultiplier;
 
+	uint32 GridId;
+
+	FTransform CachedGridTransform;
+
+	// World -> grid-local affine, as 2D rows (we never need the local Z)
+	// LocalX = dot(WorldToLocalX, (P, 1)), LocalY = dot(WorldToLocalY, (P, 1))
+	FVector4 WorldToLocalX;
+	FVector4 WorldToLocalY;
+	FVector4 WorldToLocalZ;
+
+	TArray<float> CellCenterX;
+	TArray<float> CellCenterY;
+	TArray<float> CellCenterZ;
+
+	void RefreshCachedTransform();
+
+	// Actor-local (pre-transform) center of the cell
+	FVector GetCellLocalPosition(const FCellRef& CellRef) const;
+
+	// World space to actor-local space, dropping Z
+	FORCEINLINE FVector2D WorldToLocal2D(const FVector& Point) const
+	{
+		return FVector2D(
+			WorldToLocalX.X * Point.X + WorldToLocalX.Y * Point.Y + WorldToLocalX.Z * Point.Z + WorldToLocalX.W,
+			WorldToLocalY.X * Point.X + WorldToLocalY.Y * Point.Y + WorldToLocalY.Z * Point.Z + WorldToLocalY.W);
+	}
+
+	// ... and just the Z, for picking layers (same units as HeightData)
+	FORCEINLINE float WorldToLocalHeight(const FVector& Point) const
+	{
+		return WorldToLocalZ.X * Point.X + WorldToLocalZ.Y * Point.Y + WorldToLocalZ.Z * Point.Z + WorldToLocalZ.W;
+	}
+
+	// Shared tail end of GetCellRef and GetCellRefs
+	FCellRef LocalPointToCellRef(FVector2D LocalPoint, bool bClamp) const;
+
+public:
 
 	// Data from NavSystem --------------------------------
 
 	UFUNCTION(BlueprintCallable)
 	bool RefreshDataFromNav();
 
+	// When baking ObstacleHeightData, non-traversable cells are probed with a physics trace down from this far above
+	// the grid to this far below it (in local units)
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float ObstacleProbeHeight;
+
+	// Rebake ObstacleHeightData from the world's collision. Needs Data and HeightData to be up to date.
+	UFUNCTION(BlueprintCallable)
+	void RefreshObstacleHeights();
+
+	// Recompute MinCostMultiplier from CostData
+	void RefreshCostBounds();
+
+	// Recompute ClearanceData from Data, using an exact Euclidean distance transform
+	// (Felzenszwalb & Huttenlocher: one 1D pass down the columns, then one along the rows -- linear in the cell count)
+	UFUNCTION(BlueprintCallable)
+	void RefreshClearance();
+
+private:
+	// Recompute the clearance of the cells in Box (all of it, without MaxClearance), returning the box of cells
+	// whose clearance changed (invalid if none did)
+	FGridBox UpdateClearance(const FGridBox& Box);
+
+	// Box, plus every cell whose (capped) clearance could depend on a cell in it
+	FGridBox GetClearanceBox(const FGridBox& Box) const;
+
+public:
+
+	// Layers --------------------------------
+	// Most columns of the grid have a single walkable surface, stored in the per-cell arrays as always (layer 0).
+	// Where the nav mesh has surfaces stacked above each other (floors of a building, a bridge over a road), the
+	// column gets extra layers: layer 0 is the highest surface, layers 1, 2, ... go down from there.
+	// Extra layers are stored after the per-column cells in every per-cell array, and ColumnLayers says where each
+	// layered column's are. So CellRefToIndex works for any layer, and memory grows with the number of stacked
+	// surfaces actually present, not with the number of floors times the size of the grid.
+	// GetCellRef picks the layer from the point's Z. Where a layered column is involved, adjacent cells are only
+	// connected if their heights are within LayerStepHeight, which is how searches go over and under each other.
+	// Note, FGAGridMap only stores per-layer values if asked to (see FGAGridMap::EnableLayers) -- the distance maps
+	// built by Dijkstra are, while perception and tactical maps stay one value per column.
+
+	// Two nav surfaces over the same cell at least this far apart vertically are separate layers.
+	// Should be more than an agent's height, and more than LayerStepHeight.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float MinLayerSeparation;
+
+	// Most an agent can step up or down between adjacent cells, where layered columns are involved
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float LayerStepHeight;
+
+	FORCEINLINE bool HasLayers() const { return ExtraLayerCellCount > 0; }
+
+	FORCEINLINE bool IsColumnLayered(int32 X, int32 Y) const
+	{
+		int32 Index = Indexer.CellToIndex(X, Y);
+		return HasLayers() && Data.IsValidIndex(Index) && EnumHasAnyFlags(Data[Index], ECellData::CellDataLayered);
+	}
+
+	// Number of layers in the column (at least 1)
+	UFUNCTION(BlueprintCallable)
+	int32 GetLayerCount(int32 X, int32 Y) const;
+
+	// The layer of the column an agent at LocalZ is on: the highest surface no more than LayerStepHeight above LocalZ
+	// (or the lowest one, if they're all above it). LocalZ is in the same space as HeightData.
+	int32 GetLayerAtHeight(int32 X, int32 Y, float LocalZ) const;
+
+	// The layer of the column you'd step onto from a cell at height FromLocalZ: the closest surface within
+	// LayerStepHeight, or INDEX_NONE if there isn't one
+	int32 GetConnectedLayer(int32 X, int32 Y, float FromLocalZ) const;
+
+	// Total number of cells on extra layers
+	FORCEINLINE int32 GetExtraLayerCellCount() const { return ExtraLayerCellCount; }
+
+private:
+	// Column (Y * XCount + X) -> its extra layers. Only layered columns are in here.
+	UPROPERTY()
+	TMap<int32, FGAColumnLayers> ColumnLayers;
+
+	// The other way around: for each extra layer cell, (column, layer). Built from ColumnLayers.
+	TArray<FIntPoint> ExtraLayerCells;
+	void RefreshExtraLayerCells();
+
+	UPROPERTY()
+	int32 ExtraLayerCellCount;
+
+	int32 LayerCellToIndex(const FCellRef& CellRef) const;
+
+	// Append extra layers to a column, from its surfaces sorted from highest to lowest (Surfaces[0] is layer 0,
+	// which is already in place)
+	void AddColumnLayers(int32 X, int32 Y, const TArray<TPair<float, uint8>>& Surfaces);
+
+	// ClearanceData for layered areas in Box, which the distance transform (which only sees layer 0) gets wrong
+	void RefreshLayeredClearance(const FGridBox& Box);
+
+public:
+
+	// Dynamic obstacles --------------------------------
+	// Obstacles are stamped into BlockedData, and any traversable cell under at least one obstacle is flagged
+	// CellDataBlocked instead of CellDataTraversable until the last obstacle covering it is removed.
+	// A cell is covered if its center is inside the shape. Shapes are given in world space, and are projected onto
+	// the grid, onto the layer at the shape's height (see GetLayerAtHeight). Obstacles are runtime-only: they aren't
+	// saved, and RefreshDataFromNav clears them.
+	// Each Add returns an id to pass to RemoveObstacle, or INDEX_NONE if the shape didn't cover any cells.
+
+	UFUNCTION(BlueprintCallable)
+	int32 AddBoxObstacle(const FVector& Center, const FVector2D& HalfSize, float YawDegrees = 0.0f);
+
+	UFUNCTION(BlueprintCallable)
+	int32 AddCircleObstacle(const FVector& Center, float Radius);
+
+	// Points are the polygon's vertices, in order. Any simple polygon will do (convex or not).
+	UFUNCTION(BlueprintCallable)
+	int32 AddPolygonObstacle(const TArray<FVector>& Points);
+
+	UFUNCTION(BlueprintCallable)
+	bool RemoveObstacle(int32 ObstacleId);
+
+
+	// Change notifications --------------------------------
+	// The grid is divided into coarse regions of RegionSize x RegionSize cells, each with a version number that is
+	// bumped whenever anything in it changes (obstacles, cost stamps, a nav refresh). Anything caching grid-derived
+	// data can remember the versions of the regions it depends on, and compare later, rather than listen for events.
+
+	static constexpr int32 RegionShift = 4;
+	static constexpr int32 RegionSize = 1 << RegionShift;		// 16
+
+	// Everything that changes, everywhere. Fine for a handful of listeners.
+	FGAGridChangedEvent OnGridChanged;
+
+	// Per-region subscriptions, for when there are lots of listeners that each care about a small area (e.g. paths).
+	// Note, subscribing doesn't change the grid, so this is available through a const grid.
+	FORCEINLINE FGAGridChangeDispatcher& GetChangeDispatcher() const { return ChangeDispatcher; }
+
+	// Bump the versions of every region overlapping Box, and broadcast OnGridChanged.
+	// Call this if you edit Data (or the costs) by hand.
+	UFUNCTION(BlueprintCallable)
+	void NotifyCellsChanged(const FGridBox& Box);
+
+	// Incremented on every change, anywhere on the grid
+	FORCEINLINE uint32 GetGridVersion() const { return GridVersion; }
+
+	FORCEINLINE int32 GetRegionCountX() const { return RegionsX; }
+	FORCEINLINE int32 GetRegionCountY() const { return RegionsY; }
+
+	FORCEINLINE int32 CellToRegionIndex(const FCellRef& CellRef) const
+	{
+		return (CellRef.Y >> RegionShift) * RegionsX + (CellRef.X >> RegionShift);
+	}
+
+	FORCEINLINE uint32 GetRegionVersion(int32 RegionIndex) const
+	{
+		return RegionVersions.IsValidIndex(RegionIndex) ? RegionVersions[RegionIndex] : 0;
+	}
+
+	// The cells covered by a region
+	FGridBox GetRegionBox(int32 RegionIndex) const;
+
+	// Indices of all the regions overlapping Box
+	void GetRegionsInBox(const FGridBox& Box, TArray<int32>& RegionIndicesOut) const;
+
+
+	// Snapshots --------------------------------
+	// An immutable copy of the grid as it is right now, to hand to code running off the game thread (see
+	// FGAGridSnapshot). Game thread only. Returns the same snapshot until something changes, and after that only
+	// copies the regions that changed since the last one.
+	TSharedRef<const FGAGridSnapshot, ESPMode::ThreadSafe> GetSnapshot() const;
+
+private:
+	struct FObstacle
+	{
+		TArray<int32> CellIndices;
+		FGridBox Bounds;
+	};
+
+	TMap<int32, FObstacle> Obstacles;
+	int32 NextObstacleId;
+
+	TArray<uint32> RegionVersions;
+	mutable FGAGridChangeDispatcher ChangeDispatcher;
+	mutable TSharedPtr<const FGAGridSnapshot, ESPMode::ThreadSafe> LatestSnapshot;
+	int32 RegionsX;
+	int32 RegionsY;
+	uint32 GridVersion;
+
+	// Rasterize a polygon given in normalized grid space (where a cell is 1 unit wide), into the cells whose centers it contains
+	// LocalZ picks the layer in layered columns
+	void RasterizePolygon(const TArray<FVector2D>& GridPoints, float LocalZ, TArray<int32>& CellIndicesOut, FGridBox& BoundsOut) const;
+
+	int32 AddObstacle(FObstacle&& Obstacle);
+
+public:
+
+	// Streaming --------------------------------
+	// For big worlds split over many grids (see UGAGridSystem), a grid that's far from the action can drop all of
+	// its per-cell data, and load it back in later. Under World Partition, the grid actors themselves are streamed
+	// along with their cells, so none of this is needed; UGAGridSystem's distance-based streaming uses it for
+	// everything else (and for testing).
+	// The baked data (traversability, heights, clearance, costs) is written to a cache file under Saved/ the first
+	// time the grid is unloaded, and read back asynchronously. Runtime obstacles survive a round trip; cost stamps don't.
+	// While a grid isn't resident, nothing should touch its cells: UGAGridSystem won't return it, and
+	// the components treat it as no grid at all.
+
+	// Free the per-cell data. Returns false if the cache couldn't be written and read back (in which case nothing is
+	// freed). If it can't be read back when it comes to loading after all, the grid goes to Failed, and stays unloaded.
+	UFUNCTION(BlueprintCallable)
+	bool UnloadData();
+
+	// Start loading the per-cell data back in. Returns false if it isn't unloaded.
+	UFUNCTION(BlueprintCallable)
+	bool RequestLoadData();
+
+	FORCEINLINE bool IsDataResident() const { return Residency == EGAGridResidency::Resident; }
+
+	UFUNCTION(BlueprintCallable)
+	EGAGridResidency GetResidency() const { return Residency; }
+
+	// Bytes currently allocated for per-cell data
+	UFUNCTION(BlueprintCallable)
+	int64 GetResidentDataSize() const;
+
+private:
+	EGAGridResidency Residency;
+
+	// Bumped whenever a load starts or is cancelled, so stale loads can be recognized and dropped
+	int32 LoadRequestId;
+
+	// False whenever the baked data has changed since the cache was written
+	bool bStreamingCacheValid;
+
+	// Size of the cache file as written, to check it's still there before trusting it
+	int64 StreamingCacheFileSize;
+
+	FString GetStreamingCachePath() const;
+
+	// Write the cache, then read it back and check it comes out the same. False if it doesn't (or can't be written).
+	bool WriteStreamingCache();
+	void FinishLoadData(const TArray<uint8>& CompressedBytes, int32 RequestId);
+
+	// Read or write the baked per-cell arrays
+	void SerializeBakedData(FArchive& Ar);
+
+public:
+
 	// Debugging and Visualization --------------------------------
 
 	UPROPERTY(EditAnywhere)
@@ -220,4 +772,9 @@ public:
 	UFUNCTION(BlueprintCallable)
 	bool RefreshDebugTexture();
 
+	// Time the real searches and diffusion on this grid in each memory layout (results go to the log). The grid is
+	// relaid out for the run and put back in its own layout afterwards.
+	UFUNCTION(CallInEditor, Category = "Debug")
+	void BenchmarkMemoryLayouts();
+
 };
\ No newline at end of file
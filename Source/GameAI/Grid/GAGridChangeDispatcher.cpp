@@ -0,0 +1,104 @@
+#include "GAGridChangeDispatcher.h"
+
+
+void FGAGridChangeDispatcher::Reset(int32 RegionCount)
+{
+	Subscriptions.Empty();
+	RegionSubscribers.Empty();
+	RegionSubscribers.SetNum(RegionCount);
+}
+
+int32 FGAGridChangeDispatcher::Subscribe(const TArray<int32>& RegionIndices, FGARegionChangedDelegate&& Delegate)
+{
+	if (!Delegate.IsBound())
+	{
+		return 0;
+	}
+
+	int32 SubscriptionId = NextSubscriptionId++;
+
+	FSubscription& Subscription = Subscriptions.Add(SubscriptionId);
+	Subscription.Delegate = MoveTemp(Delegate);
+	Subscription.RegionIndices = RegionIndices;
+
+	AddToRegions(SubscriptionId, RegionIndices);
+
+	return SubscriptionId;
+}
+
+bool FGAGridChangeDispatcher::UpdateSubscription(int32 SubscriptionId, const TArray<int32>& RegionIndices)
+{
+	FSubscription* Subscription = Subscriptions.Find(SubscriptionId);
+	if (Subscription == NULL)
+	{
+		return false;
+	}
+
+	RemoveFromRegions(SubscriptionId, Subscription->RegionIndices);
+	Subscription->RegionIndices = RegionIndices;
+	AddToRegions(SubscriptionId, RegionIndices);
+
+	return true;
+}
+
+bool FGAGridChangeDispatcher::Unsubscribe(int32 SubscriptionId)
+{
+	FSubscription Subscription;
+	if (!Subscriptions.RemoveAndCopyValue(SubscriptionId, Subscription))
+	{
+		return false;
+	}
+
+	RemoveFromRegions(SubscriptionId, Subscription.RegionIndices);
+	return true;
+}
+
+void FGAGridChangeDispatcher::Dispatch(TArrayView<const int32> RegionIndices, const FGridBox& DirtyBox)
+{
+	// Gather first, so each subscriber is called once, and so that subscribers can safely
+	// (un)subscribe from inside their callbacks
+	TArray<int32, TInlineAllocator<32>> ToCall;
+	for (int32 RegionIndex : RegionIndices)
+	{
+		if (RegionSubscribers.IsValidIndex(RegionIndex))
+		{
+			for (int32 SubscriptionId : RegionSubscribers[RegionIndex])
+			{
+				ToCall.AddUnique(SubscriptionId);
+			}
+		}
+	}
+
+	for (int32 SubscriptionId : ToCall)
+	{
+		// Note, might have gone away during an earlier callback
+		FSubscription* Subscription = Subscriptions.Find(SubscriptionId);
+		if (Subscription)
+		{
+			FGARegionChangedDelegate Delegate = Subscription->Delegate;
+			Delegate.ExecuteIfBound(DirtyBox);
+		}
+	}
+}
+
+void FGAGridChangeDispatcher::AddToRegions(int32 SubscriptionId, const TArray<int32>& RegionIndices)
+{
+	for (int32 RegionIndex : RegionIndices)
+	{
+		if (RegionSubscribers.IsValidIndex(RegionIndex))
+		{
+			RegionSubscribers[RegionIndex].AddUnique(SubscriptionId);
+		}
+	}
+}
+
+void FGAGridChangeDispatcher::RemoveFromRegions(int32 SubscriptionId, const TArray<int32>& RegionIndices)
+{
+	for (int32 RegionIndex : RegionIndices)
+	{
+		if (RegionSubscribers.IsValidIndex(RegionIndex))
+		{
+			RegionSubscribers[RegionIndex].RemoveSwap(SubscriptionId, EAllowShrinking::No);
+		}
+	}
+}
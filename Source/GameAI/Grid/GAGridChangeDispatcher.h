@@ -0,0 +1,53 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GAGridMap.h"
+
+
+// Called with the (clipped) box of cells that changed
+DECLARE_DELEGATE_OneParam(FGARegionChangedDelegate, const FGridBox& /*DirtyBox*/);
+
+
+// Routes grid change notifications to only the listeners that care about the changed area.
+// Listeners subscribe to a set of coarse regions (see AGAGridActor::RegionSize), and when cells change, only the
+// listeners subscribed to one of the affected regions get called -- once each, however many of their regions changed.
+// So a path only hears about changes near it, and the cost of a change doesn't grow with the number of paths in the world.
+
+class FGAGridChangeDispatcher
+{
+public:
+	FGAGridChangeDispatcher() : NextSubscriptionId(1) {}
+
+	// Size the per-region tables. Drops all subscriptions.
+	void Reset(int32 RegionCount);
+
+	// Returns a subscription id (never 0), or 0 if it fails
+	int32 Subscribe(const TArray<int32>& RegionIndices, FGARegionChangedDelegate&& Delegate);
+
+	// Move an existing subscription to a new set of regions
+	bool UpdateSubscription(int32 SubscriptionId, const TArray<int32>& RegionIndices);
+
+	bool Unsubscribe(int32 SubscriptionId);
+
+	// Call every subscriber to any of RegionIndices
+	void Dispatch(TArrayView<const int32> RegionIndices, const FGridBox& DirtyBox);
+
+	int32 GetSubscriptionCount() const { return Subscriptions.Num(); }
+
+private:
+	struct FSubscription
+	{
+		FGARegionChangedDelegate Delegate;
+		TArray<int32> RegionIndices;
+	};
+
+	void AddToRegions(int32 SubscriptionId, const TArray<int32>& RegionIndices);
+	void RemoveFromRegions(int32 SubscriptionId, const TArray<int32>& RegionIndices);
+
+	TMap<int32, FSubscription> Subscriptions;
+
+	// For each region, the ids of the subscriptions that include it
+	TArray<TArray<int32>> RegionSubscribers;
+
+	int32 NextSubscriptionId;
+};
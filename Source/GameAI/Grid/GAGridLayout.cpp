@@ -0,0 +1,126 @@
+#include "GAGridLayout.h"
+#include "GAGridActor.h"
+#include "GameAI/Pathfinding/GAPathComponent.h"
+#include "GameAI/Perception/GATargetComponent.h"
+#include "HAL/PlatformTime.h"
+
+
+FGAGridIndexer::FGAGridIndexer(EGAGridMemoryLayout LayoutIn, int32 XCountIn, int32 YCountIn)
+	: Layout(LayoutIn), XCount(XCountIn), YCount(YCountIn)
+{
+	TilesX = (XCount + TileMask) >> TileShift;
+	TilesY = (YCount + TileMask) >> TileShift;
+}
+
+void FGAGridIndexer::IndexToCell(int32 Index, int32& XOut, int32& YOut) const
+{
+	if (Layout == EGAGridMemoryLayout::RowMajor)
+	{
+		XOut = Index % XCount;
+		YOut = Index / XCount;
+	}
+	else
+	{
+		int32 TileIndex = Index >> (2 * TileShift);
+		int32 InTile = Index & (TileCellCount - 1);
+		XOut = ((TileIndex % TilesX) << TileShift) | Compact3(InTile);
+		YOut = ((TileIndex / TilesX) << TileShift) | Compact3(InTile >> 1);
+	}
+}
+
+
+// Benchmark --------------------------------
+// Runs the real entry points on the real grid, so whatever the layout costs (or saves) in CellRefToIndex,
+// GetPassableNeighbors and the per-cell lookups shows up as it would in game.
+
+namespace GAGridLayoutBenchmark
+{
+	static const int32 NumRuns = 5;
+	static const int32 DiffusionSteps = 10;
+
+	// The passable cell nearest (X, Y), searching outwards ring by ring
+	static FCellRef FindPassableCell(const AGAGridActor* Grid, int32 X, int32 Y)
+	{
+		for (int32 Radius = 0; Radius < FMath::Max(Grid->XCount, Grid->YCount); Radius++)
+		{
+			for (int32 CellY = Y - Radius; CellY <= Y + Radius; CellY++)
+			{
+				for (int32 CellX = X - Radius; CellX <= X + Radius; CellX++)
+				{
+					bool bOnRing = (FMath::Abs(CellX - X) == Radius) || (FMath::Abs(CellY - Y) == Radius);
+					FCellRef Cell(CellX, CellY);
+					if (bOnRing && Grid->IsValidCell(Cell) && Grid->IsCellPassable(Cell, 0.0f))
+					{
+						return Cell;
+					}
+				}
+			}
+		}
+		return FCellRef::Invalid;
+	}
+
+	// Fastest of NumRuns, in ms
+	template<typename FunctionType>
+	static double Time(FunctionType Function)
+	{
+		double Best = DBL_MAX;
+		for (int32 Run = 0; Run < NumRuns; Run++)
+		{
+			double Start = FPlatformTime::Seconds();
+			Function();
+			Best = FMath::Min(Best, FPlatformTime::Seconds() - Start);
+		}
+		return Best * 1000.0;
+	}
+
+	void Run(AGAGridActor* Grid)
+	{
+		FCellRef Center = FindPassableCell(Grid, Grid->XCount / 2, Grid->YCount / 2);
+		FCellRef Corner = FindPassableCell(Grid, 0, 0);
+		FCellRef OppositeCorner = FindPassableCell(Grid, Grid->XCount - 1, Grid->YCount - 1);
+		if (!Center.IsValid() || !Corner.IsValid() || !OppositeCorner.IsValid())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Grid layout benchmark: %s has no passable cells"), *Grid->GetName());
+			return;
+		}
+
+		// Dijkstra over the whole grid, from the middle
+		double DijkstraTime = Time([Grid, Center]()
+		{
+			FGAGridMap DistanceMap(Grid, FLT_MAX);
+			UGAPathComponent::DijkstraFromSeeds(Grid, { TPair<FCellRef, float>(Center, 0.0f) }, DistanceMap);
+		});
+
+		// A* from corner to corner. The path component isn't registered, it just needs to find its grid.
+		UGAPathComponent* PathComponent = NewObject<UGAPathComponent>(Grid, NAME_None, RF_Transient);
+		PathComponent->GridActor = Grid;
+		PathComponent->Destination = Grid->GetCellPosition(OppositeCorner);
+		PathComponent->DestinationCell = OppositeCorner;
+		PathComponent->DestinationGrid = Grid;
+		FVector StartPoint = Grid->GetCellPosition(Corner);
+		EGAPathState AStarResult = GAPS_None;
+		double AStarTime = Time([PathComponent, StartPoint, &AStarResult]()
+		{
+			TArray<FPathStep> Steps;
+			AStarResult = PathComponent->AStar(StartPoint, Steps);
+		});
+
+		// Occupancy map diffusion, starting from a certain sighting in the middle
+		UGATargetComponent* TargetComponent = NewObject<UGATargetComponent>(Grid, NAME_None, RF_Transient);
+		TargetComponent->GridActor = Grid;
+		TargetComponent->OccupancyMapSetPosition(Grid->GetCellPosition(Center));
+		double DiffusionTime = Time([TargetComponent]()
+		{
+			for (int32 Step = 0; Step < DiffusionSteps; Step++)
+			{
+				TargetComponent->OccupancyMapDiffuse(1.0f / 30.0f);
+			}
+		});
+
+		UE_LOG(LogTemp, Display, TEXT("Grid layout benchmark (%s, %dx%d, %s): OccupancyMapDiffuse x%d %.2f ms, DijkstraFromSeeds %.2f ms, AStar %.2f ms%s"),
+			*Grid->GetName(), Grid->XCount, Grid->YCount,
+			(Grid->MemoryLayout == EGAGridMemoryLayout::RowMajor) ? TEXT("row major") : TEXT("tiled"),
+			DiffusionSteps, DiffusionTime, DijkstraTime, AStarTime,
+			(AStarResult == GAPS_Active) ? TEXT("") : TEXT(" (no path)"));
+	}
+}
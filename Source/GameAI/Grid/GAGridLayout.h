@@ -0,0 +1,111 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GAGridLayout.generated.h"
+
+
+// How per-cell arrays on the AGAGridActor (Data, HeightData, and friends) are laid out in memory
+UENUM(BlueprintType)
+enum class EGAGridMemoryLayout : uint8
+{
+	// All the cells of a row are consecutive: (0, 0), (1, 0), (2, 0) ... (0, 1), (1, 1) ...
+	// Simple, and ideal for scanning rows. But vertically adjacent cells are a whole row apart, so a 3x3
+	// stencil on a wide grid touches three distant cache lines per cell.
+	RowMajor		UMETA(DisplayName = "Row Major"),
+
+	// The grid is split into 8x8 tiles. Tiles are stored in row-major order, and the 64 cells in a tile are stored
+	// in Z-order (Morton order). A cell and all of its neighbors are almost always in the same 256-byte tile.
+	// Arrays are padded up to a whole number of tiles.
+	Tiled			UMETA(DisplayName = "Tiled (Morton)")
+};
+
+
+// Turns cell coordinates into array indices for a given layout, so the rest of the code doesn't need to care.
+// Note: only the AGAGridActor's arrays use this. FGAGridMap and TGAGridMap are always row-major, because their
+// row spans and SIMD kernels depend on it.
+
+struct FGAGridIndexer
+{
+	static constexpr int32 TileShift = 3;
+	static constexpr int32 TileSize = 1 << TileShift;					// 8
+	static constexpr int32 TileMask = TileSize - 1;
+	static constexpr int32 TileCellCount = TileSize * TileSize;			// 64
+
+	FGAGridIndexer() : Layout(EGAGridMemoryLayout::RowMajor), XCount(0), YCount(0), TilesX(0), TilesY(0) {}
+	FGAGridIndexer(EGAGridMemoryLayout LayoutIn, int32 XCountIn, int32 YCountIn);
+
+	FORCEINLINE int32 CellToIndex(int32 X, int32 Y) const
+	{
+		if (Layout == EGAGridMemoryLayout::RowMajor)
+		{
+			return Y * XCount + X;
+		}
+		else
+		{
+			int32 TileIndex = (Y >> TileShift) * TilesX + (X >> TileShift);
+			return (TileIndex << (2 * TileShift)) | MortonInTile(X & TileMask, Y & TileMask);
+		}
+	}
+
+	// Inverse of the above
+	void IndexToCell(int32 Index, int32& XOut, int32& YOut) const;
+
+	// Number of elements an array needs under this layout (including any tile padding)
+	FORCEINLINE int32 GetStorageCount() const
+	{
+		return (Layout == EGAGridMemoryLayout::RowMajor) ? (XCount * YCount) : (TilesX * TilesY * TileCellCount);
+	}
+
+	// Interleave the 3 low bits of X and Y: ...y2 x2 y1 x1 y0 x0
+	static FORCEINLINE int32 MortonInTile(int32 X, int32 Y)
+	{
+		return Spread3(X) | (Spread3(Y) << 1);
+	}
+
+	static FORCEINLINE int32 Spread3(int32 V)
+	{
+		return (V & 1) | ((V & 2) << 1) | ((V & 4) << 2);
+	}
+
+	static FORCEINLINE int32 Compact3(int32 V)
+	{
+		return (V & 1) | ((V >> 1) & 2) | ((V >> 2) & 4);
+	}
+
+	// Move the contents of an array from one layout to another. Padding cells are zero-initialized.
+	template<typename T>
+	static void Relayout(TArray<T>& Values, const FGAGridIndexer& From, const FGAGridIndexer& To)
+	{
+		if (Values.Num() != From.GetStorageCount())
+		{
+			return;
+		}
+
+		TArray<T> Result;
+		Result.SetNumZeroed(To.GetStorageCount());
+		for (int32 Y = 0; Y < FMath::Min(From.YCount, To.YCount); Y++)
+		{
+			for (int32 X = 0; X < FMath::Min(From.XCount, To.XCount); X++)
+			{
+				Result[To.CellToIndex(X, Y)] = Values[From.CellToIndex(X, Y)];
+			}
+		}
+		Values = MoveTemp(Result);
+	}
+
+	EGAGridMemoryLayout Layout;
+	int32 XCount;
+	int32 YCount;
+	int32 TilesX;
+	int32 TilesY;
+};
+
+
+class AGAGridActor;
+
+namespace GAGridLayoutBenchmark
+{
+	// Time UGATargetComponent::OccupancyMapDiffuse, UGAPathComponent::DijkstraFromSeeds and UGAPathComponent::AStar on
+	// Grid, in whatever layout it has right now, and log the results. See AGAGridActor::BenchmarkMemoryLayouts.
+	void Run(AGAGridActor* Grid);
+}
@@ -1,5 +1,7 @@
 #include "GAGridMap.h"
 #include "GAGridActor.h"
+#include "Async/ParallelFor.h"
+#include <atomic>
 
 UE_DISABLE_OPTIMIZATION
 
@@ -13,9 +15,18 @@ bool FGridBox::IsValidCell(const FCellRef& Cell) const
 
 // --------------------- FGAGridMap ---------------------
 
+// Source of unique revision stamps for all grid maps
+static std::atomic<uint64> GNextGridMapRevision(1);
+
 FGAGridMap::FGAGridMap() : XCount(INDEX_NONE), YCount(INDEX_NONE), GridBounds()
 {
 	// we are empty
+	MarkDirty();
+}
+
+void FGAGridMap::MarkDirty()
+{
+	Revision = GNextGridMapRevision.fetch_add(1, std::memory_order_relaxed);
 }
 
 
@@ -57,17 +68,27 @@ void FGAGridMap::ResetData(float InitialValue)
 		check(BoxHeight > 0);
 
 		int32 CellCount = BoxWidth * BoxHeight;
-		Data.SetNum(CellCount);
+		Data.SetNumUninitialized(CellCount);
 
-		for (int32 Index = 0; Index < CellCount; Index++)
-		{
-			Data[Index] = InitialValue;
-		}
+		GAGridKernels::Fill(Data.GetData(), CellCount, InitialValue);
 	}
 	else
 	{
 		Data.Empty();
 	}
+
+	LayerData.Reset();
+	LayerDefaultValue = InitialValue;
+
+	MarkDirty();
+}
+
+void FGAGridMap::EnableLayers(float DefaultValue)
+{
+	bLayered = true;
+	LayerDefaultValue = DefaultValue;
+	LayerData.Reset();
+	MarkDirty();
 }
 
 
@@ -99,6 +120,13 @@ bool FGAGridMap::GetValue(const FCellRef& Cell, float &ValueOut) const
 	int32 X, Y;
 	if (CellRefToLocal(Cell, X, Y))
 	{
+		if (bLayered && (Cell.Layer > 0))
+		{
+			const float* Value = LayerData.Find(FIntVector(Cell.X, Cell.Y, Cell.Layer));
+			ValueOut = Value ? *Value : LayerDefaultValue;
+			return true;
+		}
+
 		int32 Index = GridBounds.GetWidth()* Y + X;
 		check(Data.IsValidIndex(Index));
 		ValueOut = Data[Index];
@@ -111,15 +139,7 @@ bool FGAGridMap::GetMaxValue(float& MaxValueOut, float IgnoreThreshold) const
 {
 	if (IsValid())
 	{
-		MaxValueOut = -UE_MAX_FLT;
-		for (int32 Index = 0; Index < Data.Num(); Index++)
-		{
-			float Value = Data[Index];
-			if (Value <= IgnoreThreshold)
-			{
-				MaxValueOut = FMath::Max(MaxValueOut, Data[Index]);
-			}
-		}
+		MaxValueOut = GAGridKernels::MaxBelowThreshold(Data.GetData(), Data.Num(), IgnoreThreshold);
 		return true;
 	}
 	return false;
@@ -131,9 +151,17 @@ bool FGAGridMap::SetValue(const FCellRef& Cell, float Value)
 	int32 X, Y;
 	if (CellRefToLocal(Cell, X, Y))
 	{
+		if (bLayered && (Cell.Layer > 0))
+		{
+			LayerData.Add(FIntVector(Cell.X, Cell.Y, Cell.Layer), Value);
+			MarkDirty();
+			return true;
+		}
+
 		int32 Index = GridBounds.GetWidth()* Y + X;
 		check(Data.IsValidIndex(Index));
 		Data[Index] = Value;
+		MarkDirty();
 		return true;
 	}
 	return false;
@@ -141,27 +169,172 @@ bool FGAGridMap::SetValue(const FCellRef& Cell, float Value)
 
 bool FGAGridMap::IsAllZeros() const
 {
-	int32 Count = XCount * YCount;
-	for (int Index = 0; Index < Count; Index++)
+	// Note: Data only covers GridBounds, which may be smaller than the full XCount * YCount grid
+	return !GAGridKernels::AnyAbove(Data.GetData(), Data.Num(), 0.0f);
+}
+
+float FGAGridMap::SumTotal() const
+{
+	return GAGridKernels::Sum(Data.GetData(), Data.Num());
+}
+
+bool FGAGridMap::GetMinMaxValue(float& MinValueOut, float& MaxValueOut) const
+{
+	if (IsValid())
 	{
-		if (Data[Index] > 0)
+		return GAGridKernels::MinMax(Data.GetData(), Data.Num(), MinValueOut, MaxValueOut);
+	}
+	return false;
+}
+
+bool FGAGridMap::GetMaxCell(FCellRef& CellOut, float& MaxValueOut) const
+{
+	if (IsValid())
+	{
+		int32 Index = GAGridKernels::ArgMax(Data.GetData(), Data.Num(), MaxValueOut);
+		if (Index != INDEX_NONE)
 		{
-			return false;
+			int32 Width = GridBounds.GetWidth();
+			CellOut.X = GridBounds.MinX + (Index % Width);
+			CellOut.Y = GridBounds.MinY + (Index / Width);
+			return true;
 		}
 	}
+	return false;
+}
 
-	return true;
+int32 FGAGridMap::CountAbove(float Threshold) const
+{
+	return GAGridKernels::CountAbove(Data.GetData(), Data.Num(), Threshold);
 }
 
-float FGAGridMap::SumTotal() const
+void FGAGridMap::Scale(float Factor)
+{
+	GAGridKernels::Scale(Data.GetData(), Data.Num(), Factor);
+	MarkDirty();
+}
+
+bool FGAGridMap::Normalize()
 {
-	int32 Count = XCount * YCount;
-	float Total = 0.0f;
-	for (int Index = 0; Index < Count; Index++)
+	float Total = SumTotal();
+	if (Total > 0.0f)
 	{
-		Total += Data[Index];
+		Scale(1.0f / Total);
+		return true;
 	}
-	return Total;
+	return false;
 }
 
-UE_DISABLE_OPTIMIZATION
+bool FGAGridMap::ScaleAdd(const FGAGridMap& Other, float Factor)
+{
+	if (IsValid() && Other.IsValid() && (GridBounds == Other.GridBounds))
+	{
+		GAGridKernels::ScaleAdd(Data.GetData(), Other.Data.GetData(), Data.Num(), Factor);
+		MarkDirty();
+		return true;
+	}
+	return false;
+}
+
+bool FGAGridMap::Combine(const FGAGridMap& Other, EGAGridCombineOp Op)
+{
+	if (IsValid() && Other.IsValid() && (GridBounds == Other.GridBounds))
+	{
+		GAGridKernels::Combine(Data.GetData(), Other.Data.GetData(), Data.Num(), Op);
+		MarkDirty();
+		return true;
+	}
+	return false;
+}
+
+
+void FGAGridMap::ForEachRow(TFunctionRef<void(int32 Y, TArrayView<float> Row)> Func, bool bParallel)
+{
+	if (!IsValid())
+	{
+		return;
+	}
+
+	int32 Height = GridBounds.GetHeight();
+	if (bParallel)
+	{
+		ParallelFor(Height, [this, &Func](int32 LocalY)
+		{
+			int32 Y = GridBounds.MinY + LocalY;
+			Func(Y, GetRow(Y));
+		});
+	}
+	else
+	{
+		for (int32 Y = GridBounds.MinY; Y <= GridBounds.MaxY; Y++)
+		{
+			Func(Y, GetRow(Y));
+		}
+	}
+
+	MarkDirty();
+}
+
+void FGAGridMap::ForEachRow(TFunctionRef<void(int32 Y, TArrayView<const float> Row)> Func, bool bParallel) const
+{
+	if (!IsValid())
+	{
+		return;
+	}
+
+	int32 Height = GridBounds.GetHeight();
+	if (bParallel)
+	{
+		ParallelFor(Height, [this, &Func](int32 LocalY)
+		{
+			int32 Y = GridBounds.MinY + LocalY;
+			Func(Y, GetRow(Y));
+		});
+	}
+	else
+	{
+		for (int32 Y = GridBounds.MinY; Y <= GridBounds.MaxY; Y++)
+		{
+			Func(Y, GetRow(Y));
+		}
+	}
+}
+
+
+// --------------------- FGAGridMapHalo ---------------------
+
+FGAGridMapHalo::FGAGridMapHalo(const FGAGridMap& Map, int32 HaloSizeIn, float HaloValue)
+{
+	Build(Map, HaloSizeIn, HaloValue);
+}
+
+void FGAGridMapHalo::Build(const FGAGridMap& Map, int32 HaloSizeIn, float HaloValue)
+{
+	check(HaloSizeIn >= 0);
+
+	GridBounds = Map.GridBounds;
+	HaloSize = HaloSizeIn;
+
+	if (!Map.IsValid())
+	{
+		Stride = 0;
+		Data.Empty();
+		return;
+	}
+
+	int32 Width = GridBounds.GetWidth();
+	int32 Height = GridBounds.GetHeight();
+	Stride = Width + 2 * HaloSize;
+
+	// Fill everything with the halo value, then copy the interior row by row
+	Data.SetNumUninitialized(Stride * (Height + 2 * HaloSize));
+	GAGridKernels::Fill(Data.GetData(), Data.Num(), HaloValue);
+
+	for (int32 Y = GridBounds.MinY; Y <= GridBounds.MaxY; Y++)
+	{
+		float* Dest = Data.GetData() + (Y - GridBounds.MinY + HaloSize) * Stride + HaloSize;
+		FMemory::Memcpy(Dest, Map.GetRowData(Y), Width * sizeof(float));
+	}
+}
+
+UE_ENABLE_OPTIMIZATION
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include "CoreMinimal.h"
 #include "Math/MathFwd.h"
+#include "Containers/ArrayView.h"
+#include "Templates/Function.h"
+#include "GAGridMapKernels.h"
 #include "GAGridMap.generated.h"
 
 
@@ -48,6 +51,22 @@ struct FGridBox
 	int32 GetCellCount() const { return ((MaxX - MinX) + 1) * ((MaxY - MinY) + 1); }
 
 	bool IsValidCell(const FCellRef& Cell) const;
+
+	// True if the two boxes share at least one cell
+	bool Intersects(const FGridBox& Other) const
+	{
+		return IsValid() && Other.IsValid() && (MinX <= Other.MaxX) && (Other.MinX <= MaxX) && (MinY <= Other.MaxY) && (Other.MinY <= MaxY);
+	}
+
+	bool operator==(const FGridBox& Other) const
+	{
+		return (MinX == Other.MinX) && (MaxX == Other.MaxX) && (MinY == Other.MinY) && (MaxY == Other.MaxY);
+	}
+
+	bool operator!=(const FGridBox& Other) const
+	{
+		return !(*this == Other);
+	}
 };
 
 
@@ -97,8 +116,144 @@ struct FGAGridMap
 	float SumTotal() const;
 
 
+	// Bulk operations --------------------------------
+	// All of these run over the whole map at once using the vectorized kernels in GAGridMapKernels.h
+
+	bool GetMinMaxValue(float& MinValueOut, float& MaxValueOut) const;
+
+	// Find the cell holding the largest value (the first one, in row order, if there's a tie)
+	bool GetMaxCell(FCellRef& CellOut, float& MaxValueOut) const;
+
+	// Number of cells with a value strictly greater than Threshold
+	int32 CountAbove(float Threshold) const;
+
+	void Scale(float Factor);
+
+	// Scale the map so its values sum to 1. Returns false (and leaves the map alone) if the sum is not positive.
+	bool Normalize();
+
+	// Data = Data + Other.Data * Factor
+	// Both maps must have the same bounds
+	bool ScaleAdd(const FGAGridMap& Other, float Factor);
+
+	// Data = Op(Data, Other.Data), cell by cell
+	// Both maps must have the same bounds
+	bool Combine(const FGAGridMap& Other, EGAGridCombineOp Op);
+
+
+	// Change tracking --------------------------------
+	// Every change to the values made through this API stamps the map with a new, globally unique Revision.
+	// Derived data (e.g. FGAGridMapRegionCache) remembers the revision it was built from and rebuilds lazily.
+	// Copies of a map share its revision, which is fine: they also share its values.
+
+	// Call this after writing to Data (or through GetRowData/GetRow) directly
+	void MarkDirty();
+
+	FORCEINLINE uint64 GetRevision() const { return Revision; }
+
+
+	// Raw access --------------------------------
+	// These skip the per-call validity checks done by GetValue/SetValue, so they're meant for hot loops
+	// that already iterate over GridBounds. X and Y are always in grid cell coordinates (i.e. the same
+	// coordinates as an FCellRef), NOT local coordinates.
+	// Note: writing through the non-const accessors does NOT update the revision -- call MarkDirty() when done.
+
+	// Flattened index into Data of the given cell. No bounds checking!
+	FORCEINLINE int32 GetLocalIndex(int32 X, int32 Y) const
+	{
+		return (Y - GridBounds.MinY) * GridBounds.GetWidth() + (X - GridBounds.MinX);
+	}
+
+	// Pointer to the first value of row Y, i.e. the value at (GridBounds.MinX, Y)
+	FORCEINLINE float* GetRowData(int32 Y)
+	{
+		checkSlow((Y >= GridBounds.MinY) && (Y <= GridBounds.MaxY));
+		return Data.GetData() + (Y - GridBounds.MinY) * GridBounds.GetWidth();
+	}
+
+	FORCEINLINE const float* GetRowData(int32 Y) const
+	{
+		checkSlow((Y >= GridBounds.MinY) && (Y <= GridBounds.MaxY));
+		return Data.GetData() + (Y - GridBounds.MinY) * GridBounds.GetWidth();
+	}
+
+	// The values of row Y as a contiguous span. Element 0 is the cell (GridBounds.MinX, Y)
+	FORCEINLINE TArrayView<float> GetRow(int32 Y)
+	{
+		return TArrayView<float>(GetRowData(Y), GridBounds.GetWidth());
+	}
+
+	FORCEINLINE TArrayView<const float> GetRow(int32 Y) const
+	{
+		return TArrayView<const float>(GetRowData(Y), GridBounds.GetWidth());
+	}
+
+	// Call Func once for each row in GridBounds, with the row's Y (in grid cell coordinates) and its span of values
+	// If bParallel is true, rows are processed concurrently on the task graph, so Func must only touch its own row
+	// (reading other rows of a DIFFERENT map is fine).
+	void ForEachRow(TFunctionRef<void(int32 Y, TArrayView<float> Row)> Func, bool bParallel = false);
+	void ForEachRow(TFunctionRef<void(int32 Y, TArrayView<const float> Row)> Func, bool bParallel = false) const;
+
+
 	FORCEINLINE bool IsValid() const
 	{
 		return GridBounds.IsValid() && (GridBounds.GetCellCount() == Data.Num());
 	}
-};
\ No newline at end of file
+
+
+	// Layers --------------------------------
+	// By default a map holds one value per column, and ignores FCellRef::Layer. After EnableLayers, it also holds a
+	// value for each extra layer of a multi-layer grid (see Layers in AGAGridActor). Those are rare, so they're kept
+	// sparsely, and only GetValue and SetValue see them -- the bulk operations and raw access cover layer 0 only.
+
+	// Cells on extra layers start out at DefaultValue (normally the value the map was initialized to)
+	void EnableLayers(float DefaultValue);
+
+	FORCEINLINE bool IsLayered() const { return bLayered; }
+
+private:
+	uint64 Revision;
+
+	bool bLayered = false;
+	float LayerDefaultValue = 0.0f;
+
+	// (X, Y, Layer) -> value, for cells with Layer > 0
+	TMap<FIntVector, float> LayerData;
+};
+
+
+// A read-only copy of a FGAGridMap padded with a border ("halo") of a fixed value on every side.
+// This makes 3x3 (or larger) stencils branch-free: reading one cell past the edge of the map
+// simply returns the halo value instead of requiring a bounds check.
+// Usage:
+//		FGAGridMapHalo Halo(Map, 1, 0.0f);
+//		const float* Above = Halo.GetRowData(Y - 1);		// note, valid even for Y == MinY
+//		float Left = Above[X - Map.GridBounds.MinX - 1];		// note, valid even for X == MinX
+
+struct FGAGridMapHalo
+{
+	FGAGridMapHalo() : HaloSize(0), Stride(0) {}
+	FGAGridMapHalo(const FGAGridMap& Map, int32 HaloSizeIn, float HaloValue);
+
+	// Rebuild from the given map. Reuses the existing allocation where possible.
+	void Build(const FGAGridMap& Map, int32 HaloSizeIn, float HaloValue);
+
+	// Pointer to the value at (GridBounds.MinX, Y). Valid for Y in [MinY - HaloSize, MaxY + HaloSize]
+	// and for offsets in [-HaloSize, Width + HaloSize)
+	FORCEINLINE const float* GetRowData(int32 Y) const
+	{
+		checkSlow((Y >= GridBounds.MinY - HaloSize) && (Y <= GridBounds.MaxY + HaloSize));
+		return Data.GetData() + (Y - GridBounds.MinY + HaloSize) * Stride + HaloSize;
+	}
+
+	// Value at (X, Y) in grid cell coordinates, anywhere within the halo
+	FORCEINLINE float GetValue(int32 X, int32 Y) const
+	{
+		return GetRowData(Y)[X - GridBounds.MinX];
+	}
+
+	FGridBox GridBounds;
+	int32 HaloSize;
+	int32 Stride;
+	TArray<float> Data;
+};
@@ -0,0 +1,286 @@
+#include "GAGridMapKernels.h"
+#include "Math/VectorRegister.h"
+
+// Note: unlike most files in this project, we deliberately leave optimization ON here.
+// These are the inner loops everything else leans on, and they are useless in a debug build.
+
+
+namespace GAGridKernels
+{
+	// Horizontal reductions of the four lanes of a vector register
+	static FORCEINLINE float HorizontalSum(const VectorRegister4Float& Vec)
+	{
+		alignas(16) float Lanes[4];
+		VectorStoreAligned(Vec, Lanes);
+		return (Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3]);
+	}
+
+	static FORCEINLINE float HorizontalMin(const VectorRegister4Float& Vec)
+	{
+		alignas(16) float Lanes[4];
+		VectorStoreAligned(Vec, Lanes);
+		return FMath::Min(FMath::Min(Lanes[0], Lanes[1]), FMath::Min(Lanes[2], Lanes[3]));
+	}
+
+	static FORCEINLINE float HorizontalMax(const VectorRegister4Float& Vec)
+	{
+		alignas(16) float Lanes[4];
+		VectorStoreAligned(Vec, Lanes);
+		return FMath::Max(FMath::Max(Lanes[0], Lanes[1]), FMath::Max(Lanes[2], Lanes[3]));
+	}
+
+
+	void Fill(float* Data, int32 Num, float Value)
+	{
+		const VectorRegister4Float V = VectorSetFloat1(Value);
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			VectorStore(V, Data + Index);
+		}
+		for (; Index < Num; Index++)
+		{
+			Data[Index] = Value;
+		}
+	}
+
+	float Sum(const float* Data, int32 Num)
+	{
+		// Two independent accumulators to hide the latency of the adds
+		VectorRegister4Float Acc0 = VectorZeroFloat();
+		VectorRegister4Float Acc1 = VectorZeroFloat();
+		int32 Index = 0;
+
+		for (; Index + 8 <= Num; Index += 8)
+		{
+			Acc0 = VectorAdd(Acc0, VectorLoad(Data + Index));
+			Acc1 = VectorAdd(Acc1, VectorLoad(Data + Index + 4));
+		}
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			Acc0 = VectorAdd(Acc0, VectorLoad(Data + Index));
+		}
+
+		float Total = HorizontalSum(VectorAdd(Acc0, Acc1));
+		for (; Index < Num; Index++)
+		{
+			Total += Data[Index];
+		}
+		return Total;
+	}
+
+	bool MinMax(const float* Data, int32 Num, float& MinOut, float& MaxOut)
+	{
+		if (Num <= 0)
+		{
+			return false;
+		}
+
+		VectorRegister4Float MinV = VectorSetFloat1(UE_MAX_FLT);
+		VectorRegister4Float MaxV = VectorSetFloat1(-UE_MAX_FLT);
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			VectorRegister4Float V = VectorLoad(Data + Index);
+			MinV = VectorMin(MinV, V);
+			MaxV = VectorMax(MaxV, V);
+		}
+
+		MinOut = HorizontalMin(MinV);
+		MaxOut = HorizontalMax(MaxV);
+		for (; Index < Num; Index++)
+		{
+			MinOut = FMath::Min(MinOut, Data[Index]);
+			MaxOut = FMath::Max(MaxOut, Data[Index]);
+		}
+		return true;
+	}
+
+	float MaxBelowThreshold(const float* Data, int32 Num, float IgnoreThreshold)
+	{
+		const VectorRegister4Float Threshold = VectorSetFloat1(IgnoreThreshold);
+		const VectorRegister4Float Lowest = VectorSetFloat1(-UE_MAX_FLT);
+		VectorRegister4Float MaxV = Lowest;
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			VectorRegister4Float V = VectorLoad(Data + Index);
+			// Replace anything above the threshold with -MAX so it can't win
+			V = VectorSelect(VectorCompareLE(V, Threshold), V, Lowest);
+			MaxV = VectorMax(MaxV, V);
+		}
+
+		float Result = HorizontalMax(MaxV);
+		for (; Index < Num; Index++)
+		{
+			if (Data[Index] <= IgnoreThreshold)
+			{
+				Result = FMath::Max(Result, Data[Index]);
+			}
+		}
+		return Result;
+	}
+
+	int32 ArgMax(const float* Data, int32 Num, float& MaxOut)
+	{
+		float MinValue;
+		if (!MinMax(Data, Num, MinValue, MaxOut))
+		{
+			return INDEX_NONE;
+		}
+
+		// Second pass to find where the max lives. Vectorized compare, so we only drop to
+		// scalar code for the one block that contains the hit.
+		const VectorRegister4Float MaxV = VectorSetFloat1(MaxOut);
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			uint32 Mask = VectorMaskBits(VectorCompareEQ(VectorLoad(Data + Index), MaxV));
+			if (Mask != 0)
+			{
+				return Index + FMath::CountTrailingZeros(Mask);
+			}
+		}
+		for (; Index < Num; Index++)
+		{
+			if (Data[Index] == MaxOut)
+			{
+				return Index;
+			}
+		}
+
+		// Only reachable if the data contains NaNs
+		return INDEX_NONE;
+	}
+
+	int32 CountAbove(const float* Data, int32 Num, float Threshold)
+	{
+		const VectorRegister4Float ThresholdV = VectorSetFloat1(Threshold);
+		int32 Count = 0;
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			uint32 Mask = VectorMaskBits(VectorCompareGT(VectorLoad(Data + Index), ThresholdV));
+			Count += FMath::CountBits(Mask);
+		}
+		for (; Index < Num; Index++)
+		{
+			Count += (Data[Index] > Threshold) ? 1 : 0;
+		}
+		return Count;
+	}
+
+	bool AnyAbove(const float* Data, int32 Num, float Threshold)
+	{
+		const VectorRegister4Float ThresholdV = VectorSetFloat1(Threshold);
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			if (VectorMaskBits(VectorCompareGT(VectorLoad(Data + Index), ThresholdV)) != 0)
+			{
+				return true;
+			}
+		}
+		for (; Index < Num; Index++)
+		{
+			if (Data[Index] > Threshold)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Scale(float* Data, int32 Num, float Scale)
+	{
+		const VectorRegister4Float ScaleV = VectorSetFloat1(Scale);
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			VectorStore(VectorMultiply(VectorLoad(Data + Index), ScaleV), Data + Index);
+		}
+		for (; Index < Num; Index++)
+		{
+			Data[Index] *= Scale;
+		}
+	}
+
+	void ScaleAdd(float* Dest, const float* Src, int32 Num, float Scale)
+	{
+		const VectorRegister4Float ScaleV = VectorSetFloat1(Scale);
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			VectorRegister4Float Result = VectorMultiplyAdd(VectorLoad(Src + Index), ScaleV, VectorLoad(Dest + Index));
+			VectorStore(Result, Dest + Index);
+		}
+		for (; Index < Num; Index++)
+		{
+			Dest[Index] += Src[Index] * Scale;
+		}
+	}
+
+	// The op is a template parameter so that the switch happens once per call, not once per element
+	template<EGAGridCombineOp Op>
+	static FORCEINLINE VectorRegister4Float CombineVector(const VectorRegister4Float& A, const VectorRegister4Float& B)
+	{
+		switch (Op)
+		{
+		case EGAGridCombineOp::Add:			return VectorAdd(A, B);
+		case EGAGridCombineOp::Subtract:	return VectorSubtract(A, B);
+		case EGAGridCombineOp::Multiply:	return VectorMultiply(A, B);
+		case EGAGridCombineOp::Min:			return VectorMin(A, B);
+		case EGAGridCombineOp::Max:			return VectorMax(A, B);
+		}
+		return A;
+	}
+
+	template<EGAGridCombineOp Op>
+	static FORCEINLINE float CombineScalar(float A, float B)
+	{
+		switch (Op)
+		{
+		case EGAGridCombineOp::Add:			return A + B;
+		case EGAGridCombineOp::Subtract:	return A - B;
+		case EGAGridCombineOp::Multiply:	return A * B;
+		case EGAGridCombineOp::Min:			return FMath::Min(A, B);
+		case EGAGridCombineOp::Max:			return FMath::Max(A, B);
+		}
+		return A;
+	}
+
+	template<EGAGridCombineOp Op>
+	static void CombineImpl(float* Dest, const float* Src, int32 Num)
+	{
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			VectorStore(CombineVector<Op>(VectorLoad(Dest + Index), VectorLoad(Src + Index)), Dest + Index);
+		}
+		for (; Index < Num; Index++)
+		{
+			Dest[Index] = CombineScalar<Op>(Dest[Index], Src[Index]);
+		}
+	}
+
+	void Combine(float* Dest, const float* Src, int32 Num, EGAGridCombineOp Op)
+	{
+		switch (Op)
+		{
+		case EGAGridCombineOp::Add:			CombineImpl<EGAGridCombineOp::Add>(Dest, Src, Num); break;
+		case EGAGridCombineOp::Subtract:	CombineImpl<EGAGridCombineOp::Subtract>(Dest, Src, Num); break;
+		case EGAGridCombineOp::Multiply:	CombineImpl<EGAGridCombineOp::Multiply>(Dest, Src, Num); break;
+		case EGAGridCombineOp::Min:			CombineImpl<EGAGridCombineOp::Min>(Dest, Src, Num); break;
+		case EGAGridCombineOp::Max:			CombineImpl<EGAGridCombineOp::Max>(Dest, Src, Num); break;
+		}
+	}
+}
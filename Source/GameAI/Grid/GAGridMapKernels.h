@@ -0,0 +1,54 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+// Vectorized kernels over contiguous spans of floats, used by FGAGridMap (and anything else that keeps
+// its values in a flat array).
+// These are written against UE's VectorRegister4Float abstraction, which maps to SSE on x64, NEON on ARM,
+// and plain scalar code on platforms without vector intrinsics, so there's no separate fallback path to maintain.
+// Every kernel processes 4 values at a time and then mops up the remaining 0-3 values with scalar code.
+
+enum class EGAGridCombineOp : uint8
+{
+	Add,			// Dest = Dest + Src
+	Subtract,		// Dest = Dest - Src
+	Multiply,		// Dest = Dest * Src
+	Min,			// Dest = Min(Dest, Src)
+	Max				// Dest = Max(Dest, Src)
+};
+
+
+namespace GAGridKernels
+{
+	// Set every value to Value
+	void Fill(float* Data, int32 Num, float Value);
+
+	// Sum of all values
+	float Sum(const float* Data, int32 Num);
+
+	// Min and max of all values. Returns false if Num == 0
+	bool MinMax(const float* Data, int32 Num, float& MinOut, float& MaxOut);
+
+	// Max of all values that are <= IgnoreThreshold (values above the threshold are skipped)
+	// Returns -UE_MAX_FLT if no value qualifies
+	float MaxBelowThreshold(const float* Data, int32 Num, float IgnoreThreshold);
+
+	// Index of the (first) largest value, or INDEX_NONE if Num == 0
+	int32 ArgMax(const float* Data, int32 Num, float& MaxOut);
+
+	// Number of values strictly greater than Threshold
+	int32 CountAbove(const float* Data, int32 Num, float Threshold);
+
+	// True if any value is strictly greater than Threshold. Early-outs on the first hit.
+	bool AnyAbove(const float* Data, int32 Num, float Threshold);
+
+	// Data = Data * Scale
+	void Scale(float* Data, int32 Num, float Scale);
+
+	// Dest = Dest + Src * Scale
+	void ScaleAdd(float* Dest, const float* Src, int32 Num, float Scale);
+
+	// Dest = Op(Dest, Src)
+	void Combine(float* Dest, const float* Src, int32 Num, EGAGridCombineOp Op);
+}
@@ -0,0 +1,316 @@
+#include "GAGridMapKernels.h"
+#include "GAGridMap.h"
+#include "GAGridActor.h"
+#include "Misc/AutomationTest.h"
+
+UE_DISABLE_OPTIMIZATION
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Every kernel against a plain scalar loop, for every length up to a few vectors' worth (so every size of 0-3 value
+// tail gets hit), starting at every offset into the buffer (so the unaligned loads get hit too). Then the FGAGridMap
+// bulk operations built on them, on maps covering odd-sized sub-boxes of the grid.
+
+namespace GAGridKernelsTest
+{
+	static const int32 MaxLength = 37;
+	static const int32 MaxOffset = 3;
+
+	// Whole numbers, so there are plenty of ties for ArgMax and the thresholds
+	static void MakeValues(FRandomStream& Random, int32 Num, TArray<float>& ValuesOut)
+	{
+		ValuesOut.SetNumUninitialized(Num);
+		for (float& Value : ValuesOut)
+		{
+			Value = float(Random.RandRange(-8, 8));
+		}
+	}
+
+	static bool IsNear(float A, float B)
+	{
+		return FMath::IsNearlyEqual(A, B, 1.0e-4f * FMath::Max(1.0f, FMath::Abs(B)));
+	}
+
+	static float ReferenceCombine(float Dest, float Src, EGAGridCombineOp Op)
+	{
+		switch (Op)
+		{
+		case EGAGridCombineOp::Add:
+			return Dest + Src;
+		case EGAGridCombineOp::Subtract:
+			return Dest - Src;
+		case EGAGridCombineOp::Multiply:
+			return Dest * Src;
+		case EGAGridCombineOp::Min:
+			return FMath::Min(Dest, Src);
+		default:
+			return FMath::Max(Dest, Src);
+		}
+	}
+
+	static const EGAGridCombineOp AllOps[] = { EGAGridCombineOp::Add, EGAGridCombineOp::Subtract, EGAGridCombineOp::Multiply, EGAGridCombineOp::Min, EGAGridCombineOp::Max };
+
+	static FGAGridMap MakeMap(const FGridBox& Box, FRandomStream& Random)
+	{
+		FGAGridMap Map;
+		Map.XCount = 40;
+		Map.YCount = 30;
+		Map.GridBounds = Box;
+		Map.ResetData(0.0f);
+		for (int32 Y = Box.MinY; Y <= Box.MaxY; Y++)
+		{
+			for (int32 X = Box.MinX; X <= Box.MaxX; X++)
+			{
+				Map.SetValue(FCellRef(X, Y), float(Random.RandRange(-8, 8)));
+			}
+		}
+		return Map;
+	}
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGAGridKernelsReductionTest, "GameAI.Grid.Kernels.Reductions", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FGAGridKernelsReductionTest::RunTest(const FString& Parameters)
+{
+	using namespace GAGridKernelsTest;
+	FRandomStream Random(12345);
+	TArray<float> Buffer;
+
+	for (int32 Num = 0; Num <= MaxLength; Num++)
+	{
+		for (int32 Offset = 0; Offset <= MaxOffset; Offset++)
+		{
+			MakeValues(Random, Num + Offset, Buffer);
+			const float* Data = Buffer.GetData() + Offset;
+			FString Case = FString::Printf(TEXT("%d values at offset %d"), Num, Offset);
+
+			float Sum = 0.0f;
+			float Min = UE_MAX_FLT;
+			float Max = -UE_MAX_FLT;
+			float MaxBelow = -UE_MAX_FLT;
+			int32 ArgMax = INDEX_NONE;
+			int32 CountAbove = 0;
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				Sum += Data[Index];
+				Min = FMath::Min(Min, Data[Index]);
+				if ((ArgMax == INDEX_NONE) || (Data[Index] > Max))
+				{
+					ArgMax = Index;
+				}
+				Max = FMath::Max(Max, Data[Index]);
+				MaxBelow = (Data[Index] <= 2.0f) ? FMath::Max(MaxBelow, Data[Index]) : MaxBelow;
+				CountAbove += (Data[Index] > 1.0f) ? 1 : 0;
+			}
+
+			TestTrue(FString::Printf(TEXT("Sum, %s"), *Case), IsNear(GAGridKernels::Sum(Data, Num), Sum));
+
+			float MinOut = 0.0f, MaxOut = 0.0f;
+			bool bMinMax = GAGridKernels::MinMax(Data, Num, MinOut, MaxOut);
+			TestEqual(FString::Printf(TEXT("MinMax result, %s"), *Case), bMinMax, Num > 0);
+			if (bMinMax)
+			{
+				TestEqual(FString::Printf(TEXT("MinMax min, %s"), *Case), MinOut, Min);
+				TestEqual(FString::Printf(TEXT("MinMax max, %s"), *Case), MaxOut, Max);
+			}
+
+			TestEqual(FString::Printf(TEXT("MaxBelowThreshold, %s"), *Case), GAGridKernels::MaxBelowThreshold(Data, Num, 2.0f), MaxBelow);
+
+			float ArgMaxValue = 0.0f;
+			int32 ArgMaxOut = GAGridKernels::ArgMax(Data, Num, ArgMaxValue);
+			TestEqual(FString::Printf(TEXT("ArgMax index (first of any ties), %s"), *Case), ArgMaxOut, ArgMax);
+			if (ArgMax != INDEX_NONE)
+			{
+				TestEqual(FString::Printf(TEXT("ArgMax value, %s"), *Case), ArgMaxValue, Max);
+			}
+
+			TestEqual(FString::Printf(TEXT("CountAbove, %s"), *Case), GAGridKernels::CountAbove(Data, Num, 1.0f), CountAbove);
+			TestEqual(FString::Printf(TEXT("AnyAbove, %s"), *Case), GAGridKernels::AnyAbove(Data, Num, 1.0f), CountAbove > 0);
+			TestFalse(FString::Printf(TEXT("AnyAbove the max, %s"), *Case), GAGridKernels::AnyAbove(Data, Num, Max));
+		}
+	}
+
+	return true;
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGAGridKernelsElementwiseTest, "GameAI.Grid.Kernels.Elementwise", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FGAGridKernelsElementwiseTest::RunTest(const FString& Parameters)
+{
+	using namespace GAGridKernelsTest;
+	FRandomStream Random(23456);
+	TArray<float> Dest, Src, Expected;
+
+	for (int32 Num = 0; Num <= MaxLength; Num++)
+	{
+		for (int32 Offset = 0; Offset <= MaxOffset; Offset++)
+		{
+			FString Case = FString::Printf(TEXT("%d values at offset %d"), Num, Offset);
+
+			// The values either side of the span must come through untouched, so the tails can't overrun
+			MakeValues(Random, Num + Offset + 4, Dest);
+			Expected = Dest;
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				Expected[Offset + Index] = 3.5f;
+			}
+			GAGridKernels::Fill(Dest.GetData() + Offset, Num, 3.5f);
+			TestTrue(FString::Printf(TEXT("Fill, %s"), *Case), Dest == Expected);
+
+			MakeValues(Random, Num + Offset + 4, Dest);
+			Expected = Dest;
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				Expected[Offset + Index] *= -0.25f;
+			}
+			GAGridKernels::Scale(Dest.GetData() + Offset, Num, -0.25f);
+			TestTrue(FString::Printf(TEXT("Scale, %s"), *Case), Dest == Expected);
+
+			// Src at a different offset from Dest
+			int32 SrcOffset = MaxOffset - Offset;
+			MakeValues(Random, Num + SrcOffset, Src);
+			const float* SrcData = Src.GetData() + SrcOffset;
+
+			MakeValues(Random, Num + Offset + 4, Dest);
+			Expected = Dest;
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				Expected[Offset + Index] += SrcData[Index] * 1.5f;
+			}
+			GAGridKernels::ScaleAdd(Dest.GetData() + Offset, SrcData, Num, 1.5f);
+			TestTrue(FString::Printf(TEXT("ScaleAdd, %s"), *Case), Dest == Expected);
+
+			for (EGAGridCombineOp Op : AllOps)
+			{
+				MakeValues(Random, Num + Offset + 4, Dest);
+				Expected = Dest;
+				for (int32 Index = 0; Index < Num; Index++)
+				{
+					Expected[Offset + Index] = ReferenceCombine(Expected[Offset + Index], SrcData[Index], Op);
+				}
+				GAGridKernels::Combine(Dest.GetData() + Offset, SrcData, Num, Op);
+				TestTrue(FString::Printf(TEXT("Combine op %d, %s"), int32(Op), *Case), Dest == Expected);
+			}
+		}
+	}
+
+	return true;
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGAGridKernelsSubBoxMapTest, "GameAI.Grid.Kernels.SubBoxMaps", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FGAGridKernelsSubBoxMapTest::RunTest(const FString& Parameters)
+{
+	using namespace GAGridKernelsTest;
+	FRandomStream Random(34567);
+
+	// A single cell, odd widths off the origin, a width that's a multiple of 4 with an odd height, and the whole grid
+	const FGridBox Boxes[] = { FGridBox(0, 0, 0, 0), FGridBox(3, 9, 2, 4), FGridBox(5, 17, 3, 9), FGridBox(8, 15, 11, 13), FGridBox(0, 39, 0, 29) };
+
+	for (const FGridBox& Box : Boxes)
+	{
+		FString Case = FString::Printf(TEXT("box (%d-%d, %d-%d)"), Box.MinX, Box.MaxX, Box.MinY, Box.MaxY);
+		FGAGridMap Map = MakeMap(Box, Random);
+		FGAGridMap Other = MakeMap(Box, Random);
+
+		float Sum = 0.0f;
+		float Min = UE_MAX_FLT;
+		float Max = -UE_MAX_FLT;
+		float MaxBelow = -UE_MAX_FLT;
+		int32 CountAbove = 0;
+		FCellRef MaxCell;
+		for (int32 Y = Box.MinY; Y <= Box.MaxY; Y++)
+		{
+			for (int32 X = Box.MinX; X <= Box.MaxX; X++)
+			{
+				float Value = 0.0f;
+				Map.GetValue(FCellRef(X, Y), Value);
+				Sum += Value;
+				Min = FMath::Min(Min, Value);
+				if (!MaxCell.IsValid() || (Value > Max))
+				{
+					MaxCell = FCellRef(X, Y);
+				}
+				Max = FMath::Max(Max, Value);
+				MaxBelow = (Value <= 2.0f) ? FMath::Max(MaxBelow, Value) : MaxBelow;
+				CountAbove += (Value > 1.0f) ? 1 : 0;
+			}
+		}
+
+		TestTrue(FString::Printf(TEXT("SumTotal, %s"), *Case), IsNear(Map.SumTotal(), Sum));
+
+		float MinOut = 0.0f, MaxOut = 0.0f;
+		TestTrue(FString::Printf(TEXT("GetMinMaxValue, %s"), *Case), Map.GetMinMaxValue(MinOut, MaxOut) && (MinOut == Min) && (MaxOut == Max));
+
+		float MaxBelowOut = 0.0f;
+		TestTrue(FString::Printf(TEXT("GetMaxValue, %s"), *Case), Map.GetMaxValue(MaxBelowOut, 2.0f) && (MaxBelowOut == MaxBelow));
+
+		FCellRef MaxCellOut;
+		float MaxCellValue = 0.0f;
+		TestTrue(FString::Printf(TEXT("GetMaxCell, %s"), *Case), Map.GetMaxCell(MaxCellOut, MaxCellValue) && (MaxCellOut == MaxCell) && (MaxCellValue == Max));
+
+		TestEqual(FString::Printf(TEXT("CountAbove, %s"), *Case), Map.CountAbove(1.0f), CountAbove);
+
+		// Element-wise, against the same thing done a cell at a time
+		FGAGridMap Scaled = Map;
+		Scaled.Scale(0.5f);
+		FGAGridMap ScaleAdded = Map;
+		TestTrue(FString::Printf(TEXT("ScaleAdd result, %s"), *Case), ScaleAdded.ScaleAdd(Other, -2.0f));
+
+		for (int32 Y = Box.MinY; Y <= Box.MaxY; Y++)
+		{
+			for (int32 X = Box.MinX; X <= Box.MaxX; X++)
+			{
+				float A = 0.0f, B = 0.0f, Result = 0.0f;
+				Map.GetValue(FCellRef(X, Y), A);
+				Other.GetValue(FCellRef(X, Y), B);
+
+				Scaled.GetValue(FCellRef(X, Y), Result);
+				TestEqual(FString::Printf(TEXT("Scale at (%d, %d), %s"), X, Y, *Case), Result, A * 0.5f);
+
+				ScaleAdded.GetValue(FCellRef(X, Y), Result);
+				TestEqual(FString::Printf(TEXT("ScaleAdd at (%d, %d), %s"), X, Y, *Case), Result, A + B * -2.0f);
+			}
+		}
+
+		for (EGAGridCombineOp Op : AllOps)
+		{
+			FGAGridMap Combined = Map;
+			TestTrue(FString::Printf(TEXT("Combine op %d result, %s"), int32(Op), *Case), Combined.Combine(Other, Op));
+
+			for (int32 Y = Box.MinY; Y <= Box.MaxY; Y++)
+			{
+				for (int32 X = Box.MinX; X <= Box.MaxX; X++)
+				{
+					float A = 0.0f, B = 0.0f, Result = 0.0f;
+					Map.GetValue(FCellRef(X, Y), A);
+					Other.GetValue(FCellRef(X, Y), B);
+					Combined.GetValue(FCellRef(X, Y), Result);
+					TestEqual(FString::Printf(TEXT("Combine op %d at (%d, %d), %s"), int32(Op), X, Y, *Case), Result, ReferenceCombine(A, B, Op));
+				}
+			}
+		}
+
+		// Only the cells in the box count
+		FGAGridMap Zeros = Map;
+		Zeros.ResetData(0.0f);
+		TestTrue(FString::Printf(TEXT("IsAllZeros, %s"), *Case), Zeros.IsAllZeros());
+		Zeros.SetValue(FCellRef(Box.MaxX, Box.MaxY), 1.0f);
+		TestFalse(FString::Printf(TEXT("IsAllZeros with the last cell set, %s"), *Case), Zeros.IsAllZeros());
+
+		// Maps over different boxes don't mix
+		FGAGridMap Shifted = MakeMap(FGridBox(Box.MinX, Box.MaxX, Box.MinY + 1, Box.MaxY + 1), Random);
+		FGAGridMap Unchanged = Map;
+		TestFalse(FString::Printf(TEXT("Combine with different bounds, %s"), *Case), Unchanged.Combine(Shifted, EGAGridCombineOp::Add));
+		TestTrue(FString::Printf(TEXT("Combine with different bounds leaves the map alone, %s"), *Case), Unchanged.Data == Map.Data);
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
+
+UE_ENABLE_OPTIMIZATION
@@ -0,0 +1,288 @@
+#include "GAGridMapRegions.h"
+
+
+FGAGridMapRegionCache::FGAGridMapRegionCache() : SumRevision(0), PyramidRevision(0)
+{
+}
+
+void FGAGridMapRegionCache::Reset()
+{
+	SumTable.Empty();
+	Levels.Empty();
+	SumRevision = 0;
+	PyramidRevision = 0;
+}
+
+
+bool FGAGridMapRegionCache::ClipToLocal(const FGAGridMap& Map, const FGridBox& Box, FIntRect& LocalOut)
+{
+	if (!Map.IsValid() || !Box.IsValid())
+	{
+		return false;
+	}
+
+	const FGridBox& Bounds = Map.GridBounds;
+	LocalOut.Min.X = FMath::Max(Box.MinX, Bounds.MinX) - Bounds.MinX;
+	LocalOut.Max.X = FMath::Min(Box.MaxX, Bounds.MaxX) - Bounds.MinX;
+	LocalOut.Min.Y = FMath::Max(Box.MinY, Bounds.MinY) - Bounds.MinY;
+	LocalOut.Max.Y = FMath::Min(Box.MaxY, Bounds.MaxY) - Bounds.MinY;
+
+	return (LocalOut.Min.X <= LocalOut.Max.X) && (LocalOut.Min.Y <= LocalOut.Max.Y);
+}
+
+
+// Summed-area table --------------------------------
+
+void FGAGridMapRegionCache::UpdateSums(const FGAGridMap& Map) const
+{
+	if ((SumRevision == Map.GetRevision()) && (SumBounds == Map.GridBounds))
+	{
+		return;
+	}
+
+	int32 Width = Map.GridBounds.GetWidth();
+	int32 Height = Map.GridBounds.GetHeight();
+	int32 Stride = Width + 1;
+
+	SumTable.SetNumUninitialized(Stride * (Height + 1));
+
+	// First row is all zeros
+	for (int32 X = 0; X <= Width; X++)
+	{
+		SumTable[X] = 0.0;
+	}
+
+	for (int32 Y = 0; Y < Height; Y++)
+	{
+		const float* Row = Map.GetRowData(Map.GridBounds.MinY + Y);
+		const double* Above = SumTable.GetData() + Y * Stride;
+		double* Current = SumTable.GetData() + (Y + 1) * Stride;
+		double RowSum = 0.0;
+
+		Current[0] = 0.0;
+		for (int32 X = 0; X < Width; X++)
+		{
+			RowSum += Row[X];
+			Current[X + 1] = Above[X + 1] + RowSum;
+		}
+	}
+
+	SumRevision = Map.GetRevision();
+	SumBounds = Map.GridBounds;
+}
+
+float FGAGridMapRegionCache::GetSum(const FGAGridMap& Map, const FGridBox& Box) const
+{
+	FIntRect Local;
+	if (!ClipToLocal(Map, Box, Local))
+	{
+		return 0.0f;
+	}
+
+	UpdateSums(Map);
+
+	int32 Stride = Map.GridBounds.GetWidth() + 1;
+	const double* S = SumTable.GetData();
+
+	double Total =
+		S[(Local.Max.Y + 1) * Stride + (Local.Max.X + 1)]
+		- S[Local.Min.Y * Stride + (Local.Max.X + 1)]
+		- S[(Local.Max.Y + 1) * Stride + Local.Min.X]
+		+ S[Local.Min.Y * Stride + Local.Min.X];
+
+	return float(Total);
+}
+
+float FGAGridMapRegionCache::GetAverage(const FGAGridMap& Map, const FGridBox& Box) const
+{
+	FIntRect Local;
+	if (!ClipToLocal(Map, Box, Local))
+	{
+		return 0.0f;
+	}
+
+	int32 CellCount = (Local.Width() + 1) * (Local.Height() + 1);
+	return GetSum(Map, Box) / float(CellCount);
+}
+
+
+// Min/max pyramid --------------------------------
+
+void FGAGridMapRegionCache::UpdatePyramid(const FGAGridMap& Map) const
+{
+	if ((PyramidRevision == Map.GetRevision()) && (PyramidBounds == Map.GridBounds))
+	{
+		return;
+	}
+
+	Levels.Reset();
+
+	int32 PrevWidth = Map.GridBounds.GetWidth();
+	int32 PrevHeight = Map.GridBounds.GetHeight();
+	const float* PrevMax = Map.Data.GetData();
+	const float* PrevMin = Map.Data.GetData();
+
+	// Keep halving until we're down to a single block
+	while ((PrevWidth > 1) || (PrevHeight > 1))
+	{
+		FPyramidLevel& Level = Levels.AddDefaulted_GetRef();
+		Level.Width = (PrevWidth + 1) / 2;
+		Level.Height = (PrevHeight + 1) / 2;
+		Level.Max.SetNumUninitialized(Level.Width * Level.Height);
+		Level.Min.SetNumUninitialized(Level.Width * Level.Height);
+
+		for (int32 Y = 0; Y < Level.Height; Y++)
+		{
+			int32 Y0 = 2 * Y;
+			int32 Y1 = FMath::Min(Y0 + 1, PrevHeight - 1);
+
+			for (int32 X = 0; X < Level.Width; X++)
+			{
+				// Note, on odd-sized levels the last child is simply repeated, which doesn't change the min or max
+				int32 X0 = 2 * X;
+				int32 X1 = FMath::Min(X0 + 1, PrevWidth - 1);
+
+				Level.Max[Y * Level.Width + X] = FMath::Max(
+					FMath::Max(PrevMax[Y0 * PrevWidth + X0], PrevMax[Y0 * PrevWidth + X1]),
+					FMath::Max(PrevMax[Y1 * PrevWidth + X0], PrevMax[Y1 * PrevWidth + X1]));
+
+				Level.Min[Y * Level.Width + X] = FMath::Min(
+					FMath::Min(PrevMin[Y0 * PrevWidth + X0], PrevMin[Y0 * PrevWidth + X1]),
+					FMath::Min(PrevMin[Y1 * PrevWidth + X0], PrevMin[Y1 * PrevWidth + X1]));
+			}
+		}
+
+		PrevWidth = Level.Width;
+		PrevHeight = Level.Height;
+		PrevMax = Level.Max.GetData();
+		PrevMin = Level.Min.GetData();
+	}
+
+	PyramidRevision = Map.GetRevision();
+	PyramidBounds = Map.GridBounds;
+}
+
+float FGAGridMapRegionCache::QueryPyramid(const FGAGridMap& Map, const FIntRect& Local, bool bMax, bool bStopAbove, float StopThreshold) const
+{
+	UpdatePyramid(Map);
+
+	struct FBlock
+	{
+		int32 Level;
+		int32 X;
+		int32 Y;
+	};
+
+	int32 MapWidth = Map.GridBounds.GetWidth();
+	int32 MapHeight = Map.GridBounds.GetHeight();
+
+	// When testing for "anything above the threshold", we can treat the threshold as the best-so-far,
+	// which lets us skip every block whose max doesn't beat it
+	float Best = bStopAbove ? StopThreshold : (bMax ? -UE_MAX_FLT : UE_MAX_FLT);
+
+	TArray<FBlock, TInlineAllocator<64>> Stack;
+	Stack.Add({ Levels.Num(), 0, 0 });
+
+	while (Stack.Num() > 0)
+	{
+		FBlock Block = Stack.Pop(EAllowShrinking::No);
+
+		// Cells covered by this block (level L blocks are 2^L cells on a side)
+		int32 X0 = Block.X << Block.Level;
+		int32 Y0 = Block.Y << Block.Level;
+		int32 X1 = FMath::Min(((Block.X + 1) << Block.Level) - 1, MapWidth - 1);
+		int32 Y1 = FMath::Min(((Block.Y + 1) << Block.Level) - 1, MapHeight - 1);
+
+		if ((X1 < Local.Min.X) || (X0 > Local.Max.X) || (Y1 < Local.Min.Y) || (Y0 > Local.Max.Y))
+		{
+			// disjoint
+			continue;
+		}
+
+		float Value;
+		if (Block.Level == 0)
+		{
+			Value = Map.Data[Block.Y * MapWidth + Block.X];
+		}
+		else
+		{
+			const FPyramidLevel& Level = Levels[Block.Level - 1];
+			int32 Index = Block.Y * Level.Width + Block.X;
+			Value = bMax ? Level.Max[Index] : Level.Min[Index];
+		}
+
+		// Nothing in here can improve on what we already have
+		if (bMax ? (Value <= Best) : (Value >= Best))
+		{
+			continue;
+		}
+
+		bool bContained = (X0 >= Local.Min.X) && (X1 <= Local.Max.X) && (Y0 >= Local.Min.Y) && (Y1 <= Local.Max.Y);
+		if (bContained)
+		{
+			Best = Value;
+			if (bStopAbove)
+			{
+				return Best;
+			}
+		}
+		else
+		{
+			// Straddles the edge of the box, so look at the (up to) 4 children
+			// Note, level 0 blocks are single cells, so they're always either disjoint or contained
+			int32 ChildLevel = Block.Level - 1;
+			int32 ChildWidth = (ChildLevel == 0) ? MapWidth : Levels[ChildLevel - 1].Width;
+			int32 ChildHeight = (ChildLevel == 0) ? MapHeight : Levels[ChildLevel - 1].Height;
+
+			for (int32 DY = 0; DY <= 1; DY++)
+			{
+				for (int32 DX = 0; DX <= 1; DX++)
+				{
+					int32 CX = 2 * Block.X + DX;
+					int32 CY = 2 * Block.Y + DY;
+					if ((CX < ChildWidth) && (CY < ChildHeight))
+					{
+						Stack.Add({ ChildLevel, CX, CY });
+					}
+				}
+			}
+		}
+	}
+
+	return Best;
+}
+
+bool FGAGridMapRegionCache::GetMax(const FGAGridMap& Map, const FGridBox& Box, float& MaxOut) const
+{
+	FIntRect Local;
+	if (!ClipToLocal(Map, Box, Local))
+	{
+		return false;
+	}
+
+	MaxOut = QueryPyramid(Map, Local, true, false, 0.0f);
+	return true;
+}
+
+bool FGAGridMapRegionCache::GetMin(const FGAGridMap& Map, const FGridBox& Box, float& MinOut) const
+{
+	FIntRect Local;
+	if (!ClipToLocal(Map, Box, Local))
+	{
+		return false;
+	}
+
+	MinOut = QueryPyramid(Map, Local, false, false, 0.0f);
+	return true;
+}
+
+bool FGAGridMapRegionCache::AnyAbove(const FGAGridMap& Map, const FGridBox& Box, float Threshold) const
+{
+	FIntRect Local;
+	if (!ClipToLocal(Map, Box, Local))
+	{
+		return false;
+	}
+
+	return QueryPyramid(Map, Local, true, true, Threshold) > Threshold;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GAGridMap.h"
+
+
+// Derived data for answering rectangle queries over a FGAGridMap without scanning its cells:
+//	- a summed-area table, for O(1) "total value in this box" queries
+//	- a min/max mip pyramid, for hierarchical "max (or min) value in this box" and "is anything in this box
+//	  above a threshold" queries, which only descend into blocks that straddle the edge of the box
+//
+// The cache is optional and separate from the map -- keep one alongside any map you want to query this way.
+// Each structure is only built the first time it's needed, and is rebuilt lazily whenever the map's revision
+// changes (see FGAGridMap::MarkDirty). So it's cheap to keep one around even if it's rarely queried.
+//
+// All boxes are in grid cell coordinates, and are clipped to the map's GridBounds.
+
+struct FGAGridMapRegionCache
+{
+	FGAGridMapRegionCache();
+
+	// Sum of the values in Box
+	float GetSum(const FGAGridMap& Map, const FGridBox& Box) const;
+
+	// Average of the values in Box (0 if the box doesn't overlap the map)
+	float GetAverage(const FGAGridMap& Map, const FGridBox& Box) const;
+
+	// Max/min of the values in Box. Return false if the box doesn't overlap the map.
+	bool GetMax(const FGAGridMap& Map, const FGridBox& Box, float& MaxOut) const;
+	bool GetMin(const FGAGridMap& Map, const FGridBox& Box, float& MinOut) const;
+
+	// True if any cell in Box has a value strictly greater than Threshold
+	bool AnyAbove(const FGAGridMap& Map, const FGridBox& Box, float Threshold) const;
+
+	// Throw away everything (it'll be rebuilt on the next query)
+	void Reset();
+
+private:
+	struct FPyramidLevel
+	{
+		int32 Width;
+		int32 Height;
+		TArray<float> Max;
+		TArray<float> Min;
+	};
+
+	void UpdateSums(const FGAGridMap& Map) const;
+	void UpdatePyramid(const FGAGridMap& Map) const;
+
+	// Clip Box against the map's bounds and convert to local coordinates. Returns false if they're disjoint.
+	static bool ClipToLocal(const FGAGridMap& Map, const FGridBox& Box, FIntRect& LocalOut);
+
+	// Shared hierarchical descent for GetMax/GetMin/AnyAbove
+	// if bMax, returns the max over the local rect, otherwise the min.
+	// if bStopAbove, returns as soon as any value greater than StopThreshold is found.
+	float QueryPyramid(const FGAGridMap& Map, const FIntRect& Local, bool bMax, bool bStopAbove, float StopThreshold) const;
+
+	// Summed-area table with one extra row and column of zeros, so that
+	// SumTable[(Y + 1) * (Width + 1) + (X + 1)] holds the sum of all local cells (x <= X, y <= Y).
+	// Accumulated in double precision, since sums over big maps lose a lot of float precision when subtracted.
+	mutable TArray<double> SumTable;
+	mutable uint64 SumRevision;
+
+	// Level 0 is the map itself; Levels[0] here is the first 2x2-downsampled level, and so on up to 1x1
+	mutable TArray<FPyramidLevel> Levels;
+	mutable uint64 PyramidRevision;
+
+	// The bounds the above was built for
+	mutable FGridBox SumBounds;
+	mutable FGridBox PyramidBounds;
+};
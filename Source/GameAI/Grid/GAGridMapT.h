@@ -0,0 +1,405 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Math/Float16.h"
+#include "Containers/BitArray.h"
+#include "GAGridActor.h"
+#include "GAGridMap.h"
+#include "GAGridMapKernels.h"
+
+
+// TGAGridMap<T> is the same idea as FGAGridMap -- a set of values over (a box of) the cells of a AGAGridActor --
+// but with a choice of value type. Lots of our maps don't need 32 bits per cell:
+//
+//		bool			1 bit per cell (visibility, "heard", LOS layers...)
+//		uint8			small integer counts / flags
+//		FGAFixed16		16-bit fixed point over [0, 1] (probabilities, normalized scores)
+//		FFloat16		half precision float
+//		float			same as FGAGridMap
+//
+// Bounds semantics are identical to FGAGridMap: values exist for every cell in GridBounds, stored row by row,
+// and GetValue/SetValue on cells outside the bounds fail gracefully.
+//
+// These are C++-only (templates can't be USTRUCTs). FGAGridMap remains the Blueprint-facing float map, and
+// ToFloatMap / FromFloatMap convert between the two.
+
+
+// 16-bit unsigned fixed point value over [0, 1]
+struct FGAFixed16
+{
+	FGAFixed16() : Raw(0) {}
+	explicit FGAFixed16(float Value) : Raw(uint16(FMath::RoundToInt(FMath::Clamp(Value, 0.0f, 1.0f) * 65535.0f))) {}
+
+	FORCEINLINE float GetFloat() const { return float(Raw) * (1.0f / 65535.0f); }
+
+	bool operator==(const FGAFixed16& Other) const { return Raw == Other.Raw; }
+	bool operator!=(const FGAFixed16& Other) const { return Raw != Other.Raw; }
+
+	uint16 Raw;
+};
+
+
+// How to get each value type to and from float
+template<typename T> struct TGAGridValueTraits;
+
+template<> struct TGAGridValueTraits<float>
+{
+	static FORCEINLINE float ToFloat(float Value) { return Value; }
+	static FORCEINLINE float FromFloat(float Value) { return Value; }
+	static FORCEINLINE bool IsZero(float Value) { return Value == 0.0f; }
+};
+
+template<> struct TGAGridValueTraits<uint8>
+{
+	static FORCEINLINE float ToFloat(uint8 Value) { return float(Value); }
+	static FORCEINLINE uint8 FromFloat(float Value) { return uint8(FMath::Clamp(FMath::RoundToInt(Value), 0, 255)); }
+	static FORCEINLINE bool IsZero(uint8 Value) { return Value == 0; }
+};
+
+template<> struct TGAGridValueTraits<FGAFixed16>
+{
+	static FORCEINLINE float ToFloat(FGAFixed16 Value) { return Value.GetFloat(); }
+	static FORCEINLINE FGAFixed16 FromFloat(float Value) { return FGAFixed16(Value); }
+	static FORCEINLINE bool IsZero(FGAFixed16 Value) { return Value.Raw == 0; }
+};
+
+template<> struct TGAGridValueTraits<FFloat16>
+{
+	static FORCEINLINE float ToFloat(FFloat16 Value) { return Value.GetFloat(); }
+	static FORCEINLINE FFloat16 FromFloat(float Value) { return FFloat16(Value); }
+	static FORCEINLINE bool IsZero(FFloat16 Value) { return Value.GetFloat() == 0.0f; }
+};
+
+
+// Per-type kernels. The generic versions are plain loops (which the compiler is free to vectorize);
+// types with a better option specialize below.
+template<typename T> struct TGAGridKernels
+{
+	static void Fill(T* Data, int32 Num, T Value)
+	{
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			Data[Index] = Value;
+		}
+	}
+
+	static float Sum(const T* Data, int32 Num)
+	{
+		float Total = 0.0f;
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			Total += TGAGridValueTraits<T>::ToFloat(Data[Index]);
+		}
+		return Total;
+	}
+
+	static int32 CountNonZero(const T* Data, int32 Num)
+	{
+		int32 Count = 0;
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			Count += TGAGridValueTraits<T>::IsZero(Data[Index]) ? 0 : 1;
+		}
+		return Count;
+	}
+};
+
+template<> struct TGAGridKernels<float>
+{
+	static void Fill(float* Data, int32 Num, float Value) { GAGridKernels::Fill(Data, Num, Value); }
+	static float Sum(const float* Data, int32 Num) { return GAGridKernels::Sum(Data, Num); }
+	static int32 CountNonZero(const float* Data, int32 Num)
+	{
+		int32 Count = 0;
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			Count += (Data[Index] != 0.0f) ? 1 : 0;
+		}
+		return Count;
+	}
+};
+
+template<> struct TGAGridKernels<uint8>
+{
+	static void Fill(uint8* Data, int32 Num, uint8 Value) { FMemory::Memset(Data, Value, Num); }
+
+	// Integer accumulation: exact, and much cheaper than converting every value
+	static float Sum(const uint8* Data, int32 Num)
+	{
+		uint64 Total = 0;
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			Total += Data[Index];
+		}
+		return float(Total);
+	}
+
+	static int32 CountNonZero(const uint8* Data, int32 Num)
+	{
+		int32 Count = 0;
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			Count += (Data[Index] != 0) ? 1 : 0;
+		}
+		return Count;
+	}
+};
+
+template<> struct TGAGridKernels<FGAFixed16>
+{
+	static void Fill(FGAFixed16* Data, int32 Num, FGAFixed16 Value)
+	{
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			Data[Index] = Value;
+		}
+	}
+
+	// Sum the raw integers and scale once at the end
+	static float Sum(const FGAFixed16* Data, int32 Num)
+	{
+		uint64 Total = 0;
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			Total += Data[Index].Raw;
+		}
+		return float(double(Total) * (1.0 / 65535.0));
+	}
+
+	static int32 CountNonZero(const FGAFixed16* Data, int32 Num)
+	{
+		int32 Count = 0;
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			Count += (Data[Index].Raw != 0) ? 1 : 0;
+		}
+		return Count;
+	}
+};
+
+
+// Bounds bookkeeping shared by all value types
+struct FGAGridMapLayout
+{
+	FGAGridMapLayout() : XCount(INDEX_NONE), YCount(INDEX_NONE) {}
+	FGAGridMapLayout(const AGAGridActor* Grid, const FGridBox& GridBoxIn) : XCount(Grid->XCount), YCount(Grid->YCount), GridBounds(GridBoxIn) {}
+
+	// The XCount/YCount of the GridActor I'm built on
+	int32 XCount;
+	int32 YCount;
+
+	// The bounds over which I am defined
+	FGridBox GridBounds;
+
+	FORCEINLINE bool CellRefToLocalIndex(const FCellRef& Cell, int32& IndexOut) const
+	{
+		if (GridBounds.IsValidCell(Cell))
+		{
+			IndexOut = GetLocalIndex(Cell.X, Cell.Y);
+			return true;
+		}
+		return false;
+	}
+
+	// Flattened index of the given cell. No bounds checking!
+	FORCEINLINE int32 GetLocalIndex(int32 X, int32 Y) const
+	{
+		return (Y - GridBounds.MinY) * GridBounds.GetWidth() + (X - GridBounds.MinX);
+	}
+
+	// Cell corresponding to a flattened index
+	FORCEINLINE FCellRef LocalIndexToCellRef(int32 Index) const
+	{
+		int32 Width = GridBounds.GetWidth();
+		return FCellRef(GridBounds.MinX + (Index % Width), GridBounds.MinY + (Index / Width));
+	}
+
+	static FGridBox FullGridBox(const AGAGridActor* Grid)
+	{
+		return FGridBox(0, Grid->XCount - 1, 0, Grid->YCount - 1);
+	}
+};
+
+
+template<typename T>
+struct TGAGridMap : public FGAGridMapLayout
+{
+	using ValueType = T;
+	using Traits = TGAGridValueTraits<T>;
+
+	TGAGridMap() {}
+	TGAGridMap(const AGAGridActor* Grid, T InitialValue) : FGAGridMapLayout(Grid, FullGridBox(Grid)) { ResetData(InitialValue); }
+	TGAGridMap(const AGAGridActor* Grid, const FGridBox& GridBoxIn, T InitialValue) : FGAGridMapLayout(Grid, GridBoxIn) { ResetData(InitialValue); }
+
+	TArray<T> Data;
+
+	FORCEINLINE bool IsValid() const
+	{
+		return GridBounds.IsValid() && (GridBounds.GetCellCount() == Data.Num());
+	}
+
+	void ResetData(T InitialValue)
+	{
+		if (GridBounds.IsValid())
+		{
+			Data.SetNumUninitialized(GridBounds.GetCellCount());
+			TGAGridKernels<T>::Fill(Data.GetData(), Data.Num(), InitialValue);
+		}
+		else
+		{
+			Data.Empty();
+		}
+	}
+
+	bool GetValue(const FCellRef& Cell, T& ValueOut) const
+	{
+		int32 Index;
+		if (IsValid() && CellRefToLocalIndex(Cell, Index))
+		{
+			ValueOut = Data[Index];
+			return true;
+		}
+		return false;
+	}
+
+	bool SetValue(const FCellRef& Cell, T Value)
+	{
+		int32 Index;
+		if (IsValid() && CellRefToLocalIndex(Cell, Index))
+		{
+			Data[Index] = Value;
+			return true;
+		}
+		return false;
+	}
+
+	// Raw row access, same conventions as FGAGridMap::GetRowData
+	FORCEINLINE T* GetRowData(int32 Y) { return Data.GetData() + (Y - GridBounds.MinY) * GridBounds.GetWidth(); }
+	FORCEINLINE const T* GetRowData(int32 Y) const { return Data.GetData() + (Y - GridBounds.MinY) * GridBounds.GetWidth(); }
+
+	float SumTotal() const { return TGAGridKernels<T>::Sum(Data.GetData(), Data.Num()); }
+	int32 CountNonZero() const { return TGAGridKernels<T>::CountNonZero(Data.GetData(), Data.Num()); }
+	bool IsAllZeros() const { return CountNonZero() == 0; }
+
+	// Conversion to and from the Blueprint-facing float map (over the same bounds)
+	void ToFloatMap(FGAGridMap& MapOut) const
+	{
+		MapOut.XCount = XCount;
+		MapOut.YCount = YCount;
+		MapOut.GridBounds = GridBounds;
+		MapOut.Data.SetNumUninitialized(Data.Num());
+		for (int32 Index = 0; Index < Data.Num(); Index++)
+		{
+			MapOut.Data[Index] = Traits::ToFloat(Data[Index]);
+		}
+		MapOut.MarkDirty();
+	}
+
+	void FromFloatMap(const FGAGridMap& Map)
+	{
+		XCount = Map.XCount;
+		YCount = Map.YCount;
+		GridBounds = Map.GridBounds;
+		Data.SetNumUninitialized(Map.Data.Num());
+		for (int32 Index = 0; Index < Data.Num(); Index++)
+		{
+			Data[Index] = Traits::FromFloat(Map.Data[Index]);
+		}
+	}
+};
+
+
+// One bit per cell. Stored in a TBitArray, so there is no raw row access -- use Get/Set with a local index.
+template<>
+struct TGAGridMap<bool> : public FGAGridMapLayout
+{
+	using ValueType = bool;
+
+	TGAGridMap() {}
+	TGAGridMap(const AGAGridActor* Grid, bool InitialValue) : FGAGridMapLayout(Grid, FullGridBox(Grid)) { ResetData(InitialValue); }
+	TGAGridMap(const AGAGridActor* Grid, const FGridBox& GridBoxIn, bool InitialValue) : FGAGridMapLayout(Grid, GridBoxIn) { ResetData(InitialValue); }
+
+	TBitArray<> Data;
+
+	FORCEINLINE bool IsValid() const
+	{
+		return GridBounds.IsValid() && (GridBounds.GetCellCount() == Data.Num());
+	}
+
+	void ResetData(bool InitialValue)
+	{
+		if (GridBounds.IsValid())
+		{
+			Data.Init(InitialValue, GridBounds.GetCellCount());
+		}
+		else
+		{
+			Data.Empty();
+		}
+	}
+
+	bool GetValue(const FCellRef& Cell, bool& ValueOut) const
+	{
+		int32 Index;
+		if (IsValid() && CellRefToLocalIndex(Cell, Index))
+		{
+			ValueOut = Data[Index];
+			return true;
+		}
+		return false;
+	}
+
+	bool SetValue(const FCellRef& Cell, bool Value)
+	{
+		int32 Index;
+		if (IsValid() && CellRefToLocalIndex(Cell, Index))
+		{
+			Data[Index] = Value;
+			return true;
+		}
+		return false;
+	}
+
+	// Unchecked access by local index
+	FORCEINLINE bool Get(int32 Index) const { return Data[Index]; }
+	FORCEINLINE void Set(int32 Index, bool Value) { Data[Index] = Value; }
+
+	float SumTotal() const { return float(CountNonZero()); }
+	int32 CountNonZero() const { return Data.CountSetBits(); }
+	bool IsAllZeros() const { return Data.Find(true) == INDEX_NONE; }
+
+	void ToFloatMap(FGAGridMap& MapOut) const
+	{
+		MapOut.XCount = XCount;
+		MapOut.YCount = YCount;
+		MapOut.GridBounds = GridBounds;
+		MapOut.Data.SetNumUninitialized(Data.Num());
+		for (int32 Index = 0; Index < Data.Num(); Index++)
+		{
+			MapOut.Data[Index] = Data[Index] ? 1.0f : 0.0f;
+		}
+		MapOut.MarkDirty();
+	}
+
+	// Any value > 0 becomes a set bit
+	void FromFloatMap(const FGAGridMap& Map)
+	{
+		XCount = Map.XCount;
+		YCount = Map.YCount;
+		GridBounds = Map.GridBounds;
+		Data.Init(false, Map.Data.Num());
+		for (int32 Index = 0; Index < Map.Data.Num(); Index++)
+		{
+			if (Map.Data[Index] > 0.0f)
+			{
+				Data[Index] = true;
+			}
+		}
+	}
+};
+
+
+typedef TGAGridMap<bool> FGAGridBitMap;
+typedef TGAGridMap<uint8> FGAGridByteMap;
+typedef TGAGridMap<FGAFixed16> FGAGridFixed16Map;
+typedef TGAGridMap<FFloat16> FGAGridHalfMap;
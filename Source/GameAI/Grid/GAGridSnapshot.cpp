@@ -0,0 +1,320 @@
+#include "GAGridSnapshot.h"
+
+UE_DISABLE_OPTIMIZATION
+
+
+FGAGridSnapshot::FGAGridSnapshot()
+	: GridVersion(0), XCount(0), YCount(0), CellScale(1.0f), HalfExtents(FVector2D::ZeroVector), MinCostMultiplier(1.0f), LayerStepHeight(0.0f), ChunksX(0)
+{
+}
+
+FGAGridSnapshotRef FGAGridSnapshot::Create(const AGAGridActor& Grid, const FGAGridSnapshot* Previous)
+{
+	check(IsInGameThread());
+
+	TSharedRef<FGAGridSnapshot, ESPMode::ThreadSafe> Result = MakeShareable(new FGAGridSnapshot());
+	Result->GridVersion = Grid.GetGridVersion();
+	Result->XCount = Grid.XCount;
+	Result->YCount = Grid.YCount;
+	Result->CellScale = Grid.CellScale;
+	Result->HalfExtents = Grid.HalfExtents;
+	Result->GridTransform = Grid.GetGridTransform();
+	Result->MinCostMultiplier = Grid.GetMinCostMultiplier();
+	Result->LayerStepHeight = Grid.LayerStepHeight;
+
+	if (!Grid.IsDataResident())
+	{
+		return Result;
+	}
+
+	Result->ChunksX = Grid.GetRegionCountX();
+	int32 ChunkCount = Grid.GetRegionCountX() * Grid.GetRegionCountY();
+	Result->Chunks.SetNum(ChunkCount);
+	Result->ChunkVersions.SetNum(ChunkCount);
+
+	// Previous chunks are only any good if they cover the same cells
+	bool bCanShare = Previous && Previous->HasData() && (Previous->XCount == Grid.XCount) && (Previous->YCount == Grid.YCount);
+
+	for (int32 ChunkIndex = 0; ChunkIndex < ChunkCount; ChunkIndex++)
+	{
+		uint32 Version = Grid.GetRegionVersion(ChunkIndex);
+		Result->ChunkVersions[ChunkIndex] = Version;
+
+		if (bCanShare && (Previous->ChunkVersions[ChunkIndex] == Version))
+		{
+			Result->Chunks[ChunkIndex] = Previous->Chunks[ChunkIndex];
+		}
+		else
+		{
+			Result->Chunks[ChunkIndex] = BuildChunk(Grid, ChunkIndex);
+		}
+	}
+
+	return Result;
+}
+
+TSharedPtr<const FGAGridChunk, ESPMode::ThreadSafe> FGAGridSnapshot::BuildChunk(const AGAGridActor& Grid, int32 RegionIndex)
+{
+	TSharedPtr<FGAGridChunk, ESPMode::ThreadSafe> Chunk = MakeShared<FGAGridChunk, ESPMode::ThreadSafe>();
+	FMemory::Memzero(Chunk->Data, sizeof(Chunk->Data));
+	FMemory::Memzero(Chunk->Height, sizeof(Chunk->Height));
+	FMemory::Memzero(Chunk->Clearance, sizeof(Chunk->Clearance));
+	FMemory::Memset(Chunk->Cost, AGAGridActor::CostUnit, sizeof(Chunk->Cost));
+
+	FGridBox Box = Grid.GetRegionBox(RegionIndex);
+	for (int32 Y = Box.MinY; Y <= Box.MaxY; Y++)
+	{
+		for (int32 X = Box.MinX; X <= Box.MaxX; X++)
+		{
+			int32 LocalIndex = (Y - Box.MinY) * FGAGridChunk::Size + (X - Box.MinX);
+			int32 LayerCount = Grid.GetLayerCount(X, Y);
+
+			for (int32 Layer = 0; Layer < LayerCount; Layer++)
+			{
+				int32 CellIndex = Grid.CellRefToIndex(FCellRef(X, Y, Layer));
+				ECellData CellData = Grid.Data[CellIndex];
+				float Height = Grid.HeightData[CellIndex];
+				float Clearance = Grid.ClearanceData.IsValidIndex(CellIndex) ? Grid.ClearanceData[CellIndex] : 0.0f;
+				uint8 Cost = Grid.CostData.IsValidIndex(CellIndex) ? Grid.CostData[CellIndex] : AGAGridActor::CostUnit;
+
+				if (Layer == 0)
+				{
+					Chunk->Data[LocalIndex] = CellData;
+					Chunk->Height[LocalIndex] = Height;
+					Chunk->Clearance[LocalIndex] = Clearance;
+					Chunk->Cost[LocalIndex] = Cost;
+				}
+				else
+				{
+					if (Layer == 1)
+					{
+						Chunk->ColumnLayers.Add(LocalIndex, FIntPoint(Chunk->LayerData.Num(), LayerCount - 1));
+					}
+					Chunk->LayerData.Add(CellData);
+					Chunk->LayerHeight.Add(Height);
+					Chunk->LayerClearance.Add(Clearance);
+					Chunk->LayerCost.Add(Cost);
+				}
+			}
+		}
+	}
+
+	return Chunk;
+}
+
+int32 FGAGridSnapshot::CountSharedChunks(const FGAGridSnapshot& Other) const
+{
+	int32 Result = 0;
+	if (Chunks.Num() == Other.Chunks.Num())
+	{
+		for (int32 ChunkIndex = 0; ChunkIndex < Chunks.Num(); ChunkIndex++)
+		{
+			Result += (Chunks[ChunkIndex] == Other.Chunks[ChunkIndex]) ? 1 : 0;
+		}
+	}
+	return Result;
+}
+
+
+// Accessors --------------------------------
+
+const FGAGridChunk* FGAGridSnapshot::FindCell(const FCellRef& Cell, int32& IndexOut) const
+{
+	if (!HasData() || (Cell.X < 0) || (Cell.X >= XCount) || (Cell.Y < 0) || (Cell.Y >= YCount) || (Cell.Layer < 0))
+	{
+		return NULL;
+	}
+
+	const int32 Shift = AGAGridActor::RegionShift;
+	const int32 Mask = FGAGridChunk::Size - 1;
+	const FGAGridChunk* Chunk = Chunks[(Cell.Y >> Shift) * ChunksX + (Cell.X >> Shift)].Get();
+	int32 LocalIndex = (Cell.Y & Mask) * FGAGridChunk::Size + (Cell.X & Mask);
+
+	if (Cell.Layer == 0)
+	{
+		IndexOut = LocalIndex;
+		return Chunk;
+	}
+
+	if (EnumHasAnyFlags(Chunk->Data[LocalIndex], ECellData::CellDataLayered))
+	{
+		const FIntPoint* Layers = Chunk->ColumnLayers.Find(LocalIndex);
+		if (Layers && (Cell.Layer <= Layers->Y))
+		{
+			IndexOut = Layers->X + (Cell.Layer - 1);
+			return Chunk;
+		}
+	}
+
+	return NULL;
+}
+
+bool FGAGridSnapshot::IsValidCell(const FCellRef& Cell) const
+{
+	int32 Index;
+	return FindCell(Cell, Index) != NULL;
+}
+
+int32 FGAGridSnapshot::GetLayerCount(int32 X, int32 Y) const
+{
+	int32 Index;
+	const FGAGridChunk* Chunk = FindCell(FCellRef(X, Y), Index);
+	if (Chunk && EnumHasAnyFlags(Chunk->Data[Index], ECellData::CellDataLayered))
+	{
+		const FIntPoint* Layers = Chunk->ColumnLayers.Find(Index);
+		return Layers ? Layers->Y + 1 : 1;
+	}
+	return 1;
+}
+
+ECellData FGAGridSnapshot::GetCellData(const FCellRef& Cell) const
+{
+	int32 Index;
+	const FGAGridChunk* Chunk = FindCell(Cell, Index);
+	check(Chunk);
+	return (Cell.Layer == 0) ? Chunk->Data[Index] : Chunk->LayerData[Index];
+}
+
+float FGAGridSnapshot::GetCellHeightData(const FCellRef& Cell) const
+{
+	int32 Index;
+	const FGAGridChunk* Chunk = FindCell(Cell, Index);
+	check(Chunk);
+	return (Cell.Layer == 0) ? Chunk->Height[Index] : Chunk->LayerHeight[Index];
+}
+
+float FGAGridSnapshot::GetCellClearance(const FCellRef& Cell) const
+{
+	int32 Index;
+	const FGAGridChunk* Chunk = FindCell(Cell, Index);
+	check(Chunk);
+	return (Cell.Layer == 0) ? Chunk->Clearance[Index] : Chunk->LayerClearance[Index];
+}
+
+float FGAGridSnapshot::GetCellCostMultiplier(const FCellRef& Cell) const
+{
+	int32 Index;
+	const FGAGridChunk* Chunk = FindCell(Cell, Index);
+	check(Chunk);
+	uint8 Cost = (Cell.Layer == 0) ? Chunk->Cost[Index] : Chunk->LayerCost[Index];
+	return float(Cost) * (1.0f / AGAGridActor::CostUnit);
+}
+
+bool FGAGridSnapshot::IsCellPassable(const FCellRef& Cell, float MinClearance) const
+{
+	int32 Index;
+	const FGAGridChunk* Chunk = FindCell(Cell, Index);
+	if (Chunk == NULL)
+	{
+		return false;
+	}
+
+	ECellData CellData = (Cell.Layer == 0) ? Chunk->Data[Index] : Chunk->LayerData[Index];
+	float Clearance = (Cell.Layer == 0) ? Chunk->Clearance[Index] : Chunk->LayerClearance[Index];
+	return EnumHasAllFlags(CellData, ECellData::CellDataTraversable) && ((MinClearance <= 0.0f) || (Clearance >= MinClearance));
+}
+
+FCellRef FGAGridSnapshot::GetCellRef(const FVector& Point, bool bClamp) const
+{
+	FVector LocalPoint = GridTransform.InverseTransformPosition(Point);
+
+	if (bClamp)
+	{
+		LocalPoint.X = FMath::Clamp(LocalPoint.X, -HalfExtents.X, HalfExtents.X);
+		LocalPoint.Y = FMath::Clamp(LocalPoint.Y, -HalfExtents.Y, HalfExtents.Y);
+	}
+	else if (FMath::Abs(LocalPoint.X) > HalfExtents.X || FMath::Abs(LocalPoint.Y) > HalfExtents.Y)
+	{
+		return FCellRef::Invalid;
+	}
+
+	FCellRef Result(
+		FMath::Clamp(FMath::FloorToInt32((LocalPoint.X + HalfExtents.X) / CellScale), 0, XCount - 1),
+		FMath::Clamp(FMath::FloorToInt32((LocalPoint.Y + HalfExtents.Y) / CellScale), 0, YCount - 1));
+	Result.Layer = GetLayerAtHeight(Result.X, Result.Y, LocalPoint.Z);
+	return Result;
+}
+
+FVector FGAGridSnapshot::GetCellPosition(const FCellRef& Cell) const
+{
+	FVector LocalPosition(
+		Cell.X * CellScale + 0.5f * CellScale - HalfExtents.X,
+		Cell.Y * CellScale + 0.5f * CellScale - HalfExtents.Y,
+		IsValidCell(Cell) ? GetCellHeightData(Cell) : 0.0f);
+	return GridTransform.TransformPosition(LocalPosition);
+}
+
+int32 FGAGridSnapshot::GetLayerAtHeight(int32 X, int32 Y, float LocalZ) const
+{
+	int32 LayerCount = GetLayerCount(X, Y);
+	for (int32 Layer = 0; Layer < LayerCount - 1; Layer++)
+	{
+		if (GetCellHeightData(FCellRef(X, Y, Layer)) <= LocalZ + LayerStepHeight)
+		{
+			return Layer;
+		}
+	}
+	return LayerCount - 1;
+}
+
+int32 FGAGridSnapshot::GetConnectedLayer(int32 X, int32 Y, float FromLocalZ) const
+{
+	int32 Result = INDEX_NONE;
+	float BestDifference = LayerStepHeight;
+
+	int32 LayerCount = GetLayerCount(X, Y);
+	for (int32 Layer = 0; Layer < LayerCount; Layer++)
+	{
+		float Difference = FMath::Abs(GetCellHeightData(FCellRef(X, Y, Layer)) - FromLocalZ);
+		if (Difference <= BestDifference)
+		{
+			BestDifference = Difference;
+			Result = Layer;
+		}
+	}
+
+	return Result;
+}
+
+void FGAGridSnapshot::GetNeighbors(const FCellRef& Cell, bool OnlyTraversable, TArray<FCellRef>& Neighbors, float MinClearance) const
+{
+	if (!IsValidCell(Cell))
+	{
+		return;
+	}
+
+	bool bCellLayered = (Cell.Layer > 0) || (GetLayerCount(Cell.X, Cell.Y) > 1);
+	float CellHeight = GetCellHeightData(Cell);
+
+	for (int32 Y = Cell.Y - 1; Y <= Cell.Y + 1; Y++)
+	{
+		for (int32 X = Cell.X - 1; X <= Cell.X + 1; X++)
+		{
+			FCellRef NCell(X, Y);
+			if (((X == Cell.X) && (Y == Cell.Y)) || !IsValidCell(NCell))
+			{
+				continue;
+			}
+
+			if (bCellLayered || (GetLayerCount(X, Y) > 1))
+			{
+				NCell.Layer = GetConnectedLayer(X, Y, CellHeight);
+				if (NCell.Layer == INDEX_NONE)
+				{
+					if (OnlyTraversable)
+					{
+						continue;
+					}
+					NCell.Layer = GetLayerAtHeight(X, Y, CellHeight);
+				}
+			}
+
+			if (!OnlyTraversable || IsCellPassable(NCell, MinClearance))
+			{
+				Neighbors.Add(NCell);
+			}
+		}
+	}
+}
+
+UE_ENABLE_OPTIMIZATION
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GAGridActor.h"
+
+
+// An immutable copy of one region (see AGAGridActor::RegionSize) of a grid's per-cell data.
+// Cells are stored row-major, RegionSize x RegionSize, even at the edges of the grid (where the extra cells are empty).
+struct FGAGridChunk
+{
+	static constexpr int32 Size = AGAGridActor::RegionSize;
+	static constexpr int32 CellCount = Size * Size;
+
+	ECellData Data[CellCount];
+	float Height[CellCount];
+	float Clearance[CellCount];
+	uint8 Cost[CellCount];
+
+	// Extra layers of any layered columns in the chunk (see Layers in AGAGridActor)
+	// Local cell index -> (index of its layer 1 in the Layer arrays, number of extra layers)
+	TMap<int32, FIntPoint> ColumnLayers;
+	TArray<ECellData> LayerData;
+	TArray<float> LayerHeight;
+	TArray<float> LayerClearance;
+	TArray<uint8> LayerCost;
+};
+
+
+// A consistent, read-only view of a grid at one point in time, for reading off the game thread.
+// Get one from AGAGridActor::GetSnapshot() on the game thread, then hand it to whatever needs it -- a worker thread
+// can hold on to it for as long as it likes, without locks, while the game thread carries on editing the grid.
+// Snapshots are copy-on-write at the granularity of regions: each region's cells live in a ref-counted, immutable
+// chunk, and a new snapshot shares every chunk whose region hasn't changed (see AGAGridActor::GetRegionVersion)
+// with the previous one. So an edit only costs a copy of the regions it touched.
+// The accessors mirror AGAGridActor's, with the same rules for layers and clearance.
+
+class FGAGridSnapshot
+{
+public:
+	// Build a snapshot of Grid, sharing any chunks of Previous that are still current. Game thread only.
+	static TSharedRef<const FGAGridSnapshot, ESPMode::ThreadSafe> Create(const AGAGridActor& Grid, const FGAGridSnapshot* Previous);
+
+	// The grid's version (AGAGridActor::GetGridVersion) when this was taken
+	uint32 GridVersion;
+
+	int32 XCount;
+	int32 YCount;
+	float CellScale;
+	FVector2D HalfExtents;
+	FTransform GridTransform;
+	float MinCostMultiplier;
+	float LayerStepHeight;
+
+	// False if the grid's data wasn't resident (see AGAGridActor::UnloadData), in which case there are no cells
+	FORCEINLINE bool HasData() const { return Chunks.Num() > 0; }
+
+	// Number of chunks shared with Other (i.e. not copied when one was made from the other)
+	int32 CountSharedChunks(const FGAGridSnapshot& Other) const;
+
+	FORCEINLINE int32 GetChunkCount() const { return Chunks.Num(); }
+
+
+	// Accessors --------------------------------
+
+	bool IsValidCell(const FCellRef& Cell) const;
+
+	FCellRef GetCellRef(const FVector& Point, bool bClamp = false) const;
+
+	FVector GetCellPosition(const FCellRef& Cell) const;
+
+	int32 GetLayerCount(int32 X, int32 Y) const;
+
+	// The following all assume the cell is valid
+	ECellData GetCellData(const FCellRef& Cell) const;
+	float GetCellHeightData(const FCellRef& Cell) const;
+	float GetCellClearance(const FCellRef& Cell) const;
+	float GetCellCostMultiplier(const FCellRef& Cell) const;
+
+	bool IsCellPassable(const FCellRef& Cell, float MinClearance) const;
+
+	// See AGAGridActor::GetNeighbors
+	void GetNeighbors(const FCellRef& Cell, bool OnlyTraversable, TArray<FCellRef>& Neighbors, float MinClearance = 0.0f) const;
+
+private:
+	FGAGridSnapshot();
+
+	// The chunk holding Cell, and where in it the cell is: for layer 0, an index into the per-cell arrays,
+	// otherwise an index into the Layer arrays. Returns NULL if there's no such cell.
+	const FGAGridChunk* FindCell(const FCellRef& Cell, int32& IndexOut) const;
+
+	static TSharedPtr<const FGAGridChunk, ESPMode::ThreadSafe> BuildChunk(const AGAGridActor& Grid, int32 RegionIndex);
+
+	int32 GetLayerAtHeight(int32 X, int32 Y, float LocalZ) const;
+	int32 GetConnectedLayer(int32 X, int32 Y, float FromLocalZ) const;
+
+	int32 ChunksX;
+	TArray<TSharedPtr<const FGAGridChunk, ESPMode::ThreadSafe>> Chunks;
+
+	// Region version each chunk was built at
+	TArray<uint32> ChunkVersions;
+};
+
+typedef TSharedRef<const FGAGridSnapshot, ESPMode::ThreadSafe> FGAGridSnapshotRef;
+typedef TSharedPtr<const FGAGridSnapshot, ESPMode::ThreadSafe> FGAGridSnapshotPtr;
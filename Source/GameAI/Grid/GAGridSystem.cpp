@@ -0,0 +1,349 @@
+#include "GAGridSystem.h"
+#include "Kismet/GameplayStatics.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/World.h"
+
+
+UGAGridSystem::UGAGridSystem(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	HashBucketSize = 10000.0f;
+	MaxPortalHeightDifference = 50.0f;
+
+	bStreamGrids = false;
+	StreamInDistance = 20000.0f;
+	StreamOutDistance = 25000.0f;
+
+	PrimaryComponentTick.bCanEverTick = true;
+}
+
+
+bool UGAGridSystem::RegisterGrid(AGAGridActor* Grid)
+{
+	if (Grid == NULL)
+	{
+		return false;
+	}
+
+	Grids.AddUnique(Grid);
+	RefreshGrids();
+	return true;
+}
+
+bool UGAGridSystem::UnregisterGrid(AGAGridActor* Grid)
+{
+	bool Result = Grids.Remove(Grid) > 0;
+	if (Result)
+	{
+		RefreshGrids();
+	}
+	return Result;
+}
+
+
+UGAGridSystem* UGAGridSystem::GetGridSystem(const UObject* WorldContextObject)
+{
+	UGAGridSystem* Result = NULL;
+	AGameModeBase* GameMode = UGameplayStatics::GetGameMode(WorldContextObject);
+	if (GameMode)
+	{
+		Result = GameMode->GetComponentByClass<UGAGridSystem>();
+	}
+
+	return Result;
+}
+
+AGAGridActor* UGAGridSystem::FindGridActor(const UObject* WorldContextObject, const FVector& Location)
+{
+	UGAGridSystem* GridSystem = GetGridSystem(WorldContextObject);
+	if (GridSystem)
+	{
+		return GridSystem->FindGrid(Location);
+	}
+	else
+	{
+		AGAGridActor* Result = Cast<AGAGridActor>(UGameplayStatics::GetActorOfClass(WorldContextObject, AGAGridActor::StaticClass()));
+		return (Result && Result->IsDataResident()) ? Result : NULL;
+	}
+}
+
+AGAGridActor* UGAGridSystem::ResolveGridActor(const UObject* WorldContextObject, const FVector& Location, TSoftObjectPtr<AGAGridActor>& Cache)
+{
+	AGAGridActor* Cached = Cache.Get();
+	if (Cached && !Cached->IsDataResident())
+	{
+		// Streamed out from under us
+		Cached = NULL;
+		Cache.Reset();
+	}
+
+	if (Cached && Cached->ContainsPoint(Location))
+	{
+		return Cached;
+	}
+
+	AGAGridActor* Result = FindGridActor(WorldContextObject, Location);
+	if (Result)
+	{
+		Cache = Result;
+		return Result;
+	}
+	else
+	{
+		// Off the edge of every grid -- the one we were last on is as good a guess as any
+		return Cached;
+	}
+}
+
+
+// Lookup --------------------------------
+
+FIntPoint UGAGridSystem::GetBucket(const FVector2D& Point) const
+{
+	return FIntPoint(FMath::FloorToInt32(Point.X / HashBucketSize), FMath::FloorToInt32(Point.Y / HashBucketSize));
+}
+
+AGAGridActor* UGAGridSystem::FindGrid(const FVector& Point) const
+{
+	const TArray<int32>* Candidates = GridHash.Find(GetBucket(FVector2D(Point)));
+	if (Candidates)
+	{
+		// Usually just one or two -- only grids overlapping this bucket
+		for (int32 GridIndex : *Candidates)
+		{
+			AGAGridActor* Grid = Grids[GridIndex];
+			if (Grid && Grid->IsDataResident() && Grid->ContainsPoint(Point))
+			{
+				return Grid;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+bool UGAGridSystem::ResolvePoint(const FVector& Point, AGAGridActor*& GridOut, FCellRef& CellOut) const
+{
+	GridOut = FindGrid(Point);
+	if (GridOut)
+	{
+		CellOut = GridOut->GetCellRef(Point);
+		return CellOut.IsValid();
+	}
+
+	CellOut = FCellRef::Invalid;
+	return false;
+}
+
+
+// Portals --------------------------------
+
+const TArray<int32>& UGAGridSystem::GetPortalsFrom(const AGAGridActor* Grid) const
+{
+	static const TArray<int32> NoPortals;
+	const TArray<int32>* Result = PortalsByGrid.Find(Grid);
+	return Result ? *Result : NoPortals;
+}
+
+AGAGridActor* UGAGridSystem::GetNextGridTowards(const AGAGridActor* From, const AGAGridActor* To) const
+{
+	if ((From == NULL) || (To == NULL) || (From == To))
+	{
+		return NULL;
+	}
+
+	// Breadth-first over the grid adjacency graph. There won't be many grids, so no need for anything smarter.
+	TMap<const AGAGridActor*, AGAGridActor*> FirstStep;
+	TArray<const AGAGridActor*> Queue;
+	Queue.Add(From);
+	FirstStep.Add(From, NULL);
+
+	for (int32 QueueIndex = 0; QueueIndex < Queue.Num(); QueueIndex++)
+	{
+		const AGAGridActor* Current = Queue[QueueIndex];
+		for (int32 PortalIndex : GetPortalsFrom(Current))
+		{
+			AGAGridActor* Next = Portals[PortalIndex].ToGrid;
+			if (!FirstStep.Contains(Next))
+			{
+				AGAGridActor* Step = (Current == From) ? Next : FirstStep[Current];
+				if (Next == To)
+				{
+					return Step;
+				}
+
+				FirstStep.Add(Next, Step);
+				Queue.Add(Next);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+void UGAGridSystem::RefreshGrids()
+{
+	Grids.RemoveAll([](const TObjectPtr<AGAGridActor>& Grid) { return Grid == NULL; });
+
+	RebuildHash();
+	RebuildPortals();
+}
+
+void UGAGridSystem::RebuildHash()
+{
+	GridHash.Reset();
+
+	for (int32 GridIndex = 0; GridIndex < Grids.Num(); GridIndex++)
+	{
+		FBox2D Bounds = Grids[GridIndex]->GetWorldBounds();
+		FIntPoint MinBucket = GetBucket(Bounds.Min);
+		FIntPoint MaxBucket = GetBucket(Bounds.Max);
+
+		for (int32 Y = MinBucket.Y; Y <= MaxBucket.Y; Y++)
+		{
+			for (int32 X = MinBucket.X; X <= MaxBucket.X; X++)
+			{
+				GridHash.FindOrAdd(FIntPoint(X, Y)).Add(GridIndex);
+			}
+		}
+	}
+}
+
+void UGAGridSystem::RebuildPortals()
+{
+	Portals.Reset();
+	PortalsByGrid.Reset();
+
+	// Note, only between resident grids -- we can't look at the cells of the others
+	for (AGAGridActor* From : Grids)
+	{
+		for (AGAGridActor* To : Grids)
+		{
+			if ((From != To) && From->IsDataResident() && To->IsDataResident())
+			{
+				// Only bother if they're close enough to touch
+				FBox2D FromBounds = From->GetWorldBounds().ExpandBy(From->CellScale);
+				if (FromBounds.Intersect(To->GetWorldBounds()))
+				{
+					StitchGrids(From, To);
+				}
+			}
+		}
+	}
+}
+
+void UGAGridSystem::StitchGrids(AGAGridActor* From, AGAGridActor* To)
+{
+	// For each cell along an edge of From, look one cell further out (in From's normalized grid space)
+	// and see whether that lands on a cell of To
+	auto TryLink = [this, From, To](int32 X, int32 Y, int32 DX, int32 DY)
+	{
+		FCellRef FromCell(X, Y);
+		FVector Probe;
+		From->TransformNormalizedGridSpaceToWorld(FVector2D(X + DX + 0.5f, Y + DY + 0.5f), Probe);
+
+		FCellRef ToCell = To->GetCellRef(Probe);
+		if (!ToCell.IsValid())
+		{
+			return;
+		}
+
+		FVector FromPosition = From->GetCellPosition(FromCell);
+		FVector ToPosition = To->GetCellPosition(ToCell);
+		if (FMath::Abs(FromPosition.Z - ToPosition.Z) > MaxPortalHeightDifference)
+		{
+			return;
+		}
+
+		// Note, we don't check traversability here -- it can change at runtime, so searches check it as they go
+		FGAGridPortal& Portal = Portals.AddDefaulted_GetRef();
+		Portal.FromGrid = From;
+		Portal.FromCell = FromCell;
+		Portal.ToGrid = To;
+		Portal.ToCell = ToCell;
+		Portal.Distance = FVector::Dist(FromPosition, ToPosition);
+
+		PortalsByGrid.FindOrAdd(From).Add(Portals.Num() - 1);
+	};
+
+	for (int32 X = 0; X < From->XCount; X++)
+	{
+		TryLink(X, 0, 0, -1);
+		TryLink(X, From->YCount - 1, 0, 1);
+	}
+
+	for (int32 Y = 0; Y < From->YCount; Y++)
+	{
+		TryLink(0, Y, -1, 0);
+		TryLink(From->XCount - 1, Y, 1, 0);
+	}
+}
+
+
+// Distance-based streaming --------------------------------
+
+void UGAGridSystem::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	UWorld* World = GetWorld();
+	if (!bStreamGrids || (World == NULL))
+	{
+		return;
+	}
+
+	TArray<FVector2D, TInlineAllocator<4>> Sources;
+	for (FConstPlayerControllerIterator Iterator = World->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		APlayerController* PlayerController = Iterator->Get();
+		if (PlayerController && PlayerController->GetPawn())
+		{
+			Sources.Add(FVector2D(PlayerController->GetPawn()->GetActorLocation()));
+		}
+	}
+
+	if (Sources.Num() == 0)
+	{
+		return;
+	}
+
+	// Copy, since loading/unloading calls RefreshGrids
+	TArray<AGAGridActor*> GridsToCheck(Grids);
+	for (AGAGridActor* Grid : GridsToCheck)
+	{
+		if (Grid == NULL)
+		{
+			continue;
+		}
+
+		FBox2D Bounds = Grid->GetWorldBounds();
+		float Distance = FLT_MAX;
+		for (const FVector2D& Source : Sources)
+		{
+			Distance = FMath::Min(Distance, float(FMath::Sqrt(Bounds.ComputeSquaredDistanceToPoint(Source))));
+		}
+
+		if ((Distance <= StreamInDistance) && (Grid->GetResidency() == EGAGridResidency::Unloaded))
+		{
+			Grid->RequestLoadData();
+		}
+		else if ((Distance > StreamOutDistance) && ((Grid->GetResidency() == EGAGridResidency::Resident) || (Grid->GetResidency() == EGAGridResidency::Loading)))
+		{
+			Grid->UnloadData();
+		}
+	}
+}
+
+int64 UGAGridSystem::GetResidentDataSize() const
+{
+	int64 Result = 0;
+	for (const AGAGridActor* Grid : Grids)
+	{
+		if (Grid)
+		{
+			Result += Grid->GetResidentDataSize();
+		}
+	}
+	return Result;
+}
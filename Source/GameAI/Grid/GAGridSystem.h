@@ -0,0 +1,133 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "GAGridActor.h"
+#include "GAGridSystem.generated.h"
+
+
+// A link between a cell on the edge of one grid, and the adjacent cell on another grid
+USTRUCT(BlueprintType)
+struct FGAGridPortal
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	TObjectPtr<AGAGridActor> FromGrid;
+
+	UPROPERTY(BlueprintReadOnly)
+	FCellRef FromCell;
+
+	UPROPERTY(BlueprintReadOnly)
+	TObjectPtr<AGAGridActor> ToGrid;
+
+	UPROPERTY(BlueprintReadOnly)
+	FCellRef ToCell;
+
+	// World-space distance between the two cell centers
+	UPROPERTY(BlueprintReadOnly)
+	float Distance = 0.0f;
+};
+
+
+// Keeps track of all the grids in the world, for worlds that are split over several AGAGridActors.
+// - Finds the grid (and cell) under a world point, using a spatial hash of the grids' bounds
+// - Stitches neighboring grids together with portals: a portal links a cell along the edge of one grid to the
+//   adjacent cell of the grid next to it. Searches use them to cross from one grid to another.
+// Grids register themselves on BeginPlay. Like the perception system, this lives on the game mode.
+// If there's no grid system, everything falls back to the old "the one grid in the world" behavior.
+
+UCLASS(BlueprintType, Blueprintable, meta = (BlueprintSpawnableComponent))
+class UGAGridSystem : public UActorComponent
+{
+	GENERATED_UCLASS_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	TArray<TObjectPtr<AGAGridActor>> Grids;
+
+	bool RegisterGrid(AGAGridActor* Grid);
+	bool UnregisterGrid(AGAGridActor* Grid);
+
+	static UGAGridSystem* GetGridSystem(const UObject* WorldContextObject);
+
+	// The grid containing Location. Uses the grid system if there is one, otherwise looks for any grid in the world.
+	static AGAGridActor* FindGridActor(const UObject* WorldContextObject, const FVector& Location);
+
+	// Shared implementation of the components' GetGridActor(): returns Cache if Location is on it, otherwise finds
+	// the grid that Location is on (and updates Cache). If Location isn't on any grid, sticks with the cached one.
+	static AGAGridActor* ResolveGridActor(const UObject* WorldContextObject, const FVector& Location, TSoftObjectPtr<AGAGridActor>& Cache);
+
+
+	// Lookup --------------------------------
+
+	// The grid containing Point, or NULL
+	UFUNCTION(BlueprintCallable)
+	AGAGridActor* FindGrid(const FVector& Point) const;
+
+	// The grid and cell containing Point. Returns false if Point isn't on any grid.
+	UFUNCTION(BlueprintCallable)
+	bool ResolvePoint(const FVector& Point, AGAGridActor*& GridOut, FCellRef& CellOut) const;
+
+	// Size of the spatial hash buckets, in world units. Should be on the order of the size of a grid.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float HashBucketSize;
+
+
+	// Portals --------------------------------
+
+	// Two edge cells are only linked if their heights are this close
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float MaxPortalHeightDifference;
+
+	UPROPERTY(BlueprintReadOnly)
+	TArray<FGAGridPortal> Portals;
+
+	// Indices (into Portals) of all the portals leading out of Grid
+	const TArray<int32>& GetPortalsFrom(const AGAGridActor* Grid) const;
+
+	// The grid to head for next, to get from From to To. NULL if there's no route (or From == To).
+	AGAGridActor* GetNextGridTowards(const AGAGridActor* From, const AGAGridActor* To) const;
+
+	// Rebuild the hash and the portals. Call if a grid moves or is resized at runtime.
+	// (Grids call this themselves when they stream in or out.)
+	UFUNCTION(BlueprintCallable)
+	void RefreshGrids();
+
+
+	// Distance-based streaming --------------------------------
+	// If enabled, grids further than StreamOutDistance from every player pawn have their data unloaded, and are
+	// loaded back in when one comes within StreamInDistance (see AGAGridActor::UnloadData). Distances are to the
+	// nearest point of the grid's bounds, ignoring Z. Not needed under World Partition, which streams the grid
+	// actors themselves -- this is for other levels, and for testing.
+
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bStreamGrids;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float StreamInDistance;
+
+	// Should be a bit more than StreamInDistance, so grids on the boundary don't flip back and forth
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float StreamOutDistance;
+
+	// Total per-cell data currently in memory, over all grids
+	UFUNCTION(BlueprintCallable)
+	int64 GetResidentDataSize() const;
+
+private:
+	void RebuildHash();
+	void RebuildPortals();
+
+	// Link every edge cell of From to whatever cell of To is just across the edge
+	void StitchGrids(AGAGridActor* From, AGAGridActor* To);
+
+	FIntPoint GetBucket(const FVector2D& Point) const;
+
+	// Bucket -> indices of the grids overlapping it
+	TMap<FIntPoint, TArray<int32>> GridHash;
+
+	// Grid -> indices of the portals leading out of it
+	TMap<const AGAGridActor*, TArray<int32>> PortalsByGrid;
+};
@@ -1,6 +1,8 @@
 #include "GAPathComponent.h"
 #include "GameFramework/NavMovementComponent.h"
 #include "Kismet/GameplayStatics.h"
+#include "GameAI/Grid/GAGridSystem.h"
+#include "GameAI/Spatial/GAAgentSystem.h"
 
 
 UGAPathComponent::UGAPathComponent(const FObjectInitializer& ObjectInitializer)
@@ -9,6 +11,14 @@ UGAPathComponent::UGAPathComponent(const FObjectInitializer& ObjectInitializer)
 	State = GAPS_None;
 	bDestinationValid = false;
 	ArrivalDistance = 100.0f;
+	AgentRadius = 0.0f;
+	CorridorTolerance = 2;
+	StepReachedDistance = 50.0f;
+	ReplanCount = 0;
+	CorridorIndex = 0;
+	StepStartPoint = FVector::ZeroVector;
+	bReplanRequested = false;
+	GridSubscriptionId = 0;
 
 	// A bit of Unreal magic to make TickComponent below get called
 	PrimaryComponentTick.bCanEverTick = true;
@@ -17,27 +27,11 @@ UGAPathComponent::UGAPathComponent(const FObjectInitializer& ObjectInitializer)
 
 const AGAGridActor* UGAPathComponent::GetGridActor() const
 {
-	if (GridActor.Get())
-	{
-		return GridActor.Get();
-	}
-	else
-	{
-		AGAGridActor* Result = NULL;
-		AActor *GenericResult = UGameplayStatics::GetActorOfClass(this, AGAGridActor::StaticClass());
-		if (GenericResult)
-		{
-			Result = Cast<AGAGridActor>(GenericResult);
-			if (Result)
-			{
-				// Cache the result
-				// Note, GridActor is marked as mutable in the header, which is why this is allowed in a const method
-				GridActor = Result;
-			}
-		}
-
-		return Result;
-	}
+	// The grid under our pawn (there can be more than one grid in the world, see UGAGridSystem)
+	// Note, GridActor is marked as mutable in the header, which is why it can be updated in a const method
+	const AActor* Owner = GetOwnerPawn() ? GetOwnerPawn() : GetOwner();
+	FVector Location = Owner ? Owner->GetActorLocation() : FVector::ZeroVector;
+	return UGAGridSystem::ResolveGridActor(this, Location, GridActor);
 }
 
 APawn* UGAPathComponent::GetOwnerPawn() const
@@ -71,18 +65,27 @@ void UGAPathComponent::TickComponent(float DeltaTime, enum ELevelTick TickType,
 		return;
 	}
 
-	bool Valid = false;
-	if (bDestinationValid)
-	{
-		RefreshPath();
-		Valid = true;
-	}
-	else if (bDistanceMapPathValid)
-	{
-		Valid = true;
-	}
-	if (Valid)
+	if (bDestinationValid || bDistanceMapPathValid)
 	{
+		FVector Location = GetOwnerPawn()->GetActorLocation();
+
+		if (NeedsReplan(Location))
+		{
+			if (bDistanceMapPathValid)
+			{
+				// The distance map we built that path from is out of date, so just plan to the same place the usual way
+				bDistanceMapPathValid = false;
+				bDestinationValid = true;
+			}
+
+			RefreshPath();
+		}
+		else if (FVector::Dist(Location, Destination) <= ArrivalDistance)
+		{
+			// Yay! We got there!
+			State = GAPS_Finished;
+		}
+
 		if (State == GAPS_Active)
 		{
 			FollowPath();
@@ -107,6 +110,10 @@ EGAPathState UGAPathComponent::RefreshPath()
 
 	check(bDestinationValid);
 
+	bReplanRequested = false;
+	CorridorCells.Reset();
+	CorridorIndex = 0;
+
 	float DistanceToDestination = FVector::Dist(StartPoint, Destination);
 
 	if (DistanceToDestination <= ArrivalDistance)
@@ -120,7 +127,8 @@ EGAPathState UGAPathComponent::RefreshPath()
 		Steps.Empty();
 
 		// Replan the path!
-		State = AStar(StartPoint, UnsmoothedSteps);
+		ReplanCount++;
+		State = AStar(StartPoint, UnsmoothedSteps, AgentRadius);
 
 		// To debug A* without smoothing:
 		//Steps = UnsmoothedSteps;
@@ -131,13 +139,197 @@ EGAPathState UGAPathComponent::RefreshPath()
 		}
 	}
 
+	if (State == GAPS_Active)
+	{
+		StepStartPoint = StartPoint;
+		BuildCorridor(StartPoint);
+		SubscribeToGrid();
+	}
+	else
+	{
+		UnsubscribeFromGrid();
+	}
+
 	return State;
 }
 
 
+// Replanning --------------------------------
+
+void UGAPathComponent::RequestReplan()
+{
+	bReplanRequested = true;
+}
+
+bool UGAPathComponent::NeedsReplan(const FVector& Location)
+{
+	if (bReplanRequested || (State != GAPS_Active) || (Steps.Num() == 0))
+	{
+		// Note, this includes GAPS_Finished -- if we're still done, RefreshPath will say so without searching
+		return true;
+	}
+
+	const AGAGridActor* Grid = GetGridActor();
+	if ((Grid == NULL) || (Grid != SubscribedGrid.Get()))
+	{
+		return true;
+	}
+
+	return !AdvanceCorridor(Grid->GetCellRef(Location, true));
+}
+
+void UGAPathComponent::BuildCorridor(const FVector& StartPoint)
+{
+	CorridorCells.Reset();
+	CorridorIndex = 0;
+
+	const AGAGridActor* Grid = GetGridActor();
+	if (Grid == NULL)
+	{
+		return;
+	}
+
+	// Walk each segment of the path in half-cell increments
+	FVector SegmentStart = StartPoint;
+	for (const FPathStep& Step : Steps)
+	{
+		FVector2D P0, P1;
+		Grid->TransformPointToNormalizedGridSpace(SegmentStart, P0);
+		Grid->TransformPointToNormalizedGridSpace(Step.Point, P1);
+
+		int32 SampleCount = FMath::Max(FMath::CeilToInt32(FVector2D::Distance(P0, P1) * 2.0f), 1);
+		for (int32 Sample = 0; Sample <= SampleCount; Sample++)
+		{
+			FVector2D P = FMath::Lerp(P0, P1, float(Sample) / float(SampleCount));
+			FCellRef Cell(FMath::Clamp(FMath::FloorToInt32(P.X), 0, Grid->XCount - 1), FMath::Clamp(FMath::FloorToInt32(P.Y), 0, Grid->YCount - 1));
+			if ((CorridorCells.Num() == 0) || !(CorridorCells.Last() == Cell))
+			{
+				CorridorCells.Add(Cell);
+			}
+		}
+
+		SegmentStart = Step.Point;
+	}
+}
+
+bool UGAPathComponent::AdvanceCorridor(const FCellRef& Cell)
+{
+	for (int32 Index = CorridorIndex; Index < CorridorCells.Num(); Index++)
+	{
+		const FCellRef& CorridorCell = CorridorCells[Index];
+		if ((FMath::Abs(CorridorCell.X - Cell.X) <= CorridorTolerance) && (FMath::Abs(CorridorCell.Y - Cell.Y) <= CorridorTolerance))
+		{
+			CorridorIndex = Index;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int32 UGAPathComponent::GetCorridorMargin() const
+{
+	// Changes can affect us through the clearance field, so anything within our radius counts.
+	// Plus one cell, because a change right next to the path can change which way smoothing goes.
+	const AGAGridActor* Grid = GetGridActor();
+	float CellScale = Grid ? Grid->CellScale : 100.0f;
+	return FMath::CeilToInt32(AgentRadius / CellScale) + 1;
+}
+
+void UGAPathComponent::SubscribeToGrid()
+{
+	const AGAGridActor* Grid = GetGridActor();
+	if (Grid == NULL)
+	{
+		UnsubscribeFromGrid();
+		return;
+	}
+
+	if (Grid != SubscribedGrid.Get())
+	{
+		UnsubscribeFromGrid();
+	}
+
+	// Every region within the margin of any corridor cell
+	int32 Margin = GetCorridorMargin();
+	TArray<int32> Regions;
+	TArray<int32> CellRegions;
+	for (const FCellRef& Cell : CorridorCells)
+	{
+		CellRegions.Reset();
+		Grid->GetRegionsInBox(FGridBox(Cell.X - Margin, Cell.X + Margin, Cell.Y - Margin, Cell.Y + Margin), CellRegions);
+		for (int32 Region : CellRegions)
+		{
+			Regions.AddUnique(Region);
+		}
+	}
+
+	FGAGridChangeDispatcher& Dispatcher = Grid->GetChangeDispatcher();
+	if ((GridSubscriptionId == 0) || !Dispatcher.UpdateSubscription(GridSubscriptionId, Regions))
+	{
+		GridSubscriptionId = Dispatcher.Subscribe(Regions, FGARegionChangedDelegate::CreateUObject(this, &UGAPathComponent::OnGridRegionChanged));
+	}
+	SubscribedGrid = Grid;
+}
+
+void UGAPathComponent::UnsubscribeFromGrid()
+{
+	const AGAGridActor* Grid = SubscribedGrid.Get();
+	if (Grid)
+	{
+		Grid->GetChangeDispatcher().Unsubscribe(GridSubscriptionId);
+	}
+
+	SubscribedGrid.Reset();
+	GridSubscriptionId = 0;
+}
+
+void UGAPathComponent::OnGridRegionChanged(const FGridBox& DirtyBox)
+{
+	// Regions are coarse, so check whether the change actually comes near the part of the path we haven't walked yet
+	int32 Margin = GetCorridorMargin();
+	FGridBox Expanded(DirtyBox.MinX - Margin, DirtyBox.MaxX + Margin, DirtyBox.MinY - Margin, DirtyBox.MaxY + Margin);
+
+	for (int32 Index = CorridorIndex; Index < CorridorCells.Num(); Index++)
+	{
+		if (Expanded.IsValidCell(CorridorCells[Index]))
+		{
+			bReplanRequested = true;
+			return;
+		}
+	}
+}
+
+void UGAPathComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	UGAAgentSystem* AgentSystem = UGAAgentSystem::GetAgentSystem(this);
+	if (AgentSystem)
+	{
+		AgentSystem->RegisterAgent(this);
+	}
+}
+
+void UGAPathComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	UnsubscribeFromGrid();
+
+	UGAAgentSystem* AgentSystem = UGAAgentSystem::GetAgentSystem(this);
+	if (AgentSystem)
+	{
+		AgentSystem->UnregisterAgent(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+
+// Searches work in cell handles (see FGACellHandle). The outputs still want FCellRefs, which come from
+// AGAGridActor::HandleToCellRef as they're written.
 struct FCellRecord
 {
-	FCellRecord(const FCellRef& CellIn, const FCellRef &PrevCellIn, float CumulativeDistanceIn, float TotalScoreIn) : 
+	FCellRecord(const FGACellHandle& CellIn, const FGACellHandle& PrevCellIn, float CumulativeDistanceIn, float TotalScoreIn) :
 		Cell(CellIn), 
 		PreviousCell(PrevCellIn),
 		CumulativeDistance(CumulativeDistanceIn),
@@ -145,8 +337,8 @@ struct FCellRecord
 
 	FCellRecord() : Cell(), PreviousCell(), CumulativeDistance(0.0f), TotalScore(0.0f) {}
 
-	FCellRef Cell;
-	FCellRef PreviousCell;
+	FGACellHandle Cell;
+	FGACellHandle PreviousCell;
 	float CumulativeDistance;
 	float TotalScore;
 
@@ -156,7 +348,7 @@ struct FCellRecord
 	}
 };
 
-EGAPathState UGAPathComponent::AStar(const FVector &StartPoint, TArray<FPathStep> &StepsOut) const
+EGAPathState UGAPathComponent::AStar(const FVector &StartPoint, TArray<FPathStep> &StepsOut, float MinClearance) const
 {
 	const AGAGridActor* Grid = GetGridActor();
 	if (!Grid)
@@ -164,16 +356,71 @@ EGAPathState UGAPathComponent::AStar(const FVector &StartPoint, TArray<FPathStep
 		return GAPS_Invalid;
 	}
 
+	// If the destination is on another grid, we plan as far as the portals onto the next grid on the way there.
+	// Once we cross over, GetGridActor() changes, and we'll replan from there.
+	const AGAGridActor* TargetGrid = DestinationGrid.Get() ? DestinationGrid.Get() : Grid;
+	bool bCrossGrid = (TargetGrid != Grid);
+
+	const UGAGridSystem* GridSystem = NULL;
+	TMap<FGACellHandle, int32> GoalPortals;		// portal cell -> index into GridSystem->Portals
+
+	if (bCrossGrid)
+	{
+		GridSystem = UGAGridSystem::GetGridSystem(this);
+		const AGAGridActor* NextGrid = GridSystem ? GridSystem->GetNextGridTowards(Grid, TargetGrid) : NULL;
+		if (NextGrid == NULL)
+		{
+			return GAPS_Invalid;
+		}
+
+		for (int32 PortalIndex : GridSystem->GetPortalsFrom(Grid))
+		{
+			const FGAGridPortal& Portal = GridSystem->Portals[PortalIndex];
+			FGACellHandle FromHandle = Grid->CellRefToHandle(Portal.FromCell);
+			if ((Portal.ToGrid.Get() == NextGrid) && Portal.ToGrid->IsCellPassable(Portal.ToCell, MinClearance) && !GoalPortals.Contains(FromHandle))
+			{
+				GoalPortals.Add(FromHandle, PortalIndex);
+			}
+		}
+	}
+
+	FGACellHandle DestinationHandle = bCrossGrid ? FGACellHandle() : Grid->CellRefToHandle(DestinationCell);
+
+	auto IsGoal = [&](const FGACellHandle& Cell)
+	{
+		return bCrossGrid ? GoalPortals.Contains(Cell) : (Cell == DestinationHandle);
+	};
+
+	// Every step costs at least its length times this, so scaling the straight-line distance by it keeps the
+	// heuristic admissible
+	float HeuristicScale = Grid->GetMinCostMultiplier();
+
+	auto Heuristic = [&](const FGACellHandle& Handle, const FCellRef& Cell)
+	{
+		if (bCrossGrid)
+		{
+			// Straight-line distance to the final destination, in this grid's cells. This steers us to the portal
+			// that's best for the whole trip, rather than just the closest one.
+			return float(FVector2D::Distance(FVector2D(Grid->GetHandlePosition(Handle)), FVector2D(Destination))) / Grid->CellScale * HeuristicScale;
+		}
+		else
+		{
+			return Cell.Distance(DestinationCell) * HeuristicScale;
+		}
+	};
+
 	FCellRef StartCellRef = Grid->GetCellRef(StartPoint);
 	if (StartCellRef.IsValid())
 	{
 		TArray<FCellRecord> Heap;
-		TMap<FCellRef, FCellRecord> Closed;
+		TMap<FGACellHandle, FCellRecord> Closed;
+		TArray<FGACellStep, TInlineAllocator<8>> Neighbors;
 
-		float StartDistance = StartCellRef.Distance(DestinationCell);
+		FGACellHandle StartCell = Grid->CellRefToHandle(StartCellRef);
+		float StartDistance = Heuristic(StartCell, StartCellRef);
 
-		FCellRecord StartRecord(StartCellRef, FCellRef::Invalid, 0.0f, StartDistance);
-		Closed.Add(StartCellRef, StartRecord);
+		FCellRecord StartRecord(StartCell, FGACellHandle(), 0.0f, StartDistance);
+		Closed.Add(StartCell, StartRecord);
 
 		Heap.HeapPush(StartRecord);
 
@@ -185,7 +432,7 @@ EGAPathState UGAPathComponent::AStar(const FVector &StartPoint, TArray<FPathStep
 			// Close me!
 			Closed.Add(CurrentRecord.Cell, CurrentRecord);
 
-			if (CurrentRecord.Cell == DestinationCell)
+			if (IsGoal(CurrentRecord.Cell))
 			{
 				// We found our way! Hurray!
 				TArray<FCellRef> ReversePath;
@@ -193,7 +440,7 @@ EGAPathState UGAPathComponent::AStar(const FVector &StartPoint, TArray<FPathStep
 
 				while (CellRecord)
 				{
-					ReversePath.Add(CellRecord->Cell);
+					ReversePath.Add(Grid->HandleToCellRef(CellRecord->Cell));
 					CellRecord = Closed.Find(CellRecord->PreviousCell);
 				}
 
@@ -202,13 +449,23 @@ EGAPathState UGAPathComponent::AStar(const FVector &StartPoint, TArray<FPathStep
 				{
 					FPathStep Step;
 					Step.CellRef = ReversePath[StepIndex];
-					Step.Point = GridActor->GetCellPosition(Step.CellRef);
+					Step.Point = Grid->GetCellPosition(Step.CellRef);
 					StepsOut.Add(Step);
 				}
 
-				// minor tweak -- set the last cell position to the destination point, rather than the cell point
-				if (StepsOut.Num() > 0)
+				if (bCrossGrid)
+				{
+					// Finish with a step over the portal, onto the next grid
+					const FGAGridPortal& Portal = GridSystem->Portals[GoalPortals[CurrentRecord.Cell]];
+
+					FPathStep Step;
+					Step.CellRef = Portal.ToCell;
+					Step.Point = Portal.ToGrid->GetCellPosition(Portal.ToCell);
+					StepsOut.Add(Step);
+				}
+				else if (StepsOut.Num() > 0)
 				{
+					// minor tweak -- set the last cell position to the destination point, rather than the cell point
 					StepsOut.Last().Point = Destination;
 				}
 
@@ -216,19 +473,25 @@ EGAPathState UGAPathComponent::AStar(const FVector &StartPoint, TArray<FPathStep
 			}
 			else
 			{
-				TArray<FCellRef> Neighbors;
+				Neighbors.Reset();
+				Grid->GetPassableNeighbors(CurrentRecord.Cell, 0.0f, Neighbors);
 
-				Grid->GetNeighbors(CurrentRecord.Cell, true, Neighbors);
-
-				for (FCellRef& NCell : Neighbors)
+				for (const FGACellStep& NStep : Neighbors)
 				{
-					if (!Closed.Contains(NCell))
+					const FGACellHandle& NCell = NStep.Cell;
+
+					// Too tight for us -- unless it's where we're going
+					if ((MinClearance > 0.0f) && !IsGoal(NCell) && !Grid->IsHandlePassable(NCell, MinClearance))
 					{
-						int32 DX = FMath::Abs(CurrentRecord.Cell.X - NCell.X);
-						int32 DY = FMath::Abs(CurrentRecord.Cell.Y - NCell.Y);
+						continue;
+					}
 
-						float ParentD = ((DX > 0) && (DY > 0)) ? UE_SQRT_2 : 1.0f;
-						float H = NCell.Distance(DestinationCell);
+					if (!Closed.Contains(NCell))
+					{
+						// Cost of a step is its length times the average of the two cells' cost multipliers
+						float StepCost = 0.5f * (Grid->GetHandleCostMultiplier(CurrentRecord.Cell) + Grid->GetHandleCostMultiplier(NCell));
+						float ParentD = NStep.Length * StepCost;
+						float H = Heuristic(NCell, NStep.CellRef);
 						float TotalScore = CurrentRecord.CumulativeDistance + ParentD + H;
 
 						// See if it's already on the heap
@@ -268,10 +531,8 @@ EGAPathState UGAPathComponent::AStar(const FVector &StartPoint, TArray<FPathStep
 }
 
 
-bool UGAPathComponent::Dijkstra(const FVector& StartPoint, FGAGridMap& DistanceMapOut) const
+bool UGAPathComponent::Dijkstra(const FVector& StartPoint, FGAGridMap& DistanceMapOut, float MinClearance) const
 {
-	bool Result = false;
-
 	const AGAGridActor* Grid = GetGridActor();
 	if (!Grid)
 	{
@@ -281,38 +542,68 @@ bool UGAPathComponent::Dijkstra(const FVector& StartPoint, FGAGridMap& DistanceM
 	FCellRef StartCellRef = Grid->GetCellRef(StartPoint);
 	if (StartCellRef.IsValid())
 	{
-		FCellRecord StartRecord(StartCellRef, FCellRef::Invalid, 0.0f, 0.0f);
+		return DijkstraFromSeeds(Grid, { TPair<FCellRef, float>(StartCellRef, 0.0f) }, DistanceMapOut, MinClearance);
+	}
+
+	return false;
+}
+
+bool UGAPathComponent::DijkstraFromSeeds(const AGAGridActor* Grid, const TArray<TPair<FCellRef, float>>& Seeds, FGAGridMap& DistanceMapOut, float MinClearance)
+{
+	bool Result = false;
+
+	if (Grid && (Seeds.Num() > 0))
+	{
 		TArray<FCellRecord> Heap;
-		float DiagonalDistance = UE_SQRT_2 * Grid->CellScale;
+		TArray<FGACellStep, TInlineAllocator<8>> Neighbors;
+
+		// On a multi-layer grid, we need a distance for every layer, not just every column
+		if (Grid->HasLayers() && !DistanceMapOut.IsLayered())
+		{
+			DistanceMapOut.EnableLayers(FLT_MAX);
+		}
 
 		Result = true;
 
-		Heap.HeapPush(StartRecord);
+		for (const TPair<FCellRef, float>& Seed : Seeds)
+		{
+			FGACellHandle SeedCell = Grid->CellRefToHandle(Seed.Key);
+			if (SeedCell.IsValid())
+			{
+				Heap.HeapPush(FCellRecord(SeedCell, FGACellHandle(), Seed.Value, Seed.Value));
+			}
+		}
 
 		while (Heap.Num() > 0)
 		{
 			FCellRecord CurrentRecord;
 			Heap.HeapPop(CurrentRecord);
 
-			DistanceMapOut.SetValue(CurrentRecord.Cell, CurrentRecord.CumulativeDistance);
-
+			// With several seeds, the same cell can be pushed more than once. The first one out wins.
+			FCellRef CurrentCellRef = Grid->HandleToCellRef(CurrentRecord.Cell);
+			float ExistingDistance;
+			if (DistanceMapOut.GetValue(CurrentCellRef, ExistingDistance) && (ExistingDistance != FLT_MAX))
 			{
-				TArray<FCellRef> Neighbors;
+				continue;
+			}
 
-				Grid->GetNeighbors(CurrentRecord.Cell, true, Neighbors);
+			DistanceMapOut.SetValue(CurrentCellRef, CurrentRecord.CumulativeDistance);
+
+			{
+				Neighbors.Reset();
+				Grid->GetPassableNeighbors(CurrentRecord.Cell, MinClearance, Neighbors);
 
-				for (FCellRef& NCell : Neighbors)
+				for (const FGACellStep& NStep : Neighbors)
 				{
+					const FGACellHandle& NCell = NStep.Cell;
 					float CurrentDistanceInMap;
 
-					if (DistanceMapOut.GetValue(NCell, CurrentDistanceInMap))
+					if (DistanceMapOut.GetValue(NStep.CellRef, CurrentDistanceInMap))
 					{
 						if (CurrentDistanceInMap == FLT_MAX)
 						{
-							int32 DX = FMath::Abs(CurrentRecord.Cell.X - NCell.X);
-							int32 DY = FMath::Abs(CurrentRecord.Cell.Y - NCell.Y);
-
-							float ParentD = ((DX > 0) && (DY > 0)) ? DiagonalDistance : Grid->CellScale;
+							float StepCost = 0.5f * (Grid->GetHandleCostMultiplier(CurrentRecord.Cell) + Grid->GetHandleCostMultiplier(NCell));
+							float ParentD = NStep.Length * Grid->CellScale * StepCost;
 							float CumulativeDistance = CurrentRecord.CumulativeDistance + ParentD;
 							float TotalScore = CumulativeDistance;			// could also add penalties here
 
@@ -352,6 +643,65 @@ bool UGAPathComponent::Dijkstra(const FVector& StartPoint, FGAGridMap& DistanceM
 	return Result;
 }
 
+bool UGAPathComponent::DijkstraAcrossGrids(const FVector& StartPoint, TMap<const AGAGridActor*, FGAGridMap>& DistanceMapsOut, float MinClearance) const
+{
+	const AGAGridActor* StartGrid = GetGridActor();
+	if (!StartGrid)
+	{
+		return false;
+	}
+
+	FGAGridMap& StartMap = DistanceMapsOut.Add(StartGrid, FGAGridMap(StartGrid, FLT_MAX));
+	if (!Dijkstra(StartPoint, StartMap, MinClearance))
+	{
+		return false;
+	}
+
+	const UGAGridSystem* GridSystem = UGAGridSystem::GetGridSystem(this);
+	if (GridSystem == NULL)
+	{
+		return true;
+	}
+
+	// Breadth-first over the grids: seed each new grid through the portals from the grids we've already done
+	// Note, each grid is only visited once, so a route that leaves a grid and comes back into it won't improve
+	// on its distances. Good enough for grids laid out side by side.
+	TArray<const AGAGridActor*> Queue;
+	Queue.Add(StartGrid);
+
+	for (int32 QueueIndex = 0; QueueIndex < Queue.Num(); QueueIndex++)
+	{
+		const AGAGridActor* FromGrid = Queue[QueueIndex];
+		TMap<const AGAGridActor*, TMap<FCellRef, float>> SeedsByGrid;
+
+		for (int32 PortalIndex : GridSystem->GetPortalsFrom(FromGrid))
+		{
+			const FGAGridPortal& Portal = GridSystem->Portals[PortalIndex];
+			if (DistanceMapsOut.Contains(Portal.ToGrid.Get()) || !Portal.ToGrid->IsCellPassable(Portal.ToCell, MinClearance))
+			{
+				continue;
+			}
+
+			float FromDistance = FLT_MAX;
+			DistanceMapsOut[FromGrid].GetValue(Portal.FromCell, FromDistance);
+			if (FromDistance != FLT_MAX)
+			{
+				float& SeedDistance = SeedsByGrid.FindOrAdd(Portal.ToGrid.Get()).FindOrAdd(Portal.ToCell, FLT_MAX);
+				SeedDistance = FMath::Min(SeedDistance, FromDistance + Portal.Distance);
+			}
+		}
+
+		for (TPair<const AGAGridActor*, TMap<FCellRef, float>>& Pair : SeedsByGrid)
+		{
+			FGAGridMap& Map = DistanceMapsOut.Add(Pair.Key, FGAGridMap(Pair.Key, FLT_MAX));
+			DijkstraFromSeeds(Pair.Key, Pair.Value.Array(), Map, MinClearance);
+			Queue.Add(Pair.Key);
+		}
+	}
+
+	return true;
+}
+
 bool UGAPathComponent::BuidPathFromDistanceMap(const FVector& StartPoint, const FCellRef& EndCellRef, const FGAGridMap& DistanceMap)
 {
 	bool Result = false;
@@ -401,7 +751,8 @@ bool UGAPathComponent::BuidPathFromDistanceMap(const FVector& StartPoint, const
 
 				if (ND < D)
 				{
-					float TotalND = FVector::Dist(CurrentPosition, NeighborPosition) + ND;
+					float StepCost = 0.5f * (Grid->GetCellCostMultiplier(CurrentCell) + Grid->GetCellCostMultiplier(Neighbor));
+					float TotalND = FVector::Dist(CurrentPosition, NeighborPosition) * StepCost + ND;
 					if (TotalND < BestNeighborDistance)
 					{
 						BestNeighborDistance = TotalND;
@@ -444,7 +795,13 @@ bool UGAPathComponent::BuidPathFromDistanceMap(const FVector& StartPoint, const
 		{
 			Destination = EndPosition;
 			DestinationCell = EndCellRef;
+			DestinationGrid = Grid;
 			bDistanceMapPathValid = true;
+			bReplanRequested = false;
+
+			StepStartPoint = StartPoint;
+			BuildCorridor(StartPoint);
+			SubscribeToGrid();
 		}
 	}
 
@@ -474,7 +831,7 @@ EGAPathState UGAPathComponent::SmoothPath(const FVector& StartPoint, const TArra
 			FVector CellPoint = Grid->GetCellPosition(UnsmoothedSteps[StepIndex].CellRef);
 			FVector HitLocation;
 
-			if (Grid->TraceLine(LastPoint, CellPoint, HitLocation))
+			if (Grid->TraceLine(LastPoint, CellPoint, HitLocation, AgentRadius))
 			{
 				// we hit something
 				const FPathStep& StepToAdd = UnsmoothedSteps[StepIndex - 1];
@@ -511,7 +868,23 @@ void UGAPathComponent::FollowPath()
 		return;
 	}
 
-	// Always follow the first step, assuming that we are refreshing the whole path every tick
+	// Move on to the next step once we've reached this one, or gone past it
+	while (Steps.Num() > 1)
+	{
+		FVector2D ToStep(Steps[0].Point - StartPoint);
+		FVector2D Segment(Steps[0].Point - StepStartPoint);
+
+		bool bReached = ToStep.Size() <= StepReachedDistance;
+		bool bPassed = (Segment | ToStep) < 0.0f;
+		if (!bReached && !bPassed)
+		{
+			break;
+		}
+
+		StepStartPoint = Steps[0].Point;
+		Steps.RemoveAt(0);
+	}
+
 	FVector V = Steps[0].Point - StartPoint;
 	V.Normalize();
 
@@ -528,6 +901,10 @@ void UGAPathComponent::ClearPath()
 	bDistanceMapPathValid = false;
 	Steps.Empty();
 	State = GAPS_None;
+
+	CorridorCells.Empty();
+	CorridorIndex = 0;
+	UnsubscribeFromGrid();
 }
 
 EGAPathState UGAPathComponent::SetDestination(const FVector &DestinationPoint)
@@ -537,12 +914,19 @@ EGAPathState UGAPathComponent::SetDestination(const FVector &DestinationPoint)
 	State = GAPS_Invalid;
 	bDestinationValid = true;
 
-	const AGAGridActor* Grid = GetGridActor();
+	// Note, the destination may be on a different grid from the one we're on
+	const AGAGridActor* Grid = UGAGridSystem::FindGridActor(this, Destination);
+	if (Grid == NULL)
+	{
+		Grid = GetGridActor();
+	}
+
 	if (Grid)
 	{
 		FCellRef CellRef = Grid->GetCellRef(Destination);
 		if (CellRef.IsValid())
 		{
+			DestinationGrid = Grid;
 			DestinationCell = CellRef;
 			bDestinationValid = true;
 
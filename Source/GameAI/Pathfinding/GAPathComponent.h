@@ -68,9 +68,21 @@ class UGAPathComponent : public UActorComponent
 
 	EGAPathState RefreshPath();
 
-	EGAPathState AStar(const FVector& StartPoint, TArray<FPathStep>& StepsOut) const;
+	// MinClearance: only pass through cells at least this far from any obstacle (see AGAGridActor::ClearanceData)
+	// The destination cell itself is exempt, so we can still path right up to a wall.
+	// Both searches weight each step by the grid's traversal costs (AGAGridActor::CostData), so the distances
+	// Dijkstra writes into DistanceMapOut are cost-weighted path lengths, not plain ones.
+	EGAPathState AStar(const FVector& StartPoint, TArray<FPathStep>& StepsOut, float MinClearance = 0.0f) const;
 
-	bool Dijkstra(const FVector& StartPoint, FGAGridMap &DistanceMapOut) const;
+	bool Dijkstra(const FVector& StartPoint, FGAGridMap &DistanceMapOut, float MinClearance = 0.0f) const;
+
+	// Multi-source Dijkstra over the given grid: each seed is a cell and the distance it starts at.
+	// DistanceMapOut should be initialized to FLT_MAX. On a multi-layer grid, it's switched to a layered map.
+	static bool DijkstraFromSeeds(const AGAGridActor* Grid, const TArray<TPair<FCellRef, float>>& Seeds, FGAGridMap& DistanceMapOut, float MinClearance = 0.0f);
+
+	// Dijkstra from StartPoint that carries on through portals onto neighboring grids (see UGAGridSystem).
+	// Fills in one full-grid distance map per grid reached.
+	bool DijkstraAcrossGrids(const FVector& StartPoint, TMap<const AGAGridActor*, FGAGridMap>& DistanceMapsOut, float MinClearance = 0.0f) const;
 
 	bool BuidPathFromDistanceMap(const FVector& StartPoint, const FCellRef& CellRef, const FGAGridMap& DistanceMap);
 
@@ -80,12 +92,27 @@ class UGAPathComponent : public UActorComponent
 
 	void ClearPath();
 
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	// Parameters ------------------------
 
 	// When I'm within this distance of my destination, my path is considered finished.
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 	float ArrivalDistance;
 
+	// Radius of the agent following the path. Paths (and smoothing shortcuts) keep at least this far from obstacles.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float AgentRadius;
+
+	// How far (in cells) we can stray from our path's corridor before we consider ourselves off it, and replan
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	int32 CorridorTolerance;
+
+	// When we're within this distance of the step we're heading for (ignoring Z), we move on to the next one
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float StepReachedDistance;
+
 	// Destination ------------------------
 
 	UFUNCTION(BlueprintCallable)
@@ -103,6 +130,9 @@ class UGAPathComponent : public UActorComponent
 	UPROPERTY(BlueprintReadOnly)
 	FCellRef DestinationCell;
 
+	// The grid DestinationCell is on. Not necessarily the one we're on.
+	TWeakObjectPtr<const AGAGridActor> DestinationGrid;
+
 	UFUNCTION(BlueprintCallable)
 	float GetPathLength() const;
 
@@ -115,4 +145,49 @@ class UGAPathComponent : public UActorComponent
 	UPROPERTY(BlueprintReadWrite)
 	TArray<FPathStep> Steps;
 
+
+	// Replanning ------------------------
+	// We don't replan every tick. Once we have a path, we keep following it until either
+	//	- the grid changes near it (we subscribe to the grid regions the path crosses, see FGAGridChangeDispatcher), or
+	//	- we wander off its corridor (e.g. get pushed), or
+	//	- someone calls RequestReplan
+	// Note, this means we won't notice a *better* path opening up elsewhere (e.g. a door opening) until the next replan.
+
+	UFUNCTION(BlueprintCallable)
+	void RequestReplan();
+
+	// Number of times this component has (re)planned. Handy for checking the above is doing its job.
+	UPROPERTY(BlueprintReadOnly)
+	int32 ReplanCount;
+
+private:
+	bool NeedsReplan(const FVector& Location);
+
+	// Cells along the (smoothed) path we're following, from where we planned from to the destination
+	void BuildCorridor(const FVector& StartPoint);
+
+	// Move CorridorIndex up to the first corridor cell near Cell. Returns false if we're off the corridor.
+	bool AdvanceCorridor(const FCellRef& Cell);
+
+	// Subscribe to changes in the regions around the corridor
+	void SubscribeToGrid();
+	void UnsubscribeFromGrid();
+
+	void OnGridRegionChanged(const FGridBox& DirtyBox);
+
+	// Cells around the path that it depends on: grid changes closer than this (in cells) to it count
+	int32 GetCorridorMargin() const;
+
+	TArray<FCellRef> CorridorCells;
+	int32 CorridorIndex;
+
+	// Where the segment leading to Steps[0] starts
+	FVector StepStartPoint;
+
+	bool bReplanRequested;
+
+	// The grid (and subscription) we're subscribed to, if any
+	TWeakObjectPtr<const AGAGridActor> SubscribedGrid;
+	int32 GridSubscriptionId;
+
 };
\ No newline at end of file
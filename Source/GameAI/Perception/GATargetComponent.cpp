@@ -1,6 +1,8 @@
 #include "GATargetComponent.h"
 #include "Kismet/GameplayStatics.h"
 #include "GameAI/Grid/GAGridActor.h"
+#include "GameAI/Grid/GAGridMapT.h"
+#include "GameAI/Grid/GAGridSystem.h"
 #include "GAPerceptionSystem.h"
 //#include "IPropertyTable.h"
 #include "ProceduralMeshComponent.h"
@@ -24,26 +26,18 @@ UGATargetComponent::UGATargetComponent(const FObjectInitializer& ObjectInitializ
 
 AGAGridActor* UGATargetComponent::GetGridActor() const
 {
+	// Note, this is the grid the occupancy map lives on, so once we have one we stick with it.
+	// We only move to another grid when we're seen on it (see OccupancyMapSetPosition)
 	AGAGridActor* Result = GridActor.Get();
-	if (Result)
+	if (Result && Result->IsDataResident())
 	{
 		return Result;
 	}
 	else
 	{
-		AActor* GenericResult = UGameplayStatics::GetActorOfClass(this, AGAGridActor::StaticClass());
-		if (GenericResult)
-		{
-			Result = Cast<AGAGridActor>(GenericResult);
-			if (Result)
-			{
-				// Cache the result
-				// Note, GridActor is marked as mutable in the header, which is why this is allowed in a const method
-				GridActor = Result;
-			}
-		}
-
-		return Result;
+		AActor* Owner = GetOwner();
+		FVector Location = Owner ? Owner->GetActorLocation() : FVector::ZeroVector;
+		return UGAGridSystem::ResolveGridActor(this, Location, GridActor);
 	}
 }
 
@@ -58,11 +52,8 @@ void UGATargetComponent::OnRegister()
 		PerceptionSystem->RegisterTargetComponent(this);
 	}
 
-	const AGAGridActor* Grid = GetGridActor();
-	if (Grid)
-	{
-		OccupancyMap = FGAGridMap(Grid, 0.0f);
-	}
+	// Note, no omap yet: the grids may not have registered with the grid system at this point. It gets built on
+	// first use instead (see EnsureOccupancyMap).
 }
 
 void UGATargetComponent::OnUnregister()
@@ -82,6 +73,10 @@ void UGATargetComponent::TickComponent(float DeltaTime, enum ELevelTick TickType
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
+	// (Re)build the omap if need be. Without a grid there's nothing to track the target on, but the perception state
+	// below still gets updated.
+	EnsureOccupancyMap(GetGridActor());
+
 	bool isImmediate = false;
 
 	// update my perception state FSM
@@ -130,10 +125,14 @@ void UGATargetComponent::TickComponent(float DeltaTime, enum ELevelTick TickType
 
 	if (bDebugOccupancyMap)
 	{
+		// The omap's grid as of now -- being seen this tick may have moved it onto another one
 		AGAGridActor* Grid = GetGridActor();
-		Grid->DebugGridMap = OccupancyMap;
-		GridActor->RefreshDebugTexture();
-		GridActor->DebugMeshComponent->SetVisibility(true);
+		if (Grid)
+		{
+			Grid->DebugGridMap = OccupancyMap;
+			Grid->RefreshDebugTexture();
+			Grid->DebugMeshComponent->SetVisibility(true);
+		}
 	}
 }
 
@@ -141,7 +140,16 @@ void UGATargetComponent::TickComponent(float DeltaTime, enum ELevelTick TickType
 void UGATargetComponent::OccupancyMapSetPosition(const FVector& Position)
 {
 	const AGAGridActor* Grid = GetGridActor();
-	if (Grid)
+
+	// Seen on a different grid? Then the occupancy map moves over to that one.
+	AGAGridActor* PositionGrid = UGAGridSystem::FindGridActor(this, Position);
+	if (PositionGrid && (PositionGrid != Grid))
+	{
+		Grid = PositionGrid;
+		GridActor = PositionGrid;
+	}
+
+	if (EnsureOccupancyMap(Grid))
 	{
 		FCellRef CellRef = Grid->GetCellRef(Position);
 		if (CellRef.IsValid())
@@ -156,18 +164,36 @@ void UGATargetComponent::OccupancyMapSetPosition(const FVector& Position)
 }
 
 
+bool UGATargetComponent::EnsureOccupancyMap(const AGAGridActor* Grid)
+{
+	if (Grid == NULL)
+	{
+		return false;
+	}
+
+	if ((OccupancyGrid.Get() != Grid) || !OccupancyMap.IsValid() || (OccupancyMap.GridBounds != FGAGridMapLayout::FullGridBox(Grid)))
+	{
+		OccupancyMap = FGAGridMap(Grid, 0.0f);
+		OccupancyRegions.Reset();
+		OccupancyGrid = Grid;
+	}
+	return true;
+}
+
+
 void UGATargetComponent::OccupancyMapUpdate()
 {
 	
 	AActor* Owner = GetOwner();
 	FVector OwnerLocation = Owner->GetActorLocation();
 	const AGAGridActor* Grid = GetGridActor();
-	if (Grid)
+	if (EnsureOccupancyMap(Grid))
 	{
-		FGAGridMap VisibilityMap(Grid, 0.0f);
+		// Both of these are just yes/no per cell, so one bit per cell is plenty
+		FGAGridBitMap VisibilityMap(Grid, false);
 
 		// Similar to the visibility map, I need a sound map.
-		FGAGridMap SoundMap(Grid, 0.0f);
+		FGAGridBitMap SoundMap(Grid, false);
 		
 		float Offset = 50.0f;
 
@@ -192,26 +218,26 @@ void UGATargetComponent::OccupancyMapUpdate()
 				{
 					for (int32 X = VisibilityMap.GridBounds.MinX; X <= VisibilityMap.GridBounds.MaxX; X++)
 					{
-						float Value;
+						bool Value;
 						FCellRef Cell(X, Y);
 						// Note, don't bother re-testing if we already know the cell to be visible.
 						if (EnumHasAllFlags(Grid->GetCellData(Cell), ECellData::CellDataTraversable))
 						{
-							if (VisibilityMap.GetValue(Cell, Value) && (Value == 0.0f))
+							if (VisibilityMap.GetValue(Cell, Value) && !Value)
 							{
 								FVector CellPoint = Grid->GetCellPosition(Cell);
 								CellPoint.Z += Offset;
 								if (PerceptionComponent->HasClearLOS(Owner, CellPoint))
 								{
 									// it's visible!
-									VisibilityMap.SetValue(Cell, 1.0f);
+									VisibilityMap.SetValue(Cell, true);
 								}
 							}
 						}
 						else
 						{
 							// consider it visible if it's not traversable
-							VisibilityMap.SetValue(Cell, 1.0f);
+							VisibilityMap.SetValue(Cell, true);
 						}
 					}
 				}
@@ -225,35 +251,35 @@ void UGATargetComponent::OccupancyMapUpdate()
 			if (EnumHasAllFlags(Grid->GetCellData(ActualTargetCell), ECellData::CellDataTraversable))
 			{
 				// consider it not visible if the player is standing on it
-				VisibilityMap.SetValue(ActualTargetCell, 0.0f);
+				VisibilityMap.SetValue(ActualTargetCell, false);
 			}
 		}
 
 		// STEP 2: Clear out the probability in the visible cells
 		{
 			float TotalP = 0.0f;
+			int32 Width = OccupancyMap.GridBounds.GetWidth();
 
-			for (int32 Y = VisibilityMap.GridBounds.MinY; Y <= VisibilityMap.GridBounds.MaxY; Y++)
+			// The visibility map and the omap both cover the whole grid (see EnsureOccupancyMap), so their rows line up
+
+			for (int32 Y = OccupancyMap.GridBounds.MinY; Y <= OccupancyMap.GridBounds.MaxY; Y++)
 			{
-				for (int32 X = VisibilityMap.GridBounds.MinX; X <= VisibilityMap.GridBounds.MaxX; X++)
-				{
-					float Visible;
-					FCellRef Cell(X, Y);
+				int32 VisibleRowStart = VisibilityMap.GetLocalIndex(OccupancyMap.GridBounds.MinX, Y);
+				float* PRow = OccupancyMap.GetRowData(Y);
 
-					if (VisibilityMap.GetValue(Cell, Visible) && (Visible > 0.0f))
+				for (int32 LocalX = 0; LocalX < Width; LocalX++)
+				{
+					if (VisibilityMap.Get(VisibleRowStart + LocalX))
 					{
-						OccupancyMap.SetValue(Cell, 0.0f);
+						PRow[LocalX] = 0.0f;
 					}
 					else
 					{
-						float P;
-						if (OccupancyMap.GetValue(Cell, P))
-						{
-							TotalP += P;
-						}
+						TotalP += PRow[LocalX];
 					}
 				}
 			}
+			OccupancyMap.MarkDirty();
 
 			if (TotalP > 0.0f)
 			{
@@ -262,25 +288,8 @@ void UGATargetComponent::OccupancyMapUpdate()
 				FCellRef MaxCell;
 
 				// STEP 3: Renormalize the OMap, so that it's still a valid probability distribution
-				for (int32 Y = OccupancyMap.GridBounds.MinY; Y <= OccupancyMap.GridBounds.MaxY; Y++)
-				{
-					for (int32 X = OccupancyMap.GridBounds.MinX; X <= OccupancyMap.GridBounds.MaxX; X++)
-					{
-						float P;
-						FCellRef Cell(X, Y);
-
-						if (OccupancyMap.GetValue(Cell, P) && (P > 0.0f))
-						{
-							float NewP = P * NormFactor;
-							OccupancyMap.SetValue(Cell, NewP);
-							if (NewP > MaxP)
-							{
-								MaxP = NewP;
-								MaxCell = Cell;
-							}
-						}
-					}
-				}
+				OccupancyMap.Scale(NormFactor);
+				OccupancyMap.GetMaxCell(MaxCell, MaxP);
 
 				// STEP 4: Extract the highest-likelihood cell on the omap and refresh the LastKnownState.
 				// if (MaxCell.IsValid())
@@ -295,7 +304,6 @@ void UGATargetComponent::OccupancyMapUpdate()
 		// At this point, the occupancy map is a probability distribution of the visibility map. Now I need to add the sound map and remake it into a proper map
 		{
 			PerceptionSystem = UGAPerceptionSystem::GetPerceptionSystem(this);
-			FGAGridMap TempMap(Grid, 0.0f);
 			if (PerceptionSystem)
 			{
 				TArray<TObjectPtr<UGAPerceptionComponent>>& PerceptionComponents = PerceptionSystem->GetAllPerceptionComponents();
@@ -306,12 +314,12 @@ void UGATargetComponent::OccupancyMapUpdate()
 					{
 						for (int32 X = SoundMap.GridBounds.MinX; X <= SoundMap.GridBounds.MaxX; X++)
 						{
-							float Value;
+							bool Value;
 							FCellRef Cell(X, Y);
 							// Note, don't bother re-testing if we already know the cell is heard.
 							if (EnumHasAllFlags(Grid->GetCellData(Cell), ECellData::CellDataTraversable))
 							{
-								if (SoundMap.GetValue(Cell, Value) && (Value == 0.0f))
+								if (SoundMap.GetValue(Cell, Value) && !Value)
 								{
 									FVector CellPoint = Grid->GetCellPosition(Cell);
 									// UE_LOG(LogTemp, Display, TEXT("Before HeardPlayerMove"));
@@ -320,14 +328,14 @@ void UGATargetComponent::OccupancyMapUpdate()
 									{
 										// It can hear the player!
 										UE_LOG(LogTemp, Display, TEXT("HeardPlayerMove"));
-										SoundMap.SetValue(Cell, 1.0f);
+										SoundMap.SetValue(Cell, true);
 									}
 								}
 							}
 							else
 							{
 								// consider it has no sound if it's not traversable
-								SoundMap.SetValue(Cell, 0.0f);
+								SoundMap.SetValue(Cell, false);
 							}
 						}
 					}
@@ -335,46 +343,35 @@ void UGATargetComponent::OccupancyMapUpdate()
 
 				// At this point, we have the visibility map (in the occupancy map), and we have the soundmap. We need to add these and remake the result into a probability distribution.
 
-				float TotalValue = 0.0f;
-				float CurrentValue = 0.0f;
-				for (int32 Y = TempMap.GridBounds.MinY; Y <= TempMap.GridBounds.MaxY; Y++)
+				// OccupancyMap += SoundMap (again, same bounds)
+				int32 Width = OccupancyMap.GridBounds.GetWidth();
+
+				for (int32 Y = OccupancyMap.GridBounds.MinY; Y <= OccupancyMap.GridBounds.MaxY; Y++)
 				{
-					for (int32 X = TempMap.GridBounds.MinX; X <= TempMap.GridBounds.MaxX; X++)
-					{
-						float P;
-						FCellRef Cell(X, Y);
+					int32 SoundRowStart = SoundMap.GetLocalIndex(OccupancyMap.GridBounds.MinX, Y);
+					float* PRow = OccupancyMap.GetRowData(Y);
 
-						OccupancyMap.GetValue(Cell, P);
-						CurrentValue = P;
-						SoundMap.GetValue(Cell, P);
-						CurrentValue += P;
-						TotalValue += CurrentValue;
-						TempMap.SetValue(Cell, CurrentValue);
+					for (int32 LocalX = 0; LocalX < Width; LocalX++)
+					{
+						if (SoundMap.Get(SoundRowStart + LocalX))
+						{
+							PRow[LocalX] += 1.0f;
+						}
 					}
 				}
+				OccupancyMap.MarkDirty();
 
 				//Re-normalizing the Occupancy map
 				FCellRef MaxCell;
 				float MaxP = 0.0f;
-				for (int32 Y = TempMap.GridBounds.MinY; Y <= TempMap.GridBounds.MaxY; Y++)
+				if (OccupancyMap.Normalize())
 				{
-					for (int32 X = TempMap.GridBounds.MinX; X <= TempMap.GridBounds.MaxX; X++)
+					FCellRef Cell;
+					if (OccupancyMap.GetMaxCell(Cell, MaxP) && (MaxP > 0.0f))
 					{
-						float P;
-						FCellRef Cell(X, Y);
-
-						TempMap.GetValue(Cell, P);
-						float NewP = P / TotalValue;
-
-						OccupancyMap.SetValue(Cell, NewP);
-						if (NewP > MaxP)
-						{
-							MaxP = NewP;
-							MaxCell = Cell;
-						}
+						MaxCell = Cell;
 					}
 				}
-	
 
 				if (MaxCell.IsValid())
 				{
@@ -391,10 +388,8 @@ void UGATargetComponent::OccupancyMapUpdate()
 void UGATargetComponent::OccupancyMapDiffuse(float DeltaTime)
 {
 	const AGAGridActor* Grid = GetGridActor();
-	if (Grid)
+	if (EnsureOccupancyMap(Grid))
 	{
-		FGAGridMap ScratchMap(Grid, 0.0f);
-
 		// TODO PART 4
 		// Diffuse the probability in the OMAP
 
@@ -405,59 +400,49 @@ void UGATargetComponent::OccupancyMapDiffuse(float DeltaTime)
 		float Alpha = DiffusionRate / (4.0f + 4.0f / UE_SQRT_2);
 		float DiagonalAlpha = Alpha / UE_SQRT_2;
 
-		for (int32 Y = OccupancyMap.GridBounds.MinY; Y <= OccupancyMap.GridBounds.MaxY; Y++)
+		// Rather than scattering each cell's probability out to its neighbors, we gather: each cell keeps whatever
+		// it doesn't give away, and (if it's traversable) receives a share from each of its 8 neighbors.
+		// Gathering means each output cell is written exactly once, so the rows can be processed in parallel.
+		// Padding both the omap and the traversability mask with a 1-cell halo of 0 (= "off the grid, not traversable")
+		// lets the 3x3 stencil run without any bounds checks.
+
+		FGAGridMap TraversableMap(Grid, OccupancyMap.GridBounds, 0.0f);
+		int32 MinX = OccupancyMap.GridBounds.MinX;
+		TraversableMap.ForEachRow([Grid, MinX](int32 Y, TArrayView<float> Row)
 		{
-			for (int32 X = OccupancyMap.GridBounds.MinX; X <= OccupancyMap.GridBounds.MaxX; X++)
+			for (int32 LocalX = 0; LocalX < Row.Num(); LocalX++)
 			{
-				FCellRef Cell(X, Y);
-				float P;
+				Row[LocalX] = EnumHasAllFlags(Grid->GetCellData(FCellRef(MinX + LocalX, Y)), ECellData::CellDataTraversable) ? 1.0f : 0.0f;
+			}
+		});
 
-				// Only do anything if I have probability to diffuse
-				if (OccupancyMap.GetValue(Cell, P) && (P > 0.0f))
-				{
-					float AdjacentD = Alpha * P;
-					float DiagonalD = DiagonalAlpha * P;
-					float TotalPDiffused = 0.0f;
+		FGAGridMapHalo P(OccupancyMap, 1, 0.0f);
+		FGAGridMapHalo T(TraversableMap, 1, 0.0f);
 
-					for (int32 DY = -1; DY <= 1; DY++)
-					{
-						for (int32 DX = -1; DX <= 1; DX++)
-						{
-							if ((DX != 0) || (DY != 0))
-							{
-								FCellRef NeighborCell(X + DX, Y + DY);
-								if (Grid->IsValidCell(NeighborCell))
-								{
-									if (EnumHasAllFlags(Grid->GetCellData(NeighborCell), ECellData::CellDataTraversable))
-									{
-										float NP;
-										if (ScratchMap.GetValue(NeighborCell, NP))
-										{
-											bool Adjacent = (DX == 0) || DY == 0;
-											float D = Adjacent ? AdjacentD : DiagonalD;
-											NP += D;
-											TotalPDiffused += D;
-
-											ScratchMap.SetValue(NeighborCell, NP);
-										}
-									}
-								}
-							}
-						}
-					}
+		OccupancyMap.ForEachRow([&P, &T, Alpha, DiagonalAlpha](int32 Y, TArrayView<float> Row)
+		{
+			const float* PAbove = P.GetRowData(Y - 1);
+			const float* PCenter = P.GetRowData(Y);
+			const float* PBelow = P.GetRowData(Y + 1);
+			const float* TAbove = T.GetRowData(Y - 1);
+			const float* TCenter = T.GetRowData(Y);
+			const float* TBelow = T.GetRowData(Y + 1);
+
+			for (int32 X = 0; X < Row.Num(); X++)
+			{
+				// Fraction of my probability I give away (only traversable neighbors receive any)
+				float Given =
+					Alpha * (TAbove[X] + TBelow[X] + TCenter[X - 1] + TCenter[X + 1]) +
+					DiagonalAlpha * (TAbove[X - 1] + TAbove[X + 1] + TBelow[X - 1] + TBelow[X + 1]);
 
-					float SP;
-					if (ScratchMap.GetValue(Cell, SP))
-					{
-						// Remember to also give my future self the remaining P that was not diffused
-						ScratchMap.SetValue(Cell, SP + (P - TotalPDiffused));
-					}
-				}
-			}
-		}
+				// What my neighbors give me
+				float Received =
+					Alpha * (PAbove[X] + PBelow[X] + PCenter[X - 1] + PCenter[X + 1]) +
+					DiagonalAlpha * (PAbove[X - 1] + PAbove[X + 1] + PBelow[X - 1] + PBelow[X + 1]);
 
-		// Finally, copy the results from the scratch map to the occupancy map
-		OccupancyMap.Data = ScratchMap.Data;
+				Row[X] = PCenter[X] * (1.0f - Given) + TCenter[X] * Received;
+			}
+		}, true);
 	}
 }
 
@@ -3,6 +3,7 @@
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
 #include "GameAI/Grid/GAGridMap.h"
+#include "GameAI/Grid/GAGridMapRegions.h"
 #include "GATargetComponent.generated.h"
 
 
@@ -68,6 +69,9 @@ class UGATargetComponent : public UActorComponent
 	UPROPERTY(BlueprintReadOnly, EditAnywhere)
 	bool bDebugOccupancyMap;
 
+	// Region queries over the occupancy map (rebuilt lazily whenever the map changes)
+	FGAGridMapRegionCache OccupancyRegions;
+
 
 	// Cached pointer to the grid actor
 	UPROPERTY()
@@ -85,6 +89,22 @@ class UGATargetComponent : public UActorComponent
 	UFUNCTION(BlueprintCallable)
 	AGAGridActor *GetGridActor() const;
 
+	// Total probability that the target is somewhere in the given box
+	UFUNCTION(BlueprintCallable)
+	float GetOccupancyInBox(const FGridBox& Box) const
+	{
+		return OccupancyRegions.GetSum(OccupancyMap, Box);
+	}
+
+	// Highest single-cell probability in the given box
+	UFUNCTION(BlueprintCallable)
+	float GetMaxOccupancyInBox(const FGridBox& Box) const
+	{
+		float MaxP = 0.0f;
+		OccupancyRegions.GetMax(OccupancyMap, Box, MaxP);
+		return MaxP;
+	}
+
 	// Return TRUE if at least ONE AI has reach Awareness == 1 for this target
 	bool IsKnown() const
 	{
@@ -107,4 +127,12 @@ class UGATargetComponent : public UActorComponent
 
 	void HidePlayer();
 
+private:
+	// Make sure the omap is on Grid and covers the whole of it, (re)building it empty if not. False if there's no grid.
+	bool EnsureOccupancyMap(const AGAGridActor* Grid);
+
+	// The grid OccupancyMap was built on. GetGridActor can move on to another one (e.g. when ours streams out), and
+	// then the omap has to start over.
+	TWeakObjectPtr<const AGAGridActor> OccupancyGrid;
+
 };
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "GAAgentSystem.h"
+#include "GameAI/Pathfinding/GAPathComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "GameFramework/GameModeBase.h"
+
+
+UGAAgentSystem::UGAAgentSystem(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	HashBucketSize = 1000.0f;
+
+	// Snapshot before the agents (and their spatial queries) tick
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.TickGroup = TG_PrePhysics;
+}
+
+
+bool UGAAgentSystem::RegisterAgent(UGAPathComponent* PathComponent)
+{
+	if (PathComponent == NULL)
+	{
+		return false;
+	}
+
+	PathComponents.AddUnique(PathComponent);
+	return true;
+}
+
+bool UGAAgentSystem::UnregisterAgent(UGAPathComponent* PathComponent)
+{
+	return PathComponents.Remove(PathComponent) > 0;
+}
+
+UGAAgentSystem* UGAAgentSystem::GetAgentSystem(const UObject* WorldContextObject)
+{
+	UGAAgentSystem* Result = NULL;
+	AGameModeBase* GameMode = UGameplayStatics::GetGameMode(WorldContextObject);
+	if (GameMode)
+	{
+		Result = GameMode->GetComponentByClass<UGAAgentSystem>();
+	}
+
+	return Result;
+}
+
+
+void UGAAgentSystem::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	RefreshAgents();
+}
+
+void UGAAgentSystem::RefreshAgents()
+{
+	PathComponents.RemoveAll([](const TObjectPtr<UGAPathComponent>& PathComponent) { return PathComponent == NULL; });
+
+	Agents.Reset();
+	AgentHash.Reset();
+
+	for (UGAPathComponent* PathComponent : PathComponents)
+	{
+		APawn* Pawn = PathComponent->GetOwnerPawn();
+		if (Pawn == NULL)
+		{
+			continue;
+		}
+
+		FGAAgentRecord& Record = Agents.AddDefaulted_GetRef();
+		Record.Pawn = Pawn;
+		Record.Position = Pawn->GetActorLocation();
+
+		// Note, this is the only place GetPathLength gets called for everyone, and it's once a frame
+		if (PathComponent->State == GAPS_Active)
+		{
+			Record.CommittedPosition = PathComponent->Destination;
+			Record.CommittedDistance = PathComponent->GetPathLength();
+		}
+		else
+		{
+			Record.CommittedPosition = Record.Position;
+			Record.CommittedDistance = 0.0f;
+		}
+
+		AgentHash.FindOrAdd(GetBucket(Record.CommittedPosition)).Add(Agents.Num() - 1);
+	}
+}
+
+
+// Queries --------------------------------
+
+FIntPoint UGAAgentSystem::GetBucket(const FVector& Point) const
+{
+	return FIntPoint(FMath::FloorToInt32(Point.X / HashBucketSize), FMath::FloorToInt32(Point.Y / HashBucketSize));
+}
+
+void UGAAgentSystem::GetAgentsInRadius(const FVector& Center, float Radius, TArray<int32>& AgentIndicesOut) const
+{
+	FIntPoint MinBucket = GetBucket(Center - FVector(Radius, Radius, 0.0f));
+	FIntPoint MaxBucket = GetBucket(Center + FVector(Radius, Radius, 0.0f));
+	float RadiusSquared = Radius * Radius;
+
+	for (int32 Y = MinBucket.Y; Y <= MaxBucket.Y; Y++)
+	{
+		for (int32 X = MinBucket.X; X <= MaxBucket.X; X++)
+		{
+			const TArray<int32>* Bucket = AgentHash.Find(FIntPoint(X, Y));
+			if (Bucket)
+			{
+				for (int32 AgentIndex : *Bucket)
+				{
+					if (FVector::DistSquared(Agents[AgentIndex].CommittedPosition, Center) <= RadiusSquared)
+					{
+						AgentIndicesOut.Add(AgentIndex);
+					}
+				}
+			}
+		}
+	}
+}
+
+int32 UGAAgentSystem::FindNearestAgent(const FVector& Point, float MaxDistance, const APawn* IgnorePawn) const
+{
+	int32 Result = INDEX_NONE;
+	float BestDistanceSquared = MaxDistance * MaxDistance;
+
+	// Search outwards one ring of buckets at a time, and stop once the ring is further away than the best so far
+	int32 MaxRing = FMath::CeilToInt32(MaxDistance / HashBucketSize);
+	FIntPoint CenterBucket = GetBucket(Point);
+
+	for (int32 Ring = 0; Ring <= MaxRing; Ring++)
+	{
+		float RingDistance = float(FMath::Max(Ring - 1, 0)) * HashBucketSize;
+		if ((Result != INDEX_NONE) && (RingDistance * RingDistance > BestDistanceSquared))
+		{
+			break;
+		}
+
+		for (int32 Y = CenterBucket.Y - Ring; Y <= CenterBucket.Y + Ring; Y++)
+		{
+			for (int32 X = CenterBucket.X - Ring; X <= CenterBucket.X + Ring; X++)
+			{
+				// Only the edge of the ring -- we've done the inside already
+				if ((FMath::Abs(X - CenterBucket.X) != Ring) && (FMath::Abs(Y - CenterBucket.Y) != Ring))
+				{
+					continue;
+				}
+
+				const TArray<int32>* Bucket = AgentHash.Find(FIntPoint(X, Y));
+				if (Bucket)
+				{
+					for (int32 AgentIndex : *Bucket)
+					{
+						const FGAAgentRecord& Agent = Agents[AgentIndex];
+						float DistanceSquared = FVector::DistSquared(Agent.CommittedPosition, Point);
+						if ((Agent.Pawn != IgnorePawn) && (DistanceSquared <= BestDistanceSquared))
+						{
+							BestDistanceSquared = DistanceSquared;
+							Result = AgentIndex;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return Result;
+}
+
+void UGAAgentSystem::GetCommittedPositions(TArray<FVector>& PositionsOut, TArray<float>& DistancesOut, const APawn* IgnorePawn, const AActor* IgnoreActor) const
+{
+	PositionsOut.Reserve(PositionsOut.Num() + Agents.Num());
+	DistancesOut.Reserve(DistancesOut.Num() + Agents.Num());
+
+	for (const FGAAgentRecord& Agent : Agents)
+	{
+		if ((Agent.Pawn != IgnorePawn) && (Agent.Pawn != IgnoreActor))
+		{
+			PositionsOut.Add(Agent.CommittedPosition);
+			DistancesOut.Add(Agent.CommittedDistance);
+		}
+	}
+}
+
+void UGAAgentSystem::GetCommittedPositionsInBox(const FBox2D& Box, TArray<FVector>& PositionsOut, TArray<float>& DistancesOut, const APawn* IgnorePawn, const AActor* IgnoreActor) const
+{
+	FIntPoint MinBucket = GetBucket(FVector(Box.Min, 0.0f));
+	FIntPoint MaxBucket = GetBucket(FVector(Box.Max, 0.0f));
+
+	auto AddAgent = [&](const FGAAgentRecord& Agent)
+	{
+		if ((Agent.Pawn != IgnorePawn) && (Agent.Pawn != IgnoreActor) && Box.IsInsideOrOn(FVector2D(Agent.CommittedPosition)))
+		{
+			PositionsOut.Add(Agent.CommittedPosition);
+			DistancesOut.Add(Agent.CommittedDistance);
+		}
+	};
+
+	// A box bigger than the whole hash is quicker to do by just going through everyone
+	int64 NumBuckets = int64(MaxBucket.X - MinBucket.X + 1) * int64(MaxBucket.Y - MinBucket.Y + 1);
+	if (NumBuckets > int64(AgentHash.Num()))
+	{
+		for (const FGAAgentRecord& Agent : Agents)
+		{
+			AddAgent(Agent);
+		}
+		return;
+	}
+
+	for (int32 Y = MinBucket.Y; Y <= MaxBucket.Y; Y++)
+	{
+		for (int32 X = MinBucket.X; X <= MaxBucket.X; X++)
+		{
+			const TArray<int32>* Bucket = AgentHash.Find(FIntPoint(X, Y));
+			if (Bucket)
+			{
+				for (int32 AgentIndex : *Bucket)
+				{
+					AddAgent(Agents[AgentIndex]);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "GAAgentSystem.generated.h"
+
+class UGAPathComponent;
+class APawn;
+
+
+// Where one agent is this frame, and where it's committed to going
+USTRUCT(BlueprintType)
+struct FGAAgentRecord
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	TObjectPtr<APawn> Pawn;
+
+	UPROPERTY(BlueprintReadOnly)
+	FVector Position = FVector::ZeroVector;
+
+	// The agent's destination if it's following a path, otherwise just Position
+	UPROPERTY(BlueprintReadOnly)
+	FVector CommittedPosition = FVector::ZeroVector;
+
+	// How far the agent still has to go to get to CommittedPosition (0 if it isn't moving)
+	UPROPERTY(BlueprintReadOnly)
+	float CommittedDistance = 0.0f;
+};
+
+
+// Keeps track of all the AI agents (anything with a UGAPathComponent) in the world, for queries about where the other
+// agents are. Once a frame it snapshots every agent's position and committed destination, and buckets the committed
+// positions into a uniform spatial hash, so the queries never have to go looking for actors or walk anyone's path.
+// Path components register themselves on BeginPlay. Like the perception system, this lives on the game mode.
+
+UCLASS(BlueprintType, Blueprintable, meta = (BlueprintSpawnableComponent))
+class UGAAgentSystem : public UActorComponent
+{
+	GENERATED_UCLASS_BODY()
+
+	bool RegisterAgent(UGAPathComponent* PathComponent);
+	bool UnregisterAgent(UGAPathComponent* PathComponent);
+
+	static UGAAgentSystem* GetAgentSystem(const UObject* WorldContextObject);
+
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Re-snapshot the agents and rebuild the hash. Happens every tick anyway.
+	UFUNCTION(BlueprintCallable)
+	void RefreshAgents();
+
+	// Size of the spatial hash buckets, in world units. Around the typical query radius works well.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float HashBucketSize;
+
+	// As of the last refresh
+	UPROPERTY(BlueprintReadOnly)
+	TArray<FGAAgentRecord> Agents;
+
+
+	// Queries --------------------------------
+	// These all go by CommittedPosition, i.e. where the agents will be, not where they are
+
+	// Indices into Agents of the agents committed to within Radius of Center
+	void GetAgentsInRadius(const FVector& Center, float Radius, TArray<int32>& AgentIndicesOut) const;
+
+	// Index into Agents of the agent committed closest to Point (ignoring IgnorePawn), or INDEX_NONE if there are none
+	// within MaxDistance
+	UFUNCTION(BlueprintCallable)
+	int32 FindNearestAgent(const FVector& Point, float MaxDistance, const APawn* IgnorePawn = NULL) const;
+
+	// Everyone's committed positions and distances, as parallel arrays, leaving out IgnorePawn and IgnoreActor
+	void GetCommittedPositions(TArray<FVector>& PositionsOut, TArray<float>& DistancesOut, const APawn* IgnorePawn = NULL, const AActor* IgnoreActor = NULL) const;
+
+	// The same, but only for the agents committed to somewhere inside Box (in X and Y)
+	void GetCommittedPositionsInBox(const FBox2D& Box, TArray<FVector>& PositionsOut, TArray<float>& DistancesOut, const APawn* IgnorePawn = NULL, const AActor* IgnoreActor = NULL) const;
+
+private:
+	FIntPoint GetBucket(const FVector& Point) const;
+
+	UPROPERTY()
+	TArray<TObjectPtr<UGAPathComponent>> PathComponents;
+
+	// Bucket -> indices into Agents
+	TMap<FIntPoint, TArray<int32>> AgentHash;
+};
@@ -0,0 +1,174 @@
+#include "GASpatialEvaluator.h"
+#include "GASpatialComponent.h"
+#include "Misc/AutomationTest.h"
+
+UE_DISABLE_OPTIMIZATION
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Coarse to fine (GASpatialKernels::SelectCoarseToFine, with UGASpatialComponent's default block size and K) against
+// an exhaustive search, over the same seeded score fields every run: a 64x64 box with a fifth of its cells
+// unreachable, scored by a handful of peaks of different heights and widths -- some of them only a few cells across,
+// which is what coarse to fine can miss.
+
+namespace GASpatialCoarseToFineTest
+{
+	static const int32 BoxSize = 64;
+	static const int32 NumPeaks = 8;
+
+	struct FPeak
+	{
+		float X, Y, Height, Sigma;
+	};
+
+	static void MakeCandidates(FRandomStream& Random, FGASpatialCandidates& CandidatesOut)
+	{
+		CandidatesOut.Reset();
+		CandidatesOut.Bounds = FGridBox(0, BoxSize - 1, 0, BoxSize - 1);
+		for (int32 Y = 0; Y < BoxSize; Y++)
+		{
+			for (int32 X = 0; X < BoxSize; X++)
+			{
+				if (Random.FRand() < 0.2f)
+				{
+					continue;
+				}
+
+				CandidatesOut.MapIndices.Add(Y * BoxSize + X);
+				CandidatesOut.PositionX.Add(float(X) * 100.0f);
+				CandidatesOut.PositionY.Add(float(Y) * 100.0f);
+				CandidatesOut.PositionZ.Add(0.0f);
+				CandidatesOut.PathDistance.Add(0.0f);
+			}
+		}
+		CandidatesOut.Scores.SetNumZeroed(CandidatesOut.Num());
+		CandidatesOut.LayerValues.SetNumZeroed(CandidatesOut.Num());
+	}
+
+	static void MakePeaks(FRandomStream& Random, TArray<FPeak>& PeaksOut)
+	{
+		PeaksOut.Reset();
+		for (int32 Peak = 0; Peak < NumPeaks; Peak++)
+		{
+			FPeak& NewPeak = PeaksOut.AddDefaulted_GetRef();
+			NewPeak.X = Random.FRandRange(0.0f, float(BoxSize));
+			NewPeak.Y = Random.FRandRange(0.0f, float(BoxSize));
+			NewPeak.Height = Random.FRandRange(0.5f, 1.0f);
+			NewPeak.Sigma = Random.FRandRange(2.0f, 5.0f);
+		}
+	}
+
+	static void Score(const TArray<FPeak>& Peaks, FGASpatialCandidates& Candidates)
+	{
+		for (int32 Candidate = 0; Candidate < Candidates.Num(); Candidate++)
+		{
+			FCellRef Cell = Candidates.GetCellRef(Candidate);
+			float Score = 0.0f;
+			for (const FPeak& Peak : Peaks)
+			{
+				float DistanceSquared = FMath::Square(float(Cell.X) - Peak.X) + FMath::Square(float(Cell.Y) - Peak.Y);
+				Score += Peak.Height * FMath::Exp(-DistanceSquared / (2.0f * Peak.Sigma * Peak.Sigma));
+			}
+			Candidates.Scores[Candidate] = Score;
+		}
+	}
+
+	// First best, in row order, like ChoosePosition
+	static int32 ArgMax(const FGASpatialCandidates& Candidates)
+	{
+		int32 Best = INDEX_NONE;
+		for (int32 Candidate = 0; Candidate < Candidates.Num(); Candidate++)
+		{
+			if ((Best == INDEX_NONE) || (Candidates.Scores[Candidate] > Candidates.Scores[Best]))
+			{
+				Best = Candidate;
+			}
+		}
+		return Best;
+	}
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGACoarseToFineTest, "GameAI.Spatial.CoarseToFine", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FGACoarseToFineTest::RunTest(const FString& Parameters)
+{
+	using namespace GASpatialCoarseToFineTest;
+
+	// What the regression is measured against. Exhaustive search always matches itself, so anything less than this
+	// means the block selection has got worse.
+	const int32 NumQueries = 100;
+	const float MinMatchRate = 0.9f;
+	const float MaxRefinedFraction = 0.1f;
+
+	const UGASpatialComponent* Defaults = GetDefault<UGASpatialComponent>();
+	int32 BlockSize = Defaults->CoarseBlockSize;
+	int32 TopK = Defaults->CoarseTopK;
+
+	FRandomStream Random(12345);
+	FGASpatialCandidates Candidates;
+	TArray<FPeak> Peaks;
+	TArray<int32> FineIndices;
+	TArray<float> CoarseScores;
+	int32 Matches = 0;
+	double RefinedFraction = 0.0;
+
+	for (int32 Query = 0; Query < NumQueries; Query++)
+	{
+		MakeCandidates(Random, Candidates);
+		MakePeaks(Random, Peaks);
+
+		// A random cell to keep, as if it had been chosen last time
+		FCellRef KeepCell = Candidates.GetCellRef(Random.RandHelper(Candidates.Num()));
+
+		GASpatialKernels::SelectCoarseToFine(Candidates, BlockSize, TopK, KeepCell,
+			[&Peaks](FGASpatialCandidates& Coarse) { Score(Peaks, Coarse); }, FineIndices, CoarseScores);
+
+		FGASpatialCandidates Exhaustive = Candidates;
+		Score(Peaks, Exhaustive);
+		FCellRef ExhaustiveCell = Exhaustive.GetCellRef(ArgMax(Exhaustive));
+
+		FGASpatialCandidates Fine;
+		Fine.Select(Candidates, FineIndices);
+		Score(Peaks, Fine);
+		int32 FineBest = ArgMax(Fine);
+		if ((FineBest != INDEX_NONE) && (Fine.GetCellRef(FineBest) == ExhaustiveCell))
+		{
+			Matches++;
+		}
+		RefinedFraction += double(FineIndices.Num()) / double(Candidates.Num());
+
+		bool bKept = false;
+		for (int32 Index = 0; Index < FineIndices.Num(); Index++)
+		{
+			bKept |= (Candidates.GetCellRef(FineIndices[Index]) == KeepCell);
+			if ((Index > 0) && (FineIndices[Index] <= FineIndices[Index - 1]))
+			{
+				AddError(FString::Printf(TEXT("Query %d: refined candidates out of order"), Query));
+				break;
+			}
+		}
+		TestTrue(FString::Printf(TEXT("Query %d: the kept cell's block is refined"), Query), bKept);
+		TestTrue(FString::Printf(TEXT("Query %d: at most %d blocks refined"), Query, TopK + 1), FineIndices.Num() <= (TopK + 1) * BlockSize * BlockSize);
+	}
+
+	float MatchRate = float(Matches) / float(NumQueries);
+	float MeanRefinedFraction = float(RefinedFraction / double(NumQueries));
+	AddInfo(FString::Printf(TEXT("Coarse to fine (%dx%d blocks, top %d) matched %d of %d queries, refining %.1f%% of the cells"),
+		BlockSize, BlockSize, TopK, Matches, NumQueries, 100.0f * MeanRefinedFraction));
+
+	TestTrue(FString::Printf(TEXT("Match rate %.2f, at least %.2f"), MatchRate, MinMatchRate), MatchRate >= MinMatchRate);
+	TestTrue(FString::Printf(TEXT("Refined %.3f of the cells, at most %.3f"), MeanRefinedFraction, MaxRefinedFraction), MeanRefinedFraction <= MaxRefinedFraction);
+
+	// If the coarse pass drops everything (and there's nothing to keep), there's nothing to refine
+	MakeCandidates(Random, Candidates);
+	GASpatialKernels::SelectCoarseToFine(Candidates, BlockSize, TopK, FCellRef::Invalid,
+		[](FGASpatialCandidates& Coarse) { Coarse.Reset(); }, FineIndices, CoarseScores);
+	TestEqual(TEXT("Everything dropped: nothing refined"), FineIndices.Num(), 0);
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
+
+UE_ENABLE_OPTIMIZATION
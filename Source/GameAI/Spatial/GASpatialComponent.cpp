@@ -1,44 +1,53 @@
 #include "GASpatialComponent.h"
 #include "GameAI/Pathfinding/GAPathComponent.h"
 #include "GameAI/Grid/GAGridMap.h"
+#include "GameAI/Grid/GAGridSystem.h"
 #include "Kismet/GameplayStatics.h"
 #include "Math/MathFwd.h"
 #include "GASpatialFunction.h"
+#include "GASpatialEvaluator.h"
+#include "GAAgentSystem.h"
+#include "GATacticalCache.h"
+#include "GASpatialScheduler.h"
 #include "ProceduralMeshComponent.h"
 #include "GameAI/Perception/GAPerceptionComponent.h"
+#include "Algo/StableSort.h"
 
 UE_DISABLE_OPTIMIZATION
 
+// Line of sight is checked from this far above each cell
+static const FVector LOSEyeOffset(0.0f, 0.0f, 60.0f);
+
 UGASpatialComponent::UGASpatialComponent(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
 	SampleDimensions = 8000.0f;		// should cover the bulk of the test map
+	bBranchAndBound = true;
+	BranchAndBoundBatchSize = 64;
+	LastPrunedCandidates = 0;
+	bCoarseToFine = false;
+	CoarseBlockSize = 4;
+	CoarseTopK = 16;
+	CoarseMinCandidates = 1024;
+	LastCoarseSkippedCandidates = 0;
+	AsyncTraceTimeoutSeconds = 1.0f;
+	AnytimeChunkSize = 256;
+	AnytimeBudgetMicroseconds = 500.0f;
+
+	// Only ticks while a query is in flight: an asynchronous one waiting on traces, or an anytime one with no
+	// scheduler to advance it
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
 }
 
 
 const AGAGridActor* UGASpatialComponent::GetGridActor() const
 {
-	AGAGridActor* Result = GridActor.Get();
-	if (Result)
-	{
-		return Result;
-	}
-	else
-	{
-		AActor* GenericResult = UGameplayStatics::GetActorOfClass(this, AGAGridActor::StaticClass());
-		if (GenericResult)
-		{
-			Result = Cast<AGAGridActor>(GenericResult);
-			if (Result)
-			{
-				// Cache the result
-				// Note, GridActor is marked as mutable in the header, which is why this is allowed in a const method
-				GridActor = Result;
-			}
-		}
-
-		return Result;
-	}
+	// The grid under our pawn (there can be more than one grid in the world, see UGAGridSystem)
+	// Note, GridActor is marked as mutable in the header, which is why it can be updated in a const method
+	const AActor* Owner = GetOwnerPawn() ? GetOwnerPawn() : GetOwner();
+	FVector Location = Owner ? Owner->GetActorLocation() : FVector::ZeroVector;
+	return UGAGridSystem::ResolveGridActor(this, Location, GridActor);
 }
 
 UGAPathComponent* UGASpatialComponent::GetPathComponent() const
@@ -109,18 +118,59 @@ AActor* UGASpatialComponent::GetTargetData(FTargetCache &TargetCacheOut) const
 
 bool UGASpatialComponent::ChoosePosition(bool PathfindToPosition, bool Debug)
 {
-	bool Result = false;
+	FGASpatialQuery Query;
+	if (!BeginQuery(Query, PathfindToPosition, Debug))
+	{
+		return false;
+	}
+
+	if (bCoarseToFine)
+	{
+		CoarseToFine(Query);
+	}
+
+	// Step 2: For each layer in the spatial function, evaluate and accumulate the layer
+	EvaluatePlan(*Query.SpatialFunction, Query.Plan, Query.Candidates, bBranchAndBound);
+
+	return FinishQuery(Query);
+}
+
+void UGASpatialComponent::EvaluatePlan(const UGASpatialFunction& SpatialFunction, const TArray<FGASpatialPlanStep>& Plan, FGASpatialCandidates& Candidates, bool bAllowBranchAndBound)
+{
+	// In the order the function's compiled plan says, which may put masks first, and fuse layers together
+	for (int32 StepIndex = 0; StepIndex < Plan.Num(); StepIndex++)
+	{
+		const FGASpatialPlanStep& Step = Plan[StepIndex];
+		if (bAllowBranchAndBound && IsExpensiveStep(SpatialFunction, Step) && BranchAndBound(SpatialFunction, Plan, StepIndex, Candidates))
+		{
+			// That took care of the rest of the plan
+			break;
+		}
+
+		EvaluateStep(SpatialFunction, Step, Candidates);
+	}
+}
+
+bool UGASpatialComponent::BeginQuery(FGASpatialQuery& Query, bool PathfindToPosition, bool Debug)
+{
 	const APawn* OwnerPawn = GetOwnerPawn();
 	if (OwnerPawn == NULL)
 	{
 		return false;
 	}
 
+	return BeginQueryAt(Query, OwnerPawn->GetActorLocation(), PathfindToPosition, Debug);
+}
+
+bool UGASpatialComponent::BeginQueryAt(FGASpatialQuery& Query, const FVector& StartLocation, bool PathfindToPosition, bool Debug)
+{
 	const AGAGridActor* Grid = GetGridActor();
 	UGAPathComponent* PathComponentPtr = GetPathComponent();
 
 	FCellRef LastCell = BestCell;
 	BestCell = FCellRef::Invalid;
+	LastPrunedCandidates = 0;
+	LastCoarseSkippedCandidates = 0;
 
 	if (Grid == NULL)
 	{
@@ -154,127 +204,387 @@ bool UGASpatialComponent::ChoosePosition(bool PathfindToPosition, bool Debug)
 
 	FBox2D Box(EForceInit::ForceInit);
 	FIntRect CellRect;
-	FVector StartLocation = OwnerPawn->GetActorLocation();
 	FVector2D PawnLocation(StartLocation);
 	Box += PawnLocation;
 	Box = Box.ExpandBy(SampleDimensions / 2.0f);
-	if (GridActor->GridSpaceBoundsToRect2D(Box, CellRect))
+	if (!GridActor->GridSpaceBoundsToRect2D(Box, CellRect))
 	{
-		// Super annoying, by the way, that FIntRect is not blueprint accessible, because it forces us instead
-		// to make a separate bp-accessible FStruct that represents _exactly the same thing_.
-		FGridBox GridBox(CellRect);
+		return false;
+	}
 
-		// This is the grid map I'm going to fill with values
-		FGAGridMap GridMap(Grid, GridBox, 0.0f);
+	// Super annoying, by the way, that FIntRect is not blueprint accessible, because it forces us instead
+	// to make a separate bp-accessible FStruct that represents _exactly the same thing_.
+	FGridBox GridBox(CellRect);
 
-		// Fill in this distance map using Dijkstra!
-		FGAGridMap DistanceMap(Grid, GridBox, FLT_MAX);
+	Query.SpatialFunction = SpatialFunction;
+	Query.Plan = SpatialFunction->GetPlan();
+	Query.bPathfindToPosition = PathfindToPosition;
+	Query.bDebug = Debug;
+	Query.StartLocation = StartLocation;
+	Query.LastCell = LastCell;
 
+	// This is the grid map I'm going to fill with values
+	Query.GridMap = FGAGridMap(Grid, GridBox, 0.0f);
 
-		// ~~~ STEPS TO FILL IN FOR ASSIGNMENT 3 ~~~
+	// Fill in this distance map using Dijkstra!
+	Query.DistanceMap = FGAGridMap(Grid, GridBox, FLT_MAX);
 
+	// Step 1: Run Dijkstra's to determine which cells we should even be evaluating (the GATHER phase)
+	PathComponentPtr->Dijkstra(StartLocation, Query.DistanceMap, PathComponentPtr->AgentRadius);
 
-		// Step 1: Run Dijkstra's to determine which cells we should even be evaluating (the GATHER phase)
-		// (You should add a Dijkstra() function to the UGAPathComponent())
-		// I would recommend adding a method to the path component which looks something like
-		PathComponentPtr->Dijkstra(StartLocation, DistanceMap);
+	// Give the last best cell a bonus
+	Query.GridMap.SetValue(LastCell, SpatialFunction->LastCellBonus);
 
-		// Give the last best cell a bonus
-		GridMap.SetValue(LastCell, SpatialFunction->LastCellBonus);
+	// Only the accessible cells found in step 1 get evaluated, so gather them up once, along with everything
+	// the layers need to know about them
+	Query.Candidates.Gather(*Grid, Query.DistanceMap);
+	Query.Candidates.LoadScores(Query.GridMap);
 
-		// Step 2: For each layer in the spatial function, evaluate and accumulate the layer in GridMap
-		// Note, only evaluate accessible cells found in step 1
-		for (const FFunctionLayer& Layer : SpatialFunction->Layers)
+	return true;
+}
+
+bool UGASpatialComponent::FinishQuery(FGASpatialQuery& Query)
+{
+	bool Result = false;
+	UGAPathComponent* PathComponentPtr = GetPathComponent();
+
+	// Step 3: pick the best cell
+
+	{
+		float BestScore;
+		int32 BestCandidate = GAGridKernels::ArgMax(Query.Candidates.Scores.GetData(), Query.Candidates.Num(), BestScore);
+		if (BestCandidate != INDEX_NONE)
 		{
-			// figure out how to evaluate each layer type, and accumulate the value in the GridMap
-			EvaluateLayer(Layer, DistanceMap, GridMap);
+			BestCell = Query.Candidates.GetCellRef(BestCandidate);
+			Result = true;
 		}
+	}
 
-		// Step 3: pick the best cell in GridMap
+	// Only the debug view and blueprints look at the map itself
+	Query.Candidates.StoreScores(Query.GridMap);
 
+	if (Query.bPathfindToPosition && PathComponentPtr)
+	{
+		if (BestCell.IsValid())
+		{
+			// Step 4: Go there!
+			PathComponentPtr->BuidPathFromDistanceMap(Query.StartLocation, BestCell, Query.DistanceMap);
+		}
+		else
 		{
-			float BestScore = -FLT_MAX;
+			PathComponentPtr->ClearPath();
+		}
+	}
 
-			for (int32 Y = GridMap.GridBounds.MinY; Y <= GridMap.GridBounds.MaxY; Y++)
-			{
-				for (int32 X = GridMap.GridBounds.MinX; X <= GridMap.GridBounds.MaxX; X++)
-				{
-					FCellRef CellRef(X, Y);
-					float D;
+	if (Query.bDebug && GridActor.Get())
+	{
+		// Note: this outputs (basically) the results of the position selection
+		// However, you can get creative with the debugging here. For example, maybe you want
+		// to be able to examine the values of a specific layer in the spatial function
+		// You could create a separate debug map above (where you're doing the evaluations) and
+		// cache it off for debug rendering. Ideally you'd be able to control what layer you wanted to 
+		// see from blueprint
+
+		GridActor->DebugGridMap = Query.GridMap;
+		GridActor->RefreshDebugTexture();
+		GridActor->DebugMeshComponent->SetVisibility(true);		//cheeky!
+	}
 
-					DistanceMap.GetValue(CellRef, D);
+	return Result;
+}
 
-					if (D < FLT_MAX)
-					{
-						float V;
 
-						GridMap.GetValue(CellRef, V);
+// Asynchronous queries --------------------------------
 
-						if (V > BestScore)
-						{
-							BestScore = V;
-							BestCell = CellRef;
-							Result = true;
-						}
-					}
-				}
-			}
-		}
+bool UGASpatialComponent::ChoosePositionAsync(bool PathfindToPosition, bool Debug)
+{
+	if (ActiveQuery.IsValid())
+	{
+		// One at a time
+		return false;
+	}
+
+	TUniquePtr<FGASpatialQuery> Query = MakeUnique<FGASpatialQuery>();
+	if (!BeginQuery(*Query, PathfindToPosition, Debug))
+	{
+		return false;
+	}
+
+	ActiveQuery = MoveTemp(Query);
+	AdvanceQuery();
+	return true;
+}
+
+void UGASpatialComponent::CancelQuery()
+{
+	// Any traces still in flight just finish with nobody listening
+	ActiveQuery.Reset();
+	SetComponentTickEnabled(false);
+}
 
-		if (PathfindToPosition)
+void UGASpatialComponent::AdvanceQuery()
+{
+	FGASpatialQuery& Query = *ActiveQuery;
+	const TArray<FFunctionLayer>& Layers = Query.SpatialFunction->Layers;
+
+	while (Query.NextStep < Query.Plan.Num())
+	{
+		const FGASpatialPlanStep& Step = Query.Plan[Query.NextStep];
+		const FFunctionLayer& Layer = Layers[Step.Layers[0]];
+		if (Step.bFused)
+		{
+			EvaluateFusedLayers(*Query.SpatialFunction, Step, Query.Candidates);
+		}
+		else if (IsPhysicsLOSLayer(Layer) && (Query.PendingTraces.Num() == 0) && SampleCachedLayer(Layer, Query.Candidates, false))
+		{
+			// Someone else already traced all of it this frame
+			AccumulateLayer(Layer, Query.Candidates);
+		}
+		else if (IsPhysicsLOSLayer(Layer))
 		{
-			if (BestCell.IsValid())
+			if (Query.PendingTraces.Num() == 0)
 			{
-				// Step 4: Go there!
-				// This will involve reconstructing the path and then getting it into the UGAPathComponent
-				// Depending on what your cached Dijkstra data looks like, the path reconstruction might be implemented here
-				// or in the UGAPathComponent
-
-				PathComponentPtr->BuidPathFromDistanceMap(StartLocation, BestCell, DistanceMap);
+				if (bBranchAndBound)
+				{
+					// No point tracing for cells that can't win
+					PruneByBounds(*Query.SpatialFunction, Query.Plan, Query.NextStep, Query.Candidates);
+				}
+				Query.TraceStartTime = GetWorld()->GetRealTimeSeconds();
+				SubmitLOSTraces(Query);
+				if (Query.PendingTraces.Num() > 0)
+				{
+					// Come back for them once the physics scene has run them
+					SetComponentTickEnabled(true);
+					return;
+				}
 			}
-			else
+			else if (!CollectLOSTraces(Query))
 			{
-				PathComponentPtr->ClearPath();
+				return;
 			}
+
+			AccumulateLayer(Layer, Query.Candidates);
+		}
+		else
+		{
+			EvaluateLayer(Layer, Query.Candidates);
+		}
+
+		Query.NextStep++;
+	}
+
+	// Done. Note, clear ActiveQuery first, so listeners can start another one.
+	TUniquePtr<FGASpatialQuery> FinishedQuery = MoveTemp(ActiveQuery);
+	SetComponentTickEnabled(false);
+
+	bool bSuccess = FinishQuery(*FinishedQuery);
+	OnPositionChosen.Broadcast(bSuccess, BestCell);
+}
+
+bool UGASpatialComponent::IsPhysicsLOSLayer(const FFunctionLayer& Layer)
+{
+	return (Layer.Input == SI_LOS) && (Layer.LOSMethod == SL_PhysicsTrace);
+}
+
+void UGASpatialComponent::SubmitLOSTraces(FGASpatialQuery& Query) const
+{
+	UWorld* World = GetWorld();
+	FTargetCache TargetData;
+	AActor* TargetActor = GetTargetData(TargetData);
+
+	FCollisionQueryParams Params;
+	Params.AddIgnoredActor(TargetActor);
+	Params.AddIgnoredActor(GetOwnerPawn());
+
+	FGASpatialCandidates& Candidates = Query.Candidates;
+	Query.PendingTraces.SetNum(Candidates.Num());
+
+	for (int32 Candidate = 0; Candidate < Candidates.Num(); Candidate++)
+	{
+		FVector Start = Candidates.GetPosition(Candidate) + LOSEyeOffset;
+		Query.PendingTraces[Candidate] = World->AsyncLineTraceByChannel(EAsyncTraceType::Test, Start, TargetData.Position, ECollisionChannel::ECC_Visibility, Params);
+	}
+}
+
+bool UGASpatialComponent::CollectLOSTraces(FGASpatialQuery& Query) const
+{
+	UWorld* World = GetWorld();
+	float* Values = Query.Candidates.LayerValues.GetData();
+	FTraceDatum Datum;
+	bool bTimedOut = (World->GetRealTimeSeconds() - Query.TraceStartTime) > AsyncTraceTimeoutSeconds;
+
+	// The whole batch runs together, so if the last one is done they all are
+	if (!World->QueryTraceData(Query.PendingTraces.Last(), Datum))
+	{
+		if (World->IsTraceHandleValid(Query.PendingTraces.Last(), false) && !bTimedOut)
+		{
+			// Not run yet
+			return false;
+		}
+		else if (!bTimedOut)
+		{
+			// The results were there last frame, and we missed them. Send the whole batch out again.
+			SubmitLOSTraces(Query);
+			return false;
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("%s: line of sight traces timed out, treating %d cells as blocked"), *GetNameSafe(GetOwner()), Query.PendingTraces.Num());
+		}
+	}
+
+	for (int32 Candidate = 0; Candidate < Query.PendingTraces.Num(); Candidate++)
+	{
+		if (World->QueryTraceData(Query.PendingTraces[Candidate], Datum))
+		{
+			Values[Candidate] = (Datum.OutHits.Num() > 0) ? 0.0f : 1.0f;
 		}
+		else
+		{
+			// Lost or timed out. Call it blocked, like a hit.
+			Values[Candidate] = 0.0f;
+		}
+	}
+
+	Query.PendingTraces.Reset();
+	return true;
+}
+
+void UGASpatialComponent::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-		
-		if (Debug)
+	if (!ActiveQuery.IsValid())
+	{
+		SetComponentTickEnabled(false);
+	}
+	else if (ActiveQuery->bAnytime)
+	{
+		// (Scheduled queries don't tick us, but just in case)
+		if (!ActiveQuery->bScheduled)
 		{
-			// Note: this outputs (basically) the results of the position selection
-			// However, you can get creative with the debugging here. For example, maybe you want
-			// to be able to examine the values of a specific layer in the spatial function
-			// You could create a separate debug map above (where you're doing the evaluations) and
-			// cache it off for debug rendering. Ideally you'd be able to control what layer you wanted to 
-			// see from blueprint
-			
-			GridActor->DebugGridMap = GridMap;
-			GridActor->RefreshDebugTexture();
-			GridActor->DebugMeshComponent->SetVisibility(true);		//cheeky!
+			StepQuery(FPlatformTime::Seconds() + double(AnytimeBudgetMicroseconds) * 1.0e-6);
 		}
 	}
+	else
+	{
+		AdvanceQuery();
+	}
+}
 
-	return Result;
+void UGASpatialComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	CancelQuery();
+	Super::EndPlay(EndPlayReason);
 }
 
 
-void UGASpatialComponent::EvaluateLayer(const FFunctionLayer& Layer, const FGAGridMap &DistanceMap, FGAGridMap &GridMap) const
+void UGASpatialComponent::EvaluateLayer(const FFunctionLayer& Layer, FGASpatialCandidates& Candidates, bool bFillCache) const
 {
 	UWorld* World = GetWorld();
 	AActor* OwnerPawn = GetOwnerPawn();
-	const AGAGridActor* Grid = GetGridActor();
 	FTargetCache TargetData;
 	AActor* TargetActor = GetTargetData(TargetData);
 	FVector TargetPosition = TargetData.Position;
-	FVector Offset(0.0f, 0.0f, 60.0f);
 
-	TArray<FVector> AllyPositions;
-	TArray<float> AllyDistances;
+	int32 NumCandidates = Candidates.Num();
+	float* Values = Candidates.LayerValues.GetData();
+
+	if (Layer.Op == SO_Normalize)
+	{
+		// Doesn't have an input to speak of
+		GASpatialKernels::Normalize(Candidates.Scores.GetData(), NumCandidates);
+		return;
+	}
 
-	if (Layer.Input == SI_AllyDistance)
+	// Layers that come out the same for everyone are shared through the tactical cache, if there is one
+	if (SampleCachedLayer(Layer, Candidates, bFillCache))
 	{
+		AccumulateLayer(Layer, Candidates);
+		return;
+	}
+
+	// First the input, for every candidate at once
+	switch (Layer.Input)
+	{
+	case SI_None:
+		GAGridKernels::Fill(Values, NumCandidates, 0.0f);
+		break;
+	case SI_TargetRange:
+		GASpatialKernels::DistanceToPoint(Candidates, TargetPosition, Values);
+		break;
+	case SI_PathDistance:
+		FMemory::Memcpy(Values, Candidates.PathDistance.GetData(), NumCandidates * sizeof(float));
+		break;
+	case SI_LOS:
+	{
+		const AGAGridActor* Grid = GetGridActor();
+		FCollisionQueryParams Params;
+		Params.AddIgnoredActor(TargetActor);		// Probably want to ignore the target actor
+		Params.AddIgnoredActor(OwnerPawn);			// Probably want to ignore the AI themself
+
+		for (int32 Candidate = 0; Candidate < NumCandidates; Candidate++)
+		{
+			FVector Start = Candidates.GetPosition(Candidate) + LOSEyeOffset;
+			bool bHitSomething;
+
+			switch (Layer.LOSMethod)
+			{
+			case SL_Heightfield:
+			{
+				FVector HitLocation;
+				bHitSomething = Grid->TraceHeightfield(Start, TargetPosition, HitLocation);
+				break;
+			}
+			case SL_GridTrace:
+			{
+				FVector HitLocation;
+				bHitSomething = Grid->TraceLine(Start, TargetPosition, HitLocation);
+				break;
+			}
+			default:
+			{
+				FHitResult HitResult;
+				bHitSomething = World->LineTraceSingleByChannel(HitResult, Start, TargetPosition, ECollisionChannel::ECC_Visibility, Params);
+				break;
+			}
+			}
+
+			Values[Candidate] = bHitSomething ? 0.0f : 1.0f;
+		}
+		break;
+	}
+	case SI_AllyDistance:
+	{
+		TArray<FVector> AllyPositions;
+		TArray<float> AllyDistances;
+
+		UGAAgentSystem* AgentSystem = UGAAgentSystem::GetAgentSystem(this);
+		if (AgentSystem)
+		{
+			// Already worked out for this frame. With a baked curve, anyone further than its last key from every
+			// candidate comes out the same as nobody at all, so only the agents near the candidates need looking at.
+			const FGACurveLUT& LUT = Layer.ResponseLUT;
+			float MinX, MaxX, MinY, MaxY;
+			if (LUT.IsBuilt() && !LUT.IsIdentity() &&
+				GAGridKernels::MinMax(Candidates.PositionX.GetData(), NumCandidates, MinX, MaxX) &&
+				GAGridKernels::MinMax(Candidates.PositionY.GetData(), NumCandidates, MinY, MaxY))
+			{
+				FBox2D Box(FVector2D(MinX, MinY), FVector2D(MaxX, MaxY));
+				AgentSystem->GetCommittedPositionsInBox(Box.ExpandBy(FMath::Max(LUT.MaxTime, 0.0f)), AllyPositions, AllyDistances, Cast<APawn>(OwnerPawn), TargetActor);
+			}
+			else
+			{
+				AgentSystem->GetCommittedPositions(AllyPositions, AllyDistances, Cast<APawn>(OwnerPawn), TargetActor);
+			}
+		}
+
+		// No agent system, so go and find everyone ourselves
 		TArray<AActor *> Actors;
-		UGameplayStatics::GetAllActorsOfClass(World, APawn::StaticClass(), Actors);
+		if (AgentSystem == NULL)
+		{
+			UGameplayStatics::GetAllActorsOfClass(World, APawn::StaticClass(), Actors);
+		}
 
 		for (AActor* Actor : Actors)
 		{
@@ -292,9 +602,6 @@ void UGASpatialComponent::EvaluateLayer(const FFunctionLayer& Layer, const FGAGr
 					UGAPathComponent *OtherPathComponent = Controller->GetComponentByClass<UGAPathComponent>();
 					if (OtherPathComponent)
 					{
-						FVector Position;
-						float D;
-
 						// Keep track of where our allies are -- but note that if they are headed towards a
 						// destination (according to their path component) we use THAT as the ally position, 
 						// rather than their current position.
@@ -302,137 +609,572 @@ void UGASpatialComponent::EvaluateLayer(const FFunctionLayer& Layer, const FGAGr
 
 						if (OtherPathComponent->State == GAPS_Active)
 						{
-							Position = OtherPathComponent->Destination;
-							D = OtherPathComponent->GetPathLength();
+							AllyPositions.Add(OtherPathComponent->Destination);
+							AllyDistances.Add(OtherPathComponent->GetPathLength());
 						}
 						else
 						{
-							Position = Pawn->GetActorLocation();
-							D = 0.0f;
+							AllyPositions.Add(Pawn->GetActorLocation());
+							AllyDistances.Add(0.0f);
 						}
-						AllyPositions.Add(Position);
-						AllyDistances.Add(D);
 					}
 				}
 			}
 		}
+
+		// The distance to the closest ally
+		// HOWEVER ... if we are (path) closer to a cell than THEY are to THEIR destination
+		// we are allowed to disregard them, since we would get their first, and they can deal 
+		// with us instead.
+		GASpatialKernels::MinDistanceToCloserPoints(Candidates, AllyPositions, AllyDistances, Values);
+		break;
 	}
+	};
 
+	AccumulateLayer(Layer, Candidates);
+}
 
-	for (int32 Y = GridMap.GridBounds.MinY; Y <= GridMap.GridBounds.MaxY; Y++)
+bool UGASpatialComponent::SampleCachedLayer(const FFunctionLayer& Layer, FGASpatialCandidates& Candidates, bool bComputeMissing) const
+{
+	UGATacticalCache* TacticalCache = UGATacticalCache::GetTacticalCache(this);
+	if ((TacticalCache == NULL) || !UGATacticalCache::IsCacheable(Layer))
+	{
+		return false;
+	}
+
+	FTargetCache TargetData;
+	AActor* TargetActor = GetTargetData(TargetData);
+	return TacticalCache->SampleLayer(GetGridActor(), Layer, TargetActor, TargetData.Position, LOSEyeOffset, Candidates, Candidates.LayerValues.GetData(), bComputeMissing);
+}
+
+void UGASpatialComponent::EvaluateResponse(const FFunctionLayer& Layer, float* Values, int32 Num)
+{
+	if (Layer.ResponseLUT.IsBuilt())
+	{
+		GASpatialKernels::EvalCurve(Layer.ResponseLUT, Values, Num);
+	}
+	else
 	{
-		for (int32 X = GridMap.GridBounds.MinX; X <= GridMap.GridBounds.MaxX; X++)
+		// Not baked yet (see UGASpatialFunction::Compile) -- go to the curve itself
+		const FRichCurve* Curve = Layer.ResponseCurve.GetRichCurveConst();
+		for (int32 Index = 0; Index < Num; Index++)
 		{
-			FCellRef CellRef(X, Y);
+			Values[Index] = Curve->Eval(Values[Index], Values[Index]);
+		}
+	}
+}
+
+void UGASpatialComponent::AccumulateLayer(const FFunctionLayer& Layer, FGASpatialCandidates& Candidates) const
+{
+	int32 NumCandidates = Candidates.Num();
+	float* Values = Candidates.LayerValues.GetData();
+
+	// Run the layer's input through the response curve, and accumulate it
+	EvaluateResponse(Layer, Values, NumCandidates);
+
+	if (Layer.Op == SO_Mask)
+	{
+		// Everything after this only sees the survivors
+		Candidates.RemoveBelow(Values, Layer.Threshold);
+	}
+	else
+	{
+		GASpatialKernels::ApplyOp(Layer.Op, Candidates.Scores.GetData(), Values, NumCandidates);
+	}
+}
 
-			if (EnumHasAllFlags(Grid->GetCellData(CellRef), ECellData::CellDataTraversable))
+void UGASpatialComponent::EvaluateStep(const UGASpatialFunction& SpatialFunction, const FGASpatialPlanStep& Step, FGASpatialCandidates& Candidates, bool bFillCache) const
+{
+	if (Step.bFused)
+	{
+		EvaluateFusedLayers(SpatialFunction, Step, Candidates);
+	}
+	else
+	{
+		for (int32 LayerIndex : Step.Layers)
+		{
+			EvaluateLayer(SpatialFunction.Layers[LayerIndex], Candidates, bFillCache);
+		}
+	}
+}
+
+// Anytime queries --------------------------------
+
+bool UGASpatialComponent::ChoosePositionAnytime(bool PathfindToPosition, bool Debug)
+{
+	if (ActiveQuery.IsValid() || (GetOwnerPawn() == NULL) || (SpatialFunctionReference.Get() == NULL))
+	{
+		return false;
+	}
+
+	ActiveQuery = MakeUnique<FGASpatialQuery>();
+	ActiveQuery->bAnytime = true;
+	ActiveQuery->bPathfindToPosition = PathfindToPosition;
+	ActiveQuery->bDebug = Debug;
+
+	UGASpatialScheduler* Scheduler = UGASpatialScheduler::GetSpatialScheduler(this);
+	if (Scheduler)
+	{
+		ActiveQuery->bScheduled = true;
+		Scheduler->AddQuery(this);
+	}
+	else
+	{
+		SetComponentTickEnabled(true);
+	}
+	return true;
+}
+
+bool UGASpatialComponent::GetBestSoFar(FCellRef& CellOut, float& ScoreOut) const
+{
+	if (!IsAnytimeQueryRunning() || (ActiveQuery->BestCandidate == INDEX_NONE))
+	{
+		return false;
+	}
+
+	CellOut = ActiveQuery->Candidates.GetCellRef(ActiveQuery->BestCandidate);
+	ScoreOut = ActiveQuery->BestScore;
+	return true;
+}
+
+bool UGASpatialComponent::CompleteQueryNow()
+{
+	if (!IsAnytimeQueryRunning())
+	{
+		return false;
+	}
+
+	FinishAnytimeQuery();
+	return true;
+}
+
+bool UGASpatialComponent::StepQuery(double Deadline)
+{
+	if (!IsAnytimeQueryRunning())
+	{
+		return true;
+	}
+
+	FGASpatialQuery& Query = *ActiveQuery;
+	if (!Query.bGathered)
+	{
+		// The gather (Dijkstra, mostly) doesn't split up, so it's a slice on its own
+		if (!BeginQuery(Query, Query.bPathfindToPosition, Query.bDebug))
+		{
+			FinishAnytimeQuery();
+			return true;
+		}
+
+		Query.bGathered = true;
+		PrepareAnytimeQuery(Query);
+		if (FPlatformTime::Seconds() >= Deadline)
+		{
+			return false;
+		}
+	}
+
+	do
+	{
+		if (!EvaluateAnytimeChunk(Query))
+		{
+			FinishAnytimeQuery();
+			return true;
+		}
+	} while (FPlatformTime::Seconds() < Deadline);
+
+	return false;
+}
+
+void UGASpatialComponent::PrepareAnytimeQuery(FGASpatialQuery& Query) const
+{
+	FGASpatialCandidates& Candidates = Query.Candidates;
+	int32 NumCandidates = Candidates.Num();
+
+	Query.Order.SetNumUninitialized(NumCandidates);
+	for (int32 Candidate = 0; Candidate < NumCandidates; Candidate++)
+	{
+		Query.Order[Candidate] = Candidate;
+	}
+	Query.Evaluated.SetNumZeroed(NumCandidates);
+	Query.NextCandidate = 0;
+	Query.BestCandidate = INDEX_NONE;
+	Query.BestScore = -UE_MAX_FLT;
+
+	bool bHasNormalize = Query.SpatialFunction->Layers.ContainsByPredicate([](const FFunctionLayer& Layer) { return Layer.Op == SO_Normalize; });
+	Query.ChunkSize = bHasNormalize ? FMath::Max(NumCandidates, 1) : FMath::Max(AnytimeChunkSize, 1);
+
+	// Most promising first
+	TArray<float> Lower;
+	Lower.SetNumUninitialized(NumCandidates);
+	Query.UpperBounds.SetNumUninitialized(NumCandidates);
+	bool bLowerValid;
+	if (GASpatialKernels::BoundRemainingSteps(*Query.SpatialFunction, Query.Plan, Candidates.Scores.GetData(),
+		Lower.GetData(), Query.UpperBounds.GetData(), NumCandidates, bLowerValid))
+	{
+		const TArray<float>& Upper = Query.UpperBounds;
+		Algo::StableSort(Query.Order, [&Upper](int32 A, int32 B) { return Upper[A] > Upper[B]; });
+	}
+	else
+	{
+		Query.UpperBounds.Reset();
+		const TArray<float>& PathDistance = Candidates.PathDistance;
+		Algo::StableSort(Query.Order, [&PathDistance](int32 A, int32 B) { return PathDistance[A] < PathDistance[B]; });
+	}
+}
+
+bool UGASpatialComponent::EvaluateAnytimeChunk(FGASpatialQuery& Query)
+{
+	FGASpatialCandidates& Candidates = Query.Candidates;
+	int32 NumCandidates = Candidates.Num();
+	if (Query.NextCandidate >= NumCandidates)
+	{
+		return false;
+	}
+
+	// Nothing left could beat (or tie) the best so far
+	if ((Query.UpperBounds.Num() > 0) && (Query.BestCandidate != INDEX_NONE) && (Query.UpperBounds[Query.Order[Query.NextCandidate]] < Query.BestScore))
+	{
+		return false;
+	}
+
+	int32 Count = FMath::Min(Query.ChunkSize, NumCandidates - Query.NextCandidate);
+	TArray<int32> ChunkIndices(Query.Order.GetData() + Query.NextCandidate, Count);
+	ChunkIndices.Sort();
+	Query.NextCandidate += Count;
+
+	// The chunk goes through the whole function on its own. No branch and bound: the order takes care of that.
+	FGASpatialCandidates Chunk;
+	Chunk.Select(Candidates, ChunkIndices);
+	EvaluatePlan(*Query.SpatialFunction, Query.Plan, Chunk, false);
+
+	// Masks may have dropped some of the chunk. The survivors are still in order, so match them back up.
+	int32 Survivor = 0;
+	for (int32 Candidate : ChunkIndices)
+	{
+		if ((Survivor < Chunk.Num()) && (Chunk.MapIndices[Survivor] == Candidates.MapIndices[Candidate]))
+		{
+			float Score = Chunk.Scores[Survivor];
+			Candidates.Scores[Candidate] = Score;
+			Query.Evaluated[Candidate] = 1.0f;
+
+			// Ties go to the first in row order, same as ChoosePosition
+			if ((Query.BestCandidate == INDEX_NONE) || (Score > Query.BestScore) || ((Score == Query.BestScore) && (Candidate < Query.BestCandidate)))
 			{
-				float CellDistance;
-				if (DistanceMap.GetValue(CellRef, CellDistance) &&
-					(CellDistance < FLT_MAX))
-				{
-					// evaluate me!
+				Query.BestCandidate = Candidate;
+				Query.BestScore = Score;
+			}
+			Survivor++;
+		}
+	}
 
-					float Value = 0.0f;
+	return true;
+}
 
-					switch (Layer.Input)
-					{
-					case SI_None:
-						break;
-					case SI_TargetRange:
-					{
-						FVector CellPosition = Grid->GetCellPosition(CellRef);
-						Value = FVector::Distance(CellPosition, TargetPosition);
-					}
-					break;
-					case SI_PathDistance:
-						Value = CellDistance;
-						break;
-					case SI_LOS:
-					{
-						FVector CellPosition = Grid->GetCellPosition(CellRef) + Offset;
-						FHitResult HitResult;
-						FCollisionQueryParams Params;
-						FVector Start = CellPosition;
-						FVector End = TargetPosition;
-						Params.AddIgnoredActor(TargetActor);		// Probably want to ignore the target actor
-						Params.AddIgnoredActor(OwnerPawn);			// Probably want to ignore the AI themself
-						bool bHitSomething = World->LineTraceSingleByChannel(HitResult, Start, End, ECollisionChannel::ECC_Visibility, Params);
-						Value = bHitSomething ? 0.0f : 1.0f;
-						break;
-					}
-					case SI_AllyDistance:
-					{
-						FVector CellPosition = Grid->GetCellPosition(CellRef);
-						float MinDistanceToAlly = BIG_NUMBER;
-						int32 NumAllies = AllyPositions.Num();
+void UGASpatialComponent::FinishAnytimeQuery()
+{
+	// Note, clear ActiveQuery first, so listeners can start another one
+	TUniquePtr<FGASpatialQuery> FinishedQuery = MoveTemp(ActiveQuery);
+	SetComponentTickEnabled(false);
 
-						// find the closest ally to this point
-						// HOWEVER ... if we are (path) closer to this cell than THEY are to THEIR destination
-						// we are allowed to disregard them, since we would get their first, and they can deal 
-						// with us instead.
+	bool bSuccess = false;
+	if (FinishedQuery->bGathered)
+	{
+		// Only what we got round to counts
+		FinishedQuery->Candidates.RemoveBelow(FinishedQuery->Evaluated.GetData(), 0.5f);
+		bSuccess = FinishQuery(*FinishedQuery);
+	}
+	OnPositionChosen.Broadcast(bSuccess, bSuccess ? BestCell : FCellRef::Invalid);
+}
 
-						for (int32 AllyIndex = 0; AllyIndex < NumAllies; AllyIndex++)
-						{
-							if (AllyDistances[AllyIndex] < CellDistance)
-							{
-								float D = FVector::Distance(CellPosition, AllyPositions[AllyIndex]);
-								if (D < MinDistanceToAlly)
-								{
-									MinDistanceToAlly = D;
-								}
-							}
-						}
-						Value = MinDistanceToAlly;
-						break;
-					}
-					};
 
+// Branch and bound --------------------------------
 
-					{
-						// Next, run it through the response curve using something like this
-						float ModifiedValue = Layer.ResponseCurve.GetRichCurveConst()->Eval(Value, Value);
-						float CurrentValue = 0.0f;
-						float ResultValue = 0.0f;
+bool UGASpatialComponent::IsExpensiveStep(const UGASpatialFunction& SpatialFunction, const FGASpatialPlanStep& Step)
+{
+	if (Step.bFused)
+	{
+		return false;
+	}
 
-						GridMap.GetValue(CellRef, CurrentValue);
+	ESpatialInput Input = SpatialFunction.Layers[Step.Layers[0]].Input;
+	return (Input == SI_LOS) || (Input == SI_AllyDistance);
+}
 
-						switch (Layer.Op)
-						{
-						case SO_None:
-							ResultValue = CurrentValue;
-							break;
-						case SO_Add:
-							ResultValue = CurrentValue + ModifiedValue;
-							break;
-						case SO_Multiply:
-							ResultValue = CurrentValue * ModifiedValue;
-							break;
-						}
+bool UGASpatialComponent::PruneByBounds(const UGASpatialFunction& SpatialFunction, const TArray<FGASpatialPlanStep>& Plan, int32 FirstStep, FGASpatialCandidates& Candidates)
+{
+	int32 NumCandidates = Candidates.Num();
+	TArrayView<const FGASpatialPlanStep> RemainingSteps = MakeArrayView(Plan).Slice(FirstStep, Plan.Num() - FirstStep);
+
+	TArray<float> Lower;
+	Lower.SetNumUninitialized(NumCandidates);
+	bool bLowerValid;
+	if (!GASpatialKernels::BoundRemainingSteps(SpatialFunction, RemainingSteps, Candidates.Scores.GetData(),
+		Lower.GetData(), Candidates.LayerValues.GetData(), NumCandidates, bLowerValid))
+	{
+		return false;
+	}
 
-						GridMap.SetValue(CellRef, ResultValue);
-					}
+	// Some cell is going to score at least BestLower, so anything that can't reach it is out
+	float MinLower, BestLower;
+	if (bLowerValid && GAGridKernels::MinMax(Lower.GetData(), NumCandidates, MinLower, BestLower))
+	{
+		LastPrunedCandidates += Candidates.RemoveBelow(Candidates.LayerValues.GetData(), BestLower);
+	}
+	return true;
+}
+
+bool UGASpatialComponent::BranchAndBound(const UGASpatialFunction& SpatialFunction, const TArray<FGASpatialPlanStep>& Plan, int32 FirstStep, FGASpatialCandidates& Candidates)
+{
+	if (!PruneByBounds(SpatialFunction, Plan, FirstStep, Candidates))
+	{
+		return false;
+	}
+
+	int32 NumCandidates = Candidates.Num();
+	TArray<float> Upper(Candidates.LayerValues);
+
+	// Most promising first
+	TArray<int32> Order;
+	Order.SetNumUninitialized(NumCandidates);
+	for (int32 Candidate = 0; Candidate < NumCandidates; Candidate++)
+	{
+		Order[Candidate] = Candidate;
+	}
+	Algo::StableSort(Order, [&Upper](int32 A, int32 B) { return Upper[A] > Upper[B]; });
+
+	// 1 for each candidate we fully evaluated (and no mask dropped)
+	TArray<float> Evaluated;
+	Evaluated.SetNumZeroed(NumCandidates);
+
+	float BestScore = -UE_MAX_FLT;
+	FGASpatialCandidates Batch;
+	TArray<int32> BatchIndices;
+	int32 Next = 0;
+
+	// Note, >= so that anything that could tie still gets evaluated, and the usual tie-break (first in row order) holds
+	while ((Next < NumCandidates) && (Upper[Order[Next]] >= BestScore))
+	{
+		int32 Count = FMath::Min(BranchAndBoundBatchSize, NumCandidates - Next);
+
+		// Back into row order within the batch, which keeps the tactical cache's region lookups together
+		BatchIndices.Reset();
+		BatchIndices.Append(Order.GetData() + Next, Count);
+		BatchIndices.Sort();
+		Next += Count;
+
+		// Only take what the tactical cache already has. On a miss, the batch traces its own cells and nothing else.
+		Batch.Select(Candidates, BatchIndices);
+		for (int32 StepIndex = FirstStep; StepIndex < Plan.Num(); StepIndex++)
+		{
+			EvaluateStep(SpatialFunction, Plan[StepIndex], Batch, false);
+		}
+
+		// Masks may have dropped some of the batch. The survivors are still in order, so match them back up.
+		int32 Survivor = 0;
+		for (int32 Candidate : BatchIndices)
+		{
+			if ((Survivor < Batch.Num()) && (Batch.MapIndices[Survivor] == Candidates.MapIndices[Candidate]))
+			{
+				Candidates.Scores[Candidate] = Batch.Scores[Survivor];
+				Evaluated[Candidate] = 1.0f;
+				BestScore = FMath::Max(BestScore, Batch.Scores[Survivor]);
+				Survivor++;
+			}
+		}
+	}
+
+	LastPrunedCandidates += Candidates.RemoveBelow(Evaluated.GetData(), 0.5f);
+	return true;
+}
+
+// Coarse to fine --------------------------------
+
+void UGASpatialComponent::CoarseToFine(FGASpatialQuery& Query)
+{
+	FGASpatialCandidates& Candidates = Query.Candidates;
+	int32 NumCandidates = Candidates.Num();
+	if (NumCandidates < CoarseMinCandidates)
+	{
+		return;
+	}
+
+	// The coarse pass. No branch and bound here: we want the top K, not just the best.
+	TArray<int32> FineIndices;
+	TArray<float> CoarseScores;
+	GASpatialKernels::SelectCoarseToFine(Candidates, CoarseBlockSize, CoarseTopK, Query.LastCell,
+		[this, &Query](FGASpatialCandidates& Coarse) { EvaluatePlan(*Query.SpatialFunction, Query.Plan, Coarse, false); },
+		FineIndices, CoarseScores);
+
+	if (FineIndices.Num() == 0)
+	{
+		// Everything got masked out at the coarse level. Don't trust that -- do the lot.
+		return;
+	}
+
+	// Everything in the chosen blocks goes on to be evaluated at full resolution. Everything else keeps its block's
+	// coarse score in the map, for the debug view.
+	float* MapData = Query.GridMap.Data.GetData();
+	int32 NextFine = 0;
+	for (int32 Candidate = 0; Candidate < NumCandidates; Candidate++)
+	{
+		if ((NextFine < FineIndices.Num()) && (FineIndices[NextFine] == Candidate))
+		{
+			NextFine++;
+		}
+		else if (CoarseScores[Candidate] != -UE_MAX_FLT)
+		{
+			MapData[Candidates.MapIndices[Candidate]] = CoarseScores[Candidate];
+		}
+	}
+
+	LastCoarseSkippedCandidates = NumCandidates - FineIndices.Num();
+	FGASpatialCandidates Fine;
+	Fine.Select(Candidates, FineIndices);
+	Candidates = MoveTemp(Fine);
+}
+
+FGACoarseToFineStats UGASpatialComponent::BenchmarkCoarseToFine(int32 NumQueries)
+{
+	FGACoarseToFineStats Stats;
+	const APawn* OwnerPawn = GetOwnerPawn();
+	if (OwnerPawn == NULL)
+	{
+		return Stats;
+	}
 
+	// Start from cells we can get to from here
+	FCellRef SavedBestCell = BestCell;
+	FGASpatialQuery Reachable;
+	BestCell = FCellRef::Invalid;
+	if (!BeginQueryAt(Reachable, OwnerPawn->GetActorLocation(), false, false) || (Reachable.Candidates.Num() == 0))
+	{
+		BestCell = SavedBestCell;
+		return Stats;
+	}
 
-					// HERE ARE SOME ADDITIONAL HINTS
+	// Same start points every run
+	FRandomStream Random(12345);
+	double TotalScoreLoss = 0.0;
+	int64 ExhaustiveCandidates = 0;
+	int64 CoarseToFineCandidates = 0;
 
-					// Here's how to get the player's pawn
+	for (int32 QueryIndex = 0; QueryIndex < NumQueries; QueryIndex++)
+	{
+		FVector StartLocation = Reachable.Candidates.GetPosition(Random.RandHelper(Reachable.Candidates.Num()));
+		FCellRef ChosenCells[2];
+		float ChosenScores[2] = { -UE_MAX_FLT, -UE_MAX_FLT };
+		bool bStarted = true;
 
-					// Here's how to cast a ray
+		// Exhaustive first, then coarse to fine, both with no memory of a previous choice
+		for (int32 Pass = 0; (Pass < 2) && bStarted; Pass++)
+		{
+			BestCell = FCellRef::Invalid;
+			FGASpatialQuery Query;
+			double StartTime = FPlatformTime::Seconds();
 
-					// UWorld* World = GetWorld();
-					// FHitResult HitResult;
-					// FCollisionQueryParams Params;
-					// FVector Start = Grid->GetCellPosition(CellRef);		// need a ray start
-					// FVector End = PlayerPawn->GetActorLocation();		// need a ray end
-					// Start.Z = End.Z;		// Hack: we don't have Z information in the grid actor -- take the player's z value and raycast against that
-					// Add any actors that should be ignored by the raycast by calling
-					// Params.AddIgnoredActor(PlayerPawn);			// Probably want to ignore the player pawn
-					// Params.AddIgnoredActor(OwnerPawn);			// Probably want to ignore the AI themself
-					// bool bHitSomething = World->LineTraceSingleByChannel(HitResult, Start, End, ECollisionChannel::ECC_Visibility, Params);
-					// If bHitSomething is false, then we have a clear LOS
+			bStarted = BeginQueryAt(Query, StartLocation, false, false);
+			if (bStarted)
+			{
+				if (Pass == 0)
+				{
+					ExhaustiveCandidates += Query.Candidates.Num();
+				}
+				else
+				{
+					CoarseToFine(Query);
+					CoarseToFineCandidates += Query.Candidates.Num();
+				}
+
+				EvaluatePlan(*Query.SpatialFunction, Query.Plan, Query.Candidates, bBranchAndBound);
+				if (FinishQuery(Query))
+				{
+					ChosenCells[Pass] = BestCell;
+					Query.GridMap.GetValue(BestCell, ChosenScores[Pass]);
 				}
 			}
+
+			float Milliseconds = float((FPlatformTime::Seconds() - StartTime) * 1000.0);
+			if (Pass == 0)
+			{
+				Stats.ExhaustiveMilliseconds += Milliseconds;
+			}
+			else
+			{
+				Stats.CoarseToFineMilliseconds += Milliseconds;
+			}
+		}
+
+		if (!bStarted)
+		{
+			continue;
+		}
+
+		Stats.Queries++;
+		if (ChosenCells[0] == ChosenCells[1])
+		{
+			Stats.Matches++;
+		}
+		else if (ChosenCells[0].IsValid() && ChosenCells[1].IsValid())
+		{
+			TotalScoreLoss += ChosenScores[0] - ChosenScores[1];
+		}
+	}
+
+	BestCell = SavedBestCell;
+
+	if (Stats.Queries > 0)
+	{
+		Stats.MeanScoreLoss = float(TotalScoreLoss / double(Stats.Queries));
+		Stats.MeanExhaustiveCandidates = float(double(ExhaustiveCandidates) / double(Stats.Queries));
+		Stats.MeanCoarseToFineCandidates = float(double(CoarseToFineCandidates) / double(Stats.Queries));
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Coarse to fine benchmark (%d queries, %dx%d blocks, top %d): matched %d (%.1f%%), mean score loss %f, %.0f vs %.0f cells, %.2f ms vs %.2f ms"),
+		Stats.Queries, CoarseBlockSize, CoarseBlockSize, CoarseTopK,
+		Stats.Matches, (Stats.Queries > 0) ? (100.0f * float(Stats.Matches) / float(Stats.Queries)) : 0.0f,
+		Stats.MeanScoreLoss, Stats.MeanExhaustiveCandidates, Stats.MeanCoarseToFineCandidates,
+		Stats.ExhaustiveMilliseconds, Stats.CoarseToFineMilliseconds);
+
+	return Stats;
+}
+
+
+void UGASpatialComponent::EvaluateFusedLayers(const UGASpatialFunction& SpatialFunction, const FGASpatialPlanStep& Step, FGASpatialCandidates& Candidates) const
+{
+	// 1KB of scores and 1KB of values: comfortably L1-sized
+	static const int32 BlockSize = 256;
+
+	FTargetCache TargetData;
+	GetTargetData(TargetData);
+
+	int32 NumCandidates = Candidates.Num();
+	float* Scores = Candidates.Scores.GetData();
+	float* Values = Candidates.LayerValues.GetData();
+
+	for (int32 Begin = 0; Begin < NumCandidates; Begin += BlockSize)
+	{
+		int32 Count = FMath::Min(BlockSize, NumCandidates - Begin);
+
+		for (int32 LayerIndex : Step.Layers)
+		{
+			const FFunctionLayer& Layer = SpatialFunction.Layers[LayerIndex];
+			check(UGASpatialFunction::IsFusable(Layer));
+
+			switch (Layer.Input)
+			{
+			case SI_TargetRange:
+				GASpatialKernels::DistanceToPoint(Candidates, TargetData.Position, Values + Begin, Begin, Count);
+				break;
+			case SI_PathDistance:
+				FMemory::Memcpy(Values + Begin, Candidates.PathDistance.GetData() + Begin, Count * sizeof(float));
+				break;
+			default:
+				GAGridKernels::Fill(Values + Begin, Count, 0.0f);
+				break;
+			}
+
+			EvaluateResponse(Layer, Values + Begin, Count);
+			GASpatialKernels::ApplyOp(Layer.Op, Scores + Begin, Values + Begin, Count);
 		}
 	}
 }
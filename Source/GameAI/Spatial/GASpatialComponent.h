@@ -3,6 +3,9 @@
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
 #include "GameAI/Grid/GAGridActor.h"
+#include "GameAI/Grid/GAGridMap.h"
+#include "GASpatialEvaluator.h"
+#include "WorldCollision.h"
 #include "GASpatialComponent.generated.h"
 
 class UGASpatialFunction;
@@ -10,6 +13,88 @@ struct FFunctionLayer;
 class AGAGridActor;
 class UGAPathComponent;
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FGAPositionChosenEvent, bool, bSuccess, FCellRef, ChosenCell);
+
+
+// Results of UGASpatialComponent::BenchmarkCoarseToFine
+USTRUCT(BlueprintType)
+struct FGACoarseToFineStats
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 Queries = 0;
+
+	// How many times coarse to fine picked the same cell as the exhaustive search
+	UPROPERTY(BlueprintReadOnly)
+	int32 Matches = 0;
+
+	// On average, how much lower the score of coarse to fine's pick was (0 if it always matched)
+	UPROPERTY(BlueprintReadOnly)
+	float MeanScoreLoss = 0.0f;
+
+	// On average, how many cells each evaluated at full resolution
+	UPROPERTY(BlueprintReadOnly)
+	float MeanExhaustiveCandidates = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly)
+	float MeanCoarseToFineCandidates = 0.0f;
+
+	// Total time spent in each
+	UPROPERTY(BlueprintReadOnly)
+	float ExhaustiveMilliseconds = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly)
+	float CoarseToFineMilliseconds = 0.0f;
+};
+
+
+// Everything a ChoosePosition needs to carry from one step to the next. For ChoosePositionAsync, this lives on
+// across frames while the physics traces are out.
+struct FGASpatialQuery
+{
+	const UGASpatialFunction* SpatialFunction = NULL;
+	bool bPathfindToPosition = false;
+	bool bDebug = false;
+	FVector StartLocation = FVector::ZeroVector;
+
+	// The best cell from the previous query, which gets LastCellBonus
+	FCellRef LastCell;
+
+	FGAGridMap GridMap;
+	FGAGridMap DistanceMap;
+	FGASpatialCandidates Candidates;
+
+	// The spatial function's compiled plan (see UGASpatialFunction::Compile), and the first step not yet evaluated
+	TArray<FGASpatialPlanStep> Plan;
+	int32 NextStep = 0;
+
+	// One per candidate, for step NextStep, while its traces are out
+	TArray<FTraceHandle> PendingTraces;
+
+	// When step NextStep first sent its traces out (world real time), for AsyncTraceTimeoutSeconds
+	double TraceStartTime = 0.0;
+
+	// Anytime queries only (see UGASpatialComponent::ChoosePositionAnytime)
+	bool bAnytime = false;
+	bool bScheduled = false;
+	bool bGathered = false;
+
+	// The candidates, most promising first, and how far through them we are
+	TArray<int32> Order;
+	int32 NextCandidate = 0;
+	int32 ChunkSize = 0;
+
+	// Each candidate's upper bound (see GASpatialKernels::BoundRemainingSteps). Empty if the function can't be bounded.
+	TArray<float> UpperBounds;
+
+	// 1 for each candidate fully evaluated (and not masked out)
+	TArray<float> Evaluated;
+
+	int32 BestCandidate = INDEX_NONE;
+	float BestScore = -UE_MAX_FLT;
+};
+
 // Our spatial component
 // This component is going to help make us make decisions about where to stand
 // Note: this should go on the AI's controller, not the pawn.
@@ -59,7 +144,192 @@ class UGASpatialComponent : public UActorComponent
 	UFUNCTION(BlueprintCallable)
 	bool ChoosePosition(bool PathfindToPosition, bool Debug);
 
-	void EvaluateLayer(const FFunctionLayer& Layer, const FGAGridMap& DistanceMap, FGAGridMap& GridMap) const;
+	// Evaluate one layer of the spatial function over the candidate cells, and accumulate it into their scores.
+	// Without bFillCache, a layer the tactical cache can serve only uses it if every cell is already there, and
+	// otherwise computes its own input.
+	void EvaluateLayer(const FFunctionLayer& Layer, FGASpatialCandidates& Candidates, bool bFillCache = true) const;
+
+	// Evaluate one step of a compiled spatial function (see UGASpatialFunction::Compile)
+	void EvaluateStep(const UGASpatialFunction& SpatialFunction, const FGASpatialPlanStep& Step, FGASpatialCandidates& Candidates, bool bFillCache = true) const;
+
+
+	// Branch and bound --------------------------------
+	// Most cells can't win, and we can often tell before paying for their line of sight. When ChoosePosition gets to
+	// an expensive layer (line of sight, ally distance), it bounds every cell's final score using the output ranges of
+	// the layers still to come (see UGASpatialFunction::GetLayerRange), and:
+	// - drops the cells whose best possible score is below some other cell's worst possible score
+	// - evaluates the rest of the function for the remaining cells in batches, most promising first, and stops as soon
+	//   as no cell left could beat (or tie) the best score found so far
+	// The chosen cell is exactly the one an exhaustive evaluation picks. It only kicks in when the remaining layers
+	// can be bounded -- a layer with a distance input and no curve, or a Normalize, can't be.
+	// ChoosePositionAsync only does the first part, before submitting its traces.
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	bool bBranchAndBound;
+
+	// Cells per batch in the second part. Smaller batches prune more, bigger ones make better use of the kernels.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1"))
+	int32 BranchAndBoundBatchSize;
+
+	// For profiling: how many candidates the last query skipped this way
+	UPROPERTY(BlueprintReadOnly)
+	int32 LastPrunedCandidates;
+
+
+	// Coarse to fine --------------------------------
+	// A cheaper, approximate ChoosePosition for big sample boxes. The reachable cells are split into blocks of
+	// CoarseBlockSize x CoarseBlockSize, and the whole function is evaluated once per block, at the cell nearest its
+	// middle. Only the cells in the CoarseTopK best blocks (plus the block holding last time's choice, so
+	// LastCellBonus still works) are then evaluated at full resolution.
+	// It can miss a narrow peak in a block whose middle scores badly -- bigger blocks and a smaller K are cheaper but
+	// miss more. BenchmarkCoarseToFine measures how often it matches the exhaustive answer.
+	// ChoosePositionAsync always evaluates at full resolution.
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	bool bCoarseToFine;
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "2"))
+	int32 CoarseBlockSize;
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1"))
+	int32 CoarseTopK;
+
+	// Below this many reachable cells, it isn't worth it: just evaluate them all
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	int32 CoarseMinCandidates;
+
+	// For profiling: how many candidates the last query never evaluated at full resolution
+	UPROPERTY(BlueprintReadOnly)
+	int32 LastCoarseSkippedCandidates;
+
+	// Run NumQueries queries from random reachable cells around the owner, both exhaustively and coarse to fine, and
+	// compare the answers (results go to the log too). Doesn't move anyone.
+	UFUNCTION(BlueprintCallable)
+	FGACoarseToFineStats BenchmarkCoarseToFine(int32 NumQueries = 100);
+
+
+	// Asynchronous queries --------------------------------
+	// ChoosePositionAsync does the same as ChoosePosition, except that physics-trace line of sight layers submit all
+	// their traces to the physics scene in one batch (UWorld::AsyncLineTraceByChannel) instead of tracing each cell
+	// on the spot. The query picks up again on a later tick, once the results are in, and OnPositionChosen fires
+	// when it's done. Without any such layers it completes straight away, before ChoosePositionAsync returns.
+	// Note, the grid and the target are sampled when the query starts, and aren't checked again.
+
+	// Returns false (and won't fire OnPositionChosen) if the query couldn't be started, or one is already running
+	UFUNCTION(BlueprintCallable)
+	bool ChoosePositionAsync(bool PathfindToPosition, bool Debug);
+
+	// The physics scene only keeps trace results for the frame after they were submitted. If we miss that tick (a
+	// hitch, a pause, a tick interval), the traces are sent out again -- unless they've already been out for this
+	// long, in which case every cell still waiting counts as blocked, so the query always finishes.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0"))
+	float AsyncTraceTimeoutSeconds;
+
+	UFUNCTION(BlueprintCallable)
+	void CancelQuery();
+
+	UFUNCTION(BlueprintCallable, BlueprintPure)
+	bool IsQueryRunning() const { return ActiveQuery.IsValid(); }
+
+	UPROPERTY(BlueprintAssignable)
+	FGAPositionChosenEvent OnPositionChosen;
+
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+
+	// Anytime queries --------------------------------
+	// ChoosePositionAnytime does the work of ChoosePosition a little at a time, under a time budget per frame, so
+	// that lots of agents choosing at once don't all land on the same frame. Nothing happens straight away: the gather
+	// runs on a later frame, and then the candidates go through the whole spatial function a chunk at a time, most
+	// promising first (by upper bound, see Branch and bound, if the function can be bounded; otherwise nearest first).
+	// At any point GetBestSoFar has the best cell fully evaluated so far, and CompleteQueryNow settles for it.
+	// Otherwise the query runs until every candidate is done -- or, with bounds, until none left could win, in
+	// which case it picks exactly what ChoosePosition would -- and fires OnPositionChosen.
+	// With a UGASpatialScheduler on the game mode, it shares out one budget between all the agents. Without one,
+	// each query gets AnytimeBudgetMicroseconds a frame to itself.
+	// Note, a function with a Normalize can't be split up by candidate, so it gets done in one chunk.
+
+	// Returns false if a query is already running, or this one can't be started
+	UFUNCTION(BlueprintCallable)
+	bool ChoosePositionAnytime(bool PathfindToPosition, bool Debug);
+
+	// False if there's no anytime query running, or it hasn't finished a chunk yet
+	UFUNCTION(BlueprintCallable)
+	bool GetBestSoFar(FCellRef& CellOut, float& ScoreOut) const;
+
+	// Stop the anytime query early, and go with the best so far. OnPositionChosen fires as usual.
+	UFUNCTION(BlueprintCallable)
+	bool CompleteQueryNow();
+
+	UFUNCTION(BlueprintCallable, BlueprintPure)
+	bool IsAnytimeQueryRunning() const { return ActiveQuery.IsValid() && ActiveQuery->bAnytime; }
+
+	bool IsQueryGathered() const { return ActiveQuery.IsValid() && ActiveQuery->bGathered; }
+
+	// Work on the anytime query until Deadline (in FPlatformTime::Seconds). Always does at least one slice -- the
+	// gather, or one chunk -- even if Deadline has already passed. Returns true once the query is over.
+	bool StepQuery(double Deadline);
+
+	// Candidates per chunk. Smaller chunks stick to the budget more closely, bigger ones make better use of the kernels.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1"))
+	int32 AnytimeChunkSize;
+
+	// Time per frame for an anytime query, when there's no scheduler
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0"))
+	float AnytimeBudgetMicroseconds;
+
+private:
+	// Steps 1 and 3-4 of ChoosePosition: gathering the candidates, and picking one and acting on it
+	bool BeginQuery(FGASpatialQuery& Query, bool PathfindToPosition, bool Debug);
+	bool BeginQueryAt(FGASpatialQuery& Query, const FVector& StartLocation, bool PathfindToPosition, bool Debug);
+	bool FinishQuery(FGASpatialQuery& Query);
+
+	// Fill in Candidates.LayerValues from the tactical cache (see UGATacticalCache::SampleLayer). False if there's no
+	// cache, or it can't (or, without bComputeMissing, can't yet) provide this layer.
+	bool SampleCachedLayer(const FFunctionLayer& Layer, FGASpatialCandidates& Candidates, bool bComputeMissing) const;
+
+	// Line of sight and ally distance: the ones worth pruning for
+	static bool IsExpensiveStep(const UGASpatialFunction& SpatialFunction, const FGASpatialPlanStep& Step);
+
+	// First part of branch and bound (see above) for Candidates, ahead of step FirstStep of Plan. Returns false if the
+	// remaining steps can't be bounded. Otherwise, leaves each survivor's upper bound in LayerValues.
+	bool PruneByBounds(const UGASpatialFunction& SpatialFunction, const TArray<FGASpatialPlanStep>& Plan, int32 FirstStep, FGASpatialCandidates& Candidates);
+
+	// Both parts: finishes evaluating the plan from FirstStep on, leaving only the cells it fully evaluated. Returns
+	// false (having done nothing) if the remaining steps can't be bounded.
+	bool BranchAndBound(const UGASpatialFunction& SpatialFunction, const TArray<FGASpatialPlanStep>& Plan, int32 FirstStep, FGASpatialCandidates& Candidates);
+
+	// Step 2 of ChoosePosition: the whole plan, over Candidates
+	void EvaluatePlan(const UGASpatialFunction& SpatialFunction, const TArray<FGASpatialPlanStep>& Plan, FGASpatialCandidates& Candidates, bool bAllowBranchAndBound);
+
+	// Cut Query's candidates down to the cells in the most promising blocks (see bCoarseToFine)
+	void CoarseToFine(FGASpatialQuery& Query);
+
+	// Anytime queries: put the candidates in order, evaluate the next chunk of them (false if there's nothing left
+	// worth evaluating), and wrap up with whatever's been evaluated
+	void PrepareAnytimeQuery(FGASpatialQuery& Query) const;
+	bool EvaluateAnytimeChunk(FGASpatialQuery& Query);
+	void FinishAnytimeQuery();
+
+	// Run the curve and op of a layer whose input is already in Candidates.LayerValues
+	void AccumulateLayer(const FFunctionLayer& Layer, FGASpatialCandidates& Candidates) const;
+
+	// A fused step: all its layers, input to op, a block of candidates at a time, so each block's scores and inputs
+	// stay in cache for the whole step instead of going round memory once per layer
+	void EvaluateFusedLayers(const UGASpatialFunction& SpatialFunction, const FGASpatialPlanStep& Step, FGASpatialCandidates& Candidates) const;
+
+	// Values = the layer's response curve of Values
+	static void EvaluateResponse(const FFunctionLayer& Layer, float* Values, int32 Num);
+
+	// Evaluate ActiveQuery's steps until we have to wait on traces, or we're done
+	void AdvanceQuery();
+
+	static bool IsPhysicsLOSLayer(const FFunctionLayer& Layer);
+	void SubmitLOSTraces(FGASpatialQuery& Query) const;
 
+	// Fill in LayerValues from the traces. Returns false if they aren't all back yet.
+	bool CollectLOSTraces(FGASpatialQuery& Query) const;
 
+	TUniquePtr<FGASpatialQuery> ActiveQuery;
 };
\ No newline at end of file
@@ -0,0 +1,554 @@
+#include "GASpatialEvaluator.h"
+#include "GameAI/Grid/GAGridMapKernels.h"
+#include "Math/VectorRegister.h"
+#include "Algo/StableSort.h"
+
+// Note: like GAGridMapKernels.cpp, we deliberately leave optimization ON here. These are the inner loops of every
+// spatial query.
+
+
+// FGASpatialCandidates --------------------------------
+
+void FGASpatialCandidates::Reset()
+{
+	Bounds = FGridBox();
+	MapIndices.Reset();
+	PositionX.Reset();
+	PositionY.Reset();
+	PositionZ.Reset();
+	PathDistance.Reset();
+	Scores.Reset();
+	LayerValues.Reset();
+}
+
+void FGASpatialCandidates::Gather(const AGAGridActor& Grid, const FGAGridMap& DistanceMap)
+{
+	Reset();
+
+	Bounds = DistanceMap.GridBounds;
+	if (!DistanceMap.IsValid())
+	{
+		return;
+	}
+
+	// Usually only a fraction of the box is reachable, but reserving for all of it saves growing five arrays
+	int32 Width = Bounds.GetWidth();
+	int32 MaxCount = Bounds.GetCellCount();
+	MapIndices.Reserve(MaxCount);
+	PositionX.Reserve(MaxCount);
+	PositionY.Reserve(MaxCount);
+	PositionZ.Reserve(MaxCount);
+	PathDistance.Reserve(MaxCount);
+
+	for (int32 Y = Bounds.MinY; Y <= Bounds.MaxY; Y++)
+	{
+		const float* DistanceRow = DistanceMap.GetRowData(Y);
+		int32 RowStart = (Y - Bounds.MinY) * Width;
+
+		for (int32 LocalX = 0; LocalX < Width; LocalX++)
+		{
+			if (DistanceRow[LocalX] < FLT_MAX)
+			{
+				FCellRef CellRef(Bounds.MinX + LocalX, Y);
+				if (EnumHasAllFlags(Grid.GetCellData(CellRef), ECellData::CellDataTraversable))
+				{
+					FVector Position = Grid.GetCellPosition(CellRef);
+					MapIndices.Add(RowStart + LocalX);
+					PositionX.Add(float(Position.X));
+					PositionY.Add(float(Position.Y));
+					PositionZ.Add(float(Position.Z));
+					PathDistance.Add(DistanceRow[LocalX]);
+				}
+			}
+		}
+	}
+
+	Scores.SetNumZeroed(Num());
+	LayerValues.SetNumUninitialized(Num());
+}
+
+void FGASpatialCandidates::LoadScores(const FGAGridMap& Map)
+{
+	check(Map.GridBounds == Bounds);
+	const float* MapData = Map.Data.GetData();
+	for (int32 Candidate = 0; Candidate < Num(); Candidate++)
+	{
+		Scores[Candidate] = MapData[MapIndices[Candidate]];
+	}
+}
+
+void FGASpatialCandidates::StoreScores(FGAGridMap& Map) const
+{
+	check(Map.GridBounds == Bounds);
+	float* MapData = Map.Data.GetData();
+	for (int32 Candidate = 0; Candidate < Num(); Candidate++)
+	{
+		MapData[MapIndices[Candidate]] = Scores[Candidate];
+	}
+	Map.MarkDirty();
+}
+
+int32 FGASpatialCandidates::RemoveBelow(const float* Values, float Threshold)
+{
+	// Compact everything in place. Values may well be LayerValues, which is fine: we never write ahead of our read.
+	int32 Kept = 0;
+	for (int32 Candidate = 0; Candidate < Num(); Candidate++)
+	{
+		if (Values[Candidate] >= Threshold)
+		{
+			if (Kept != Candidate)
+			{
+				MapIndices[Kept] = MapIndices[Candidate];
+				PositionX[Kept] = PositionX[Candidate];
+				PositionY[Kept] = PositionY[Candidate];
+				PositionZ[Kept] = PositionZ[Candidate];
+				PathDistance[Kept] = PathDistance[Candidate];
+				Scores[Kept] = Scores[Candidate];
+				LayerValues[Kept] = Values[Candidate];
+			}
+			Kept++;
+		}
+	}
+
+	int32 Removed = Num() - Kept;
+	if (Removed > 0)
+	{
+		MapIndices.SetNum(Kept, EAllowShrinking::No);
+		PositionX.SetNum(Kept, EAllowShrinking::No);
+		PositionY.SetNum(Kept, EAllowShrinking::No);
+		PositionZ.SetNum(Kept, EAllowShrinking::No);
+		PathDistance.SetNum(Kept, EAllowShrinking::No);
+		Scores.SetNum(Kept, EAllowShrinking::No);
+		LayerValues.SetNum(Kept, EAllowShrinking::No);
+	}
+	return Removed;
+}
+
+void FGASpatialCandidates::Select(const FGASpatialCandidates& Source, TArrayView<const int32> Indices)
+{
+	Reset();
+	Bounds = Source.Bounds;
+
+	int32 Count = Indices.Num();
+	MapIndices.SetNumUninitialized(Count);
+	PositionX.SetNumUninitialized(Count);
+	PositionY.SetNumUninitialized(Count);
+	PositionZ.SetNumUninitialized(Count);
+	PathDistance.SetNumUninitialized(Count);
+	Scores.SetNumUninitialized(Count);
+	LayerValues.SetNumUninitialized(Count);
+
+	for (int32 Index = 0; Index < Count; Index++)
+	{
+		int32 Candidate = Indices[Index];
+		MapIndices[Index] = Source.MapIndices[Candidate];
+		PositionX[Index] = Source.PositionX[Candidate];
+		PositionY[Index] = Source.PositionY[Candidate];
+		PositionZ[Index] = Source.PositionZ[Candidate];
+		PathDistance[Index] = Source.PathDistance[Candidate];
+		Scores[Index] = Source.Scores[Candidate];
+	}
+}
+
+
+// Kernels --------------------------------
+
+namespace GASpatialKernels
+{
+	void DistanceToPoint(const FGASpatialCandidates& Candidates, const FVector& Point, float* Out)
+	{
+		DistanceToPoint(Candidates, Point, Out, 0, Candidates.Num());
+	}
+
+	void DistanceToPoint(const FGASpatialCandidates& Candidates, const FVector& Point, float* Out, int32 Begin, int32 Count)
+	{
+		check((Begin >= 0) && (Begin + Count <= Candidates.Num()));
+		const float* X = Candidates.PositionX.GetData() + Begin;
+		const float* Y = Candidates.PositionY.GetData() + Begin;
+		const float* Z = Candidates.PositionZ.GetData() + Begin;
+		int32 Num = Count;
+
+		const VectorRegister4Float PX = VectorSetFloat1(float(Point.X));
+		const VectorRegister4Float PY = VectorSetFloat1(float(Point.Y));
+		const VectorRegister4Float PZ = VectorSetFloat1(float(Point.Z));
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			VectorRegister4Float DX = VectorSubtract(VectorLoad(X + Index), PX);
+			VectorRegister4Float DY = VectorSubtract(VectorLoad(Y + Index), PY);
+			VectorRegister4Float DZ = VectorSubtract(VectorLoad(Z + Index), PZ);
+			VectorRegister4Float DistSquared = VectorMultiplyAdd(DX, DX, VectorMultiplyAdd(DY, DY, VectorMultiply(DZ, DZ)));
+			VectorStore(VectorSqrt(DistSquared), Out + Index);
+		}
+		for (; Index < Num; Index++)
+		{
+			float DX = X[Index] - float(Point.X);
+			float DY = Y[Index] - float(Point.Y);
+			float DZ = Z[Index] - float(Point.Z);
+			Out[Index] = FMath::Sqrt(DX * DX + DY * DY + DZ * DZ);
+		}
+	}
+
+	void MinDistanceToCloserPoints(const FGASpatialCandidates& Candidates, TArrayView<const FVector> Points, TArrayView<const float> PointDistances, float* Out)
+	{
+		check(Points.Num() == PointDistances.Num());
+
+		const float* X = Candidates.PositionX.GetData();
+		const float* Y = Candidates.PositionY.GetData();
+		const float* Z = Candidates.PositionZ.GetData();
+		const float* PathDistance = Candidates.PathDistance.GetData();
+		int32 Num = Candidates.Num();
+
+		GAGridKernels::Fill(Out, Num, BIG_NUMBER);
+
+		// Compare squared distances, and only take the square roots at the end
+		for (int32 PointIndex = 0; PointIndex < Points.Num(); PointIndex++)
+		{
+			const FVector& Point = Points[PointIndex];
+			const VectorRegister4Float PX = VectorSetFloat1(float(Point.X));
+			const VectorRegister4Float PY = VectorSetFloat1(float(Point.Y));
+			const VectorRegister4Float PZ = VectorSetFloat1(float(Point.Z));
+			const VectorRegister4Float PD = VectorSetFloat1(PointDistances[PointIndex]);
+			int32 Index = 0;
+
+			for (; Index + 4 <= Num; Index += 4)
+			{
+				VectorRegister4Float DX = VectorSubtract(VectorLoad(X + Index), PX);
+				VectorRegister4Float DY = VectorSubtract(VectorLoad(Y + Index), PY);
+				VectorRegister4Float DZ = VectorSubtract(VectorLoad(Z + Index), PZ);
+				VectorRegister4Float DistSquared = VectorMultiplyAdd(DX, DX, VectorMultiplyAdd(DY, DY, VectorMultiply(DZ, DZ)));
+
+				VectorRegister4Float Current = VectorLoad(Out + Index);
+				VectorRegister4Float Counts = VectorCompareLT(PD, VectorLoad(PathDistance + Index));
+				VectorStore(VectorSelect(Counts, VectorMin(Current, DistSquared), Current), Out + Index);
+			}
+			for (; Index < Num; Index++)
+			{
+				if (PointDistances[PointIndex] < PathDistance[Index])
+				{
+					float DX = X[Index] - float(Point.X);
+					float DY = Y[Index] - float(Point.Y);
+					float DZ = Z[Index] - float(Point.Z);
+					Out[Index] = FMath::Min(Out[Index], DX * DX + DY * DY + DZ * DZ);
+				}
+			}
+		}
+
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			if (Out[Index] < BIG_NUMBER)
+			{
+				Out[Index] = FMath::Sqrt(Out[Index]);
+			}
+		}
+	}
+
+	void EvalCurve(const FGACurveLUT& LUT, float* Values, int32 Num)
+	{
+		if (LUT.IsIdentity())
+		{
+			return;
+		}
+
+		// The table lookups themselves are scalar (there's no gather), but the positions and the lerps are not
+		const float* Samples = LUT.Samples.GetData();
+		int32 LastIndex = LUT.Samples.Num() - 2;
+		const VectorRegister4Float MinTimeV = VectorSetFloat1(LUT.MinTime);
+		const VectorRegister4Float InvStepV = VectorSetFloat1(LUT.InvStep);
+		const VectorRegister4Float MaxPositionV = VectorSetFloat1(float(LUT.Samples.Num() - 1));
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			VectorRegister4Float Position = VectorMultiply(VectorSubtract(VectorLoad(Values + Index), MinTimeV), InvStepV);
+			Position = VectorMin(VectorMax(Position, VectorZeroFloat()), MaxPositionV);
+
+			alignas(16) float Lanes[4];
+			alignas(16) float Lower[4];
+			alignas(16) float Upper[4];
+			alignas(16) float Fraction[4];
+			VectorStoreAligned(Position, Lanes);
+
+			for (int32 Lane = 0; Lane < 4; Lane++)
+			{
+				int32 SampleIndex = FMath::Min(int32(Lanes[Lane]), LastIndex);
+				Lower[Lane] = Samples[SampleIndex];
+				Upper[Lane] = Samples[SampleIndex + 1];
+				Fraction[Lane] = Lanes[Lane] - float(SampleIndex);
+			}
+
+			VectorRegister4Float LowerV = VectorLoadAligned(Lower);
+			VectorRegister4Float Result = VectorMultiplyAdd(VectorSubtract(VectorLoadAligned(Upper), LowerV), VectorLoadAligned(Fraction), LowerV);
+			VectorStore(Result, Values + Index);
+		}
+		for (; Index < Num; Index++)
+		{
+			Values[Index] = LUT.Eval(Values[Index]);
+		}
+	}
+
+	void ApplyOp(ESpatialOp Op, float* Scores, const float* Values, int32 Num)
+	{
+		switch (Op)
+		{
+		case SO_Add:
+			GAGridKernels::Combine(Scores, Values, Num, EGAGridCombineOp::Add);
+			break;
+		case SO_Multiply:
+			GAGridKernels::Combine(Scores, Values, Num, EGAGridCombineOp::Multiply);
+			break;
+		case SO_Subtract:
+			GAGridKernels::Combine(Scores, Values, Num, EGAGridCombineOp::Subtract);
+			break;
+		case SO_Min:
+			GAGridKernels::Combine(Scores, Values, Num, EGAGridCombineOp::Min);
+			break;
+		case SO_Max:
+			GAGridKernels::Combine(Scores, Values, Num, EGAGridCombineOp::Max);
+			break;
+		case SO_Power:
+			// No vector pow, but this is rare enough not to matter. Clamp so a negative score can't make a NaN.
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				Scores[Index] = FMath::Pow(FMath::Max(Scores[Index], 0.0f), Values[Index]);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	void Normalize(float* Scores, int32 Num)
+	{
+		float MinScore, MaxScore;
+		if (!GAGridKernels::MinMax(Scores, Num, MinScore, MaxScore))
+		{
+			return;
+		}
+
+		float Range = MaxScore - MinScore;
+		if (Range <= UE_SMALL_NUMBER)
+		{
+			GAGridKernels::Fill(Scores, Num, 1.0f);
+			return;
+		}
+
+		const VectorRegister4Float MinV = VectorSetFloat1(MinScore);
+		const VectorRegister4Float InvRangeV = VectorSetFloat1(1.0f / Range);
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			VectorStore(VectorMultiply(VectorSubtract(VectorLoad(Scores + Index), MinV), InvRangeV), Scores + Index);
+		}
+		for (; Index < Num; Index++)
+		{
+			Scores[Index] = (Scores[Index] - MinScore) / Range;
+		}
+	}
+
+	// [Lower, Upper] = Op([Lower, Upper], [ValueMin, ValueMax])
+	static void ApplyOpBounds(ESpatialOp Op, float* Lower, float* Upper, float ValueMin, float ValueMax, int32 Num)
+	{
+		switch (Op)
+		{
+		case SO_Add:
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				Lower[Index] += ValueMin;
+				Upper[Index] += ValueMax;
+			}
+			break;
+		case SO_Subtract:
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				Lower[Index] -= ValueMax;
+				Upper[Index] -= ValueMin;
+			}
+			break;
+		case SO_Multiply:
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				float A = Lower[Index] * ValueMin;
+				float B = Lower[Index] * ValueMax;
+				float C = Upper[Index] * ValueMin;
+				float D = Upper[Index] * ValueMax;
+				Lower[Index] = FMath::Min(FMath::Min(A, B), FMath::Min(C, D));
+				Upper[Index] = FMath::Max(FMath::Max(A, B), FMath::Max(C, D));
+			}
+			break;
+		case SO_Min:
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				Lower[Index] = FMath::Min(Lower[Index], ValueMin);
+				Upper[Index] = FMath::Min(Upper[Index], ValueMax);
+			}
+			break;
+		case SO_Max:
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				Lower[Index] = FMath::Max(Lower[Index], ValueMin);
+				Upper[Index] = FMath::Max(Upper[Index], ValueMax);
+			}
+			break;
+		case SO_Power:
+			// Pow(Max(Score, 0), Value) is monotonic in each argument on its own, so the extremes are at the corners
+			for (int32 Index = 0; Index < Num; Index++)
+			{
+				float BaseMin = FMath::Max(Lower[Index], 0.0f);
+				float BaseMax = FMath::Max(Upper[Index], 0.0f);
+				if ((ValueMin < 0.0f) && (BaseMin <= 0.0f))
+				{
+					// Could be a division by zero
+					Lower[Index] = 0.0f;
+					Upper[Index] = UE_MAX_FLT;
+					continue;
+				}
+
+				float A = FMath::Pow(BaseMin, ValueMin);
+				float B = FMath::Pow(BaseMin, ValueMax);
+				float C = FMath::Pow(BaseMax, ValueMin);
+				float D = FMath::Pow(BaseMax, ValueMax);
+				Lower[Index] = FMath::Min(FMath::Min(A, B), FMath::Min(C, D));
+				Upper[Index] = FMath::Min(FMath::Max(FMath::Max(A, B), FMath::Max(C, D)), UE_MAX_FLT);
+			}
+			break;
+		default:
+			// SO_None and SO_Mask leave the score alone
+			break;
+		}
+	}
+
+	bool BoundRemainingSteps(const UGASpatialFunction& SpatialFunction, TArrayView<const FGASpatialPlanStep> Steps, const float* Scores,
+		float* Lower, float* Upper, int32 Num, bool& bLowerValidOut)
+	{
+		bLowerValidOut = true;
+		FMemory::Memcpy(Lower, Scores, Num * sizeof(float));
+		FMemory::Memcpy(Upper, Scores, Num * sizeof(float));
+
+		for (const FGASpatialPlanStep& Step : Steps)
+		{
+			for (int32 LayerIndex : Step.Layers)
+			{
+				const FFunctionLayer& Layer = SpatialFunction.Layers[LayerIndex];
+				float ValueMin, ValueMax;
+				if (!UGASpatialFunction::GetLayerRange(Layer, ValueMin, ValueMax))
+				{
+					return false;
+				}
+
+				if ((Layer.Op == SO_Mask) && (ValueMin < Layer.Threshold))
+				{
+					bLowerValidOut = false;
+				}
+				ApplyOpBounds(Layer.Op, Lower, Upper, ValueMin, ValueMax, Num);
+			}
+		}
+
+		// Overflow can make a NaN of an infinity times zero. Call that unbounded, rather than let it compare false.
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			if (FMath::IsNaN(Lower[Index]))
+			{
+				Lower[Index] = -UE_MAX_FLT;
+			}
+			if (FMath::IsNaN(Upper[Index]))
+			{
+				Upper[Index] = UE_MAX_FLT;
+			}
+		}
+		return true;
+	}
+
+	void SelectCoarseToFine(const FGASpatialCandidates& Candidates, int32 BlockSize, int32 TopK, const FCellRef& KeepCell,
+		TFunctionRef<void(FGASpatialCandidates&)> Evaluate, TArray<int32>& FineIndicesOut, TArray<float>& CoarseScoresOut)
+	{
+		FineIndicesOut.Reset();
+		int32 NumCandidates = Candidates.Num();
+		CoarseScoresOut.Init(-UE_MAX_FLT, NumCandidates);
+		BlockSize = FMath::Max(BlockSize, 2);
+
+		const FGridBox& Bounds = Candidates.Bounds;
+		int32 BlocksX = (Bounds.GetWidth() + BlockSize - 1) / BlockSize;
+		int32 BlocksY = (Bounds.GetHeight() + BlockSize - 1) / BlockSize;
+		auto GetBlock = [&Bounds, BlockSize, BlocksX](const FCellRef& Cell)
+		{
+			return ((Cell.Y - Bounds.MinY) / BlockSize) * BlocksX + ((Cell.X - Bounds.MinX) / BlockSize);
+		};
+
+		// Sort the candidates into blocks, and pick the one nearest the middle of each to stand in for it
+		TArray<int32> CandidateBlocks;
+		CandidateBlocks.SetNumUninitialized(NumCandidates);
+		TArray<int32> Representatives;
+		Representatives.Init(INDEX_NONE, BlocksX * BlocksY);
+		TArray<float> RepresentativeDistances;
+		RepresentativeDistances.SetNumUninitialized(BlocksX * BlocksY);
+		float Middle = 0.5f * float(BlockSize - 1);
+
+		for (int32 Candidate = 0; Candidate < NumCandidates; Candidate++)
+		{
+			FCellRef Cell = Candidates.GetCellRef(Candidate);
+			int32 Block = GetBlock(Cell);
+			CandidateBlocks[Candidate] = Block;
+
+			float DistanceSquared = FMath::Square(float((Cell.X - Bounds.MinX) % BlockSize) - Middle) + FMath::Square(float((Cell.Y - Bounds.MinY) % BlockSize) - Middle);
+			if ((Representatives[Block] == INDEX_NONE) || (DistanceSquared < RepresentativeDistances[Block]))
+			{
+				Representatives[Block] = Candidate;
+				RepresentativeDistances[Block] = DistanceSquared;
+			}
+		}
+
+		TArray<int32> RepresentativeIndices;
+		for (int32 Candidate : Representatives)
+		{
+			if (Candidate != INDEX_NONE)
+			{
+				RepresentativeIndices.Add(Candidate);
+			}
+		}
+		RepresentativeIndices.Sort();
+
+		FGASpatialCandidates Coarse;
+		Coarse.Select(Candidates, RepresentativeIndices);
+		Evaluate(Coarse);
+
+		// The best blocks. (A block whose representative was dropped doesn't get a look in.)
+		TArray<int32> Order;
+		Order.SetNumUninitialized(Coarse.Num());
+		for (int32 Index = 0; Index < Coarse.Num(); Index++)
+		{
+			Order[Index] = Index;
+		}
+		Algo::StableSort(Order, [&Coarse](int32 A, int32 B) { return Coarse.Scores[A] > Coarse.Scores[B]; });
+
+		TArray<bool> RefineBlock;
+		RefineBlock.Init(false, BlocksX * BlocksY);
+		for (int32 Rank = 0; Rank < FMath::Min(TopK, Order.Num()); Rank++)
+		{
+			RefineBlock[GetBlock(Coarse.GetCellRef(Order[Rank]))] = true;
+		}
+		if (Bounds.IsValidCell(KeepCell))
+		{
+			RefineBlock[GetBlock(KeepCell)] = true;
+		}
+
+		TArray<float> BlockScores;
+		BlockScores.Init(-UE_MAX_FLT, BlocksX * BlocksY);
+		for (int32 Index = 0; Index < Coarse.Num(); Index++)
+		{
+			BlockScores[GetBlock(Coarse.GetCellRef(Index))] = Coarse.Scores[Index];
+		}
+
+		for (int32 Candidate = 0; Candidate < NumCandidates; Candidate++)
+		{
+			int32 Block = CandidateBlocks[Candidate];
+			CoarseScoresOut[Candidate] = BlockScores[Block];
+			if (RefineBlock[Block])
+			{
+				FineIndicesOut.Add(Candidate);
+			}
+		}
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameAI/Grid/GAGridActor.h"
+#include "GameAI/Grid/GAGridMap.h"
+#include "GASpatialFunction.h"
+
+
+// The cells a spatial query scores, gathered once up front in structure-of-arrays form.
+// Gather() walks the Dijkstra distance map a single time and keeps only the cells we could actually get to, along
+// with everything the layers want to know about them. After that each layer of the spatial function is one pass over
+// these flat arrays (see GASpatialKernels), rather than a walk of the whole box that re-does the lookups per cell.
+// Candidates are kept in row order, so "first best" means the same thing it does for FGAGridMap::GetMaxCell.
+
+struct FGASpatialCandidates
+{
+	// Collect every traversable cell of DistanceMap with a finite distance
+	void Gather(const AGAGridActor& Grid, const FGAGridMap& DistanceMap);
+
+	void Reset();
+
+	FORCEINLINE int32 Num() const { return MapIndices.Num(); }
+
+	// The cell a candidate refers to
+	FORCEINLINE FCellRef GetCellRef(int32 Candidate) const
+	{
+		int32 Width = Bounds.GetWidth();
+		return FCellRef(Bounds.MinX + (MapIndices[Candidate] % Width), Bounds.MinY + (MapIndices[Candidate] / Width));
+	}
+
+	FORCEINLINE FVector GetPosition(int32 Candidate) const
+	{
+		return FVector(PositionX[Candidate], PositionY[Candidate], PositionZ[Candidate]);
+	}
+
+	// Scores <- the values Map holds for the candidates, and back again. Map must have the gathered bounds.
+	void LoadScores(const FGAGridMap& Map);
+	void StoreScores(FGAGridMap& Map) const;
+
+	// Drop every candidate whose value in Values (one per candidate, e.g. LayerValues) is below Threshold, keeping
+	// the rest in order. Returns how many were dropped. Note, StoreScores leaves the dropped cells' values alone.
+	int32 RemoveBelow(const float* Values, float Threshold);
+
+	// Become a copy of just the given candidates of Source (scores included), in the order given
+	void Select(const FGASpatialCandidates& Source, TArrayView<const int32> Indices);
+
+	// The bounds of the distance map we gathered from
+	FGridBox Bounds;
+
+	// Index of each candidate into the Data of a map with the gathered bounds (see FGAGridMap::GetLocalIndex)
+	TArray<int32> MapIndices;
+
+	// World-space cell centers
+	TArray<float> PositionX;
+	TArray<float> PositionY;
+	TArray<float> PositionZ;
+
+	TArray<float> PathDistance;
+
+	// The accumulated score of each candidate
+	TArray<float> Scores;
+
+	// Scratch space for the layer being evaluated: its input, then its response
+	TArray<float> LayerValues;
+};
+
+
+// Kernels for evaluating the layers of a spatial function over FGASpatialCandidates.
+// Same deal as GAGridKernels: written against VectorRegister4Float, 4 candidates at a time, scalar for the rest.
+
+namespace GASpatialKernels
+{
+	// Out = distance from each candidate to Point. With Begin and Count, just candidates [Begin, Begin + Count),
+	// with Out[0] for candidate Begin.
+	void DistanceToPoint(const FGASpatialCandidates& Candidates, const FVector& Point, float* Out);
+	void DistanceToPoint(const FGASpatialCandidates& Candidates, const FVector& Point, float* Out, int32 Begin, int32 Count);
+
+	// Out = distance from each candidate to the nearest of Points -- but a point only counts for the candidates it's
+	// (path) closer to than the candidate is to us, i.e. PointDistances[i] < PathDistance. BIG_NUMBER if none count.
+	void MinDistanceToCloserPoints(const FGASpatialCandidates& Candidates, TArrayView<const FVector> Points, TArrayView<const float> PointDistances, float* Out);
+
+	// Values = LUT(Values). See FGACurveLUT::Eval, which this matches exactly.
+	void EvalCurve(const FGACurveLUT& LUT, float* Values, int32 Num);
+
+	// Scores = Op(Scores, Values), for the element-wise ops. SO_Mask and SO_Normalize aren't element-wise -- see
+	// FGASpatialCandidates::RemoveBelow and Normalize -- and do nothing here.
+	void ApplyOp(ESpatialOp Op, float* Scores, const float* Values, int32 Num);
+
+	// Scores = (Scores - Min) / (Max - Min), i.e. rescaled to [0, 1]. If they're all the same, they all become 1.
+	void Normalize(float* Scores, int32 Num);
+
+	// Bound the final score of each candidate, given its score so far (Scores) and the steps still to run: Lower and
+	// Upper come out such that Lower <= final score <= Upper, by interval arithmetic over each remaining layer's range
+	// (see UGASpatialFunction::GetLayerRange).
+	// Returns false if any remaining layer can't be bounded, in which case neither is any score. bLowerValidOut is
+	// false if a remaining mask might drop any candidate -- then Upper still holds, but Lower means nothing.
+	bool BoundRemainingSteps(const UGASpatialFunction& SpatialFunction, TArrayView<const FGASpatialPlanStep> Steps, const float* Scores,
+		float* Lower, float* Upper, int32 Num, bool& bLowerValidOut);
+
+	// The block selection behind UGASpatialComponent::CoarseToFine. Splits Candidates.Bounds into BlockSize x
+	// BlockSize blocks, has Evaluate score the candidate nearest the middle of each (it may drop some, like a mask
+	// does), and returns in FineIndicesOut every candidate in the TopK best blocks, plus KeepCell's block, in order.
+	// Empty if Evaluate dropped everything and there's no KeepCell. CoarseScoresOut gets each candidate's block's
+	// coarse score, or -UE_MAX_FLT if the block's representative was dropped.
+	void SelectCoarseToFine(const FGASpatialCandidates& Candidates, int32 BlockSize, int32 TopK, const FCellRef& KeepCell,
+		TFunctionRef<void(FGASpatialCandidates&)> Evaluate, TArray<int32>& FineIndicesOut, TArray<float>& CoarseScoresOut);
+}
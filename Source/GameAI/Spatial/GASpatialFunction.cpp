@@ -3,5 +3,255 @@
 UGASpatialFunction::UGASpatialFunction(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
+	CurveLUTResolution = 256;
+	CurveLUTTolerance = 0.01f;
+}
+
+
+// FGACurveLUT --------------------------------
+
+void FGACurveLUT::Reset()
+{
+	MinTime = 0.0f;
+	InvStep = 0.0f;
+	MaxTime = 0.0f;
+	Samples.Reset();
+	MaxError = 0.0f;
+	MinOutput = 0.0f;
+	MaxOutput = 0.0f;
+	bBuilt = false;
+}
+
+void FGACurveLUT::Build(const FRichCurve& Curve, int32 Resolution)
+{
+	Reset();
+	bBuilt = true;
+
+	if (!Curve.HasAnyData())
+	{
+		// Leave it empty -- see IsIdentity
+		return;
+	}
+
+	Curve.GetTimeRange(MinTime, MaxTime);
+
+	Resolution = FMath::Max(Resolution, 2);
+	float Step = (MaxTime - MinTime) / float(Resolution - 1);
+	InvStep = (Step > UE_SMALL_NUMBER) ? (1.0f / Step) : 0.0f;
+
+	// Note, with a single key (or all keys at the same time) InvStep is 0, so every input lands on the first sample
+	Samples.SetNumUninitialized(Resolution);
+	for (int32 Index = 0; Index < Resolution; Index++)
+	{
+		float Time = (Index == Resolution - 1) ? MaxTime : (MinTime + float(Index) * Step);
+		Samples[Index] = Curve.Eval(Time);
+	}
+
+	MinOutput = FMath::Min(Samples);
+	MaxOutput = FMath::Max(Samples);
+
+	MaxError = MeasureMaxError(Curve);
+}
+
+float FGACurveLUT::MeasureMaxError(const FRichCurve& Curve, int32 NumProbes) const
+{
+	if (!Curve.HasAnyData() || (NumProbes < 2))
+	{
+		return 0.0f;
+	}
+
+	float CurveMin, CurveMax;
+	Curve.GetTimeRange(CurveMin, CurveMax);
+
+	// Probe a little past either end too, to check the clamping
+	float Margin = FMath::Max(0.1f * (CurveMax - CurveMin), 1.0f);
+	float ProbeMin = CurveMin - Margin;
+	float ProbeStep = ((CurveMax + Margin) - ProbeMin) / float(NumProbes - 1);
+
+	float Result = 0.0f;
+	for (int32 Probe = 0; Probe < NumProbes; Probe++)
+	{
+		float Time = ProbeMin + float(Probe) * ProbeStep;
+		Result = FMath::Max(Result, FMath::Abs(Eval(Time) - Curve.Eval(Time, Time)));
+	}
+	return Result;
+}
+
+
+// Compiling --------------------------------
+
+bool UGASpatialFunction::IsFusable(const FFunctionLayer& Layer)
+{
+	bool bCheapInput = (Layer.Input == SI_None) || (Layer.Input == SI_TargetRange) || (Layer.Input == SI_PathDistance);
+	return bCheapInput && (Layer.Op != SO_Mask) && (Layer.Op != SO_Normalize);
+}
+
+bool UGASpatialFunction::GetLayerRange(const FFunctionLayer& Layer, float& MinOut, float& MaxOut)
+{
+	if ((Layer.Op == SO_Normalize) || !Layer.ResponseLUT.IsBuilt())
+	{
+		return false;
+	}
+
+	const FGACurveLUT& LUT = Layer.ResponseLUT;
+	switch (Layer.Input)
+	{
+	case SI_None:
+		MinOut = MaxOut = LUT.Eval(0.0f);
+		return true;
+	case SI_LOS:
+		// Only ever 0 or 1
+		MinOut = FMath::Min(LUT.Eval(0.0f), LUT.Eval(1.0f));
+		MaxOut = FMath::Max(LUT.Eval(0.0f), LUT.Eval(1.0f));
+		return true;
+	default:
+		// Distances could be anything, so only the curve can bound these
+		if (LUT.IsIdentity())
+		{
+			return false;
+		}
+		MinOut = LUT.MinOutput;
+		MaxOut = LUT.MaxOutput;
+		return true;
+	}
+}
+
+// Rough relative cost of a layer's input per cell, for ordering masks
+static int32 GetInputCost(const FFunctionLayer& Layer)
+{
+	switch (Layer.Input)
+	{
+	case SI_LOS:
+		return (Layer.LOSMethod == SL_PhysicsTrace) ? 3 : 2;
+	case SI_AllyDistance:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+void UGASpatialFunction::Compile()
+{
+	for (FFunctionLayer& Layer : Layers)
+	{
+		const FRichCurve* Curve = Layer.ResponseCurve.GetRichCurveConst();
+		if (Curve)
+		{
+			Layer.ResponseLUT.Build(*Curve, CurveLUTResolution);
+		}
+		else
+		{
+			Layer.ResponseLUT.Reset();
+		}
+	}
+
+	// First the order. A mask only looks at its own input, and the cells it throws out don't matter to any
+	// element-wise layer, so it can go to the front -- of its segment, anyway: a Normalize depends on which cells are
+	// left, so nothing moves past one.
+	TArray<int32> Order;
+	Order.Reserve(Layers.Num());
+	int32 SegmentStart = 0;
+	int32 NumSegmentMasks = 0;
+
+	for (int32 LayerIndex = 0; LayerIndex < Layers.Num(); LayerIndex++)
+	{
+		const FFunctionLayer& Layer = Layers[LayerIndex];
+		if (Layer.Op == SO_Mask)
+		{
+			// Keep the segment's masks cheapest first, but otherwise in their original order
+			int32 InsertAt = SegmentStart + NumSegmentMasks;
+			while ((InsertAt > SegmentStart) && (GetInputCost(Layers[Order[InsertAt - 1]]) > GetInputCost(Layer)))
+			{
+				InsertAt--;
+			}
+			Order.Insert(LayerIndex, InsertAt);
+			NumSegmentMasks++;
+		}
+		else
+		{
+			Order.Add(LayerIndex);
+			if (Layer.Op == SO_Normalize)
+			{
+				SegmentStart = Order.Num();
+				NumSegmentMasks = 0;
+			}
+		}
+	}
+
+	// Then the steps, fusing runs of cheap element-wise layers
+	Plan.Reset();
+	for (int32 LayerIndex : Order)
+	{
+		bool bFusable = IsFusable(Layers[LayerIndex]);
+		if (bFusable && (Plan.Num() > 0) && Plan.Last().bFused)
+		{
+			Plan.Last().Layers.Add(LayerIndex);
+		}
+		else
+		{
+			FGASpatialPlanStep& Step = Plan.AddDefaulted_GetRef();
+			Step.Layers.Add(LayerIndex);
+			Step.bFused = bFusable;
+		}
+	}
+
+	bCompiled = true;
+}
+
+TArray<FGASpatialPlanStep> UGASpatialFunction::GetPlan() const
+{
+	if (bCompiled)
+	{
+		// Make sure the layers haven't changed under us since
+		int32 NumPlanned = 0;
+		for (const FGASpatialPlanStep& Step : Plan)
+		{
+			NumPlanned += Step.Layers.Num();
+		}
+		if (NumPlanned == Layers.Num())
+		{
+			return Plan;
+		}
+	}
+
+	TArray<FGASpatialPlanStep> Result;
+	for (int32 LayerIndex = 0; LayerIndex < Layers.Num(); LayerIndex++)
+	{
+		Result.AddDefaulted_GetRef().Layers.Add(LayerIndex);
+	}
+	return Result;
+}
+
+float UGASpatialFunction::GetCurveLUTError(int32 LayerIndex) const
+{
+	return Layers.IsValidIndex(LayerIndex) ? Layers[LayerIndex].ResponseLUT.MaxError : -1.0f;
+}
+
+void UGASpatialFunction::PostInitProperties()
+{
+	Super::PostInitProperties();
+	Compile();
+}
+
+void UGASpatialFunction::PostLoad()
+{
+	Super::PostLoad();
+	Compile();
+}
+
+#if WITH_EDITOR
+void UGASpatialFunction::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	Compile();
 
+	for (int32 LayerIndex = 0; LayerIndex < Layers.Num(); LayerIndex++)
+	{
+		float Error = Layers[LayerIndex].ResponseLUT.MaxError;
+		if (Error > CurveLUTTolerance)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("%s: layer %d's baked response curve is off by up to %f. Consider raising CurveLUTResolution."), *GetName(), LayerIndex, Error);
+		}
+	}
 }
+#endif
@@ -23,23 +23,89 @@ enum ESpatialOp
 {
 	SO_None				UMETA(DisplayName = "None"),
 	SO_Add				UMETA(DisplayName = "Add"),			// add this layer to the accumulated buffer
-	SO_Multiply			UMETA(DisplayName = "Multiply")		// multiply this layer into the accumulated buffer
-	// Add others if you want!
+	SO_Multiply			UMETA(DisplayName = "Multiply"),	// multiply this layer into the accumulated buffer
+	SO_Subtract			UMETA(DisplayName = "Subtract"),	// subtract this layer from the accumulated buffer
+	SO_Min				UMETA(DisplayName = "Min"),			// the smaller of this layer and the accumulated buffer
+	SO_Max				UMETA(DisplayName = "Max"),			// the larger of this layer and the accumulated buffer
+	SO_Power			UMETA(DisplayName = "Power"),		// raise the accumulated buffer (clamped at 0) to the power of this layer
+	SO_Mask				UMETA(DisplayName = "Mask"),		// drop any cell where this layer is below Threshold from consideration
+	SO_Normalize		UMETA(DisplayName = "Normalize")	// rescale the accumulated buffer to [0, 1] over the remaining cells (ignores the input)
+};
+
+// How an SI_LOS layer decides whether a cell can see the target. In order of decreasing accuracy (and cost).
+UENUM(BlueprintType)
+enum ESpatialLOSMethod
+{
+	SL_PhysicsTrace		UMETA(DisplayName = "Physics Trace"),		// a line trace against the world's collision, per cell
+	SL_Heightfield		UMETA(DisplayName = "Heightfield Trace"),	// AGAGridActor::TraceHeightfield: a 3D line against the grid's baked obstacle heights
+	SL_GridTrace		UMETA(DisplayName = "Grid Trace")			// AGAGridActor::TraceLine: blocked by any cell you couldn't walk through
+};
+
+
+// A response curve baked into a table of evenly spaced samples, so evaluating it is a lerp instead of a key search.
+// Inputs outside the curve's time range are clamped to it (the same as the curve's default constant extrapolation).
+// A curve with no keys bakes to an empty table: evaluating it leaves the input alone, like FRichCurve::Eval(X, X) does.
+
+struct FGACurveLUT
+{
+	// Sample Curve at Resolution evenly spaced points over its time range
+	void Build(const FRichCurve& Curve, int32 Resolution);
+
+	void Reset();
+
+	// True once built. An unbuilt table is not the same as an empty one: callers should fall back on the curve.
+	FORCEINLINE bool IsBuilt() const { return bBuilt; }
+
+	FORCEINLINE bool IsIdentity() const { return Samples.Num() == 0; }
+
+	FORCEINLINE float Eval(float Value) const
+	{
+		if (IsIdentity())
+		{
+			return Value;
+		}
+
+		float Position = FMath::Clamp((Value - MinTime) * InvStep, 0.0f, float(Samples.Num() - 1));
+		int32 Index = FMath::Min(int32(Position), Samples.Num() - 2);
+		return FMath::Lerp(Samples[Index], Samples[Index + 1], Position - float(Index));
+	}
+
+	// Largest difference from Curve, checked at NumProbes points spread over (and a bit beyond) its time range
+	float MeasureMaxError(const FRichCurve& Curve, int32 NumProbes = 1024) const;
+
+	float MinTime = 0.0f;
+	float InvStep = 0.0f;
+
+	// Eval is flat beyond this (and below MinTime)
+	float MaxTime = 0.0f;
+
+	// Always at least two samples (unless empty), so Eval can lerp without checking
+	TArray<float> Samples;
+
+	// Largest error found by MeasureMaxError when it was built
+	float MaxError = 0.0f;
+
+	// The smallest and largest samples. Eval never goes outside these (unless it's the identity).
+	float MinOutput = 0.0f;
+	float MaxOutput = 0.0f;
+
+private:
+	bool bBuilt = false;
 };
 
 
 // A single layer in our spatial function
 // In our simple model, we keep a single buffer (a GridMap) that accumulates the values from each 
-// subsequent using an ESpatialOp -- at first this is just addition or multiplication. So you can
-// express spatial functions of the form 
-// Output = (((((I0 + I1) * I2) + I3) * I4) * I5)
+// subsequent using an ESpatialOp. So you can express spatial functions of the form 
+// Output = (((((I0 + I1) * I2) - I3) max I4) * I5)
+// Mask layers are the exception: rather than change the buffer, they remove cells from the running altogether.
 
 USTRUCT(BlueprintType)
 struct FFunctionLayer
 {
 	GENERATED_USTRUCT_BODY()
 
-	FFunctionLayer() : Input(SI_None), Op(SO_None) {}
+	FFunctionLayer() : Input(SI_None), Op(SO_None), LOSMethod(SL_PhysicsTrace), Threshold(0.5f) {}
 
 	UPROPERTY(BlueprintReadOnly, EditAnywhere)
 	TEnumAsByte<ESpatialInput> Input;
@@ -50,6 +116,28 @@ struct FFunctionLayer
 	UPROPERTY(BlueprintReadOnly, EditAnywhere)
 	TEnumAsByte<ESpatialOp> Op;
 
+	// Only used by SI_LOS layers. The grid traces need no physics queries at all.
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, meta = (EditCondition = "Input == ESpatialInput::SI_LOS"))
+	TEnumAsByte<ESpatialLOSMethod> LOSMethod;
+
+	// Only used by SO_Mask layers: cells where the layer (after its response curve) is below this are dropped
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, meta = (EditCondition = "Op == ESpatialOp::SO_Mask"))
+	float Threshold;
+
+	// ResponseCurve, baked (see UGASpatialFunction::Compile)
+	FGACurveLUT ResponseLUT;
+};
+
+
+// One step of a compiled spatial function (see UGASpatialFunction::Compile)
+struct FGASpatialPlanStep
+{
+	// Indices into UGASpatialFunction::Layers, in the order to evaluate them
+	TArray<int32, TInlineAllocator<4>> Layers;
+
+	// If true, Layers are all cheap element-wise layers, to be evaluated together in a single pass over the
+	// candidates (see UGASpatialFunction::IsFusable). Otherwise there's exactly one layer.
+	bool bFused = false;
 };
 
 
@@ -67,4 +155,52 @@ class UGASpatialFunction: public UObject
 	// Our list of layers
 	UPROPERTY(BlueprintReadOnly, EditAnywhere)
 	TArray<FFunctionLayer> Layers;
+
+
+	// Baked response curves --------------------------------
+	// Each layer's response curve is baked into a lookup table when the function loads, and again whenever it's
+	// edited. More samples means a closer fit to the curve (linear curves are exact at any resolution).
+
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "2", ClampMax = "65536"))
+	int32 CurveLUTResolution;
+
+	// In the editor, warn about any layer whose baked curve is further than this from the real one
+	UPROPERTY(EditAnywhere)
+	float CurveLUTTolerance;
+
+	// Compiling --------------------------------
+	// When the function loads (and whenever it's edited), its layers are compiled into a plan:
+	// - Every layer's response curve is baked into a lookup table
+	// - Mask layers are moved as early as they can go (they don't depend on the buffer, but can't move past a
+	//   Normalize, which does depend on which cells are left), cheapest first. Everything after them -- expensive line of
+	//   sight layers in particular -- then only runs on the cells that survive.
+	// - Runs of adjacent cheap element-wise layers are fused into one step, evaluated in a single pass
+
+	// Recompile the plan and re-bake every layer's response curve
+	void Compile();
+
+	// The compiled plan. If the function hasn't been compiled, just one step per layer, in order.
+	TArray<FGASpatialPlanStep> GetPlan() const;
+
+	// Cheap to compute per cell, and only touches that cell's own score, so it can be fused with its neighbors
+	static bool IsFusable(const FFunctionLayer& Layer);
+
+	// The range of values a layer can produce (after its response curve), for bounding scores ahead of time.
+	// Returns false if there's no telling, e.g. an unbounded input with no curve, or a Normalize.
+	static bool GetLayerRange(const FFunctionLayer& Layer, float& MinOut, float& MaxOut);
+
+	// The largest difference between a layer's baked curve and its real one. -1 if there's no such layer.
+	UFUNCTION(BlueprintCallable)
+	float GetCurveLUTError(int32 LayerIndex) const;
+
+	virtual void PostInitProperties() override;
+	virtual void PostLoad() override;
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+private:
+	TArray<FGASpatialPlanStep> Plan;
+	bool bCompiled = false;
 };
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "GASpatialFunction.h"
+#include "Misc/AutomationTest.h"
+
+UE_DISABLE_OPTIMIZATION
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Baked response curves (FGACurveLUT) against FRichCurve::Eval, at the default resolution and tolerance of a
+// UGASpatialFunction. Probes run well past both ends of the curve, to check the clamping too.
+
+namespace GASpatialFunctionTest
+{
+	static void CheckCurve(FAutomationTestBase& Test, const TCHAR* Name, const FRichCurve& Curve)
+	{
+		const UGASpatialFunction* Defaults = GetDefault<UGASpatialFunction>();
+		FGACurveLUT LUT;
+		LUT.Build(Curve, Defaults->CurveLUTResolution);
+		Test.TestTrue(FString::Printf(TEXT("%s: built"), Name), LUT.IsBuilt());
+
+		float MinTime = -100.0f, MaxTime = 100.0f;
+		if (Curve.HasAnyData())
+		{
+			Curve.GetTimeRange(MinTime, MaxTime);
+		}
+		float Margin = FMath::Max(0.5f * (MaxTime - MinTime), 10.0f);
+
+		const int32 NumProbes = 4001;
+		float WorstError = 0.0f;
+		float WorstTime = 0.0f;
+		for (int32 Probe = 0; Probe < NumProbes; Probe++)
+		{
+			float Time = FMath::Lerp(MinTime - Margin, MaxTime + Margin, float(Probe) / float(NumProbes - 1));
+			float Error = FMath::Abs(LUT.Eval(Time) - Curve.Eval(Time, Time));
+			if (Error > WorstError)
+			{
+				WorstError = Error;
+				WorstTime = Time;
+			}
+		}
+
+		Test.TestTrue(FString::Printf(TEXT("%s: off by %f at %f, tolerance %f"), Name, WorstError, WorstTime, Defaults->CurveLUTTolerance), WorstError <= Defaults->CurveLUTTolerance);
+		Test.TestTrue(FString::Printf(TEXT("%s: measured error %f within tolerance"), Name, LUT.MaxError), LUT.MaxError <= Defaults->CurveLUTTolerance);
+
+		// The output range (used to bound the layer) has to hold everything Eval can return
+		if (!LUT.IsIdentity())
+		{
+			for (int32 Probe = 0; Probe < NumProbes; Probe++)
+			{
+				float Value = LUT.Eval(FMath::Lerp(MinTime - Margin, MaxTime + Margin, float(Probe) / float(NumProbes - 1)));
+				if ((Value < LUT.MinOutput) || (Value > LUT.MaxOutput))
+				{
+					Test.AddError(FString::Printf(TEXT("%s: Eval gave %f, outside [%f, %f]"), Name, Value, LUT.MinOutput, LUT.MaxOutput));
+					break;
+				}
+			}
+		}
+	}
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGACurveLUTTest, "GameAI.Spatial.CurveLUT", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FGACurveLUTTest::RunTest(const FString& Parameters)
+{
+	using namespace GASpatialFunctionTest;
+
+	// A typical falloff with a kink in it, somewhere between two samples
+	FRichCurve Linear;
+	Linear.SetKeyInterpMode(Linear.AddKey(0.0f, 0.0f), RCIM_Linear);
+	Linear.SetKeyInterpMode(Linear.AddKey(1037.0f, 1.0f), RCIM_Linear);
+	Linear.SetKeyInterpMode(Linear.AddKey(3000.0f, 0.25f), RCIM_Linear);
+	CheckCurve(*this, TEXT("Linear"), Linear);
+
+	FRichCurve Cubic;
+	Cubic.SetKeyInterpMode(Cubic.AddKey(0.0f, 1.0f), RCIM_Cubic);
+	Cubic.SetKeyInterpMode(Cubic.AddKey(500.0f, 0.2f), RCIM_Cubic);
+	Cubic.SetKeyInterpMode(Cubic.AddKey(1200.0f, 0.9f), RCIM_Cubic);
+	Cubic.SetKeyInterpMode(Cubic.AddKey(2000.0f, 0.0f), RCIM_Cubic);
+	Cubic.AutoSetTangents();
+	CheckCurve(*this, TEXT("Cubic"), Cubic);
+
+	FRichCurve SingleKey;
+	SingleKey.AddKey(250.0f, 0.75f);
+	CheckCurve(*this, TEXT("Single key"), SingleKey);
+
+	// No keys: leaves the input alone
+	FRichCurve Empty;
+	CheckCurve(*this, TEXT("Empty"), Empty);
+	{
+		FGACurveLUT LUT;
+		LUT.Build(Empty, GetDefault<UGASpatialFunction>()->CurveLUTResolution);
+		TestTrue(TEXT("Empty: bakes to the identity"), LUT.IsIdentity());
+		TestEqual(TEXT("Empty: evaluates to its input"), LUT.Eval(123.0f), 123.0f);
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
+
+UE_ENABLE_OPTIMIZATION
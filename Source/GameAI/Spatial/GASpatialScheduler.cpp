@@ -0,0 +1,98 @@
+#include "GASpatialScheduler.h"
+#include "GASpatialComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "GameFramework/GameModeBase.h"
+
+
+UGASpatialScheduler::UGASpatialScheduler(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	FrameBudgetMicroseconds = 2000.0f;
+	MaxQueriesStartedPerFrame = 2;
+	LastFrameMicroseconds = 0.0f;
+	NextQuery = 0;
+
+	PrimaryComponentTick.bCanEverTick = true;
+}
+
+UGASpatialScheduler* UGASpatialScheduler::GetSpatialScheduler(const UObject* WorldContextObject)
+{
+	UGASpatialScheduler* Result = NULL;
+	AGameModeBase* GameMode = UGameplayStatics::GetGameMode(WorldContextObject);
+	if (GameMode)
+	{
+		Result = GameMode->GetComponentByClass<UGASpatialScheduler>();
+	}
+
+	return Result;
+}
+
+void UGASpatialScheduler::AddQuery(UGASpatialComponent* SpatialComponent)
+{
+	if (SpatialComponent)
+	{
+		Queries.AddUnique(SpatialComponent);
+	}
+}
+
+void UGASpatialScheduler::RemoveFinishedQueries()
+{
+	Queries.RemoveAll([](const TObjectPtr<UGASpatialComponent>& SpatialComponent)
+	{
+		return (SpatialComponent == NULL) || !SpatialComponent->IsAnytimeQueryRunning();
+	});
+}
+
+void UGASpatialScheduler::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	// Note, queries finish (and new ones start, from OnPositionChosen) in the middle of the loop below, so the list
+	// only gets tidied up before and after
+	RemoveFinishedQueries();
+	int32 NumQueries = Queries.Num();
+	if (NumQueries == 0)
+	{
+		LastFrameMicroseconds = 0.0f;
+		return;
+	}
+
+	double StartTime = FPlatformTime::Seconds();
+	double Deadline = StartTime + double(FrameBudgetMicroseconds) * 1.0e-6;
+	int32 NumStarted = 0;
+	NextQuery = NextQuery % NumQueries;
+
+	for (int32 Served = 0; Served < NumQueries; Served++)
+	{
+		UGASpatialComponent* SpatialComponent = Queries[(NextQuery + Served) % NumQueries];
+		if (!SpatialComponent->IsAnytimeQueryRunning())
+		{
+			continue;
+		}
+
+		if (!SpatialComponent->IsQueryGathered())
+		{
+			if (NumStarted >= MaxQueriesStartedPerFrame)
+			{
+				continue;
+			}
+			NumStarted++;
+		}
+
+		// Everyone gets an even share of what's left, so one expensive query can't starve the rest. Whoever's first
+		// always gets to run, though, so something moves every frame.
+		double Now = FPlatformTime::Seconds();
+		if ((Now >= Deadline) && (Served > 0))
+		{
+			break;
+		}
+		double Share = FMath::Max(Deadline - Now, 0.0) / double(NumQueries - Served);
+		SpatialComponent->StepQuery(Now + Share);
+	}
+
+	// Someone else goes first next frame
+	NextQuery++;
+	RemoveFinishedQueries();
+
+	LastFrameMicroseconds = float((FPlatformTime::Seconds() - StartTime) * 1.0e6);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "GASpatialScheduler.generated.h"
+
+class UGASpatialComponent;
+
+
+// Runs every agent's anytime spatial query (see UGASpatialComponent::ChoosePositionAnytime) under one shared budget
+// per frame, so that a burst of agents all deciding where to go at once is spread over several frames instead of
+// landing on one. Each frame the budget is split evenly between the running queries, starting with a different one
+// each time, and only MaxQueriesStartedPerFrame new queries get to run their gather (the one part that can't be
+// split up). Like the other systems, this lives on the game mode; without one, each query ticks on its own budget.
+
+UCLASS(BlueprintType, Blueprintable, meta = (BlueprintSpawnableComponent))
+class UGASpatialScheduler : public UActorComponent
+{
+	GENERATED_UCLASS_BODY()
+
+	static UGASpatialScheduler* GetSpatialScheduler(const UObject* WorldContextObject);
+
+	// Called by the component when it starts an anytime query. It drops out again by itself once the query is over.
+	void AddQuery(UGASpatialComponent* SpatialComponent);
+
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Time to spend on spatial queries each frame, across all agents
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0"))
+	float FrameBudgetMicroseconds;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "1"))
+	int32 MaxQueriesStartedPerFrame;
+
+	// For profiling: time actually spent last frame (a query always gets at least one chunk once it's started, so
+	// this can go a little over)
+	UPROPERTY(BlueprintReadOnly)
+	float LastFrameMicroseconds;
+
+	UFUNCTION(BlueprintCallable, BlueprintPure)
+	int32 GetNumQueries() const { return Queries.Num(); }
+
+private:
+	void RemoveFinishedQueries();
+
+	UPROPERTY()
+	TArray<TObjectPtr<UGASpatialComponent>> Queries;
+
+	// Who goes first next frame
+	int32 NextQuery;
+};
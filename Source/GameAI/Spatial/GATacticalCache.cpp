@@ -0,0 +1,183 @@
+#include "GATacticalCache.h"
+#include "GASpatialEvaluator.h"
+#include "GAAgentSystem.h"
+#include "GameAI/Grid/GAGridActor.h"
+#include "Kismet/GameplayStatics.h"
+#include "GameFramework/GameModeBase.h"
+#include "Engine/World.h"
+
+
+UGATacticalCache::UGATacticalCache(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	UnusedLifetimeFrames = 30;
+	CellsComputed = 0;
+	CellsReused = 0;
+
+	PrimaryComponentTick.bCanEverTick = true;
+}
+
+UGATacticalCache* UGATacticalCache::GetTacticalCache(const UObject* WorldContextObject)
+{
+	UGATacticalCache* Result = NULL;
+	AGameModeBase* GameMode = UGameplayStatics::GetGameMode(WorldContextObject);
+	if (GameMode)
+	{
+		Result = GameMode->GetComponentByClass<UGATacticalCache>();
+	}
+
+	return Result;
+}
+
+bool UGATacticalCache::IsCacheable(const FFunctionLayer& Layer)
+{
+	return (Layer.Input == SI_LOS);
+}
+
+void UGATacticalCache::Flush()
+{
+	Entries.Reset();
+	CellsComputed = 0;
+	CellsReused = 0;
+}
+
+void UGATacticalCache::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	for (TMap<FLayerKey, FLayerEntry>::TIterator It(Entries); It; ++It)
+	{
+		if (GFrameCounter - It.Value().LastUsedFrame > uint64(UnusedLifetimeFrames))
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+
+bool UGATacticalCache::SampleLayer(const AGAGridActor* Grid, const FFunctionLayer& Layer, const AActor* Target, const FVector& TargetPosition,
+	const FVector& EyeOffset, const FGASpatialCandidates& Candidates, float* ValuesOut, bool bComputeMissing)
+{
+	if ((Grid == NULL) || !IsCacheable(Layer))
+	{
+		return false;
+	}
+
+	FLayerKey Key;
+	Key.Grid = Grid;
+	Key.Target = Target;
+	Key.Input = uint8(Layer.Input);
+	Key.LOSMethod = uint8(Layer.LOSMethod);
+
+	// Note, the exact target position doesn't matter until it moves out of its cell. A cell computed a few frames
+	// ago for a different point in the same cell is close enough.
+	FCellRef TargetCell = Grid->GetCellRef(TargetPosition, true);
+	FLayerEntry& Entry = Entries.FindOrAdd(Key);
+	if (!(Entry.TargetCell == TargetCell) || (Entry.GridVersion != Grid->GetGridVersion()))
+	{
+		Entry.Regions.Reset();
+		Entry.TargetCell = TargetCell;
+		Entry.TargetPosition = TargetPosition;
+		Entry.GridVersion = Grid->GetGridVersion();
+	}
+	Entry.LastUsedFrame = GFrameCounter;
+
+	// Candidates come in row order, so consecutive ones are nearly always in the same region
+	int32 CurrentRegion = INDEX_NONE;
+	FLayerEntry::FRegion* Region = NULL;
+	FCollisionQueryParams Params;
+	bool bParamsReady = false;
+
+	for (int32 Candidate = 0; Candidate < Candidates.Num(); Candidate++)
+	{
+		FCellRef Cell = Candidates.GetCellRef(Candidate);
+		int32 RegionIndex = Grid->CellToRegionIndex(Cell);
+
+		if (RegionIndex != CurrentRegion)
+		{
+			Region = Entry.Regions.Find(RegionIndex);
+			if ((Region == NULL) && !bComputeMissing)
+			{
+				return false;
+			}
+			else if (Region == NULL)
+			{
+				Region = &Entry.Regions.Add(RegionIndex);
+				Region->Values.SetNumZeroed(AGAGridActor::RegionSize * AGAGridActor::RegionSize);
+				Region->Computed.Init(false, AGAGridActor::RegionSize * AGAGridActor::RegionSize);
+			}
+
+			CurrentRegion = RegionIndex;
+		}
+
+		int32 LocalX = Cell.X & (AGAGridActor::RegionSize - 1);
+		int32 LocalY = Cell.Y & (AGAGridActor::RegionSize - 1);
+		int32 LocalIndex = (LocalY << AGAGridActor::RegionShift) + LocalX;
+
+		if (Region->Computed[LocalIndex])
+		{
+			CellsReused++;
+		}
+		else if (bComputeMissing)
+		{
+			if (!bParamsReady)
+			{
+				InitTraceParams(Target, Params);
+				bParamsReady = true;
+			}
+
+			Region->Values[LocalIndex] = ComputeCell(Grid, Layer, Entry.TargetPosition, EyeOffset, Params, Cell);
+			Region->Computed[LocalIndex] = true;
+			CellsComputed++;
+		}
+		else
+		{
+			return false;
+		}
+
+		ValuesOut[Candidate] = Region->Values[LocalIndex];
+	}
+
+	return true;
+}
+
+void UGATacticalCache::InitTraceParams(const AActor* Target, FCollisionQueryParams& ParamsOut) const
+{
+	// We can't leave out the agent asking (the answer is for everyone), so leave out all of them
+	ParamsOut.AddIgnoredActor(Target);
+	UGAAgentSystem* AgentSystem = UGAAgentSystem::GetAgentSystem(this);
+	if (AgentSystem)
+	{
+		for (const FGAAgentRecord& Agent : AgentSystem->Agents)
+		{
+			ParamsOut.AddIgnoredActor(Agent.Pawn);
+		}
+	}
+}
+
+float UGATacticalCache::ComputeCell(const AGAGridActor* Grid, const FFunctionLayer& Layer, const FVector& TargetPosition, const FVector& EyeOffset,
+	const FCollisionQueryParams& Params, const FCellRef& Cell) const
+{
+	FVector Start = Grid->GetCellPosition(Cell) + EyeOffset;
+	FVector HitLocation;
+	bool bHitSomething;
+
+	switch (Layer.LOSMethod)
+	{
+	case SL_Heightfield:
+		bHitSomething = Grid->TraceHeightfield(Start, TargetPosition, HitLocation);
+		break;
+	case SL_GridTrace:
+		bHitSomething = Grid->TraceLine(Start, TargetPosition, HitLocation);
+		break;
+	default:
+	{
+		UWorld* World = GetWorld();
+		FHitResult HitResult;
+		bHitSomething = World && World->LineTraceSingleByChannel(HitResult, Start, TargetPosition, ECollisionChannel::ECC_Visibility, Params);
+		break;
+	}
+	}
+
+	return bHitSomething ? 0.0f : 1.0f;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "GASpatialFunction.h"
+#include "GATacticalCache.generated.h"
+
+class AGAGridActor;
+struct FGASpatialCandidates;
+struct FCollisionQueryParams;
+
+
+// Spatial layer inputs that only depend on the target and the cell -- not on who's asking -- worked out once and
+// shared by every agent's ChoosePosition. In practice that's line of sight to the target: target range qualifies
+// too, but it's cheaper to work out on the spot (it's always fused, see UGASpatialFunction::IsFusable).
+// Each cell is computed the first time any agent asks for it, and kept until the target moves to another cell or the
+// grid changes. So with twenty agents around the same target, each cell is traced once instead of up to twenty
+// times -- and no cell is traced that some agent didn't actually need.
+// The cached values are the layer's raw input, before its response curve, so layers with different curves still
+// share them. Like the other systems, this lives on the game mode; without one, layers compute their own inputs.
+
+UCLASS(BlueprintType, Blueprintable, meta = (BlueprintSpawnableComponent))
+class UGATacticalCache : public UActorComponent
+{
+	GENERATED_UCLASS_BODY()
+
+	static UGATacticalCache* GetTacticalCache(const UObject* WorldContextObject);
+
+	// True for the layers the cache can serve
+	static bool IsCacheable(const FFunctionLayer& Layer);
+
+	// Fill ValuesOut (one per candidate) with Layer's input towards Target. Line of sight goes from EyeOffset above
+	// each cell to TargetPosition. Computes any of the candidates' cells that aren't cached yet, unless
+	// bComputeMissing is false, in which case it returns false (with ValuesOut incomplete) if any cell is missing.
+	bool SampleLayer(const AGAGridActor* Grid, const FFunctionLayer& Layer, const AActor* Target, const FVector& TargetPosition,
+		const FVector& EyeOffset, const FGASpatialCandidates& Candidates, float* ValuesOut, bool bComputeMissing = true);
+
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Throw everything away
+	UFUNCTION(BlueprintCallable)
+	void Flush();
+
+	// Drop layers no agent has asked for in this many frames
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 UnusedLifetimeFrames;
+
+	// For profiling: cells computed, and cells served from the cache, since the last Flush
+	UPROPERTY(BlueprintReadOnly)
+	int32 CellsComputed;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 CellsReused;
+
+private:
+	struct FLayerKey
+	{
+		const AGAGridActor* Grid;
+		const AActor* Target;
+		uint8 Input;
+		uint8 LOSMethod;
+
+		bool operator==(const FLayerKey& Other) const
+		{
+			return (Grid == Other.Grid) && (Target == Other.Target) && (Input == Other.Input) && (LOSMethod == Other.LOSMethod);
+		}
+
+		friend uint32 GetTypeHash(const FLayerKey& Key)
+		{
+			return HashCombineFast(HashCombineFast(GetTypeHash(Key.Grid), GetTypeHash(Key.Target)), (uint32(Key.Input) << 8) | Key.LOSMethod);
+		}
+	};
+
+	struct FLayerEntry
+	{
+		// What the values were computed for. If any of these change, the whole layer is stale.
+		FCellRef TargetCell;
+		FVector TargetPosition;
+		uint32 GridVersion = 0;
+
+		uint64 LastUsedFrame = 0;
+
+		// Region index -> RegionSize x RegionSize values, row-major, and which of them have been computed. Cells are
+		// grouped by region only so that a layer's storage grows with the area the agents actually look at.
+		struct FRegion
+		{
+			TArray<float> Values;
+			TBitArray<> Computed;
+		};
+		TMap<int32, FRegion> Regions;
+	};
+
+	// Line of sight ignores the target and every agent (the answer is for everyone)
+	void InitTraceParams(const AActor* Target, FCollisionQueryParams& ParamsOut) const;
+
+	float ComputeCell(const AGAGridActor* Grid, const FFunctionLayer& Layer, const FVector& TargetPosition, const FVector& EyeOffset,
+		const FCollisionQueryParams& Params, const FCellRef& Cell) const;
+
+	TMap<FLayerKey, FLayerEntry> Entries;
+};